@@ -22,6 +22,7 @@
 #  include "config.h"
 #endif
 
+#include <cstdlib>
 #include <cstring>
 #include <iostream>
 #include <gtk/gtk.h>
@@ -38,6 +39,15 @@
 //#define DEBUG
 //#define DDEBUG
 
+/* Smaller articles are parsed in place. That is faster than a trip through
+ * the parse pipeline and the text does not jump after the lookup. */
+const guint32 ASYNC_PARSE_MIN_SIZE = 16 * 1024;
+/* Smaller pictures are decoded in place, for the same reason. */
+const guint32 ASYNC_IMAGE_MIN_SIZE = 32 * 1024;
+/* Articles are rendered at once while the page has less article data than
+ * this, that is enough to fill the window. The rest are deferred. */
+const size_t DEFER_ARTICLES_MIN_SIZE = 32 * 1024;
+
 /* Helper class.
  * Provides a means to generate a unique mark name and insert it at the 
  * specified point. All marks inserted by this class are deleted when this 
@@ -197,12 +207,12 @@ private:
 };
 
 struct ArticleView::ParseResultItemWithMark {
-	ParseResultItem* item;
+	const ParseResultItem* item;
 	std::string mark;
 	int char_offset;
 	// true if a tmp char is added after the mark
 	bool tmp_char;
-	ParseResultItemWithMark(ParseResultItem* item, int char_offset, 
+	ParseResultItemWithMark(const ParseResultItem* item, int char_offset, 
 		bool tmp_char=false)
 	: item(item), char_offset(char_offset), tmp_char(tmp_char)
 	{
@@ -211,7 +221,8 @@ struct ArticleView::ParseResultItemWithMark {
 
 void ArticleView::append_and_mark_orig_word(const std::string& mark,
 					    const gchar *origword,
-					    const LinksPosList& links)
+					    const LinksPosList& links,
+					    const char *where_mark)
 {
 	if(mark.empty())
 		return;
@@ -236,21 +247,67 @@ void ArticleView::append_and_mark_orig_word(const std::string& mark,
 			xmlcd.copy_xml(res, cd_b - cd_str, cd_str_len);
 		} else // mark does not contain char data, only markup
 			res = mark;
-		if (links.empty())
+		if (where_mark)
+			pango_view_->insert_pango_text_with_links(res, links, where_mark);
+		else if (links.empty())
 			append_pango_text(res.c_str());
 		else
 			append_pango_text_with_links(res, links);
 	} else {
-		if (links.empty())
+		if (where_mark)
+			pango_view_->insert_pango_text_with_links(mark, links, where_mark);
+		else if (links.empty())
 			append_pango_text(mark.c_str());
 		else
 			append_pango_text_with_links(mark, links);
 	}
 }
 
+LookupStatsEntry *ArticleView::get_lookup_stats(const InstantDictIndex &index)
+{
+	if (index.type == InstantDictType_LOCAL && index.index < gpAppFrame->oLibs.ndicts())
+		return gpAppFrame->oLibs.get_lookup_stats(index.index);
+	return NULL;
+}
+
 void ArticleView::AppendData(gchar *data, const gchar *oword,
 			     const gchar *real_oword)
 {
+	StarDictParseDataPlugins &plugins = gpAppFrame->oStarDictPlugins->ParseDataPlugins;
+	const guint generation = plugins.get_generation();
+	LookupStatsEntry *lookup_stats = get_lookup_stats(dict_index);
+	const gint64 start_time = lookup_stats ? g_get_monotonic_time() : 0;
+	gint64 parse_time = 0;
+	const ParseResult *cached_result = gpAppFrame->oArticleCache.lookup(dict_index,
+		generation, data, oword);
+	if (cached_result) {
+		append_data_parse_result(real_oword, *cached_result);
+		if (lookup_stats)
+			lookup_stats_record(lookup_stats, LookupStage_Render,
+				g_get_monotonic_time() - start_time);
+		return;
+	}
+	if (!for_float_win && get_uint32(data) >= ASYNC_PARSE_MIN_SIZE
+		&& gpAppFrame->oParsePipeline
+		&& gpAppFrame->oParsePipeline->can_parse(data)) {
+		append_pending_data(data, oword, real_oword);
+		return;
+	}
+	if (!article_has_ui_fields(data)) {
+		/* The whole article is converted to a parse result,
+		 * so it can be cached. */
+		ParseResult parse_result;
+		parse_article(&plugins, data, oword, parse_result, parse_time);
+		append_data_parse_result(real_oword, parse_result);
+		gpAppFrame->oArticleCache.store(dict_index, generation, data, oword,
+			parse_result);
+		if (lookup_stats) {
+			lookup_stats_record(lookup_stats, LookupStage_ParseData, parse_time);
+			lookup_stats_record(lookup_stats, LookupStage_Render,
+				g_get_monotonic_time() - start_time - parse_time);
+		}
+		return;
+	}
 	std::string mark;
 
 	guint32 sec_size=0;
@@ -258,8 +315,7 @@ void ArticleView::AppendData(gchar *data, const gchar *oword,
 	data+=sizeof(guint32);
 	const gchar *p=data;
 	bool first_time = true;
-	size_t iPlugin;
-	size_t nPlugins = gpAppFrame->oStarDictPlugins->ParseDataPlugins.nplugins();
+	bool parsed;
 	unsigned int parsed_size;
 	ParseResult parse_result;
 	while (guint32(p - data)<data_size) {
@@ -267,89 +323,28 @@ void ArticleView::AppendData(gchar *data, const gchar *oword,
 			first_time=false;
 		else
 			mark+= "\n";
-		for (iPlugin = 0; iPlugin < nPlugins; iPlugin++) {
-			parse_result.clear();
-			if (gpAppFrame->oStarDictPlugins->ParseDataPlugins.parse(iPlugin, p, &parsed_size, parse_result, oword)) {
-				p += parsed_size;
-				break;
-			}
+		const gint64 parse_start_time = lookup_stats ? g_get_monotonic_time() : 0;
+		parsed = plugins.parse(p, &parsed_size, parse_result, oword);
+		if (parsed)
+			p += parsed_size;
+		if (lookup_stats) {
+			const gint64 t = g_get_monotonic_time() - parse_start_time;
+			lookup_stats_record(lookup_stats, LookupStage_ParseData, t);
+			parse_time += t;
 		}
-		if (iPlugin != nPlugins) {
+		if (parsed) {
 			append_and_mark_orig_word(mark, real_oword, LinksPosList());
 			mark.clear();
 			append_data_parse_result(real_oword, parse_result);
 			parse_result.clear();
 			continue;
 		}
+		sec_size = article_field_markup(p, mark);
+		if (sec_size) {
+			p += sec_size;
+			continue;
+		}
 		switch (*p) {
-			case 'm':
-			//case 'l': //TODO: convert from local encoding to utf-8
-				p++;
-				sec_size = strlen(p);
-				if (sec_size) {
-					gchar *m_str = g_markup_escape_text(p, sec_size);
-					mark+=m_str;
-					g_free(m_str);
-				}
-				sec_size++;
-				break;
-			case 'g':
-				p++;
-				sec_size=strlen(p);
-				if (sec_size) {
-					mark+=p;
-				}
-				sec_size++;
-				break;
-			case 'x':
-				p++;
-				sec_size = strlen(p) + 1;
-				mark+= _("XDXF data parsing plug-in is not found!");
-				break;
-			case 'k':
-				p++;
-				sec_size = strlen(p) + 1;
-				mark+= _("PowerWord data parsing plug-in is not found!");
-				break;
-			case 'w':
-				p++;
-				sec_size = strlen(p) + 1;
-				mark+= _("Wiki data parsing plug-in is not found!");
-				break;
-			case 'h':
-				p++;
-				sec_size = strlen(p) + 1;
-				mark+= _("HTML data parsing plug-in is not found!");
-				break;
-			case 'n':
-				p++;
-				sec_size = strlen(p) + 1;
-				mark+= _("WordNet data parsing plug-in is not found!");
-				break;
-			case 't':
-				p++;
-				sec_size = strlen(p);
-				if (sec_size) {
-					mark += "[<span foreground=\"blue\">";
-					gchar *m_str = g_markup_escape_text(p, sec_size);
-					mark += m_str;
-					g_free(m_str);
-					mark += "</span>]";
-				}
-				sec_size++;
-				break;
-			case 'y':
-				p++;
-				sec_size = strlen(p);
-				if (sec_size) {
-					mark += "[<span foreground=\"red\">";
-					gchar *m_str = g_markup_escape_text(p, sec_size);
-					mark += m_str;
-					g_free(m_str);
-					mark += "</span>]";
-				}
-				sec_size++;
-				break;
 			case 'r':
 				p++;
 				sec_size = strlen(p);
@@ -360,14 +355,6 @@ void ArticleView::AppendData(gchar *data, const gchar *oword,
 				}
 				sec_size++;
 				break;
-			/*case 'W':
-				{
-				p++;
-				sec_size=g_ntohl(get_uint32(p));
-				//TODO: sound button.
-				sec_size += sizeof(guint32);
-				}
-				break;*/
 			case 'P':
 				{
 				p++;
@@ -378,18 +365,15 @@ void ArticleView::AppendData(gchar *data, const gchar *oword,
 						mark.clear();
 						append_pixbuf(NULL);
 					} else {
-						GdkPixbufLoader* loader = gdk_pixbuf_loader_new();
-						gdk_pixbuf_loader_write(loader, (const guchar *)(p+sizeof(guint32)), sec_size, NULL);
-						gdk_pixbuf_loader_close(loader, NULL);
-						GdkPixbuf* pixbuf = gdk_pixbuf_loader_get_pixbuf(loader);
-						if (pixbuf) {
-							append_and_mark_orig_word(mark, real_oword, LinksPosList());
-							mark.clear();
-							append_pixbuf(pixbuf);
-						} else {
-							mark += _("<span foreground=\"red\">[Load image error!]</span>");
-						}
-						g_object_unref(loader);
+						const guchar *image_data = (const guchar *)(p + sizeof(guint32));
+						const std::string key = ImageLoader::make_key(get_dict_id(),
+							"", image_data, sec_size);
+						const std::string error_markup
+							= _("<span foreground=\"red\">[Load image error!]</span>");
+						append_and_mark_orig_word(mark, real_oword, LinksPosList());
+						mark.clear();
+						if (!append_image(key, image_data, sec_size, NULL, "", error_markup))
+							mark += error_markup;
 					}
 				} else {
 					mark += _("<span foreground=\"red\">[Missing Image]</span>");
@@ -397,22 +381,334 @@ void ArticleView::AppendData(gchar *data, const gchar *oword,
 				sec_size += sizeof(guint32);
 				}
 				break;
-			default:
-				if (g_ascii_isupper(*p)) {
-					p++;
-					sec_size=g_ntohl(get_uint32(p));
-					sec_size += sizeof(guint32);
-				} else {
-					p++;
-					sec_size = strlen(p)+1;
-				}
-				mark += _("Unknown data type, please upgrade StarDict!");
-				break;
 		}
 		p += sec_size;
 	}
 
 	append_and_mark_orig_word(mark, real_oword, LinksPosList());
+	if (lookup_stats)
+		lookup_stats_record(lookup_stats, LookupStage_Render,
+			g_get_monotonic_time() - start_time - parse_time);
+}
+
+/* Reserve a place for the article and parse it in the background,
+ * the article is inserted when it is ready. */
+void ArticleView::append_pending_data(const gchar *data, const gchar *oword,
+	const gchar *real_oword)
+{
+	PendingArticle *article = new PendingArticle;
+	article->view = this;
+	glib::CharStr mark(g_strdup_printf("_ArticleView_pending_%u", ++pending_num));
+	article->mark = get_impl(mark);
+	if (real_oword)
+		article->real_oword = real_oword;
+	article->dict_index = dict_index;
+	article->generation = gpAppFrame->oStarDictPlugins->ParseDataPlugins.get_generation();
+	/* left gravity, articles appended later stay after the mark */
+	pango_view_->append_mark(article->mark.c_str(), true);
+	pending_articles.push_back(article);
+	gpAppFrame->oParsePipeline->push(this, data, oword, on_article_parsed, article);
+}
+
+void ArticleView::on_article_parsed(ParseJob *job)
+{
+	PendingArticle *article = static_cast<PendingArticle *>(job->user_data);
+	article->view->insert_pending_data(article, job);
+}
+
+void ArticleView::insert_pending_data(PendingArticle *article, ParseJob *job)
+{
+	LookupStatsEntry *lookup_stats = get_lookup_stats(article->dict_index);
+	const gint64 start_time = lookup_stats ? g_get_monotonic_time() : 0;
+	/* resources of the article are looked up in its own dictionary */
+	const InstantDictIndex cur_dict_index = dict_index;
+	dict_index = article->dict_index;
+	append_data_parse_result(article->real_oword.c_str(), job->result,
+		article->mark.c_str());
+	dict_index = cur_dict_index;
+	pango_view_->delete_mark(article->mark.c_str());
+	gpAppFrame->oArticleCache.store(article->dict_index, article->generation,
+		job->data, job->oword.c_str(), job->result);
+	pending_articles.remove(article);
+	delete article;
+	if (lookup_stats) {
+		lookup_stats_record(lookup_stats, LookupStage_ParseData, job->parse_time);
+		lookup_stats_record(lookup_stats, LookupStage_Render,
+			g_get_monotonic_time() - start_time);
+	}
+}
+
+void ArticleView::cancel_pending_data(void)
+{
+	if (pending_articles.empty())
+		return;
+	/* there is no pipeline on exit, it has dropped all jobs */
+	if (gpAppFrame->oParsePipeline)
+		gpAppFrame->oParsePipeline->cancel(this);
+	for (std::list<PendingArticle *>::iterator it = pending_articles.begin();
+		it != pending_articles.end(); ++it)
+		delete *it;
+	pending_articles.clear();
+}
+
+/* Identifies the current dictionary in keys of pictures. */
+std::string ArticleView::get_dict_id(void) const
+{
+	if (dict_index.type == InstantDictType_LOCAL
+		&& dict_index.index < gpAppFrame->oLibs.ndicts())
+		return gpAppFrame->oLibs.dict_ifofilename(dict_index.index);
+	glib::CharStr id(g_strdup_printf("%d:%lu", dict_index.type,
+		(unsigned long)dict_index.index));
+	return get_impl(id);
+}
+
+/* Show the picture at where_mark, at the end if where_mark is empty.
+ * Cached pictures and small ones are shown at once, large pictures are
+ * decoded in the background and error_markup is shown if that fails.
+ * Return false if the picture cannot be decoded. */
+bool ArticleView::append_image(const std::string &key, const guchar *data,
+	gsize size, const char *label, const std::string &where_mark,
+	const std::string &error_markup)
+{
+	ImageLoader *loader = gpAppFrame->oImageLoader;
+	GdkPixbuf *pixbuf = loader->lookup(key);
+	if (!pixbuf && size >= ASYNC_IMAGE_MIN_SIZE) {
+		PendingImage *image = new PendingImage;
+		image->view = this;
+		glib::CharStr mark(g_strdup_printf("_ArticleView_image_%u", ++pending_num));
+		image->mark = get_impl(mark);
+		if (label)
+			image->label = label;
+		image->error_markup = error_markup;
+		/* left gravity, text appended later stays after the mark.
+		 * A placeholder char after the mark gives each picture its own
+		 * position, pictures at the same place keep their order whichever
+		 * of them is decoded first. */
+		if (where_mark.empty())
+			pango_view_->append_mark(image->mark.c_str(), true);
+		else
+			pango_view_->insert_mark(image->mark.c_str(), where_mark.c_str(), 0, true);
+		pango_view_->insert_text(PangoWidgetBase::PLACEHOLDER, image->mark.c_str());
+		pending_images.push_back(image);
+		loader->push(this, key, data, size, on_image_loaded, image);
+		return true;
+	}
+	if (!pixbuf)
+		pixbuf = loader->load(key, data, size);
+	if (!pixbuf)
+		return false;
+	if (where_mark.empty())
+		pango_view_->append_pixbuf(pixbuf, label);
+	else
+		pango_view_->insert_pixbuf(pixbuf, label, where_mark.c_str());
+	g_object_unref(pixbuf);
+	return true;
+}
+
+void ArticleView::on_image_loaded(ImageJob *job)
+{
+	PendingImage *image = static_cast<PendingImage *>(job->user_data);
+	image->view->insert_pending_image(image, job);
+}
+
+void ArticleView::insert_pending_image(PendingImage *image, ImageJob *job)
+{
+	const char *label = image->label.empty() ? NULL : image->label.c_str();
+	pango_view_->delete_text(image->mark.c_str(), 1, 0);
+	if (job->pixbuf)
+		pango_view_->insert_pixbuf(job->pixbuf, label, image->mark.c_str());
+	else
+		pango_view_->insert_pango_text(image->error_markup.c_str(),
+			image->mark.c_str());
+	pango_view_->delete_mark(image->mark.c_str());
+	pango_view_->reindent();
+	pending_images.remove(image);
+	delete image;
+}
+
+void ArticleView::cancel_pending_images(void)
+{
+	if (pending_images.empty())
+		return;
+	/* there is no loader on exit, it has dropped all jobs */
+	if (gpAppFrame->oImageLoader)
+		gpAppFrame->oImageLoader->cancel(this);
+	for (std::list<PendingImage *>::iterator it = pending_images.begin();
+		it != pending_images.end(); ++it)
+		delete *it;
+	pending_images.clear();
+}
+
+void ArticleView::AppendArticles(const gchar *orig_word, gchar **Word,
+	gchar ***WordData)
+{
+	if (!for_float_win && appended_size >= DEFER_ARTICLES_MIN_SIZE) {
+		defer_articles(orig_word, Word, WordData);
+		return;
+	}
+	for (size_t j = 0; Word[j]; ++j)
+		for (size_t k = 0; WordData[j][k]; ++k)
+			appended_size += get_uint32(WordData[j][k]);
+	append_articles(orig_word, Word, WordData);
+}
+
+void ArticleView::append_articles(const gchar *orig_word, gchar **Word,
+	gchar ***WordData)
+{
+	for (size_t j = 0; Word[j]; ++j) {
+		AppendWord(Word[j]);
+		AppendData(WordData[j][0], Word[j], orig_word);
+		AppendNewline();
+		for (size_t k = 1; WordData[j][k]; ++k) {
+			AppendDataSeparate();
+			AppendData(WordData[j][k], Word[j], orig_word);
+			AppendNewline();
+		}
+	}
+}
+
+/* Reserve a place for the articles, the data is copied, the caller frees it
+ * right after the page is shown. */
+void ArticleView::defer_articles(const gchar *orig_word, gchar **Word,
+	gchar ***WordData)
+{
+	DeferredArticles *articles = new DeferredArticles;
+	glib::CharStr mark(g_strdup_printf("_ArticleView_deferred_%u", ++pending_num));
+	articles->mark = get_impl(mark);
+	articles->header = int(bookindex) - 1;
+	articles->dict_index = dict_index;
+	if (orig_word)
+		articles->orig_word = orig_word;
+	const guint nwords = g_strv_length(Word);
+	articles->words = g_strdupv(Word);
+	articles->data = (gchar ***)g_malloc(sizeof(gchar **) * nwords);
+	for (guint j = 0; j < nwords; ++j) {
+		size_t count = 0;
+		while (WordData[j][count])
+			++count;
+		articles->data[j] = (gchar **)g_malloc(sizeof(gchar *) * (count + 1));
+		for (size_t k = 0; k < count; ++k)
+			articles->data[j][k] = stardict_datadup(WordData[j][k]);
+		articles->data[j][count] = NULL;
+	}
+	/* The header mark of the next dictionary goes after the placeholder, so
+	 * it stays after these articles when they are rendered. */
+	pango_view_->append_placeholder(articles->mark.c_str());
+	deferred_articles.push_back(articles);
+	if (render_idle_id)
+		return;
+	/* low priority, the visible part of the page is drawn first */
+	render_idle_id = g_idle_add_full(G_PRIORITY_LOW, on_render_idle, this, NULL);
+	render_adjustment = gtk_scrolled_window_get_vadjustment(
+		GTK_SCROLLED_WINDOW(pango_view_->window()));
+	g_object_ref(render_adjustment);
+	render_scroll_id = g_signal_connect(render_adjustment, "value-changed",
+		G_CALLBACK(on_render_scroll), this);
+}
+
+void ArticleView::RenderDeferredArticles(const char *header_mark)
+{
+	if (deferred_articles.empty())
+		return;
+	const int header = header_mark ? atoi(header_mark) : G_MAXINT;
+	while (!deferred_articles.empty() && deferred_articles.front()->header <= header)
+		render_first_deferred();
+	if (deferred_articles.empty())
+		stop_deferred_rendering();
+}
+
+/* Articles are rendered in the order they appear on the page, so the text
+ * above the articles being rendered does not change. */
+void ArticleView::render_first_deferred(void)
+{
+	DeferredArticles *articles = deferred_articles.front();
+	deferred_articles.pop_front();
+	const InstantDictIndex cur_dict_index = dict_index;
+	dict_index = articles->dict_index;
+	pango_view_->begin_fill_placeholder(articles->mark.c_str());
+	append_articles(articles->orig_word.c_str(), articles->words, articles->data);
+	pango_view_->end_fill_placeholder(articles->mark.c_str());
+	dict_index = cur_dict_index;
+	free_deferred_articles(articles);
+}
+
+gboolean ArticleView::on_render_idle(gpointer user_data)
+{
+	ArticleView *view = static_cast<ArticleView *>(user_data);
+	view->render_first_deferred();
+	if (!view->deferred_articles.empty())
+		return TRUE;
+	view->render_idle_id = 0;
+	view->stop_deferred_rendering();
+	return FALSE;
+}
+
+/* The user scrolls to articles not rendered yet. One dictionary is rendered
+ * per scroll step, the height of just inserted text is not known till it is
+ * laid out. */
+void ArticleView::on_render_scroll(GtkAdjustment *adjustment, gpointer user_data)
+{
+	ArticleView *view = static_cast<ArticleView *>(user_data);
+	const gint margin = gint(gtk_adjustment_get_page_size(adjustment));
+	if (view->deferred_articles.empty() || !view->pango_view_->is_mark_visible(
+			view->deferred_articles.front()->mark.c_str(), margin))
+		return;
+	view->render_first_deferred();
+	if (view->deferred_articles.empty())
+		view->stop_deferred_rendering();
+}
+
+void ArticleView::stop_deferred_rendering(void)
+{
+	if (render_idle_id) {
+		g_source_remove(render_idle_id);
+		render_idle_id = 0;
+	}
+	if (render_adjustment) {
+		g_signal_handler_disconnect(render_adjustment, render_scroll_id);
+		g_object_unref(render_adjustment);
+		render_adjustment = NULL;
+		render_scroll_id = 0;
+	}
+}
+
+void ArticleView::cancel_deferred_articles(void)
+{
+	stop_deferred_rendering();
+	for (std::list<DeferredArticles *>::iterator it = deferred_articles.begin();
+		it != deferred_articles.end(); ++it)
+		free_deferred_articles(*it);
+	deferred_articles.clear();
+	appended_size = 0;
+}
+
+void ArticleView::free_deferred_articles(DeferredArticles *articles)
+{
+	for (size_t j = 0; articles->words[j]; ++j) {
+		for (size_t k = 0; articles->data[j][k]; ++k)
+			g_free(articles->data[j][k]);
+		g_free(articles->data[j]);
+	}
+	g_free(articles->data);
+	g_strfreev(articles->words);
+	delete articles;
+}
+
+ArticleView::~ArticleView()
+{
+	cancel_pending_data();
+	cancel_pending_images();
+	cancel_deferred_articles();
+}
+
+void ArticleView::clear()
+{
+	cancel_pending_data();
+	cancel_pending_images();
+	cancel_deferred_articles();
+	pango_view_->clear();
+	bookindex = 0;
+	headerindex = -1;
 }
 
 void ArticleView::AppendNewline()
@@ -573,7 +869,7 @@ void ArticleView::append_resource_file_list(const gchar *p)
 }
 
 void ArticleView::append_data_parse_result(const gchar *real_oword, 
-	ParseResult& parse_result)
+	const ParseResult& parse_result, const char *where_mark)
 {
 	/* Why ParseResultItem's cannot be inserted into the pango_view_ in the 
 	 * order they appear in the parse_result list? 
@@ -625,7 +921,8 @@ void ArticleView::append_data_parse_result(const gchar *real_oword,
 	 * 
 	 * */
 	Marks marks(pango_view_.get());
-	std::string start_mark = marks.append_mark(true);
+	std::string start_mark = where_mark ? marks.insert_mark(where_mark, 0, true)
+		: marks.append_mark(true);
 	std::list<ParseResultItemWithMark> delayed_insert_list;
 	// compose markup
 	{
@@ -633,7 +930,7 @@ void ArticleView::append_data_parse_result(const gchar *real_oword,
 		int char_offset = 0;
 		const char tmp_char = 'x'; // may be any unicode char excluding '<', '&', '>'
 
-		for (std::list<ParseResultItem>::iterator it = parse_result.item_list.begin(); 
+		for (std::list<ParseResultItem>::const_iterator it = parse_result.item_list.begin(); 
 			it != parse_result.item_list.end(); ++it) {
 			switch (it->type) {
 				case ParseResultItemType_mark:
@@ -677,7 +974,8 @@ void ArticleView::append_data_parse_result(const gchar *real_oword,
 					break;
 			}
 		}
-		append_and_mark_orig_word(markup_str, real_oword, LinksPosList());
+		append_and_mark_orig_word(markup_str, real_oword, LinksPosList(),
+			where_mark);
 		markup_str.clear();
 		pango_view_->flush();
 	}
@@ -789,7 +1087,6 @@ void ArticleView::append_data_res_image(
 		else
 			pango_view_->insert_pixbuf(NULL, key.c_str(), mark.c_str());
 	} else {
-		GdkPixbuf* pixbuf = NULL;
 		if (dict_index.type == InstantDictType_LOCAL) {
 			StorageType type = gpAppFrame->oLibs.GetStorageType(dict_index.index);
 			if (type == StorageType_DATABASE || type == StorageType_FILE) {
@@ -797,24 +1094,15 @@ void ArticleView::append_data_res_image(
 					(dict_index.index, key)) {
 					const guint32 size = get_uint32(content);
 					const guchar *data = (const guchar *)(content+sizeof(guint32));
-					GdkPixbufLoader* loader = gdk_pixbuf_loader_new();
-					gdk_pixbuf_loader_write(loader, data, size, NULL);
-					gdk_pixbuf_loader_close(loader, NULL);
-					pixbuf = gdk_pixbuf_loader_get_pixbuf(loader);
-					if(pixbuf)
-						g_object_ref(G_OBJECT(pixbuf));
-					g_object_unref(loader);
+					std::string error_markup("<span foreground=\"red\">");
+					glib::CharStr m_str(g_markup_escape_text(key.c_str(), -1));
+					error_markup += get_impl(m_str);
+					error_markup += "</span>";
+					loaded = append_image(ImageLoader::make_key(get_dict_id(), key,
+						data, size), data, size, key.c_str(), mark, error_markup);
 				}
 			}
 		}
-		if (pixbuf) {
-			loaded = true;
-			if(mark.empty())
-				pango_view_->append_pixbuf(pixbuf, key.c_str());
-			else
-				pango_view_->insert_pixbuf(pixbuf, key.c_str(), mark.c_str());
-			g_object_unref(pixbuf);
-		}
 	}
 }
 
@@ -21,10 +21,14 @@
 #define ARTICLEVIEW_H
 
 #include <string>
+#include <list>
 #include <gtk/gtk.h>
 
 #include "pangoview.h" 
 #include "lib/dictbase.h"
+#include "lib/lookupstats.h"
+#include "lib/parsepipeline.h"
+#include "imageloader.h"
 
 enum BookNameStyle
 {
@@ -38,34 +42,55 @@ class ArticleView {
 public:
 	ArticleView(GtkContainer *owner, BookNameStyle booknamestyle, bool floatw=false)
 		: bookindex(0), bookname_style(booknamestyle), pango_view_(PangoWidgetBase::create(owner, floatw)),
-		for_float_win(floatw), headerindex(-1) {}
+		for_float_win(floatw), headerindex(-1), pending_num(0), appended_size(0),
+		render_idle_id(0), render_adjustment(NULL), render_scroll_id(0) { dict_index.type = InstantDictType_UNKNOWN; }
 	ArticleView(GtkBox *owner, BookNameStyle booknamestyle, bool floatw=false)
 		:  bookname_style(booknamestyle),
 		pango_view_(PangoWidgetBase::create(owner, floatw)),
-		for_float_win(floatw), headerindex(-1) {}
+		for_float_win(floatw), headerindex(-1), pending_num(0), appended_size(0),
+		render_idle_id(0), render_adjustment(NULL), render_scroll_id(0) { dict_index.type = InstantDictType_UNKNOWN; }
+	~ArticleView();
 
 	void SetDictIndex(InstantDictIndex index);
 	void AppendHeaderMark();
 	void AppendHeader(const char *dict_name, const char *dict_link = NULL);
 	void AppendWord(const gchar *word);
 	void AppendData(gchar *data, const gchar *oword, const gchar *origword);
+	/* Append the words of the current dictionary with their articles.
+	 * Word and WordData are those of one dictionary in TextWin::Show.
+	 * When the page already has enough text to fill the window, the articles
+	 * are deferred: their place is reserved and they are rendered when
+	 * scrolled into view or when the main loop is idle. */
+	void AppendArticles(const gchar *orig_word, gchar **Word, gchar ***WordData);
+	/* Render deferred articles up to those of the dictionary with the header
+	 * mark header_mark, so the mark is at its final place.
+	 * NULL - render all articles. */
+	void RenderDeferredArticles(const char *header_mark = NULL);
 	void AppendNewline();
 	void AppendDataSeparate();
 
 	GtkWidget *widget() { return pango_view_->widget(); }
-	void scroll_to(gdouble val) { pango_view_->scroll_to(val); }
+	void scroll_to(gdouble val) {
+		if (val > 0)
+			RenderDeferredArticles();
+		pango_view_->scroll_to(val);
+	}
 	void set_text(const char *str) { pango_view_->set_text(str); }
 	void append_text(const char *str) { pango_view_->append_text(str); }
 	void append_pango_text(const char *str) { pango_view_->append_pango_text(str); }
 	void append_pixbuf(GdkPixbuf *pixbuf, const char *label = NULL) { pango_view_->append_pixbuf(pixbuf, label); }
 	void append_widget(GtkWidget *widget) { pango_view_->append_widget(widget); }
 	void set_pango_text(const char *str) { pango_view_->set_pango_text(str); }
-	std::string get_text() { return pango_view_->get_text(); }
+	std::string get_text() {
+		RenderDeferredArticles();
+		return pango_view_->get_text();
+	}
 	void append_pango_text_with_links(const std::string& str,
 					  const LinksPosList& links) {
 		pango_view_->append_pango_text_with_links(str, links);
 	}
-	void clear() { pango_view_->clear(); bookindex = 0; headerindex = -1; }
+	/* Clear the view and cancel articles being parsed in the background. */
+	void clear();
 	void append_mark(const char *mark) { pango_view_->append_mark(mark); }
 	void begin_update() { pango_view_->begin_update(); }
 	void end_update() { pango_view_->end_update(); }
@@ -85,6 +110,37 @@ public:
 	void set_bookname_style(BookNameStyle style) { bookname_style = style; }
 private:
 	struct ParseResultItemWithMark;
+	/* an article in the parse pipeline */
+	struct PendingArticle {
+		ArticleView *view;
+		/* the article is inserted at this mark */
+		std::string mark;
+		std::string real_oword;
+		InstantDictIndex dict_index;
+		/* of parse-data plugins, for the article cache */
+		guint generation;
+	};
+	/* a picture being decoded in the background */
+	struct PendingImage {
+		ArticleView *view;
+		/* the picture is inserted at this mark */
+		std::string mark;
+		std::string label;
+		/* shown if the picture cannot be decoded */
+		std::string error_markup;
+	};
+	/* articles of a dictionary waiting to be rendered */
+	struct DeferredArticles {
+		/* the articles are inserted at this mark */
+		std::string mark;
+		/* number of the dictionary header mark */
+		int header;
+		InstantDictIndex dict_index;
+		std::string orig_word;
+		/* copies of Word and WordData */
+		gchar **words;
+		gchar ***data;
+	};
 
 	unsigned int bookindex;
 	BookNameStyle bookname_style;
@@ -93,13 +149,46 @@ private:
 	InstantDictIndex dict_index;
 	/* Count headers. Add extra space before headers with index > 0. */
 	int headerindex;
+	std::list<PendingArticle *> pending_articles;
+	std::list<PendingImage *> pending_images;
+	/* for unique names of pending article and picture marks */
+	guint pending_num;
+	std::list<DeferredArticles *> deferred_articles;
+	/* size of article data rendered since the view was cleared */
+	size_t appended_size;
+	guint render_idle_id;
+	GtkAdjustment *render_adjustment;
+	gulong render_scroll_id;
 
+	LookupStatsEntry *get_lookup_stats(const InstantDictIndex &index);
 	std::string xdxf2pango(const char *p, const gchar *oword, LinksPosList& links_list);
 	void append_and_mark_orig_word(const std::string& mark,
 				       const gchar *origword,
-				       const LinksPosList& links);
+				       const LinksPosList& links,
+				       const char *where_mark = NULL);
 	void append_resource_file_list(const gchar *p);
-	void append_data_parse_result(const gchar *real_oword, ParseResult& parse_result);
+	void append_data_parse_result(const gchar *real_oword, const ParseResult& parse_result,
+		const char *where_mark = NULL);
+	void append_pending_data(const gchar *data, const gchar *oword,
+		const gchar *real_oword);
+	static void on_article_parsed(ParseJob *job);
+	void insert_pending_data(PendingArticle *article, ParseJob *job);
+	void cancel_pending_data(void);
+	std::string get_dict_id(void) const;
+	bool append_image(const std::string &key, const guchar *data, gsize size,
+		const char *label, const std::string &where_mark,
+		const std::string &error_markup);
+	static void on_image_loaded(ImageJob *job);
+	void insert_pending_image(PendingImage *image, ImageJob *job);
+	void cancel_pending_images(void);
+	void append_articles(const gchar *orig_word, gchar **Word, gchar ***WordData);
+	void defer_articles(const gchar *orig_word, gchar **Word, gchar ***WordData);
+	void render_first_deferred(void);
+	static gboolean on_render_idle(gpointer user_data);
+	static void on_render_scroll(GtkAdjustment *adjustment, gpointer user_data);
+	void stop_deferred_rendering(void);
+	void cancel_deferred_articles(void);
+	static void free_deferred_articles(DeferredArticles *articles);
 	void append_data_res_image(const std::string& key, const std::string& mark,
 		bool& loaded);
 	void append_data_res_sound(const std::string& key, const std::string& mark,
@@ -39,6 +39,7 @@ static gboolean quit_option = FALSE;
 static gchar **query_words = NULL;
 static gchar *dirs_config_option = NULL;
 static gchar *dirs_config_option_pre = NULL;
+static gchar *lookup_stats_option = NULL;
 #if defined(_WIN32)
 static gboolean portable_mode_option = FALSE;
 static gboolean portable_mode_option_pre = FALSE;
@@ -62,6 +63,8 @@ static const GOptionEntry options [] =
 #endif
 	{ "dirs-config", 0, 0, G_OPTION_ARG_FILENAME, &dirs_config_option,
 	  N_("StarDict directories configuration file"), "config-file" },
+	{ "lookup-stats", 0, 0, G_OPTION_ARG_STRING, &lookup_stats_option,
+	  N_("Print lookup latency statistics on exit and on SIGUSR1 (text or json)"), "format" },
 #if defined(_WIN32)
 	{ "portable-mode", 0, 0, G_OPTION_ARG_NONE, &portable_mode_option,
 	  N_("Activate portable mode"), NULL },
@@ -84,6 +87,8 @@ public:
 		query_words = NULL;
 		g_free(dirs_config_option_pre);
 		dirs_config_option_pre = NULL;
+		g_free(lookup_stats_option);
+		lookup_stats_option = NULL;
 	}
 } cleanOptions;
 
@@ -155,6 +160,11 @@ gchar const * CmdLineOptions::get_dirs_config_pre(void)
 	return dirs_config_option_pre;
 }
 
+gchar const * CmdLineOptions::get_lookup_stats(void)
+{
+	return lookup_stats_option;
+}
+
 #if defined(_WIN32)
 gboolean CmdLineOptions::get_portable_mode(void)
 {
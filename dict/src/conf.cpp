@@ -115,6 +115,8 @@ AppConf::AppConf() :
 	add_entry("/apps/stardict/preferences/network/port", 2628);
 	add_entry("/apps/stardict/preferences/network/user", std::string());
 	add_entry("/apps/stardict/preferences/network/md5passwd", std::string());
+	// keep net dictionary responses in the cache directory
+	add_entry("/apps/stardict/preferences/network/netdict_disk_cache", false);
 	// may store relative path
 	add_entry("/apps/stardict/preferences/main_window/skin", std::string());
 	add_entry("/apps/stardict/preferences/main_window/hide_on_startup", false);
@@ -182,6 +184,8 @@ AppConf::AppConf() :
 	add_entry("/apps/stardict/preferences/dictionary/enable_collation", false);
 	add_entry("/apps/stardict/preferences/dictionary/collate_function", 0);
 	add_entry("/apps/stardict/preferences/dictionary/do_not_load_bad_dict", true);
+	// check loaded dictionaries for changes every N seconds, 0 - never
+	add_entry("/apps/stardict/preferences/dictionary/auto_reload_interval", 60);
 	//add_entry("/apps/stardict/preferences/dictionary/add_new_dict_in_active_group", true);
 	//add_entry("/apps/stardict/preferences/dictionary/add_new_plugin_in_active_group", true);
 
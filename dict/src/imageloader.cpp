@@ -0,0 +1,216 @@
+/*
+ * This file is part of StarDict.
+ *
+ * StarDict is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * StarDict is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with StarDict.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include "imageloader.h"
+
+ImageLoader::ImageLoader(gint max_threads, size_t _max_size)
+:
+	max_size(_max_size),
+	cur_size(0)
+{
+	g_mutex_init(&mutex);
+	pool = g_thread_pool_new(worker_func, this, max_threads, FALSE, NULL);
+}
+
+ImageLoader::~ImageLoader()
+{
+	g_mutex_lock(&mutex);
+	for (std::list<ImageJob *>::iterator it = jobs.begin(); it != jobs.end(); ++it)
+		g_atomic_int_set(&(*it)->cancelled, 1);
+	g_mutex_unlock(&mutex);
+	/* cancelled jobs are dropped by the workers */
+	g_thread_pool_free(pool, FALSE, TRUE);
+	/* only jobs waiting for the main loop remain */
+	for (std::list<ImageJob *>::iterator it = jobs.begin(); it != jobs.end(); ++it) {
+		g_source_remove((*it)->idle_id);
+		free_job(*it);
+	}
+	g_mutex_clear(&mutex);
+	clear();
+}
+
+/* FNV-1a hash of the picture data */
+static guint32 data_hash(const guchar *data, gsize size)
+{
+	guint32 hash = 2166136261U;
+	for (gsize i = 0; i < size; ++i) {
+		hash ^= data[i];
+		hash *= 16777619U;
+	}
+	return hash;
+}
+
+std::string ImageLoader::make_key(const std::string &dict_id, const std::string &name,
+	const guchar *data, gsize size)
+{
+	gchar buf[32];
+	g_snprintf(buf, sizeof(buf), "%lu:%08x:", (unsigned long)size, data_hash(data, size));
+	std::string key(buf);
+	key += dict_id;
+	key += '\n';
+	key += name;
+	return key;
+}
+
+GdkPixbuf *ImageLoader::lookup(const std::string &key)
+{
+	EntryMap::iterator it = entry_map.find(key);
+	if (it == entry_map.end())
+		return NULL;
+	entries.splice(entries.begin(), entries, it->second);
+	return GDK_PIXBUF(g_object_ref((*it->second)->pixbuf));
+}
+
+GdkPixbuf *ImageLoader::load(const std::string &key, const guchar *data, gsize size)
+{
+	GdkPixbuf *pixbuf = decode(data, size);
+	if (pixbuf)
+		store(key, pixbuf);
+	return pixbuf;
+}
+
+void ImageLoader::push(gpointer owner, const std::string &key, const guchar *data,
+	gsize size, on_image_loaded_func_t on_loaded, gpointer user_data)
+{
+	ImageJob *job = new ImageJob;
+	job->owner = owner;
+	job->user_data = user_data;
+	job->on_loaded = on_loaded;
+	job->key = key;
+	job->data = (guchar *)g_memdup(data, size);
+	job->size = size;
+	job->pixbuf = NULL;
+	job->loader = this;
+	job->cancelled = 0;
+	job->idle_id = 0;
+	g_mutex_lock(&mutex);
+	jobs.push_back(job);
+	g_mutex_unlock(&mutex);
+	g_thread_pool_push(pool, job, NULL);
+}
+
+void ImageLoader::cancel(gpointer owner)
+{
+	g_mutex_lock(&mutex);
+	for (std::list<ImageJob *>::iterator it = jobs.begin(); it != jobs.end(); ++it) {
+		if ((*it)->owner == owner)
+			g_atomic_int_set(&(*it)->cancelled, 1);
+	}
+	g_mutex_unlock(&mutex);
+}
+
+void ImageLoader::clear(void)
+{
+	for (EntryList::iterator it = entries.begin(); it != entries.end(); ++it) {
+		g_object_unref((*it)->pixbuf);
+		delete *it;
+	}
+	entries.clear();
+	entry_map.clear();
+	cur_size = 0;
+}
+
+GdkPixbuf *ImageLoader::decode(const guchar *data, gsize size)
+{
+	GdkPixbufLoader* loader = gdk_pixbuf_loader_new();
+	gdk_pixbuf_loader_write(loader, data, size, NULL);
+	gdk_pixbuf_loader_close(loader, NULL);
+	GdkPixbuf *pixbuf = gdk_pixbuf_loader_get_pixbuf(loader);
+	if (pixbuf)
+		g_object_ref(G_OBJECT(pixbuf));
+	g_object_unref(loader);
+	return pixbuf;
+}
+
+void ImageLoader::store(const std::string &key, GdkPixbuf *pixbuf)
+{
+	const size_t size = sizeof(Entry) + key.length()
+		+ size_t(gdk_pixbuf_get_rowstride(pixbuf)) * gdk_pixbuf_get_height(pixbuf);
+	if (size > max_size)
+		return;
+	EntryMap::iterator it = entry_map.find(key);
+	if (it != entry_map.end()) {
+		Entry *old = *it->second;
+		cur_size -= old->size;
+		entries.erase(it->second);
+		entry_map.erase(it);
+		g_object_unref(old->pixbuf);
+		delete old;
+	}
+	while (!entries.empty() && cur_size + size > max_size) {
+		Entry *last = entries.back();
+		cur_size -= last->size;
+		entry_map.erase(last->key);
+		entries.pop_back();
+		g_object_unref(last->pixbuf);
+		delete last;
+	}
+	Entry *entry = new Entry;
+	entry->key = key;
+	entry->pixbuf = GDK_PIXBUF(g_object_ref(pixbuf));
+	entry->size = size;
+	entries.push_front(entry);
+	entry_map[entry->key] = entries.begin();
+	cur_size += size;
+}
+
+void ImageLoader::worker_func(gpointer data, gpointer user_data)
+{
+	ImageJob *job = static_cast<ImageJob *>(data);
+	ImageLoader *loader = static_cast<ImageLoader *>(user_data);
+
+	if (!g_atomic_int_get(&job->cancelled))
+		job->pixbuf = decode(job->data, job->size);
+
+	g_mutex_lock(&loader->mutex);
+	const bool cancelled = g_atomic_int_get(&job->cancelled);
+	if (cancelled)
+		loader->jobs.remove(job);
+	else
+		/* back to main thread */
+		job->idle_id = g_idle_add(on_job_done, job);
+	g_mutex_unlock(&loader->mutex);
+	if (cancelled)
+		free_job(job);
+}
+
+gboolean ImageLoader::on_job_done(gpointer data)
+{
+	ImageJob *job = static_cast<ImageJob *>(data);
+	ImageLoader *loader = job->loader;
+	g_mutex_lock(&loader->mutex);
+	loader->jobs.remove(job);
+	g_mutex_unlock(&loader->mutex);
+	if (job->pixbuf)
+		loader->store(job->key, job->pixbuf);
+	if (!g_atomic_int_get(&job->cancelled))
+		job->on_loaded(job);
+	free_job(job);
+	return FALSE;
+}
+
+void ImageLoader::free_job(ImageJob *job)
+{
+	if (job->pixbuf)
+		g_object_unref(job->pixbuf);
+	g_free(job->data);
+	delete job;
+}
@@ -0,0 +1,109 @@
+/*
+ * This file is part of StarDict.
+ *
+ * StarDict is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * StarDict is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with StarDict.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _STARDICT_IMAGE_LOADER_H_
+#define _STARDICT_IMAGE_LOADER_H_
+
+#include <glib.h>
+#include <gdk-pixbuf/gdk-pixbuf.h>
+#include <string>
+#include <list>
+#include <map>
+
+class ImageLoader;
+struct ImageJob;
+
+typedef void (*on_image_loaded_func_t)(ImageJob *job);
+
+/* A picture queued for decoding. */
+struct ImageJob {
+	gpointer owner;
+	gpointer user_data;
+	/* Invoked in the main thread, unless the job is cancelled. */
+	on_image_loaded_func_t on_loaded;
+	std::string key;
+	/* copy of the encoded picture */
+	guchar *data;
+	gsize size;
+	/* NULL if the data cannot be decoded, owned by the job */
+	GdkPixbuf *pixbuf;
+private:
+	friend class ImageLoader;
+	ImageLoader *loader;
+	gint cancelled;
+	guint idle_id;
+};
+
+/* Decodes pictures of articles in worker threads and caches the result.
+ * Large pictures freeze the user interface while they are decoded, and the
+ * same pictures are decoded again each time an article is shown. The loader
+ * decodes pictures in the background and keeps recently shown pixbufs, the
+ * least recently used are dropped when their total size exceeds the limit.
+ * A picture is identified by a key made with make_key. The key includes the
+ * size and a hash of the encoded data, so a reloaded dictionary never gets a
+ * stale picture.
+ * Jobs are identified by owner, as in ParsePipeline. A cancelled job is
+ * dropped without notification.
+ * All methods must be called in the main thread. */
+class ImageLoader {
+public:
+	/* max_cache_size - in bytes of decoded pixels */
+	ImageLoader(gint max_threads, size_t max_cache_size);
+	~ImageLoader();
+	/* dict_id identifies the dictionary, name - the picture in the
+	 * dictionary, it may be empty. */
+	static std::string make_key(const std::string &dict_id, const std::string &name,
+		const guchar *data, gsize size);
+	/* Return a new reference to the cached pixbuf, NULL if not cached. */
+	GdkPixbuf *lookup(const std::string &key);
+	/* Decode the picture now and cache it.
+	 * Return a new reference, NULL if the data cannot be decoded. */
+	GdkPixbuf *load(const std::string &key, const guchar *data, gsize size);
+	/* Decode the picture in the background, it is cached before on_loaded
+	 * is invoked. */
+	void push(gpointer owner, const std::string &key, const guchar *data,
+		gsize size, on_image_loaded_func_t on_loaded, gpointer user_data);
+	void cancel(gpointer owner);
+	void clear(void);
+private:
+	struct Entry {
+		std::string key;
+		GdkPixbuf *pixbuf;
+		size_t size;
+	};
+	/* most recently used first */
+	typedef std::list<Entry *> EntryList;
+	typedef std::map<std::string, EntryList::iterator> EntryMap;
+
+	static GdkPixbuf *decode(const guchar *data, gsize size);
+	static void worker_func(gpointer data, gpointer user_data);
+	static gboolean on_job_done(gpointer data);
+	static void free_job(ImageJob *job);
+	void store(const std::string &key, GdkPixbuf *pixbuf);
+
+	GThreadPool *pool;
+	/* protects jobs */
+	GMutex mutex;
+	/* jobs not yet delivered to the main thread */
+	std::list<ImageJob *> jobs;
+	size_t max_size;
+	size_t cur_size;
+	EntryList entries;
+	EntryMap entry_map;
+};
+
+#endif
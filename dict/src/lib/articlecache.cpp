@@ -0,0 +1,157 @@
+/*
+ * This file is part of StarDict.
+ *
+ * StarDict is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * StarDict is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with StarDict.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <cstring>
+
+#include "utils.h"
+#include "articlecache.h"
+
+ArticleCache::ArticleCache(size_t _max_size)
+:
+	max_size(_max_size),
+	cur_size(0)
+{
+}
+
+ArticleCache::~ArticleCache()
+{
+	clear();
+}
+
+/* FNV-1a hash of the article data */
+static guint32 data_hash(const gchar *data, guint32 size)
+{
+	guint32 hash = 2166136261U;
+	for (guint32 i = 0; i < size; ++i) {
+		hash ^= (guchar)data[i];
+		hash *= 16777619U;
+	}
+	return hash;
+}
+
+void ArticleCache::build_key(std::string &key, const InstantDictIndex &dict_index,
+	guint generation, const gchar *data, const gchar *oword)
+{
+	const guint32 size = get_uint32(data);
+	gchar buf[64];
+	g_snprintf(buf, sizeof(buf), "%d:%lu:%u:%u:%08x:", dict_index.type,
+		(unsigned long)dict_index.index, generation, size,
+		data_hash(data + sizeof(guint32), size));
+	key = buf;
+	if (oword)
+		key += oword;
+}
+
+const ParseResult *ArticleCache::lookup(const InstantDictIndex &dict_index,
+	guint generation, const gchar *data, const gchar *oword)
+{
+	std::string key;
+	build_key(key, dict_index, generation, data, oword);
+	EntryMap::iterator it = entry_map.find(key);
+	if (it == entry_map.end())
+		return NULL;
+	Entry *entry = *it->second;
+	const size_t data_size = sizeof(guint32) + get_uint32(data);
+	if (entry->data.length() != data_size
+		|| memcmp(entry->data.data(), data, data_size) != 0)
+		return NULL;
+	entries.splice(entries.begin(), entries, it->second);
+	return &entry->result;
+}
+
+void ArticleCache::store(const InstantDictIndex &dict_index, guint generation,
+	const gchar *data, const gchar *oword, const ParseResult &result)
+{
+	const size_t data_size = sizeof(guint32) + get_uint32(data);
+	if (data_size > max_size)
+		return;
+	Entry *entry = new Entry;
+	entry->size = data_size;
+	if (!copy_result(result, entry->result, entry->size) || entry->size > max_size) {
+		delete entry;
+		return;
+	}
+	build_key(entry->key, dict_index, generation, data, oword);
+	entry->data.assign(data, data_size);
+	EntryMap::iterator it = entry_map.find(entry->key);
+	if (it != entry_map.end()) {
+		Entry *old = *it->second;
+		cur_size -= old->size;
+		entries.erase(it->second);
+		entry_map.erase(it);
+		delete old;
+	}
+	while (!entries.empty() && cur_size + entry->size > max_size) {
+		Entry *last = entries.back();
+		cur_size -= last->size;
+		entry_map.erase(last->key);
+		entries.pop_back();
+		delete last;
+	}
+	entries.push_front(entry);
+	entry_map[entry->key] = entries.begin();
+	cur_size += entry->size;
+}
+
+void ArticleCache::clear(void)
+{
+	for (EntryList::iterator it = entries.begin(); it != entries.end(); ++it)
+		delete *it;
+	entries.clear();
+	entry_map.clear();
+	cur_size = 0;
+}
+
+/* Deep copy of result. size is increased by the approximate size of the copy.
+ * Return false if the result cannot be copied. */
+bool ArticleCache::copy_result(const ParseResult &src, ParseResult &dst, size_t &size)
+{
+	for (std::list<ParseResultItem>::const_iterator it = src.item_list.begin();
+		it != src.item_list.end(); ++it) {
+		ParseResultItem item;
+		item.type = it->type;
+		switch (it->type) {
+			case ParseResultItemType_mark:
+				item.mark = new ParseResultMarkItem(*it->mark);
+				size += item.mark->pango.length();
+				break;
+			case ParseResultItemType_link:
+				item.link = new ParseResultLinkItem(*it->link);
+				size += item.link->pango.length();
+				break;
+			case ParseResultItemType_res:
+				item.res = new ParseResultResItem(*it->res);
+				size += item.res->key.length();
+				break;
+			case ParseResultItemType_FormatBeg:
+				item.format_beg = new ParseResultFormatBegItem(*it->format_beg);
+				break;
+			case ParseResultItemType_FormatEnd:
+				item.format_end = new ParseResultFormatEndItem(*it->format_end);
+				break;
+			default:
+				return false;
+		}
+		size += sizeof(ParseResultItem);
+		dst.item_list.push_back(item);
+	}
+	return true;
+}
@@ -0,0 +1,76 @@
+/*
+ * This file is part of StarDict.
+ *
+ * StarDict is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * StarDict is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with StarDict.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _STARDICT_ARTICLE_CACHE_H_
+#define _STARDICT_ARTICLE_CACHE_H_
+
+#include <glib.h>
+#include <string>
+#include <list>
+#include <map>
+
+#include "dictbase.h"
+#include "parsedata_plugin.h"
+
+/* Cache of parsed articles.
+ * The same article is often shown again: the user returns to a word from
+ * the history, the floating window shows what the main window has just shown.
+ * The cache keeps ParseResult lists of recently shown articles, so they are
+ * not parsed again.
+ * An article is identified by its dictionary, the searched word, the
+ * generation of parse-data plugins and the article data itself. The data is
+ * compared byte by byte, that is much faster than parsing, and stays correct
+ * when dictionaries are reloaded or reordered.
+ * Articles with widgets cannot be cached, widgets are owned by the view
+ * showing them. The least recently used articles are dropped when the total
+ * size of cached articles exceeds the limit.
+ * Must be used in the main thread only. */
+class ArticleCache {
+public:
+	/* max_size - in bytes */
+	explicit ArticleCache(size_t max_size);
+	~ArticleCache();
+	/* Return NULL if the article is not cached. The result is valid till the
+	 * cache is modified. */
+	const ParseResult *lookup(const InstantDictIndex &dict_index, guint generation,
+		const gchar *data, const gchar *oword);
+	void store(const InstantDictIndex &dict_index, guint generation,
+		const gchar *data, const gchar *oword, const ParseResult &result);
+	void clear(void);
+private:
+	struct Entry {
+		std::string key;
+		/* article data, including the size */
+		std::string data;
+		ParseResult result;
+		size_t size;
+	};
+	/* most recently used first */
+	typedef std::list<Entry *> EntryList;
+	typedef std::map<std::string, EntryList::iterator> EntryMap;
+
+	static void build_key(std::string &key, const InstantDictIndex &dict_index,
+		guint generation, const gchar *data, const gchar *oword);
+	static bool copy_result(const ParseResult &src, ParseResult &dst, size_t &size);
+
+	size_t max_size;
+	size_t cur_size;
+	EntryList entries;
+	EntryMap entry_map;
+};
+
+#endif
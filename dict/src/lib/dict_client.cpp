@@ -27,12 +27,16 @@
 #endif
 
 #include <glib.h>
+#include <cstring>
+#include <cstdlib>
+#include <iterator>
 
 #include "sockets.h"
 
 #include "dict_client.h"
 
 sigc::signal<void, const std::string&> DictClient::on_error_;
+sigc::signal<void, size_t> DictClient::on_definition_;
 sigc::signal<void, const DictClient::IndexList&>
 DictClient::on_simple_lookup_end_;
 sigc::signal<void, const DictClient::StringList&>
@@ -75,6 +79,7 @@ enum DICTStatusCode {
 };
 
 
+/* The command is flushed by DictClient together with the other queued ones. */
 void DICT::Cmd::send(GIOChannel *channel, GError *&err)
 {
 	g_assert(channel);
@@ -86,24 +91,23 @@ void DICT::Cmd::send(GIOChannel *channel, GError *&err)
 	if (res != G_IO_STATUS_NORMAL)
 		return;
 
-	/* force flushing of the write buffer */
-	res = g_io_channel_flush(channel, &err);
-
-	if (res != G_IO_STATUS_NORMAL)
-		return;
-
 	state_ = DICT::Cmd::DATA;
 }
 
 class DefineCmd : public DICT::Cmd {
 public:
-	DefineCmd(const gchar *database, const gchar *word) {
+	DefineCmd(const gchar *database, const gchar *word) : finished_(0) {
 		char *quote_word = g_shell_quote(word);
 		query_ = std::string("DEFINE ") + database + ' ' + quote_word +
 			"\r\n";
 		g_free(quote_word);
 	}
 	bool parse(gchar *str, int code);
+	void end_text() { finished_ = reslist_.size(); }
+	size_t completed() const { return finished_; }
+private:
+	/* definitions with the whole text */
+	size_t finished_;
 };
 
 class MatchCmd : public DICT::Cmd {
@@ -173,19 +177,18 @@ bool MatchCmd::parse(gchar *str, int code)
 
           if (p)
             p = g_utf8_next_char (p);
-	  g_debug("server replied: %d matches found\n", atoi (p));
-        } else if (0 == strcmp (str, "."))
-		state_ = FINISH;
+	  g_debug("server replied: %d matches found\n", p ? atoi (p) : 0);
+        } else if (code != 0)
+		return true;
 	else {
           gchar *word, *db_name, *p;
 
           db_name = str;
-          if (!db_name)
-		  return false;
 
           p = g_utf8_strchr(db_name, -1, ' ');
-          if (p)
-            *p = '\0';
+          if (!p)
+		  return false;
+          *p = '\0';
 
           word = g_utf8_next_char (p);
 
@@ -212,7 +215,7 @@ bool DefineCmd::parse(gchar *str, int code)
 		if (p)
 			p = g_utf8_next_char (p);
 
-		g_debug("server replied: %d definitions found\n", atoi(p));
+		g_debug("server replied: %d definitions found\n", p ? atoi(p) : 0);
 		break;
 	}
 	case STATUS_WORD_DB_NAME: {
@@ -222,48 +225,42 @@ bool DefineCmd::parse(gchar *str, int code)
 
 		/* skip the status code */
 		word = g_utf8_strchr(word, -1, ' ');
+		if (!word)
+			return false;
 		word = g_utf8_next_char(word);
 
 		if (word[0] == '\"')
 			word = g_utf8_next_char(word);
 
 		p = g_utf8_strchr(word, -1, '\"');
-		if (p)
+		if (p) {
 			*p = '\0';
-
-		p = g_utf8_next_char(p);
+			p = g_utf8_next_char(p);
+		}
 
 		/* the database name is not protected by "" */
-		db_name = g_utf8_next_char(p);
-		if (!db_name)
-			break;
-
-		p = g_utf8_strchr(db_name, -1, ' ');
-		if (p)
-			*p = '\0';
-
-		p = g_utf8_next_char(p);
-
-		db_full = g_utf8_next_char(p);
-		if (!db_full)
-			break;
-
-		if (db_full[0] == '\"')
-			db_full = g_utf8_next_char(db_full);
-
-		p = g_utf8_strchr(db_full, -1, '\"');
-		if (p)
-			*p = '\0';
-
-		g_debug("{ word .= '%s', db_name .= '%s', db_full .= '%s' }\n",
-			word, db_name, db_full);
+		db_name = p ? g_utf8_next_char(p) : NULL;
+		if (db_name) {
+			p = g_utf8_strchr(db_name, -1, ' ');
+			if (p)
+				*p = '\0';
+			db_full = p ? g_utf8_next_char(p) : NULL;
+			if (db_full && db_full[0] == '\"')
+				db_full = g_utf8_next_char(db_full);
+			p = db_full ? g_utf8_strchr(db_full, -1, '\"') : NULL;
+			if (p)
+				*p = '\0';
+			g_debug("{ word .= '%s', db_name .= '%s', db_full .= '%s' }\n",
+				word, db_name, db_full ? db_full : "");
+		}
 		reslist_.push_back(DICT::Definition(word));
 		break;
 	}
-	default:
-		if (!reslist_.empty() && strcmp(".", str))
+	case 0:
+		if (!reslist_.empty())
 			reslist_.back().data_ += std::string(str) + "\n";
-
+		break;
+	default:
 		break;
 	}
 	return true;
@@ -277,29 +274,50 @@ DictClient::DictClient(const char *host, int port)
 	sd_ = -1;
 	channel_ = NULL;
 	source_id_ = 0;
+	out_source_id_ = 0;
+	idle_source_id_ = 0;
 	is_connected_ = false;
+	connecting_ = false;
+	retried_ = false;
+	sent_count_ = 0;
+	in_text_ = false;
+	lookup_id_ = 0;
 	last_index_ = 0;
 }
 
 DictClient::~DictClient()
 {
 	disconnect();
+	clean_commands();
 }
 
 void DictClient::connect()
 {
-    Socket::resolve(host_, this, on_resolved);
+	connecting_ = true;
+	Socket::resolve(host_, this, on_resolved);
 }
 
-void DictClient::on_resolved(gpointer data, struct hostent *ret)
+void DictClient::on_resolved(gpointer data, bool resolved, const SocketAddressList *addrs)
 {
 	DictClient *oDictClient = (DictClient *)data;
-	oDictClient->sd_ = Socket::socket();
+	if (!resolved) {
+		oDictClient->on_connection_lost("Can not resolve " + oDictClient->host_);
+		return;
+	}
+	Socket::connect(*addrs, oDictClient->port_, oDictClient, on_connected);
+}
 
-	if (oDictClient->sd_ == -1) {
-		on_error_.emit("Can not create socket: " + Socket::get_error_msg());
+void DictClient::on_connected(gpointer data, int socket)
+{
+	DictClient *oDictClient = (DictClient *)data;
+	if (socket == -1) {
+		gchar *mes = g_strdup_printf("Can not connect to %s: %s\n",
+					     oDictClient->host_.c_str(), Socket::get_error_msg().c_str());
+		oDictClient->on_connection_lost(mes);
+		g_free(mes);
 		return;
 	}
+	oDictClient->sd_ = socket;
 
 #ifdef _WIN32
 	oDictClient->channel_ = g_io_channel_win32_new_socket(oDictClient->sd_);
@@ -318,23 +336,14 @@ void DictClient::on_resolved(gpointer data, struct hostent *ret)
 	GError *err = NULL;
 	g_io_channel_set_flags(oDictClient->channel_, GIOFlags(flags), &err);
 	if (err) {
-		g_io_channel_unref(oDictClient->channel_);
-		oDictClient->channel_ = NULL;
-		on_error_.emit("Unable to set the channel as non-blocking: " +
-			       std::string(err->message));
+		std::string mes = "Unable to set the channel as non-blocking: " +
+			std::string(err->message);
 		g_error_free(err);
+		oDictClient->on_connection_lost(mes);
 		return;
 	}
 
-	if (!Socket::connect(oDictClient->sd_, ret, oDictClient->port_)) {
-		gchar *mes = g_strdup_printf("Can not connect to %s: %s\n",
-					     oDictClient->host_.c_str(), Socket::get_error_msg().c_str());
-		on_error_.emit(mes);
-		g_free(mes);
-		return;
-	}
-
-	oDictClient->source_id_ = g_io_add_watch(oDictClient->channel_, GIOCondition(G_IO_IN | G_IO_ERR),
+	oDictClient->source_id_ = g_io_add_watch(oDictClient->channel_, GIOCondition(G_IO_IN | G_IO_ERR | G_IO_HUP),
 				   on_io_event, oDictClient);
 }
 
@@ -344,17 +353,83 @@ void DictClient::disconnect()
 		g_source_remove(source_id_);
 		source_id_ = 0;
 	}
+	if (out_source_id_) {
+		g_source_remove(out_source_id_);
+		out_source_id_ = 0;
+	}
+	if (idle_source_id_) {
+		g_source_remove(idle_source_id_);
+		idle_source_id_ = 0;
+	}
 
 	if (channel_) {
 		g_io_channel_shutdown(channel_, TRUE, NULL);
 		g_io_channel_unref(channel_);
 		channel_ = NULL;
 	}
+	Socket::cancel_resolve(this);
+	Socket::cancel_connect(this);
 	if (sd_ != -1) {
 		Socket::close(sd_);
 		sd_ = -1;
 	}
 	is_connected_ = false;
+	connecting_ = false;
+	in_text_ = false;
+}
+
+void DictClient::clean_commands()
+{
+	for (std::list<DICT::Cmd *>::iterator it = cmdlist_.begin(); it != cmdlist_.end(); ++it)
+		delete *it;
+	cmdlist_.clear();
+	sent_count_ = 0;
+}
+
+/* The server closed the connection or it could not be made. The server may
+ * close an idle connection just as commands are written, the commands are
+ * sent once more on a new connection. */
+void DictClient::on_connection_lost(const std::string& mes)
+{
+	disconnect();
+	if (cmdlist_.empty())
+		return;
+	if (!retried_) {
+		retried_ = true;
+		for (std::list<DICT::Cmd *>::iterator it = cmdlist_.begin(); it != cmdlist_.end(); ++it)
+			(*it)->reset();
+		sent_count_ = 0;
+		connect();
+		return;
+	}
+	clean_commands();
+	if (!mes.empty())
+		on_error_.emit(mes);
+}
+
+gboolean DictClient::on_idle_timeout(gpointer data)
+{
+	DictClient *dict_client = static_cast<DictClient *>(data);
+	dict_client->idle_source_id_ = 0;
+	dict_client->disconnect();
+	return FALSE;
+}
+
+gboolean DictClient::on_io_out_event(GIOChannel *ch, GIOCondition cond,
+				     gpointer user_data)
+{
+	DictClient *dict_client = static_cast<DictClient *>(user_data);
+	GError *err = NULL;
+	GIOStatus res = g_io_channel_flush(dict_client->channel_, &err);
+	if (res == G_IO_STATUS_AGAIN)
+		return TRUE;
+	dict_client->out_source_id_ = 0;
+	if (err) {
+		std::string mes = err->message;
+		g_error_free(err);
+		dict_client->on_connection_lost(mes);
+	}
+	return FALSE;
 }
 
 gboolean DictClient::on_io_event(GIOChannel *ch, GIOCondition cond,
@@ -369,33 +444,29 @@ gboolean DictClient::on_io_event(GIOChannel *ch, GIOCondition cond,
 		return FALSE;
 	}
 
-	if (cond & G_IO_ERR) {
-		gchar *mes =
-			g_strdup_printf("Connection failed to the dictionary server at %s:%d",
-					dict_client->host_.c_str(), dict_client->port_);
-		on_error_.emit(mes);
-		g_free(mes);
-		return FALSE;
-	}
-
 	GError *err = NULL;
 	gsize term, len;
 	gchar *line;
 	GIOStatus res;
 
 	for (;;) {
-		if (!dict_client->channel_)
-			break;
 		res = g_io_channel_read_line(dict_client->channel_, &line,
 					     &len, &term, &err);
-		if (res == G_IO_STATUS_ERROR) {
+		if (res == G_IO_STATUS_ERROR || res == G_IO_STATUS_EOF) {
+			std::string mes;
 			if (err) {
-				on_error_.emit("Error while reading reply from server: " +
-					       std::string(err->message));
+				mes = "Error while reading reply from server: " +
+					std::string(err->message);
 				g_error_free(err);
+			} else {
+				gchar *str =
+					g_strdup_printf("Connection failed to the dictionary server at %s:%d",
+							dict_client->host_.c_str(), dict_client->port_);
+				mes = str;
+				g_free(str);
 			}
-			dict_client->disconnect();
-
+			dict_client->source_id_ = 0;
+			dict_client->on_connection_lost(mes);
 			return FALSE;
 		}
 
@@ -404,26 +475,136 @@ gboolean DictClient::on_io_event(GIOChannel *ch, GIOCondition cond,
 
 		//truncate the line terminator before parsing
 		line[term] = '\0';
-		int status_code = get_status_code(line);
+		int status_code = dict_client->in_text_ ? 0 : get_status_code(line);
 		bool res = dict_client->parse(line, status_code);
 		g_free(line);
 		if (!res) {
-			dict_client->disconnect();
+			dict_client->source_id_ = 0;
+			dict_client->on_connection_lost("");
 			return FALSE;
 		}
+		/* a handler of a signal may have started a new connection */
+		if (dict_client->channel_ != ch)
+			return FALSE;
 	}
 
 	return TRUE;
 }
 
+/* Write the commands not sent yet, all at once. */
+bool DictClient::write_commands()
+{
+	if (!is_connected_ || sent_count_ == cmdlist_.size())
+		return true;
+	if (idle_source_id_) {
+		g_source_remove(idle_source_id_);
+		idle_source_id_ = 0;
+	}
+	GError *err = NULL;
+	std::list<DICT::Cmd *>::iterator it = cmdlist_.begin();
+	std::advance(it, sent_count_);
+	for (; it != cmdlist_.end(); ++it) {
+		(*it)->send(channel_, err);
+		if (err) {
+			on_error_.emit(err->message);
+			g_error_free(err);
+			return false;
+		}
+		sent_count_++;
+	}
+	GIOStatus res = g_io_channel_flush(channel_, &err);
+	if (err) {
+		on_error_.emit(err->message);
+		g_error_free(err);
+		return false;
+	}
+	if (res == G_IO_STATUS_AGAIN && !out_source_id_)
+		out_source_id_ = g_io_add_watch(channel_, G_IO_OUT, on_io_out_event, this);
+	return true;
+}
+
+void DictClient::queue_command(DICT::Cmd *cmd)
+{
+	cmd->lookup_id_ = lookup_id_;
+	cmdlist_.push_back(cmd);
+	if (is_connected_) {
+		if (!write_commands())
+			on_connection_lost("");
+	} else if (!connecting_) {
+		connect();
+	}
+}
+
+/* A new lookup replaces the results of the previous one. The commands of the
+ * previous lookup that are not sent yet are dropped, the replies of the sent
+ * ones are ignored. */
+void DictClient::start_lookup()
+{
+	lookup_id_++;
+	std::list<DICT::Cmd *>::iterator it = cmdlist_.begin();
+	std::advance(it, sent_count_);
+	while (it != cmdlist_.end()) {
+		delete *it;
+		it = cmdlist_.erase(it);
+	}
+	defmap_.clear();
+	ilist_.clear();
+	last_index_ = 0;
+}
+
+/* Pass the definitions received entirely to on_definition_. */
+void DictClient::stream_definitions(DICT::Cmd *cmd)
+{
+	if (!cmd->simple_ || cmd->lookup_id_ != lookup_id_)
+		return;
+	const DICT::DefList& res = cmd->result();
+	while (cmd->streamed_ < cmd->completed()) {
+		const size_t index = last_index_++;
+		defmap_.insert(std::make_pair(index, res[cmd->streamed_++]));
+		ilist_.push_back(index);
+		on_definition_.emit(index);
+	}
+}
+
+/* The reply of the first command is read. */
+void DictClient::finish_command()
+{
+	DICT::Cmd *cmd = cmdlist_.front();
+	cmdlist_.pop_front();
+	sent_count_--;
+	retried_ = false;
+	if (cmdlist_.empty())
+		idle_source_id_ = g_timeout_add_seconds(IDLE_TIMEOUT, on_idle_timeout, this);
+	if (cmd->lookup_id_ == lookup_id_ && cmd->last_) {
+		if (cmd->simple_) {
+			stream_definitions(cmd);
+			IndexList ilist(ilist_);
+			delete cmd;
+			on_simple_lookup_end_.emit(ilist);
+			return;
+		}
+		StringList slist;
+		const DICT::DefList& res = cmd->result();
+		for (size_t i = 0; i < res.size(); ++i)
+			slist.push_back(res[i].word_);
+		delete cmd;
+		on_complex_lookup_end_.emit(slist);
+		return;
+	}
+	stream_definitions(cmd);
+	delete cmd;
+}
+
 bool DictClient::parse(gchar *line, int status_code)
 {
 	g_debug("get %s\n", line);
 
-	if (!cmd_.get()) {
-		if (status_code == STATUS_CONNECT)
+	if (!is_connected_) {
+		if (status_code == STATUS_CONNECT) {
 			is_connected_ = true;
-		else if (status_code == STATUS_SERVER_DOWN ||
+			connecting_ = false;
+			return write_commands();
+		} else if (status_code == STATUS_SERVER_DOWN ||
 			 status_code == STATUS_SHUTDOWN) {
 			gchar *mes =
 				g_strdup_printf("Unable to connect to the "
@@ -434,89 +615,77 @@ bool DictClient::parse(gchar *line, int status_code)
 						status_code);
 			on_error_.emit(mes);
 			g_free(mes);
-			return true;
+			clean_commands();
+			return false;
 		} else {
 			gchar *mes =
 				g_strdup_printf("Unable to parse the dictionary"
 						" server reply: '%s'", line);
 			on_error_.emit(mes);
 			g_free(mes);
+			clean_commands();
 			return false;
 		}
 	}
 
-	bool success = false;
+	/* the server closes an idle connection */
+	if (status_code == STATUS_SHUTDOWN || sent_count_ == 0)
+		return false;
+
+	DICT::Cmd *cmd = cmdlist_.front();
+
+	if (in_text_) {
+		if (strcmp(line, ".") == 0) {
+			in_text_ = false;
+			cmd->end_text();
+			stream_definitions(cmd);
+			return true;
+		}
+		/* a leading dot is doubled, ".." is a line of one dot */
+		if (line[0] == '.')
+			line++;
+		return cmd->parse(line, 0);
+	}
 
 	switch (status_code) {
+	case STATUS_WORD_DB_NAME:
+	case STATUS_N_MATCHES_FOUND:
+		in_text_ = true;
+		return cmd->parse(line, status_code);
+	case STATUS_N_DEFINITIONS_RETRIEVED:
+		return cmd->parse(line, status_code);
 	case STATUS_BAD_PARAMETERS:
 	{
 		gchar *mes = g_strdup_printf("Bad parameters for command '%s'",
-					     cmd_->query().c_str());
+					     cmd->query().c_str());
 		on_error_.emit(mes);
 		g_free(mes);
-		cmd_->state_ = DICT::Cmd::FINISH;
 		break;
 	}
 	case STATUS_BAD_COMMAND:
 	{
 		gchar *mes = g_strdup_printf("Bad command '%s'",
-					     cmd_->query().c_str());
+					     cmd->query().c_str());
 		on_error_.emit(mes);
 		g_free(mes);
-		cmd_->state_ = DICT::Cmd::FINISH;
 		break;
 	}
+	case STATUS_INVALID:
+	{
+		gchar *mes =
+			g_strdup_printf("Unable to parse the dictionary"
+					" server reply: '%s'", line);
+		on_error_.emit(mes);
+		g_free(mes);
+		return false;
+	}
 	default:
-		success = true;
+		/* STATUS_OK, STATUS_NO_MATCH, STATUS_BAD_DATABASE and the
+		 * other codes end the reply */
 		break;
 	}
-
-	if (cmd_->state_ == DICT::Cmd::START) {
-		GError *err = NULL;
-		cmd_->send(channel_, err);
-		if (err) {
-			on_error_.emit(err->message);
-			g_error_free(err);
-			return false;
-		}
-		return true;
-	}
-
-	if (status_code == STATUS_OK || cmd_->state_ == DICT::Cmd::FINISH ||
-	    status_code == STATUS_NO_MATCH ||
-	    status_code == STATUS_BAD_DATABASE ||
-	    status_code == STATUS_BAD_STRATEGY ||
-	    status_code == STATUS_NO_DATABASES_PRESENT ||
-	    status_code == STATUS_NO_STRATEGIES_PRESENT) {
-		defmap_.clear();
-		const DICT::DefList& res = cmd_->result();
-		if (simple_lookup_) {
-			IndexList ilist(res.size());
-			for (size_t i = 0; i < res.size(); ++i) {
-				ilist[i] = last_index_;
-				defmap_.insert(std::make_pair(last_index_++, res[i]));
-			}
-			last_index_ = 0;
-			cmd_.reset(0);
-			disconnect();
-			on_simple_lookup_end_.emit(ilist);
-		} else {
-			StringList slist;
-			for (size_t i = 0; i < res.size(); ++i)
-				slist.push_back(res[i].word_);
-			last_index_ = 0;
-			cmd_.reset(0);
-			disconnect();
-			on_complex_lookup_end_.emit(slist);
-		}
-
-		return success;
-	}
-
-	if (!cmd_->parse(line, status_code))
-		return false;
-
-
+	cmd->state_ = DICT::Cmd::FINISH;
+	finish_command();
 	return true;
 }
 
@@ -545,50 +714,63 @@ int DictClient::get_status_code(gchar *line)
 
 void DictClient::lookup_simple(const gchar *word)
 {
-	simple_lookup_ = true;
+	start_lookup();
 
 	if (!word || !*word) {
 		on_simple_lookup_end_.emit(IndexList());
 		return;
 	}
 
-	if (!channel_ || !source_id_)
-			return;
-    connect();
+	DICT::Cmd *cmd = new DefineCmd("*", word);
+	cmd->simple_ = true;
+	queue_command(cmd);
+}
+
+void DictClient::define_words(const StringList& words)
+{
+	start_lookup();
 
-	cmd_.reset(new DefineCmd("*", word));
+	if (words.empty()) {
+		on_simple_lookup_end_.emit(IndexList());
+		return;
+	}
+
+	/* the commands are queued first and written together with the last one */
+	StringList::const_iterator it = words.begin();
+	for (size_t i = 1; i < words.size(); ++i, ++it) {
+		DICT::Cmd *cmd = new DefineCmd("*", it->c_str());
+		cmd->simple_ = true;
+		cmd->last_ = false;
+		cmd->lookup_id_ = lookup_id_;
+		cmdlist_.push_back(cmd);
+	}
+	DICT::Cmd *cmd = new DefineCmd("*", it->c_str());
+	cmd->simple_ = true;
+	queue_command(cmd);
 }
 
 void DictClient::lookup_with_rule(const gchar *word)
 {
-	simple_lookup_ = false;
+	start_lookup();
 
 	if (!word || !*word) {
 		on_complex_lookup_end_.emit(StringList());
 		return;
 	}
 
-	if (!channel_ || !source_id_)
-			return;
-    connect();
-
-	cmd_.reset(new RegexpCmd("*", word));
+	queue_command(new RegexpCmd("*", word));
 }
 
 void DictClient::lookup_with_fuzzy(const gchar *word)
 {
-	simple_lookup_ = false;
+	start_lookup();
 
 	if (!word || !*word) {
 		on_complex_lookup_end_.emit(StringList());
 		return;
 	}
 
-	if (!channel_ || !source_id_)
-			return;
-    connect();
-
-	cmd_.reset(new LevCmd("*", word));
+	queue_command(new LevCmd("*", word));
 }
 
 const gchar *DictClient::get_word(size_t index) const
@@ -608,4 +790,3 @@ const gchar *DictClient::get_word_data(size_t index) const
 		return NULL;
 	return it->second.data_.c_str();
 }
-
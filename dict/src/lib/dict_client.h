@@ -22,12 +22,15 @@
 
 #include <glib.h>
 #include <string>
-#include <memory>
+#include <list>
 #include <map>
 #include <vector>
 
 #include "stardict-sigc++.h"
 
+struct SocketAddress;
+typedef std::vector<SocketAddress> SocketAddressList;
+
 namespace DICT {
 	struct Definition {
 		std::string word_;
@@ -42,11 +45,26 @@ namespace DICT {
 		enum State {
 			START, DATA, FINISH
 		} state_;
+		/* the lookup the command belongs to */
+		guint lookup_id_;
+		/* the results are definitions of a simple lookup */
+		bool simple_;
+		/* the last command of the lookup */
+		bool last_;
+		/* definitions passed to DictClient::on_definition_ */
+		size_t streamed_;
 
-		Cmd() : state_(START) {}
+		Cmd() : state_(START), lookup_id_(0), simple_(false), last_(true), streamed_(0) {}
 		virtual ~Cmd() {}
 		virtual const std::string& query() { return query_; }
+		/* code is 0 for the lines of a text reply, the leading dots are
+		 * unescaped, end_text() follows the last line */
 		virtual bool parse(gchar *str, int code) = 0;
+		virtual void end_text() {}
+		/* the number of results received entirely */
+		virtual size_t completed() const { return reslist_.size(); }
+		/* the command is sent again, streamed_ is kept */
+		void reset() { state_ = START; reslist_.clear(); }
 
 		void send(GIOChannel *channel, GError *&err);
 		const DefList& result() const { return reslist_; }
@@ -56,12 +74,21 @@ namespace DICT {
 	};
 };
 
+/* A client of a DICT server (RFC 2229). The connection is kept open between
+ * lookups, the commands are written as soon as they are queued, without
+ * waiting for the replies of the previous ones. */
 class DictClient {
 public:
 	typedef std::vector<size_t> IndexList;
 	typedef std::list<std::string> StringList;
 
+	/* seconds an unused connection is kept open */
+	static const guint IDLE_TIMEOUT = 60;
+
 	static sigc::signal<void, const std::string&> on_error_;
+	/* A definition of a simple lookup is received, the index is valid for
+	 * get_word() and get_word_data() till the next lookup. */
+	static sigc::signal<void, size_t> on_definition_;
 	static sigc::signal<void, const IndexList&> on_simple_lookup_end_;
 	static sigc::signal<void, const StringList&> on_complex_lookup_end_;
 
@@ -70,26 +97,51 @@ public:
 	void lookup_simple(const gchar *word);
 	void lookup_with_rule(const gchar *word);
 	void lookup_with_fuzzy(const gchar *word);
+	/* A simple lookup of several words, the words found by
+	 * lookup_with_rule() for example. The DEFINE commands are sent at once. */
+	void define_words(const StringList& words);
 	const gchar *get_word(size_t index) const;
 	const gchar *get_word_data(size_t index) const;
 private:
 	int sd_;
 	GIOChannel *channel_;
 	guint source_id_;
+	guint out_source_id_;
+	guint idle_source_id_;
 	std::string host_;
 	int port_;
+	/* the banner is received */
 	bool is_connected_;
-	std::auto_ptr<DICT::Cmd> cmd_;
+	/* resolving, connecting or waiting for the banner */
+	bool connecting_;
+	/* the queued commands are sent again after the connection is lost */
+	bool retried_;
+	/* the first sent_count_ commands are sent and wait for the reply */
+	std::list<DICT::Cmd *> cmdlist_;
+	size_t sent_count_;
+	/* reading a text reply */
+	bool in_text_;
+	guint lookup_id_;
 	typedef std::map<size_t, DICT::Definition> DefMap;
 	DefMap defmap_;
+	IndexList ilist_;
 	size_t last_index_;
-	bool simple_lookup_;
 
 	void disconnect();
+	void clean_commands();
 	static gboolean on_io_event(GIOChannel *, GIOCondition, gpointer);
+	static gboolean on_io_out_event(GIOChannel *, GIOCondition, gpointer);
+	static gboolean on_idle_timeout(gpointer);
 	static int get_status_code(gchar *line);
 	void connect();
-	static void on_resolved(gpointer data, struct hostent *ret);
+	static void on_resolved(gpointer data, bool resolved, const SocketAddressList *addrs);
+	static void on_connected(gpointer data, int socket);
+	void start_lookup();
+	void queue_command(DICT::Cmd *cmd);
+	bool write_commands();
+	void stream_definitions(DICT::Cmd *cmd);
+	void finish_command();
+	void on_connection_lost(const std::string& mes);
 	bool parse(gchar *line, int status_code);
 };
 
@@ -0,0 +1,239 @@
+/*
+ * This file is part of StarDict.
+ *
+ * StarDict is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * StarDict is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with StarDict.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include "dictreloader.h"
+
+/* the worker thread must not touch the user interface */
+static show_progress_t silent_show_progress;
+
+/* Seconds between a change in a watched directory and the check.
+ * Dictionary files are rarely written at once, wait for the rest of them. */
+static const guint CHANGE_DELAY = 2;
+
+DictReloader::DictReloader(Libs *_libs)
+:
+	libs(_libs),
+	interval(0),
+	timeout_id(0),
+	change_timeout_id(0),
+	thread(NULL),
+	task(NULL)
+{
+}
+
+DictReloader::~DictReloader()
+{
+	set_interval(0);
+	wait();
+	if (task) {
+		g_source_remove(task->idle_id);
+		free_task(task);
+	}
+}
+
+void DictReloader::set_interval(guint _interval)
+{
+	interval = _interval;
+	if (timeout_id) {
+		g_source_remove(timeout_id);
+		timeout_id = 0;
+	}
+	if (!interval) {
+		remove_monitors();
+		return;
+	}
+	timeout_id = g_timeout_add_seconds(interval, on_timeout, this);
+	update_monitors();
+	/* Remember the timestamps now, a change reported by a monitor
+	 * must be seen as a change by the first check. */
+	if (!task && timestamps.empty())
+		start_task();
+}
+
+void DictReloader::wait(void)
+{
+	if (thread) {
+		g_thread_join(thread);
+		thread = NULL;
+	}
+}
+
+gboolean DictReloader::on_timeout(gpointer data)
+{
+	DictReloader *reloader = static_cast<DictReloader *>(data);
+	if (!reloader->task)
+		reloader->start_task();
+	return TRUE;
+}
+
+gboolean DictReloader::on_change_timeout(gpointer data)
+{
+	DictReloader *reloader = static_cast<DictReloader *>(data);
+	/* the running check may have missed the change, try again later */
+	if (reloader->task)
+		return TRUE;
+	reloader->change_timeout_id = 0;
+	reloader->start_task();
+	return FALSE;
+}
+
+void DictReloader::on_dir_changed(GFileMonitor *monitor, GFile *file,
+	GFile *other_file, GFileMonitorEvent event_type, gpointer user_data)
+{
+	if (event_type == G_FILE_MONITOR_EVENT_ATTRIBUTE_CHANGED)
+		return;
+	DictReloader *reloader = static_cast<DictReloader *>(user_data);
+	if (reloader->change_timeout_id)
+		g_source_remove(reloader->change_timeout_id);
+	reloader->change_timeout_id = g_timeout_add_seconds(CHANGE_DELAY,
+		on_change_timeout, reloader);
+}
+
+void DictReloader::update_monitors(void)
+{
+	MonitorMap old_monitors;
+	old_monitors.swap(monitors);
+	for (size_t i = 0; i < libs->ndicts(); ++i) {
+		glib::CharStr dir(g_path_get_dirname(libs->dict_ifofilename(i).c_str()));
+		const std::string dirname(get_impl(dir));
+		if (monitors.find(dirname) != monitors.end())
+			continue;
+		MonitorMap::iterator it = old_monitors.find(dirname);
+		if (it != old_monitors.end()) {
+			monitors[dirname] = it->second;
+			old_monitors.erase(it);
+			continue;
+		}
+		GFile *file = g_file_new_for_path(dirname.c_str());
+		GFileMonitor *monitor = g_file_monitor_directory(file, G_FILE_MONITOR_NONE, NULL, NULL);
+		g_object_unref(file);
+		/* not supported for this file system, the periodic check remains */
+		if (!monitor)
+			continue;
+		g_signal_connect(monitor, "changed", G_CALLBACK(on_dir_changed), this);
+		monitors[dirname] = monitor;
+	}
+	for (MonitorMap::iterator it = old_monitors.begin(); it != old_monitors.end(); ++it) {
+		g_file_monitor_cancel(it->second);
+		g_object_unref(it->second);
+	}
+}
+
+void DictReloader::remove_monitors(void)
+{
+	if (change_timeout_id) {
+		g_source_remove(change_timeout_id);
+		change_timeout_id = 0;
+	}
+	for (MonitorMap::iterator it = monitors.begin(); it != monitors.end(); ++it) {
+		g_file_monitor_cancel(it->second);
+		g_object_unref(it->second);
+	}
+	monitors.clear();
+}
+
+void DictReloader::start_task(void)
+{
+	task = new Task;
+	task->reloader = this;
+	task->libs = libs;
+	task->level = libs->get_CollationLevel();
+	task->func = libs->get_CollateFunction();
+	for (size_t i = 0; i < libs->ndicts(); ++i)
+		task->ifo_list.push_back(libs->dict_ifofilename(i));
+	task->timestamps.swap(timestamps);
+	task->idle_id = 0;
+	thread = g_thread_new("dict_reload", worker_thread, task);
+}
+
+gpointer DictReloader::worker_thread(gpointer data)
+{
+	Task *task = static_cast<Task *>(data);
+	TimestampMap timestamps;
+	for (std::list<std::string>::const_iterator it = task->ifo_list.begin();
+		it != task->ifo_list.end(); ++it) {
+		TimestampMap::iterator prev = task->timestamps.find(*it);
+		dict_timestamp ts;
+		if (!ts.load(*it)) {
+			// the dictionary may be in the middle of update, check it next time
+			if (prev != task->timestamps.end())
+				timestamps[*it] = prev->second;
+			continue;
+		}
+		/* The first time a dictionary is seen only its timestamp is remembered,
+		 * it has just been loaded. */
+		if (prev != task->timestamps.end() && ts.is_dict_changed(prev->second)) {
+			Dict *dict = task->libs->create_dict(*it, &silent_show_progress);
+			if (!dict) {
+				g_warning("Unable to reload dictionary %s", it->c_str());
+				timestamps[*it] = prev->second;
+				continue;
+			}
+			task->new_dicts.push_back(dict);
+		}
+		timestamps[*it] = ts;
+	}
+	task->timestamps.swap(timestamps);
+	/* back to main thread */
+	task->idle_id = g_idle_add(on_worker_done, task);
+	return NULL;
+}
+
+gboolean DictReloader::on_worker_done(gpointer data)
+{
+	Task *task = static_cast<Task *>(data);
+	task->reloader->finish_task(task);
+	return FALSE;
+}
+
+void DictReloader::finish_task(Task *t)
+{
+	wait();
+	task = NULL;
+	timestamps.swap(t->timestamps);
+	bool replaced = false;
+	/* Dictionaries loaded with other collation parameters or removed from
+	 * the list while the worker was running are dropped. */
+	const bool same_collation = libs->get_CollationLevel() == t->level
+		&& libs->get_CollateFunction() == t->func;
+	for (std::list<Dict *>::iterator it = t->new_dicts.begin(); it != t->new_dicts.end(); ++it) {
+		if (same_collation && libs->replace_dict(*it)) {
+			g_message("Dictionary %s has been reloaded", (*it)->ifofilename().c_str());
+			replaced = true;
+		} else {
+			delete *it;
+		}
+	}
+	t->new_dicts.clear();
+	free_task(t);
+	/* the list of dictionaries may have changed meanwhile */
+	if (interval)
+		update_monitors();
+	if (replaced)
+		on_reloaded_.emit();
+}
+
+void DictReloader::free_task(Task *task)
+{
+	for (std::list<Dict *>::iterator it = task->new_dicts.begin(); it != task->new_dicts.end(); ++it)
+		delete *it;
+	delete task;
+}
@@ -0,0 +1,91 @@
+/*
+ * This file is part of StarDict.
+ *
+ * StarDict is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * StarDict is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with StarDict.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _STARDICT_DICT_RELOADER_H_
+#define _STARDICT_DICT_RELOADER_H_
+
+#include <glib.h>
+#include <gio/gio.h>
+#include <list>
+#include <map>
+#include <string>
+
+#include "stardict-sigc++.h"
+#include "verify_dict.h"
+#include "stddict.h"
+
+/* Background reload of changed dictionaries.
+ * Files of the loaded dictionaries are checked in a worker thread
+ * periodically and shortly after a change in a directory with dictionaries.
+ * When any file of a dictionary changes, a new Dict object is built
+ * in the same thread, including its cache files. New objects are passed to
+ * the main thread and replace the old ones in Libs. Old objects are deleted
+ * when no lookup holds them, see Libs::LookupLock.
+ * All methods must be called in the main thread. */
+class DictReloader {
+public:
+	explicit DictReloader(Libs *libs);
+	~DictReloader();
+	/* Check dictionaries every interval seconds and watch their directories,
+	 * 0 disables checks. May be called at any time. */
+	void set_interval(guint interval);
+	/* Wait for the worker thread. Must be called before Libs::reload,
+	 * the worker uses collation functions of Libs. */
+	void wait(void);
+	/* emitted after one or more dictionaries have been replaced */
+	sigc::signal<void> on_reloaded_;
+private:
+	typedef std::map<std::string, dict_timestamp> TimestampMap;
+	struct Task {
+		DictReloader *reloader;
+		Libs *libs;
+		CollationLevelType level;
+		CollateFunctions func;
+		std::list<std::string> ifo_list;
+		TimestampMap timestamps;
+		std::list<Dict *> new_dicts;
+		guint idle_id;
+	};
+
+	typedef std::map<std::string, GFileMonitor *> MonitorMap;
+
+	static gboolean on_timeout(gpointer data);
+	static gboolean on_change_timeout(gpointer data);
+	static void on_dir_changed(GFileMonitor *monitor, GFile *file,
+		GFile *other_file, GFileMonitorEvent event_type, gpointer user_data);
+	static gpointer worker_thread(gpointer data);
+	static gboolean on_worker_done(gpointer data);
+	void start_task(void);
+	void finish_task(Task *task);
+	static void free_task(Task *task);
+	/* Watch the directories of the loaded dictionaries. */
+	void update_monitors(void);
+	void remove_monitors(void);
+
+	Libs *libs;
+	guint interval;
+	guint timeout_id;
+	/* check scheduled after a change in a watched directory */
+	guint change_timeout_id;
+	MonitorMap monitors;
+	GThread *thread;
+	Task *task;
+	/* timestamps of the loaded dictionaries as of the last check */
+	TimestampMap timestamps;
+};
+
+#endif
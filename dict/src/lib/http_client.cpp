@@ -25,12 +25,24 @@
 #include <string.h>
 #endif
 #include <cstring>
+#include <cstdio>
 
 #include "http_client.h"
 #include "sockets.h"
 
+std::map<std::string, HttpClient::HostState> HttpClient::hosts;
+
+static std::string pool_key(const std::string &host, int port)
+{
+	gchar *key = g_strdup_printf("%s:%d", host.c_str(), port);
+	std::string res(key);
+	g_free(key);
+	return res;
+}
+
 HttpClient::HttpClient()
 {
+	port_ = 80;
 	sd_ = -1;
 	channel_ = NULL;
 	in_source_id_ = 0;
@@ -40,11 +52,28 @@ HttpClient::HttpClient()
 	callback_func_ = NULL;
 	httpMethod_ = HTTP_METHOD_GET;
 	allow_absolute_URI_ = true;
+	has_slot_ = false;
+	reused_ = false;
+	retried_ = false;
+	read_state_ = READ_HEADER;
+	body_left_ = 0;
+	keep_alive_ = false;
+	inflater_ = NULL;
 }
 
 HttpClient::~HttpClient()
 {
+	if (!host_.empty()) {
+		std::map<std::string, HostState>::iterator host = hosts.find(pool_key(host_, port_));
+		if (host != hosts.end())
+			host->second.waiting.remove(this);
+	}
 	disconnect();
+	release_slot();
+	if (inflater_) {
+		inflateEnd(inflater_);
+		delete inflater_;
+	}
 	g_free(buffer);
 }
 
@@ -63,6 +92,8 @@ void HttpClient::disconnect()
 		g_io_channel_unref(channel_);
 		channel_ = NULL;
 	}
+	Socket::cancel_resolve(this);
+	Socket::cancel_connect(this);
 	if (sd_ != -1) {
 		Socket::close(sd_);
 		sd_ = -1;
@@ -86,39 +117,78 @@ void HttpClient::SendHttpRequest(const char* shost, const char* sfile, gpointer
 	host_ = shost;
 	file_ = sfile;
 	userdata = data;
+	HostState &host = hosts[pool_key(host_, port_)];
+	if (host.active >= MAX_CONNECTIONS_PER_HOST) {
+		host.waiting.push_back(this);
+		return;
+	}
+	start();
+}
+
+/* Take a place among the active requests to the host and send the request
+ * on an idle connection or on a new one. */
+void HttpClient::start()
+{
+	HostState &host = hosts[pool_key(host_, port_)];
+	host.active++;
+	has_slot_ = true;
+	IdleConnection *conn = take_idle(pool_key(host_, port_));
+	if (!conn) {
+		connect();
+		return;
+	}
+	sd_ = conn->sd;
+	channel_ = conn->channel;
+	delete conn;
+	reused_ = true;
+	begin_request();
+}
+
+void HttpClient::connect()
+{
+	reused_ = false;
 	Socket::resolve(host_, this, on_resolved);
 }
 
-void HttpClient::on_resolved(gpointer data, bool resolved, in_addr_t sa)
+/* A request of the host is done, the next waiting request may start. */
+void HttpClient::release_slot()
+{
+	if (!has_slot_)
+		return;
+	has_slot_ = false;
+	HostState &host = hosts[pool_key(host_, port_)];
+	host.active--;
+	if (!host.waiting.empty()) {
+		HttpClient *next = host.waiting.front();
+		host.waiting.pop_front();
+		next->start();
+	}
+}
+
+void HttpClient::on_resolved(gpointer data, bool resolved, const SocketAddressList *addrs)
 {
 	HttpClient *oHttpClient = (HttpClient *)data;
 	if (!resolved) {
 		gchar *mes = g_strdup_printf("Can not resolve %s: %s\n",
 			oHttpClient->host_.c_str(), Socket::get_error_msg().c_str());
-		oHttpClient->on_error_.emit(oHttpClient, mes);
+		oHttpClient->fail(mes);
 		g_free(mes);
 		return;
 	}
-
-	oHttpClient->sd_ = Socket::socket();
-	if (oHttpClient->sd_ == -1) {
-		std::string str = "Can not create socket: " + Socket::get_error_msg();
-		oHttpClient->on_error_.emit(oHttpClient, str.c_str());
-		return;
-	}
-	Socket::connect(oHttpClient->sd_, sa, 80, oHttpClient, on_connected);
+	Socket::connect(*addrs, oHttpClient->port_, oHttpClient, on_connected);
 }
 
-void HttpClient::on_connected(gpointer data, bool succeeded)
+void HttpClient::on_connected(gpointer data, int socket)
 {
 	HttpClient *oHttpClient = (HttpClient *)data;
-	if (!succeeded) {
+	if (socket == -1) {
 		gchar *mes = g_strdup_printf("Can not connect to %s: %s\n",
 			oHttpClient->host_.c_str(), Socket::get_error_msg().c_str());
-		oHttpClient->on_error_.emit(oHttpClient, mes);
+		oHttpClient->fail(mes);
 		g_free(mes);
 		return;
 	}
+	oHttpClient->sd_ = socket;
 #ifdef _WIN32
 	oHttpClient->channel_ = g_io_channel_win32_new_socket(oHttpClient->sd_);
 #else
@@ -132,15 +202,78 @@ void HttpClient::on_connected(gpointer data, bool succeeded)
 	g_io_channel_set_flags(oHttpClient->channel_, GIOFlags(flags), &err);
 	if (err) {
 		gchar *str = g_strdup_printf("Unable to set the channel as non-blocking: %s", err->message);
-		oHttpClient->on_error_.emit(oHttpClient, str);
-		g_free(str);
 		g_error_free(err);
+		oHttpClient->fail(str);
+		g_free(str);
 		return;
 	}
-	if (oHttpClient->SendRequest())
+	oHttpClient->begin_request();
+}
+
+void HttpClient::begin_request()
+{
+	read_state_ = READ_HEADER;
+	in_buf_.clear();
+	header_.clear();
+	content_.clear();
+	body_left_ = 0;
+	keep_alive_ = false;
+	if (inflater_) {
+		inflateEnd(inflater_);
+		delete inflater_;
+		inflater_ = NULL;
+	}
+	if (!SendRequest())
 		return;
-	oHttpClient->out_source_id_ = g_io_add_watch(oHttpClient->channel_, GIOCondition(G_IO_OUT), on_io_out_event, oHttpClient);
-	oHttpClient->in_source_id_ = g_io_add_watch(oHttpClient->channel_, GIOCondition(G_IO_IN | G_IO_ERR), on_io_in_event, oHttpClient);
+	out_source_id_ = g_io_add_watch(channel_, GIOCondition(G_IO_OUT), on_io_out_event, this);
+	in_source_id_ = g_io_add_watch(channel_, GIOCondition(G_IO_IN | G_IO_ERR | G_IO_HUP), on_io_in_event, this);
+}
+
+/* The connection is closed. A connection used again may have been closed by
+ * the server while it was idle, a GET request is sent once more on a new
+ * connection then. A POST is not, the server may have acted on it. */
+void HttpClient::fail(const char *error_msg)
+{
+	const bool retry = reused_ && !retried_ && httpMethod_ == HTTP_METHOD_GET
+		&& read_state_ == READ_HEADER && in_buf_.empty();
+	disconnect();
+	if (retry) {
+		retried_ = true;
+		connect();
+		return;
+	}
+	release_slot();
+	on_error_.emit(this, error_msg);
+}
+
+/* The response is read, the connection goes to the idle ones if the server
+ * keeps it open. */
+void HttpClient::finish()
+{
+	g_free(buffer);
+	buffer_len = header_.length() + content_.length();
+	buffer = (char *)g_malloc(buffer_len + 1);
+	memcpy(buffer, header_.data(), header_.length());
+	memcpy(buffer + header_.length(), content_.data(), content_.length());
+	buffer[buffer_len] = '\0'; // So the text is end by a extra '\0'.
+	content_.clear();
+	if (keep_alive_ && in_buf_.empty()) {
+		if (in_source_id_) {
+			g_source_remove(in_source_id_);
+			in_source_id_ = 0;
+		}
+		if (out_source_id_) {
+			g_source_remove(out_source_id_);
+			out_source_id_ = 0;
+		}
+		put_idle(pool_key(host_, port_), sd_, channel_);
+		sd_ = -1;
+		channel_ = NULL;
+	} else {
+		disconnect();
+	}
+	release_slot();
+	on_response_.emit(this);
 }
 
 void HttpClient::write_str(const char *str, GError **err)
@@ -159,6 +292,7 @@ void HttpClient::write_str(const char *str, GError **err)
 	res = g_io_channel_flush(channel_, err);
 }
 
+/* Returns false on error, the client may be deleted then. */
 bool HttpClient::SendRequest()
 {
 	std::string request;
@@ -167,18 +301,25 @@ bool HttpClient::SendRequest()
 	else if(httpMethod_ == HTTP_METHOD_POST)
 		request += "POST";
 	request += " ";
+	std::string host = host_;
+	if (port_ != 80) {
+		gchar *str = g_strdup_printf(":%d", port_);
+		host += str;
+		g_free(str);
+	}
 	if(allow_absolute_URI_) {
 		request += "HTTP://";
-		request += host_;
+		request += host;
 	}
 	request += file_;
 	request += " HTTP/1.1\r\n";
 
 	request += "User-Agent: Mozilla/4.0(compatible;MSIE 5.00;Windows 98)\r\n";
 	request += "Accept: */*\r\n";
+	request += "Accept-Encoding: gzip\r\n";
 
 	request += "Host: ";
-	request += host_;
+	request += host;
 	request += "\r\n";
 
 	request += headers_;
@@ -189,17 +330,18 @@ bool HttpClient::SendRequest()
 		request += "\r\n";
 		g_free(str);
 	}
-	request += "Connection: close\r\n\r\n";
+	request += "Connection: keep-alive\r\n\r\n";
 	request += body_;
 
 	GError *err = NULL;
 	write_str(request.c_str(), &err);
 	if (err) {
-		on_error_.emit(this, err->message);
+		std::string msg(err->message);
 		g_error_free(err);
-		return true;
+		fail(msg.c_str());
+		return false;
 	}
-	return false;
+	return true;
 }
 
 gboolean HttpClient::on_io_out_event(GIOChannel *ch, GIOCondition cond, gpointer user_data)
@@ -209,9 +351,12 @@ gboolean HttpClient::on_io_out_event(GIOChannel *ch, GIOCondition cond, gpointer
 	GIOStatus res = g_io_channel_flush(http_client->channel_, &err);
 	if (res == G_IO_STATUS_AGAIN) {
 		return TRUE;
-	} else if (err) {
-		http_client->on_error_.emit(http_client, err->message);
+	}
+	http_client->out_source_id_ = 0;
+	if (err) {
+		std::string msg(err->message);
 		g_error_free(err);
+		http_client->fail(msg.c_str());
 	}
 	return FALSE;
 }
@@ -219,38 +364,242 @@ gboolean HttpClient::on_io_out_event(GIOChannel *ch, GIOCondition cond, gpointer
 gboolean HttpClient::on_io_in_event(GIOChannel *ch, GIOCondition cond, gpointer user_data)
 {
 	HttpClient *http_client = static_cast<HttpClient *>(user_data);
-	if (cond & G_IO_ERR) {
-		http_client->on_error_.emit(http_client, "Http client error!");
-		return FALSE;
+	bool eof = false;
+	for (;;) {
+		gchar buf[4096];
+		gsize length;
+		GError *err = NULL;
+		GIOStatus res = g_io_channel_read_chars(http_client->channel_, buf, sizeof(buf), &length, &err);
+		if (err) {
+			gchar *str = g_strdup_printf("Error while reading reply from server: %s", err->message);
+			g_error_free(err);
+			http_client->in_source_id_ = 0;
+			http_client->fail(str);
+			g_free(str);
+			return FALSE;
+		}
+		http_client->in_buf_.append(buf, length);
+		if (res == G_IO_STATUS_EOF) {
+			eof = true;
+			break;
+		}
+		if (res != G_IO_STATUS_NORMAL)
+			break;
 	}
-	if (cond & G_IO_STATUS_EOF) {
-		http_client->on_response_.emit(http_client);
+	if (!http_client->parse_response(eof)) {
+		http_client->in_source_id_ = 0;
+		http_client->fail("Invalid reply from server!");
 		return FALSE;
 	}
-	GIOStatus res;
-	gchar *str_return = NULL;
-	gsize length;
-	GError *err = NULL;
-
-	res = g_io_channel_read_to_end(http_client->channel_, &str_return, &length, &err);
-	if (err) {
-		gchar *str = g_strdup_printf("Error while reading reply from server: %s", err->message);
-		http_client->on_error_.emit(http_client, str);
-		g_free(str);
-		g_error_free(err);
+	if (http_client->read_state_ == READ_DONE) {
+		http_client->in_source_id_ = 0;
+		http_client->finish();
 		return FALSE;
 	}
-	if (str_return) {
-		http_client->buffer = (char *)g_realloc(http_client->buffer, http_client->buffer_len + length);
-		memcpy(http_client->buffer+http_client->buffer_len, str_return, length);
-		http_client->buffer_len += length;
-		g_free(str_return);
-	}
-	if (res == G_IO_STATUS_NORMAL) {
-		http_client->buffer = (char *)g_realloc(http_client->buffer, http_client->buffer_len + 1);
-		http_client->buffer[http_client->buffer_len] = '\0'; // So the text is end by a extra '\0'.
-		http_client->on_response_.emit(http_client);
+	if (eof || (cond & G_IO_ERR)) {
+		http_client->in_source_id_ = 0;
+		http_client->fail("Http client error!");
 		return FALSE;
 	}
 	return TRUE;
 }
+
+/* Parse the received bytes as far as possible. Returns false if the reply
+ * is not valid. */
+bool HttpClient::parse_response(bool eof)
+{
+	size_t pos = 0;
+	bool ok = true;
+	while (ok && read_state_ != READ_DONE) {
+		const size_t avail = in_buf_.length() - pos;
+		if (read_state_ == READ_HEADER) {
+			const std::string::size_type end = in_buf_.find("\r\n\r\n", pos);
+			if (end == std::string::npos)
+				break;
+			header_.assign(in_buf_, pos, end + 4 - pos);
+			pos = end + 4;
+			ok = parse_header();
+		} else if (read_state_ == READ_BODY || read_state_ == READ_CHUNK_DATA) {
+			if (avail == 0)
+				break;
+			const size_t len = body_left_ < avail ? size_t(body_left_) : avail;
+			ok = add_content(in_buf_.data() + pos, len);
+			pos += len;
+			body_left_ -= len;
+			if (body_left_ == 0)
+				read_state_ = read_state_ == READ_BODY ? READ_DONE : READ_CHUNK_END;
+		} else if (read_state_ == READ_TO_EOF) {
+			ok = add_content(in_buf_.data() + pos, avail);
+			pos += avail;
+			if (eof)
+				read_state_ = READ_DONE;
+			break;
+		} else {
+			const std::string::size_type end = in_buf_.find("\r\n", pos);
+			if (end == std::string::npos)
+				break;
+			const std::string line(in_buf_, pos, end - pos);
+			pos = end + 2;
+			if (read_state_ == READ_CHUNK_SIZE) {
+				char *size_end;
+				body_left_ = g_ascii_strtoull(line.c_str(), &size_end, 16);
+				if (size_end == line.c_str())
+					ok = false;
+				else
+					read_state_ = body_left_ == 0 ? READ_TRAILER : READ_CHUNK_DATA;
+			} else if (read_state_ == READ_CHUNK_END) {
+				ok = line.empty();
+				read_state_ = READ_CHUNK_SIZE;
+			} else if (line.empty()) {
+				/* READ_TRAILER, the trailer fields are ignored */
+				read_state_ = READ_DONE;
+			}
+		}
+	}
+	in_buf_.erase(0, pos);
+	return ok;
+}
+
+/* Parse header_, choose how the body is read. */
+bool HttpClient::parse_header()
+{
+	int major, minor, code;
+	if (sscanf(header_.c_str(), "HTTP/%d.%d %d", &major, &minor, &code) != 3)
+		return false;
+	if (code >= 100 && code < 200) {
+		/* 100 Continue, the response follows */
+		header_.clear();
+		return true;
+	}
+	keep_alive_ = major > 1 || (major == 1 && minor >= 1);
+	bool chunked = false, gzip = false, has_length = false;
+	guint64 length = 0;
+	gchar **lines = g_strsplit(header_.c_str(), "\r\n", 0);
+	for (gchar **line = lines + 1; *line; line++) {
+		gchar *colon = strchr(*line, ':');
+		if (!colon)
+			continue;
+		*colon = '\0';
+		gchar *name = g_strstrip(*line);
+		gchar *value = g_ascii_strdown(g_strstrip(colon + 1), -1);
+		if (g_ascii_strcasecmp(name, "Content-Length") == 0) {
+			has_length = true;
+			length = g_ascii_strtoull(value, NULL, 10);
+		} else if (g_ascii_strcasecmp(name, "Transfer-Encoding") == 0) {
+			chunked = strstr(value, "chunked") != NULL;
+		} else if (g_ascii_strcasecmp(name, "Content-Encoding") == 0) {
+			gzip = strcmp(value, "gzip") == 0 || strcmp(value, "x-gzip") == 0;
+		} else if (g_ascii_strcasecmp(name, "Connection") == 0) {
+			if (strstr(value, "close"))
+				keep_alive_ = false;
+			else if (strstr(value, "keep-alive"))
+				keep_alive_ = true;
+		}
+		g_free(value);
+	}
+	g_strfreev(lines);
+
+	if (gzip) {
+		inflater_ = new z_stream;
+		memset(inflater_, 0, sizeof(*inflater_));
+		/* 16 - a gzip header */
+		if (inflateInit2(inflater_, 16 + MAX_WBITS) != Z_OK) {
+			delete inflater_;
+			inflater_ = NULL;
+			return false;
+		}
+	}
+	if (code == 204 || code == 304) {
+		read_state_ = READ_DONE;
+	} else if (chunked) {
+		read_state_ = READ_CHUNK_SIZE;
+	} else if (has_length) {
+		body_left_ = length;
+		read_state_ = length == 0 ? READ_DONE : READ_BODY;
+	} else {
+		keep_alive_ = false;
+		read_state_ = READ_TO_EOF;
+	}
+	return true;
+}
+
+/* Append a piece of the body to content_, inflate it if it is compressed. */
+bool HttpClient::add_content(const char *data, size_t len)
+{
+	if (!inflater_) {
+		content_.append(data, len);
+		return true;
+	}
+	inflater_->next_in = (Bytef *)data;
+	inflater_->avail_in = len;
+	while (inflater_->avail_in > 0) {
+		Bytef out[16384];
+		inflater_->next_out = out;
+		inflater_->avail_out = sizeof(out);
+		const int res = inflate(inflater_, Z_NO_FLUSH);
+		if (res != Z_OK && res != Z_STREAM_END && res != Z_BUF_ERROR)
+			return false;
+		content_.append((const char *)out, sizeof(out) - inflater_->avail_out);
+		if (res == Z_STREAM_END)
+			break;
+		if (res == Z_BUF_ERROR && inflater_->avail_out == sizeof(out))
+			return false;
+	}
+	return true;
+}
+
+void HttpClient::put_idle(const std::string &host, int sd, GIOChannel *channel)
+{
+	std::list<IdleConnection *> &idle = hosts[host].idle;
+	while (idle.size() >= size_t(MAX_CONNECTIONS_PER_HOST))
+		close_idle(idle.back());
+	IdleConnection *conn = new IdleConnection;
+	conn->host = host;
+	conn->sd = sd;
+	conn->channel = channel;
+	/* the server closes the connection or sends something unexpected */
+	conn->source_id = g_io_add_watch(channel, GIOCondition(G_IO_IN | G_IO_ERR | G_IO_HUP), on_idle_event, conn);
+	conn->timeout_id = g_timeout_add_seconds(IDLE_TIMEOUT, on_idle_timeout, conn);
+	idle.push_front(conn);
+}
+
+HttpClient::IdleConnection *HttpClient::take_idle(const std::string &host)
+{
+	std::list<IdleConnection *> &idle = hosts[host].idle;
+	if (idle.empty())
+		return NULL;
+	IdleConnection *conn = idle.front();
+	idle.pop_front();
+	g_source_remove(conn->source_id);
+	g_source_remove(conn->timeout_id);
+	return conn;
+}
+
+void HttpClient::close_idle(IdleConnection *conn)
+{
+	hosts[conn->host].idle.remove(conn);
+	if (conn->source_id)
+		g_source_remove(conn->source_id);
+	if (conn->timeout_id)
+		g_source_remove(conn->timeout_id);
+	g_io_channel_shutdown(conn->channel, TRUE, NULL);
+	g_io_channel_unref(conn->channel);
+	Socket::close(conn->sd);
+	delete conn;
+}
+
+gboolean HttpClient::on_idle_event(GIOChannel *, GIOCondition, gpointer data)
+{
+	IdleConnection *conn = static_cast<IdleConnection *>(data);
+	conn->source_id = 0;
+	close_idle(conn);
+	return FALSE;
+}
+
+gboolean HttpClient::on_idle_timeout(gpointer data)
+{
+	IdleConnection *conn = static_cast<IdleConnection *>(data);
+	conn->timeout_id = 0;
+	close_idle(conn);
+	return FALSE;
+}
@@ -24,21 +24,28 @@
 #include <string>
 #include <vector>
 #include <cstring>
-
-#ifndef _WIN32
-#  include <netdb.h>
-#else
-typedef unsigned long in_addr_t;
-#endif
+#include <list>
+#include <map>
+#include <zlib.h>
 
 #include "stardict-sigc++.h"
 
 
+struct SocketAddress;
+typedef std::vector<SocketAddress> SocketAddressList;
+
 typedef void (*get_http_response_func_t)(char *buffer, size_t buffer_len, gpointer userdata);
 enum HttpMethod {HTTP_METHOD_GET, HTTP_METHOD_POST};
 
+/* A request to a web server. The connections to a host are kept open and used
+ * again by the next requests, at most MAX_CONNECTIONS_PER_HOST requests to a
+ * host are served at the same time, the other requests wait. */
 class HttpClient {
 public:
+	static const int MAX_CONNECTIONS_PER_HOST = 4;
+	/* seconds an unused connection is kept open */
+	static const guint IDLE_TIMEOUT = 15;
+
 	sigc::signal<void, HttpClient*, const char *> on_error_;
 	sigc::signal<void, HttpClient *> on_response_;
 
@@ -63,13 +70,46 @@ public:
 	{
 		allow_absolute_URI_ = b;
 	}
+	void SetPort(int port)
+	{
+		port_ = port;
+	}
 
+	/* The header of the response, "\r\n\r\n", then the body without the
+	 * transfer and content encoding, ends with an extra '\0'. */
 	char *buffer;
 	size_t buffer_len;
 	gpointer userdata;
 	get_http_response_func_t callback_func_;
 private:
+	enum ReadState {
+		READ_HEADER,
+		READ_BODY,
+		READ_CHUNK_SIZE,
+		READ_CHUNK_DATA,
+		READ_CHUNK_END,
+		READ_TRAILER,
+		READ_TO_EOF,
+		READ_DONE,
+	};
+	struct IdleConnection {
+		std::string host;
+		int sd;
+		GIOChannel *channel;
+		guint source_id;
+		guint timeout_id;
+	};
+	struct HostState {
+		/* requests holding a connection, connecting or waiting for the response */
+		int active;
+		std::list<HttpClient *> waiting;
+		/* most recently used first */
+		std::list<IdleConnection *> idle;
+		HostState() : active(0) {}
+	};
+
 	std::string host_;
+	int port_;
 	std::string file_;
 	HttpMethod httpMethod_;
 	std::string headers_;
@@ -79,13 +119,46 @@ private:
 	GIOChannel *channel_;
 	guint in_source_id_;
 	guint out_source_id_;
-	static void on_resolved(gpointer data, bool resolved, in_addr_t sa);
-	static void on_connected(gpointer data, bool succeeded);
+	/* counted in HostState::active */
+	bool has_slot_;
+	/* the connection was taken from the idle ones */
+	bool reused_;
+	bool retried_;
+
+	ReadState read_state_;
+	/* received, not parsed yet */
+	std::string in_buf_;
+	std::string header_;
+	std::string content_;
+	/* bytes left of the body or of the chunk */
+	guint64 body_left_;
+	bool keep_alive_;
+	z_stream *inflater_;
+
+	static std::map<std::string, HostState> hosts;
+
+	static void on_resolved(gpointer data, bool resolved, const SocketAddressList *addrs);
+	static void on_connected(gpointer data, int socket);
 	static gboolean on_io_in_event(GIOChannel *, GIOCondition, gpointer);
 	static gboolean on_io_out_event(GIOChannel *, GIOCondition, gpointer);
 	void disconnect();
 	void write_str(const char *str, GError **err);
 	bool SendRequest();
+	void start();
+	void connect();
+	void begin_request();
+	void release_slot();
+	void fail(const char *error_msg);
+	void finish();
+	bool parse_response(bool eof);
+	bool parse_header();
+	bool add_content(const char *data, size_t len);
+
+	static void put_idle(const std::string &host, int sd, GIOChannel *channel);
+	static IdleConnection *take_idle(const std::string &host);
+	static void close_idle(IdleConnection *conn);
+	static gboolean on_idle_event(GIOChannel *, GIOCondition, gpointer);
+	static gboolean on_idle_timeout(gpointer);
 };
 
 #endif
@@ -0,0 +1,369 @@
+/*
+ * This file is part of StarDict.
+ *
+ * StarDict is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * StarDict is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with StarDict.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <cstring>
+#include <list>
+#include <map>
+#include <vector>
+
+#include "lookupstats.h"
+
+static const char * const stage_names[LookupStage_NUMS] = {
+	"index",
+	"collation",
+	"synonym",
+	"data",
+	"parse-data",
+	"render",
+	"full-text",
+};
+
+struct StageHistograms {
+	LatencyHistogram stages[LookupStage_NUMS];
+};
+
+/* Histograms recorded by one thread, indexed by LookupStatsEntry::num.
+ * The mutex is taken by the owner thread and by lookup_stats_dump and
+ * lookup_stats_reset only, so recording is not serialized between threads. */
+struct ThreadStats {
+	GMutex mutex;
+	std::vector<StageHistograms *> entries;
+	ThreadStats(void) { g_mutex_init(&mutex); }
+	~ThreadStats(void)
+	{
+		for (size_t i = 0; i < entries.size(); ++i)
+			delete entries[i];
+		g_mutex_clear(&mutex);
+	}
+};
+
+typedef std::map<std::string, LookupStatsEntry *> LookupStatsMap;
+/* stats_mutex protects all data below */
+static GMutex stats_mutex;
+static LookupStatsMap stats_map;
+static size_t stats_entry_count;
+static std::list<ThreadStats *> thread_stats_list;
+/* histograms of finished threads */
+static std::vector<StageHistograms> retired_stats;
+static volatile gint stats_enabled;
+
+static void free_thread_stats(gpointer data);
+static GPrivate thread_stats_key = G_PRIVATE_INIT(free_thread_stats);
+
+LatencyHistogram::LatencyHistogram(void)
+{
+	clear();
+}
+
+void LatencyHistogram::record(guint64 usec)
+{
+	++buckets[get_bucket(usec)];
+	++count;
+	total += usec;
+	if (usec > max)
+		max = usec;
+}
+
+void LatencyHistogram::clear(void)
+{
+	memset(buckets, 0, sizeof(buckets));
+	count = 0;
+	total = 0;
+	max = 0;
+}
+
+void LatencyHistogram::merge(const LatencyHistogram &h)
+{
+	for (guint i = 0; i < NBUCKETS; ++i)
+		buckets[i] += h.buckets[i];
+	count += h.count;
+	total += h.total;
+	if (h.max > max)
+		max = h.max;
+}
+
+double LatencyHistogram::get_mean(void) const
+{
+	if (count == 0)
+		return 0;
+	return double(total) / count;
+}
+
+guint64 LatencyHistogram::get_percentile(double p) const
+{
+	if (count == 0)
+		return 0;
+	guint64 rank = guint64(p / 100 * count + 0.5);
+	if (rank < 1)
+		rank = 1;
+	if (rank > count)
+		rank = count;
+	guint64 seen = 0;
+	for (guint i = 0; i < NBUCKETS; ++i) {
+		seen += buckets[i];
+		if (seen >= rank) {
+			guint64 value = get_bucket_highest_value(i);
+			return value < max ? value : max;
+		}
+	}
+	return max;
+}
+
+guint LatencyHistogram::get_bucket(guint64 usec)
+{
+	if (usec < 2*SUB_BUCKETS)
+		return guint(usec);
+	if (usec >= (G_GUINT64_CONSTANT(1) << MAX_VALUE_BITS))
+		usec = (G_GUINT64_CONSTANT(1) << MAX_VALUE_BITS) - 1;
+	const guint shift = g_bit_storage(usec) - 1 - SUB_BUCKET_BITS;
+	return shift * SUB_BUCKETS + guint(usec >> shift);
+}
+
+guint64 LatencyHistogram::get_bucket_highest_value(guint bucket)
+{
+	if (bucket < 2*SUB_BUCKETS)
+		return bucket;
+	const guint shift = bucket / SUB_BUCKETS - 1;
+	const guint64 top = bucket % SUB_BUCKETS + SUB_BUCKETS;
+	return ((top + 1) << shift) - 1;
+}
+
+/* Add histograms of the thread to merged, called with both mutexes locked. */
+static void merge_thread_stats(const ThreadStats *ts, std::vector<StageHistograms> &merged)
+{
+	if (merged.size() < ts->entries.size())
+		merged.resize(ts->entries.size());
+	for (size_t i = 0; i < ts->entries.size(); ++i) {
+		if (!ts->entries[i])
+			continue;
+		for (int j = 0; j < LookupStage_NUMS; ++j)
+			merged[i].stages[j].merge(ts->entries[i]->stages[j]);
+	}
+}
+
+static void free_thread_stats(gpointer data)
+{
+	ThreadStats *ts = static_cast<ThreadStats *>(data);
+	g_mutex_lock(&stats_mutex);
+	thread_stats_list.remove(ts);
+	g_mutex_lock(&ts->mutex);
+	merge_thread_stats(ts, retired_stats);
+	g_mutex_unlock(&ts->mutex);
+	g_mutex_unlock(&stats_mutex);
+	delete ts;
+}
+
+static ThreadStats *get_thread_stats(void)
+{
+	ThreadStats *ts = static_cast<ThreadStats *>(g_private_get(&thread_stats_key));
+	if (!ts) {
+		ts = new ThreadStats;
+		g_private_set(&thread_stats_key, ts);
+		g_mutex_lock(&stats_mutex);
+		thread_stats_list.push_back(ts);
+		g_mutex_unlock(&stats_mutex);
+	}
+	return ts;
+}
+
+void lookup_stats_enable(void)
+{
+	g_atomic_int_set(&stats_enabled, 1);
+}
+
+bool lookup_stats_enabled(void)
+{
+	return g_atomic_int_get(&stats_enabled) != 0;
+}
+
+LookupStatsEntry *lookup_stats_get_entry(const std::string &id, const std::string &name)
+{
+	if (!lookup_stats_enabled())
+		return NULL;
+	g_mutex_lock(&stats_mutex);
+	LookupStatsEntry *&entry = stats_map[id];
+	if (!entry) {
+		entry = new LookupStatsEntry;
+		entry->id = id;
+		entry->num = stats_entry_count++;
+	}
+	entry->name = name;
+	g_mutex_unlock(&stats_mutex);
+	return entry;
+}
+
+void lookup_stats_record(LookupStatsEntry *entry, LookupStage stage, guint64 usec)
+{
+	ThreadStats *ts = get_thread_stats();
+	g_mutex_lock(&ts->mutex);
+	if (ts->entries.size() <= entry->num)
+		ts->entries.resize(entry->num + 1);
+	if (!ts->entries[entry->num])
+		ts->entries[entry->num] = new StageHistograms;
+	ts->entries[entry->num]->stages[stage].record(usec);
+	g_mutex_unlock(&ts->mutex);
+}
+
+void lookup_stats_reset(void)
+{
+	g_mutex_lock(&stats_mutex);
+	retired_stats.clear();
+	for (std::list<ThreadStats *>::iterator i = thread_stats_list.begin();
+		i != thread_stats_list.end(); ++i) {
+		g_mutex_lock(&(*i)->mutex);
+		for (size_t j = 0; j < (*i)->entries.size(); ++j) {
+			delete (*i)->entries[j];
+			(*i)->entries[j] = NULL;
+		}
+		g_mutex_unlock(&(*i)->mutex);
+	}
+	g_mutex_unlock(&stats_mutex);
+}
+
+static void json_append_string(std::string &out, const std::string &str)
+{
+	out += '"';
+	for (std::string::const_iterator i = str.begin(); i != str.end(); ++i) {
+		switch (*i) {
+		case '"':
+			out += "\\\"";
+			break;
+		case '\\':
+			out += "\\\\";
+			break;
+		case '\n':
+			out += "\\n";
+			break;
+		case '\t':
+			out += "\\t";
+			break;
+		default:
+			if (static_cast<guchar>(*i) < 0x20) {
+				gchar buf[8];
+				g_snprintf(buf, sizeof(buf), "\\u%04x", static_cast<guchar>(*i));
+				out += buf;
+			} else
+				out += *i;
+		}
+	}
+	out += '"';
+}
+
+static void dump_text(std::string &out, const std::vector<StageHistograms> &merged)
+{
+	gchar *line;
+	for (LookupStatsMap::const_iterator i = stats_map.begin(); i != stats_map.end(); ++i) {
+		const LookupStatsEntry *entry = i->second;
+		if (entry->num >= merged.size())
+			continue;
+		bool header = false;
+		for (int j = 0; j < LookupStage_NUMS; ++j) {
+			const LatencyHistogram &h = merged[entry->num].stages[j];
+			if (h.get_count() == 0)
+				continue;
+			if (!header) {
+				out += entry->name;
+				out += " (";
+				out += entry->id;
+				out += ")\n";
+				line = g_strdup_printf("  %-12s %10s %10s %10s %10s %10s %10s\n",
+					"stage", "count", "mean,us", "p50,us", "p90,us", "p99,us", "max,us");
+				out += line;
+				g_free(line);
+				header = true;
+			}
+			line = g_strdup_printf("  %-12s %10" G_GUINT64_FORMAT " %10.1f %10" G_GUINT64_FORMAT
+				" %10" G_GUINT64_FORMAT " %10" G_GUINT64_FORMAT " %10" G_GUINT64_FORMAT "\n",
+				stage_names[j], h.get_count(), h.get_mean(), h.get_percentile(50),
+				h.get_percentile(90), h.get_percentile(99), h.get_max());
+			out += line;
+			g_free(line);
+		}
+	}
+}
+
+static void dump_json(std::string &out, const std::vector<StageHistograms> &merged)
+{
+	gchar *item;
+	bool first_dict = true;
+	out += "{\"dicts\":[";
+	for (LookupStatsMap::const_iterator i = stats_map.begin(); i != stats_map.end(); ++i) {
+		const LookupStatsEntry *entry = i->second;
+		if (entry->num >= merged.size())
+			continue;
+		if (!first_dict)
+			out += ',';
+		first_dict = false;
+		out += "{\"id\":";
+		json_append_string(out, entry->id);
+		out += ",\"name\":";
+		json_append_string(out, entry->name);
+		out += ",\"stages\":{";
+		bool first_stage = true;
+		for (int j = 0; j < LookupStage_NUMS; ++j) {
+			const LatencyHistogram &h = merged[entry->num].stages[j];
+			if (h.get_count() == 0)
+				continue;
+			if (!first_stage)
+				out += ',';
+			first_stage = false;
+			gchar mean[G_ASCII_DTOSTR_BUF_SIZE];
+			g_ascii_formatd(mean, sizeof(mean), "%.1f", h.get_mean());
+			item = g_strdup_printf("\"%s\":{\"count\":%" G_GUINT64_FORMAT ",\"mean_us\":%s,"
+				"\"p50_us\":%" G_GUINT64_FORMAT ",\"p90_us\":%" G_GUINT64_FORMAT
+				",\"p99_us\":%" G_GUINT64_FORMAT ",\"max_us\":%" G_GUINT64_FORMAT "}",
+				stage_names[j], h.get_count(), mean, h.get_percentile(50),
+				h.get_percentile(90), h.get_percentile(99), h.get_max());
+			out += item;
+			g_free(item);
+		}
+		out += "}}";
+	}
+	out += "]}\n";
+}
+
+void lookup_stats_dump(std::string &out, LookupStatsFormat format)
+{
+	g_mutex_lock(&stats_mutex);
+	std::vector<StageHistograms> merged(retired_stats);
+	for (std::list<ThreadStats *>::const_iterator i = thread_stats_list.begin();
+		i != thread_stats_list.end(); ++i) {
+		g_mutex_lock(&(*i)->mutex);
+		merge_thread_stats(*i, merged);
+		g_mutex_unlock(&(*i)->mutex);
+	}
+	if (format == LookupStatsFormat_JSON)
+		dump_json(out, merged);
+	else
+		dump_text(out, merged);
+	g_mutex_unlock(&stats_mutex);
+}
+
+bool lookup_stats_parse_format(const char *str, LookupStatsFormat &format)
+{
+	if (strcmp(str, "text") == 0)
+		format = LookupStatsFormat_TEXT;
+	else if (strcmp(str, "json") == 0)
+		format = LookupStatsFormat_JSON;
+	else
+		return false;
+	return true;
+}
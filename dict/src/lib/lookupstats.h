@@ -0,0 +1,130 @@
+/*
+ * This file is part of StarDict.
+ *
+ * StarDict is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * StarDict is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with StarDict.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _STARDICT_LOOKUP_STATS_H_
+#define _STARDICT_LOOKUP_STATS_H_
+
+#include <glib.h>
+#include <string>
+
+/* Lookup latency instrumentation.
+ * Time spent in each stage of a lookup is collected per dictionary.
+ * Stages are timed with LookupStageTimer objects placed in the code,
+ * collected statistics may be printed with lookup_stats_dump at any time. */
+
+enum LookupStage {
+	/* search the word in the index file */
+	LookupStage_Index,
+	/* search the word in the index sorted with a collation function */
+	LookupStage_Collation,
+	/* search the word in the synonym file */
+	LookupStage_Synonym,
+	/* read (and inflate) article data */
+	LookupStage_Data,
+	/* parse-data plug-ins */
+	LookupStage_ParseData,
+	/* insert the article into the text view, parse-data time excluded */
+	LookupStage_Render,
+	/* full-text search in the dictionary */
+	LookupStage_FullText,
+	LookupStage_NUMS,
+};
+
+enum LookupStatsFormat {
+	LookupStatsFormat_TEXT,
+	LookupStatsFormat_JSON,
+};
+
+/* Histogram of latencies in microseconds.
+ * Buckets are organized like in HDR histograms. Values less than
+ * 2*SUB_BUCKETS are counted exactly, every next power of two range is split
+ * into SUB_BUCKETS buckets of equal width. The relative error of any value
+ * reported by the histogram is less than 1/SUB_BUCKETS. */
+class LatencyHistogram {
+public:
+	LatencyHistogram(void);
+	void record(guint64 usec);
+	void clear(void);
+	void merge(const LatencyHistogram &h);
+	guint64 get_count(void) const { return count; }
+	guint64 get_max(void) const { return max; }
+	double get_mean(void) const;
+	/* p in range [0, 100], returns the highest value equivalent to the
+	 * value at percentile p */
+	guint64 get_percentile(double p) const;
+private:
+	static const guint SUB_BUCKET_BITS = 3;
+	static const guint SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+	/* values up to 2^32 usec (more than an hour), larger values are clamped */
+	static const guint MAX_VALUE_BITS = 32;
+	static const guint NBUCKETS = (MAX_VALUE_BITS - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+	static guint get_bucket(guint64 usec);
+	static guint64 get_bucket_highest_value(guint bucket);
+
+	guint32 buckets[NBUCKETS];
+	guint64 count;
+	guint64 total;
+	guint64 max;
+};
+
+/* A dictionary statistics is collected for.
+ * Every thread records latencies into its own histograms,
+ * lookup_stats_dump merges histograms of all threads. */
+struct LookupStatsEntry {
+	std::string id;
+	std::string name; // in utf-8
+	/* number of the entry, index of its histograms in a thread */
+	size_t num;
+};
+
+/* Statistics is collected only after this call. */
+extern void lookup_stats_enable(void);
+extern bool lookup_stats_enabled(void);
+/* Find or create statistics entry for the dictionary.
+ * id - any string identifying the dictionary, ifo file name for example.
+ * Returns NULL if statistics is not enabled.
+ * Entries are never freed, the returned pointer is valid till the program end.
+ * Functions in this file may be invoked from any thread. */
+extern LookupStatsEntry *lookup_stats_get_entry(const std::string &id, const std::string &name);
+extern void lookup_stats_record(LookupStatsEntry *entry, LookupStage stage, guint64 usec);
+extern void lookup_stats_reset(void);
+extern void lookup_stats_dump(std::string &out, LookupStatsFormat format);
+extern bool lookup_stats_parse_format(const char *str, LookupStatsFormat &format);
+
+/* Measures the time from construction to destruction of the object and
+ * records it into the entry. Does nothing if entry is NULL. */
+class LookupStageTimer {
+public:
+	LookupStageTimer(LookupStatsEntry *_entry, LookupStage _stage)
+	:
+		entry(_entry),
+		stage(_stage),
+		start(_entry ? g_get_monotonic_time() : 0)
+	{
+	}
+	~LookupStageTimer(void)
+	{
+		if (entry)
+			lookup_stats_record(entry, stage, g_get_monotonic_time() - start);
+	}
+private:
+	LookupStatsEntry *entry;
+	LookupStage stage;
+	gint64 start;
+};
+
+#endif
@@ -0,0 +1,120 @@
+/*
+ * This file is part of StarDict.
+ *
+ * StarDict is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * StarDict is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with StarDict.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <cstring>
+
+#include "netcache.h"
+
+NetCache::NetCache(const char *_name, size_t _max_size, GDestroyNotify _free_func,
+	guint _found_ttl, guint _not_found_ttl)
+:
+	name(_name),
+	max_size(_max_size),
+	cur_size(0),
+	free_func(_free_func),
+	found_ttl(_found_ttl),
+	not_found_ttl(_not_found_ttl)
+{
+	entry_table = g_hash_table_new(g_str_hash, g_str_equal);
+	memset(&stats, 0, sizeof(stats));
+}
+
+NetCache::~NetCache()
+{
+	if (stats.hits + stats.misses > 0)
+		g_debug("%s cache: %" G_GUINT64_FORMAT " hits, %" G_GUINT64_FORMAT
+			" misses, %" G_GUINT64_FORMAT " expired, %" G_GUINT64_FORMAT
+			" evicted, %" G_GUINT64_FORMAT " stored", name.c_str(),
+			stats.hits, stats.misses, stats.expired, stats.evicted, stats.stored);
+	clear();
+	g_hash_table_destroy(entry_table);
+}
+
+gpointer NetCache::lookup(const char *key)
+{
+	Entry *entry = static_cast<Entry *>(g_hash_table_lookup(entry_table, key));
+	if (!entry) {
+		stats.misses++;
+		return NULL;
+	}
+	if (g_get_monotonic_time() >= entry->expires) {
+		stats.expired++;
+		stats.misses++;
+		remove_entry(entry);
+		return NULL;
+	}
+	stats.hits++;
+	entries.splice(entries.begin(), entries, entry->pos);
+	return entry->value;
+}
+
+void NetCache::store(const char *key, gpointer value, size_t size, bool found)
+{
+	store_ttl(key, value, size, found ? found_ttl : not_found_ttl);
+}
+
+void NetCache::store_ttl(const char *key, gpointer value, size_t size, guint ttl)
+{
+	Entry *old = static_cast<Entry *>(g_hash_table_lookup(entry_table, key));
+	if (old)
+		remove_entry(old);
+	Entry *entry = new Entry;
+	entry->key = key;
+	entry->value = value;
+	entry->size = size + entry->key.length() + sizeof(Entry);
+	entry->expires = g_get_monotonic_time() + gint64(ttl) * G_USEC_PER_SEC;
+	while (!entries.empty() && cur_size + entry->size > max_size) {
+		stats.evicted++;
+		remove_entry(entries.back());
+	}
+	entries.push_front(entry);
+	entry->pos = entries.begin();
+	g_hash_table_insert(entry_table, (gpointer)entry->key.c_str(), entry);
+	cur_size += entry->size;
+	stats.stored++;
+}
+
+void NetCache::remove(const char *key)
+{
+	Entry *entry = static_cast<Entry *>(g_hash_table_lookup(entry_table, key));
+	if (entry)
+		remove_entry(entry);
+}
+
+void NetCache::clear(void)
+{
+	g_hash_table_remove_all(entry_table);
+	for (std::list<Entry *>::iterator it = entries.begin(); it != entries.end(); ++it) {
+		free_func((*it)->value);
+		delete *it;
+	}
+	entries.clear();
+	cur_size = 0;
+}
+
+void NetCache::remove_entry(Entry *entry)
+{
+	g_hash_table_remove(entry_table, entry->key.c_str());
+	entries.erase(entry->pos);
+	cur_size -= entry->size;
+	free_func(entry->value);
+	delete entry;
+}
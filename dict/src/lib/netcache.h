@@ -0,0 +1,91 @@
+/*
+ * This file is part of StarDict.
+ *
+ * StarDict is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * StarDict is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with StarDict.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _STARDICT_NET_CACHE_H_
+#define _STARDICT_NET_CACHE_H_
+
+#include <glib.h>
+#include <string>
+#include <list>
+
+struct NetCacheStats {
+	guint64 hits;
+	guint64 misses;
+	/* found, but too old */
+	guint64 expired;
+	/* dropped to keep the cache in its size */
+	guint64 evicted;
+	guint64 stored;
+};
+
+/* Cache of replies of network services: the StarDict server and the net
+ * dictionary plugins. The same word is often looked up again, a cached reply
+ * saves a round trip to the remote service.
+ * Entries are found by a hash of the key. Every entry expires after its time
+ * to live, a reply telling that nothing is found lives shorter, the service
+ * may learn the word. The least recently used entries are dropped when the
+ * total size of the cached replies exceeds the limit, the entry stored last
+ * is always kept, so the caller may use it after store().
+ * Must be used in the main thread only. */
+class NetCache {
+public:
+	/* an hour for a found word, five minutes for a missing one */
+	static const guint DEFAULT_FOUND_TTL = 60 * 60;
+	static const guint DEFAULT_NOT_FOUND_TTL = 5 * 60;
+
+	/* max_size - in bytes, free_func frees the values, ttl - in seconds */
+	NetCache(const char *name, size_t max_size, GDestroyNotify free_func,
+		guint found_ttl = DEFAULT_FOUND_TTL, guint not_found_ttl = DEFAULT_NOT_FOUND_TTL);
+	~NetCache();
+	/* Return NULL if the key is not cached or has expired. The value is
+	 * valid till the cache is modified. */
+	gpointer lookup(const char *key);
+	/* The cache owns value. size - the approximate size of value in bytes,
+	 * found - false if the reply tells that nothing is found. */
+	void store(const char *key, gpointer value, size_t size, bool found);
+	/* The same, the entry expires in ttl seconds. */
+	void store_ttl(const char *key, gpointer value, size_t size, guint ttl);
+	void remove(const char *key);
+	void clear(void);
+	const NetCacheStats &get_stats(void) const { return stats; }
+private:
+	struct Entry {
+		std::string key;
+		gpointer value;
+		size_t size;
+		/* g_get_monotonic_time() */
+		gint64 expires;
+		/* the place in entries */
+		std::list<Entry *>::iterator pos;
+	};
+
+	void remove_entry(Entry *entry);
+
+	std::string name;
+	size_t max_size;
+	size_t cur_size;
+	GDestroyNotify free_func;
+	guint found_ttl;
+	guint not_found_ttl;
+	/* most recently used first */
+	std::list<Entry *> entries;
+	/* key -> Entry, the keys are owned by the entries */
+	GHashTable *entry_table;
+	NetCacheStats stats;
+};
+
+#endif
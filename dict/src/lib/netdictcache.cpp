@@ -17,97 +17,232 @@
  * along with StarDict.  If not, see <http://www.gnu.org/licenses/>.
  */
 
-#include "netdictcache.h"
-#include "netdictplugin.h"
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
 
+#include <glib/gstdio.h>
+#include <cstring>
+#include <cstdlib>
+#include <ctime>
 #include <string>
 #include <vector>
-#include <map>
-
-class RespCache {
-public:
-	RespCache();
-	~RespCache();
-	NetDictResponse *get_cache_resp(const char *key);
-	void save_cache_resp(const char *key, NetDictResponse *resp);
-private:
-	static const unsigned int resp_pool_size = 50;
-	struct RespElement {
-		std::string key;
-		NetDictResponse *resp;
-	};
-	std::vector<RespElement *> resp_pool;
-	size_t cur_resp_pool_pos;
-};
+#include <algorithm>
 
-static std::map<std::string, RespCache> dictresp_map;
+#include "netdictcache.h"
+#include "netdictplugin.h"
+#include "netcache.h"
+#include "iappdirs.h"
+#include "libcommon.h"
+#include "utils.h"
+
+/* the most bytes of responses kept in memory and on disk */
+static const size_t RESP_CACHE_SIZE = 4 * 1024 * 1024;
+static const goffset DISK_CACHE_SIZE = 32 * 1024 * 1024;
+/* the disk cache is pruned again after this many bytes are written */
+static const goffset DISK_PRUNE_STEP = DISK_CACHE_SIZE / 16;
+/* a day for a found word, an hour for a missing one */
+static const guint FOUND_TTL = 24 * 60 * 60;
+static const guint NOT_FOUND_TTL = 60 * 60;
+static const char DISK_CACHE_MAGIC[] = "StarDict net dictionary cache 1\n";
 
-RespCache::RespCache()
+static void free_resp(gpointer data)
 {
-	resp_pool.resize(resp_pool_size);
-	for (size_t i = 0; i< resp_pool_size; i++) {
-		resp_pool[i] = NULL;
-	}
-	cur_resp_pool_pos = 0;
+	delete static_cast<NetDictResponse *>(data);
 }
 
-RespCache::~RespCache()
+/* All net dictionaries share the cache, a key is the dictionary and the
+ * word. */
+static NetCache resp_cache("net dictionary", RESP_CACHE_SIZE, free_resp,
+	FOUND_TTL, NOT_FOUND_TTL);
+/* empty if the responses are not kept on disk */
+static std::string disk_cache_dir;
+/* bytes written to the disk cache since it was pruned */
+static goffset disk_written = 0;
+
+static std::string cache_key(const char *dict, const char *key)
 {
-	for (std::vector<RespElement *>::iterator i = resp_pool.begin(); i != resp_pool.end(); ++i) {
-		if (*i) {
-			delete (*i)->resp;
-			delete *i;
-		}
-	}
+	std::string res(dict);
+	res += '\n';
+	res += key;
+	return res;
 }
 
-NetDictResponse *RespCache::get_cache_resp(const char *key)
+static size_t resp_size(const NetDictResponse *resp)
 {
-	for (std::vector<RespElement *>::iterator i = resp_pool.begin(); i != resp_pool.end(); ++i) {
-		if (*i) {
-			if ((*i)->key == key) {
-				return (*i)->resp;
-			}
+	size_t size = sizeof(*resp);
+	if (resp->word)
+		size += strlen(resp->word);
+	if (resp->data)
+		size += sizeof(guint32) + get_uint32(resp->data);
+	return size;
+}
+
+static std::string disk_cache_file(const std::string &ckey)
+{
+	gchar *sum = g_compute_checksum_for_string(G_CHECKSUM_MD5, ckey.c_str(), -1);
+	std::string res = build_path(disk_cache_dir, sum);
+	g_free(sum);
+	return res;
+}
+
+/* The file is the magic line, the expiry time in seconds since the epoch,
+ * then the key, the bookname, the booklink and the word, each ending with
+ * '\0', then the data if the word is found.
+ * ttl - the seconds the response has left to live. */
+static NetDictResponse *load_disk_resp(const std::string &ckey, guint &ttl)
+{
+	const std::string filename = disk_cache_file(ckey);
+	gchar *contents;
+	gsize length;
+	if (!g_file_get_contents(filename.c_str(), &contents, &length, NULL))
+		return NULL;
+	const gchar *p = contents, *end = contents + length;
+	const size_t magic_len = sizeof(DISK_CACHE_MAGIC) - 1;
+	if (length < magic_len || memcmp(p, DISK_CACHE_MAGIC, magic_len) != 0) {
+		g_free(contents);
+		return NULL;
+	}
+	p += magic_len;
+	const char *fields[5];
+	for (int i = 0; i < 5; i++) {
+		const gchar *nul = static_cast<const gchar *>(memchr(p, '\0', end - p));
+		if (!nul) {
+			g_free(contents);
+			return NULL;
 		}
+		fields[i] = p;
+		p = nul + 1;
+	}
+	const gint64 expires = g_ascii_strtoll(fields[0], NULL, 10);
+	const gint64 now = g_get_real_time() / G_USEC_PER_SEC;
+	if (ckey != fields[1] || expires <= now) {
+		g_free(contents);
+		g_unlink(filename.c_str());
+		return NULL;
 	}
-	return NULL;
+	const bool found = p < end;
+	/* the clock may have been turned back */
+	ttl = guint(std::min(expires - now, gint64(found ? FOUND_TTL : NOT_FOUND_TTL)));
+	if (found && (end - p < gint64(sizeof(guint32))
+		|| end - p != gint64(sizeof(guint32) + get_uint32(p)))) {
+		g_free(contents);
+		return NULL;
+	}
+	NetDictResponse *resp = new NetDictResponse;
+	/* the plugins keep these strings for the life of the program */
+	resp->bookname = g_intern_string(fields[2]);
+	resp->booklink = fields[3][0] ? g_intern_string(fields[3]) : NULL;
+	resp->word = g_strdup(fields[4]);
+	resp->data = found ? stardict_datadup(p) : NULL;
+	g_free(contents);
+	return resp;
 }
 
-void RespCache::save_cache_resp(const char *key, NetDictResponse *resp)
+static void prune_disk_cache(void);
+
+static void save_disk_resp(const std::string &ckey, const NetDictResponse *resp)
 {
-	if (resp_pool[cur_resp_pool_pos]) {
-		delete resp_pool[cur_resp_pool_pos]->resp;
-		delete resp_pool[cur_resp_pool_pos];
+	const bool found = resp->data != NULL;
+	gchar *expires = g_strdup_printf("%" G_GINT64_FORMAT,
+		g_get_real_time() / G_USEC_PER_SEC + (found ? FOUND_TTL : NOT_FOUND_TTL));
+	std::string contents(DISK_CACHE_MAGIC);
+	contents.append(expires, strlen(expires) + 1);
+	g_free(expires);
+	contents.append(ckey.c_str(), ckey.length() + 1);
+	const char *bookname = resp->bookname ? resp->bookname : "";
+	const char *booklink = resp->booklink ? resp->booklink : "";
+	const char *word = resp->word ? resp->word : "";
+	contents.append(bookname, strlen(bookname) + 1);
+	contents.append(booklink, strlen(booklink) + 1);
+	contents.append(word, strlen(word) + 1);
+	if (found)
+		contents.append(resp->data, sizeof(guint32) + get_uint32(resp->data));
+	if (!g_file_set_contents(disk_cache_file(ckey).c_str(), contents.data(),
+		contents.length(), NULL))
+		return;
+	disk_written += contents.length();
+	if (disk_written >= DISK_PRUNE_STEP)
+		prune_disk_cache();
+}
+
+struct DiskCacheFile {
+	std::string filename;
+	time_t mtime;
+	goffset size;
+	bool operator<(const DiskCacheFile &other) const
+	{
+		return mtime > other.mtime;
+	}
+};
+
+/* Remove the files older than a found response may live, then the oldest
+ * files while the directory is larger than DISK_CACHE_SIZE. */
+static void prune_disk_cache(void)
+{
+	disk_written = 0;
+	GDir *dir = g_dir_open(disk_cache_dir.c_str(), 0, NULL);
+	if (!dir)
+		return;
+	const time_t oldest = time(NULL) - FOUND_TTL;
+	std::vector<DiskCacheFile> files;
+	const gchar *name;
+	while ((name = g_dir_read_name(dir)) != NULL) {
+		DiskCacheFile file;
+		file.filename = build_path(disk_cache_dir, name);
+		stardict_stat_t stats;
+		if (g_stat(file.filename.c_str(), &stats) != 0
+			|| !g_file_test(file.filename.c_str(), G_FILE_TEST_IS_REGULAR))
+			continue;
+		if (stats.st_mtime < oldest) {
+			g_unlink(file.filename.c_str());
+			continue;
+		}
+		file.mtime = stats.st_mtime;
+		file.size = stats.st_size;
+		files.push_back(file);
 	}
-	resp_pool[cur_resp_pool_pos] = new RespElement();
-	resp_pool[cur_resp_pool_pos]->key = key;
-	resp_pool[cur_resp_pool_pos]->resp = resp;
-	cur_resp_pool_pos++;
-	if (cur_resp_pool_pos == resp_pool_size) {
-		cur_resp_pool_pos = 0;
+	g_dir_close(dir);
+	std::sort(files.begin(), files.end());
+	goffset total = 0;
+	for (size_t i = 0; i < files.size(); i++) {
+		total += files[i].size;
+		if (total > DISK_CACHE_SIZE)
+			g_unlink(files[i].filename.c_str());
 	}
 }
 
-static RespCache &get_response_cache(const char *dict)
+void netdict_set_disk_cache(bool enable)
 {
-	std::map<std::string, RespCache>::iterator i = dictresp_map.find(dict);
-	if (i == dictresp_map.end()) {
-		std::pair<std::map<std::string, RespCache>::iterator, bool> result;
-		result = dictresp_map.insert(std::pair<std::string, RespCache>(dict, RespCache()));
-		return result.first->second;
-	} else {
-		return i->second;
+	disk_cache_dir.clear();
+	if (!enable)
+		return;
+	const std::string dir = build_path(app_dirs->get_user_cache_dir(), "netdict");
+	if (g_mkdir_with_parents(dir.c_str(), 0700) != 0) {
+		g_warning("Unable to create the net dictionary cache directory %s", dir.c_str());
+		return;
 	}
+	disk_cache_dir = dir;
+	prune_disk_cache();
 }
 
 NetDictResponse *netdict_get_cache_resp(const char *dict, const char *key)
 {
-	RespCache &resp_cache = get_response_cache(dict);
-	return resp_cache.get_cache_resp(key);
+	const std::string ckey = cache_key(dict, key);
+	NetDictResponse *resp = static_cast<NetDictResponse *>(resp_cache.lookup(ckey.c_str()));
+	if (resp || disk_cache_dir.empty())
+		return resp;
+	guint ttl;
+	resp = load_disk_resp(ckey, ttl);
+	if (resp)
+		resp_cache.store_ttl(ckey.c_str(), resp, resp_size(resp), ttl);
+	return resp;
 }
 
 void netdict_save_cache_resp(const char *dict, const char *key, NetDictResponse *resp)
 {
-	RespCache &resp_cache = get_response_cache(dict);
-	resp_cache.save_cache_resp(key, resp);
+	const std::string ckey = cache_key(dict, key);
+	if (!disk_cache_dir.empty())
+		save_disk_resp(ckey, resp);
+	resp_cache.store(ckey.c_str(), resp, resp_size(resp), resp->data != NULL);
 }
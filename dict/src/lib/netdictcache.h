@@ -22,7 +22,13 @@
 
 struct NetDictResponse;
 
+/* Keep the responses in the user cache directory as well, so they survive
+ * a restart. */
+extern void netdict_set_disk_cache(bool enable);
+/* Return NULL if the response is not cached. The response is valid till
+ * the next netdict_save_cache_resp(). */
 extern NetDictResponse *netdict_get_cache_resp(const char *dict, const char *key);
+/* The cache owns resp. */
 extern void netdict_save_cache_resp(const char *dict, const char *key, NetDictResponse *resp);
 
 #endif
@@ -47,4 +47,6 @@ void ParseResult::clear()
 StarDictParseDataPlugInObject::StarDictParseDataPlugInObject()
 {
 	parse_func = 0;
+	types = NULL;
+	thread_safe = false;
 }
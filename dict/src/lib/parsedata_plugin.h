@@ -103,6 +103,14 @@ struct StarDictParseDataPlugInObject{
 
 	typedef bool (*parse_func_t)(const char *p, unsigned int *parsed_size, ParseResult &result, const char *oword);
 	parse_func_t parse_func;
+	/* Data type identifiers handled by parse_func, "x" for example.
+	 * parse_func is invoked only for fields of these types.
+	 * NULL - the plugin is tried for fields of any type. */
+	const char *types;
+	/* parse_func may be called from several threads at once, not only from
+	 * the main one. Such a plugin must not create widgets and must not use
+	 * mutable global data. */
+	bool thread_safe;
 };
 
 #endif
@@ -0,0 +1,321 @@
+/*
+ * This file is part of StarDict.
+ *
+ * StarDict is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * StarDict is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with StarDict.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <cstring>
+#include <glib/gi18n.h>
+
+#include "utils.h"
+#include "parsepipeline.h"
+
+/* size of the field starting with the type identifier p[0] */
+static guint32 article_field_size(const gchar *p)
+{
+	if (g_ascii_isupper(*p))
+		return 1 + sizeof(guint32) + g_ntohl(get_uint32(p + 1));
+	return strlen(p + 1) + 2;
+}
+
+static void append_mark_item(ParseResult &result, const std::string &mark)
+{
+	if (mark.empty())
+		return;
+	ParseResultItem item;
+	item.type = ParseResultItemType_mark;
+	item.mark = new ParseResultMarkItem;
+	item.mark->pango = mark;
+	result.item_list.push_back(item);
+}
+
+ParsePipeline::ParsePipeline(StarDictParseDataPlugins *_plugins, gint max_threads)
+:
+	plugins(_plugins),
+	running(0),
+	suspended(0)
+{
+	g_mutex_init(&mutex);
+	g_cond_init(&cond);
+	pool = g_thread_pool_new(worker_func, this, max_threads, FALSE, NULL);
+}
+
+ParsePipeline::~ParsePipeline()
+{
+	g_mutex_lock(&mutex);
+	for (std::list<ParseJob *>::iterator it = jobs.begin(); it != jobs.end(); ++it)
+		g_atomic_int_set(&(*it)->cancelled, 1);
+	suspended = 0;
+	g_cond_broadcast(&cond);
+	g_mutex_unlock(&mutex);
+	/* cancelled jobs are dropped by the workers */
+	g_thread_pool_free(pool, FALSE, TRUE);
+	/* only jobs waiting for the main loop remain */
+	for (std::list<ParseJob *>::iterator it = jobs.begin(); it != jobs.end(); ++it) {
+		g_source_remove((*it)->idle_id);
+		free_job(*it);
+	}
+	g_cond_clear(&cond);
+	g_mutex_clear(&mutex);
+}
+
+bool ParsePipeline::can_parse(const gchar *data) const
+{
+	const guint32 data_size = get_uint32(data);
+	data += sizeof(guint32);
+	const gchar *p = data;
+	while (guint32(p - data) < data_size) {
+		if (*p == 'r' || *p == 'P' || !plugins->thread_safe(*p))
+			return false;
+		p += article_field_size(p);
+	}
+	return true;
+}
+
+void ParsePipeline::push(gpointer owner, const gchar *data, const gchar *oword,
+	on_parsed_func_t on_parsed, gpointer user_data)
+{
+	ParseJob *job = new ParseJob;
+	job->owner = owner;
+	job->user_data = user_data;
+	job->on_parsed = on_parsed;
+	job->data = (gchar *)g_memdup(data, sizeof(guint32) + get_uint32(data));
+	job->oword = oword ? oword : "";
+	job->parse_time = 0;
+	job->pipeline = this;
+	job->cancelled = 0;
+	job->idle_id = 0;
+	g_mutex_lock(&mutex);
+	jobs.push_back(job);
+	g_mutex_unlock(&mutex);
+	g_thread_pool_push(pool, job, NULL);
+}
+
+void ParsePipeline::cancel(gpointer owner)
+{
+	g_mutex_lock(&mutex);
+	for (std::list<ParseJob *>::iterator it = jobs.begin(); it != jobs.end(); ++it) {
+		if ((*it)->owner == owner)
+			g_atomic_int_set(&(*it)->cancelled, 1);
+	}
+	g_mutex_unlock(&mutex);
+}
+
+void ParsePipeline::suspend(void)
+{
+	g_mutex_lock(&mutex);
+	++suspended;
+	while (running > 0)
+		g_cond_wait(&cond, &mutex);
+	g_mutex_unlock(&mutex);
+}
+
+void ParsePipeline::resume(void)
+{
+	g_mutex_lock(&mutex);
+	if (suspended > 0)
+		--suspended;
+	g_cond_broadcast(&cond);
+	g_mutex_unlock(&mutex);
+}
+
+void ParsePipeline::worker_func(gpointer data, gpointer user_data)
+{
+	ParseJob *job = static_cast<ParseJob *>(data);
+	ParsePipeline *pipeline = static_cast<ParsePipeline *>(user_data);
+	g_mutex_lock(&pipeline->mutex);
+	while (pipeline->suspended > 0)
+		g_cond_wait(&pipeline->cond, &pipeline->mutex);
+	++pipeline->running;
+	g_mutex_unlock(&pipeline->mutex);
+
+	if (!g_atomic_int_get(&job->cancelled))
+		parse_article(pipeline->plugins, job->data, job->oword.c_str(),
+			job->result, job->parse_time, &job->cancelled);
+
+	g_mutex_lock(&pipeline->mutex);
+	--pipeline->running;
+	const bool cancelled = g_atomic_int_get(&job->cancelled);
+	if (cancelled)
+		pipeline->jobs.remove(job);
+	else
+		/* back to main thread */
+		job->idle_id = g_idle_add(on_job_done, job);
+	g_cond_broadcast(&pipeline->cond);
+	g_mutex_unlock(&pipeline->mutex);
+	if (cancelled)
+		free_job(job);
+}
+
+gboolean ParsePipeline::on_job_done(gpointer data)
+{
+	ParseJob *job = static_cast<ParseJob *>(data);
+	ParsePipeline *pipeline = job->pipeline;
+	g_mutex_lock(&pipeline->mutex);
+	pipeline->jobs.remove(job);
+	g_mutex_unlock(&pipeline->mutex);
+	if (!g_atomic_int_get(&job->cancelled))
+		job->on_parsed(job);
+	free_job(job);
+	return FALSE;
+}
+
+bool article_has_ui_fields(const gchar *data)
+{
+	const guint32 data_size = get_uint32(data);
+	data += sizeof(guint32);
+	const gchar *p = data;
+	while (guint32(p - data) < data_size) {
+		if (*p == 'r' || *p == 'P')
+			return true;
+		p += article_field_size(p);
+	}
+	return false;
+}
+
+void parse_article(StarDictParseDataPlugins *plugins, const gchar *data,
+	const gchar *oword, ParseResult &result, gint64 &parse_time,
+	gint *cancelled)
+{
+	const guint32 data_size = get_uint32(data);
+	data += sizeof(guint32);
+	const gchar *p = data;
+	std::string mark;
+	bool first_time = true;
+	unsigned int parsed_size;
+	ParseResult parse_result;
+	while (guint32(p - data) < data_size) {
+		/* the user has typed another word, stop early */
+		if (cancelled && g_atomic_int_get(cancelled))
+			return;
+		if (first_time)
+			first_time = false;
+		else
+			mark += "\n";
+		const gint64 parse_start_time = g_get_monotonic_time();
+		const bool parsed = plugins->parse(p, &parsed_size, parse_result, oword);
+		parse_time += g_get_monotonic_time() - parse_start_time;
+		if (parsed) {
+			p += parsed_size;
+			append_mark_item(result, mark);
+			mark.clear();
+			result.item_list.splice(result.item_list.end(), parse_result.item_list);
+			continue;
+		}
+		const guint32 sec_size = article_field_markup(p, mark);
+		if (!sec_size) {
+			g_warning("Unexpected field type %c, the article is not converted completely.", *p);
+			break;
+		}
+		p += sec_size;
+	}
+	append_mark_item(result, mark);
+}
+
+void ParsePipeline::free_job(ParseJob *job)
+{
+	g_free(job->data);
+	delete job;
+}
+
+guint32 article_field_markup(const gchar *p, std::string &mark)
+{
+	guint32 sec_size;
+	const gchar type = *p++;
+	switch (type) {
+		case 'm':
+		//case 'l': //TODO: convert from local encoding to utf-8
+			sec_size = strlen(p);
+			if (sec_size) {
+				gchar *m_str = g_markup_escape_text(p, sec_size);
+				mark+=m_str;
+				g_free(m_str);
+			}
+			sec_size++;
+			break;
+		case 'g':
+			sec_size=strlen(p);
+			if (sec_size) {
+				mark+=p;
+			}
+			sec_size++;
+			break;
+		case 'x':
+			sec_size = strlen(p) + 1;
+			mark+= _("XDXF data parsing plug-in is not found!");
+			break;
+		case 'k':
+			sec_size = strlen(p) + 1;
+			mark+= _("PowerWord data parsing plug-in is not found!");
+			break;
+		case 'w':
+			sec_size = strlen(p) + 1;
+			mark+= _("Wiki data parsing plug-in is not found!");
+			break;
+		case 'h':
+			sec_size = strlen(p) + 1;
+			mark+= _("HTML data parsing plug-in is not found!");
+			break;
+		case 'n':
+			sec_size = strlen(p) + 1;
+			mark+= _("WordNet data parsing plug-in is not found!");
+			break;
+		case 't':
+			sec_size = strlen(p);
+			if (sec_size) {
+				mark += "[<span foreground=\"blue\">";
+				gchar *m_str = g_markup_escape_text(p, sec_size);
+				mark += m_str;
+				g_free(m_str);
+				mark += "</span>]";
+			}
+			sec_size++;
+			break;
+		case 'y':
+			sec_size = strlen(p);
+			if (sec_size) {
+				mark += "[<span foreground=\"red\">";
+				gchar *m_str = g_markup_escape_text(p, sec_size);
+				mark += m_str;
+				g_free(m_str);
+				mark += "</span>]";
+			}
+			sec_size++;
+			break;
+		case 'r':
+		case 'P':
+			return 0;
+		/*case 'W':
+			{
+			sec_size=g_ntohl(get_uint32(p));
+			//TODO: sound button.
+			sec_size += sizeof(guint32);
+			}
+			break;*/
+		default:
+			if (g_ascii_isupper(type)) {
+				sec_size=g_ntohl(get_uint32(p));
+				sec_size += sizeof(guint32);
+			} else {
+				sec_size = strlen(p)+1;
+			}
+			mark += _("Unknown data type, please upgrade StarDict!");
+			break;
+	}
+	return sec_size + 1;
+}
@@ -0,0 +1,113 @@
+/*
+ * This file is part of StarDict.
+ *
+ * StarDict is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * StarDict is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with StarDict.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _STARDICT_PARSE_PIPELINE_H_
+#define _STARDICT_PARSE_PIPELINE_H_
+
+#include <glib.h>
+#include <list>
+#include <string>
+
+#include "parsedata_plugin.h"
+#include "pluginmanager.h"
+
+class ParsePipeline;
+struct ParseJob;
+
+typedef void (*on_parsed_func_t)(ParseJob *job);
+
+/* An article queued for parsing. */
+struct ParseJob {
+	gpointer owner;
+	gpointer user_data;
+	/* Invoked in the main thread, unless the job is cancelled. */
+	on_parsed_func_t on_parsed;
+	/* copy of the article data, in the format of Dict::GetWordData */
+	gchar *data;
+	std::string oword;
+	/* Article converted to pango markup, fields of all types are here,
+	 * not only those parsed by plugins. */
+	ParseResult result;
+	/* microseconds spent in parse-data plugins */
+	gint64 parse_time;
+private:
+	friend class ParsePipeline;
+	ParsePipeline *pipeline;
+	gint cancelled;
+	guint idle_id;
+};
+
+/* Parses articles with parse-data plugins in worker threads.
+ * Large articles freeze the user interface while they are parsed, the
+ * pipeline does that work in the background and passes ready ParseResult
+ * lists to the main thread. Only articles where every field may be
+ * converted without the user interface can be pushed, see can_parse.
+ * Jobs are identified by owner, for example an article view. When the view is
+ * cleared, its jobs are cancelled, a cancelled job is dropped without
+ * notification, even if parsing is already complete.
+ * All methods must be called in the main thread. */
+class ParsePipeline {
+public:
+	ParsePipeline(StarDictParseDataPlugins *plugins, gint max_threads);
+	~ParsePipeline();
+	/* Whether the article data may be parsed in a worker thread. */
+	bool can_parse(const gchar *data) const;
+	void push(gpointer owner, const gchar *data, const gchar *oword,
+		on_parsed_func_t on_parsed, gpointer user_data);
+	void cancel(gpointer owner);
+	/* Parse-data plugins must not be loaded, unloaded or configured
+	 * while workers use them. suspend waits for the jobs being parsed,
+	 * queued jobs are started after resume. */
+	void suspend(void);
+	void resume(void);
+private:
+	static void worker_func(gpointer data, gpointer user_data);
+	static gboolean on_job_done(gpointer data);
+	static void free_job(ParseJob *job);
+
+	StarDictParseDataPlugins *plugins;
+	GThreadPool *pool;
+	/* protects the members below */
+	GMutex mutex;
+	GCond cond;
+	/* jobs not yet delivered to the main thread */
+	std::list<ParseJob *> jobs;
+	/* number of jobs being parsed now */
+	gint running;
+	gint suspended;
+};
+
+/* Whether the article contains fields that are shown with the help of the
+ * user interface, resource lists ('r') and pictures ('P'). */
+extern bool article_has_ui_fields(const gchar *data);
+
+/* Convert an article without user interface fields to a ParseResult, the same
+ * way ArticleView::AppendData shows it. Fields not parsed by plugins become
+ * pango markup items. Time spent in plugins is added to parse_time.
+ * Conversion stops early when *cancelled becomes non-zero. */
+extern void parse_article(StarDictParseDataPlugins *plugins, const gchar *data,
+	const gchar *oword, ParseResult &result, gint64 &parse_time,
+	gint *cancelled = NULL);
+
+/* Convert an article field that does not need parse-data plugins to pango
+ * markup and append it to mark. p points to the type identifier of the field.
+ * Resource lists ('r') and pictures ('P') need the user interface, they are
+ * not converted.
+ * Return the full size of the field, 0 if the field was not converted. */
+extern guint32 article_field_markup(const gchar *p, std::string &mark);
+
+#endif
@@ -530,6 +530,11 @@ void StarDictVirtualDictPlugins::lookup(size_t iPlugin, const gchar *word, char
 	oPlugins[iPlugin]->lookup(word, pppWord, ppppWordData);
 }
 
+void StarDictVirtualDictPlugins::prepare(size_t iPlugin, const gchar *word)
+{
+	oPlugins[iPlugin]->prepare(word);
+}
+
 const char *StarDictVirtualDictPlugins::dict_name(size_t iPlugin)
 {
 	return oPlugins[iPlugin]->dict_name();
@@ -571,6 +576,12 @@ void StarDictVirtualDictPlugin::lookup(const char *word, char ***pppWord, char *
 	obj->lookup_func(word, pppWord, ppppWordData);
 }
 
+void StarDictVirtualDictPlugin::prepare(const char *word)
+{
+	if (obj->prepare_func)
+		obj->prepare_func(word);
+}
+
 const char *StarDictVirtualDictPlugin::dict_name()
 {
 	return obj->dict_name;
@@ -848,6 +859,8 @@ const char *StarDictTtsPlugin::tts_name()
 //
 
 StarDictParseDataPlugins::StarDictParseDataPlugins()
+:
+	generation(0)
 {
 }
 
@@ -862,6 +875,7 @@ void StarDictParseDataPlugins::add(StarDictPluginBaseObject *baseobj, StarDictPa
 {
 	StarDictParseDataPlugin *plugin = new StarDictParseDataPlugin(baseobj, tts_plugin_obj);
 	oPlugins.push_back(plugin);
+	build_dispatch_table();
 }
 
 void StarDictParseDataPlugins::unload_plugin(const char *filename)
@@ -870,6 +884,7 @@ void StarDictParseDataPlugins::unload_plugin(const char *filename)
 		if (strcmp((*iter)->get_filename(), filename) == 0) {
 			delete *iter;
 			oPlugins.erase(iter);
+			build_dispatch_table();
 			break;
 		}
 	}
@@ -880,14 +895,43 @@ void StarDictParseDataPlugins::configure_plugin(const char *filename)
 	for (std::vector<StarDictParseDataPlugin *>::iterator iter = oPlugins.begin(); iter != oPlugins.end(); ++iter) {
 		if (strcmp((*iter)->get_filename(), filename) == 0) {
 			(*iter)->configure();
+			++generation;
 			break;
 		}
 	}
 }
 
-bool StarDictParseDataPlugins::parse(size_t iPlugin, const char *p, unsigned int *parsed_size, ParseResult &result, const char *oword)
+bool StarDictParseDataPlugins::parse(const char *p, unsigned int *parsed_size, ParseResult &result, const char *oword)
 {
-	return oPlugins[iPlugin]->parse(p, parsed_size, result, oword);
+	const std::vector<StarDictParseDataPlugin *> &plugins = dispatch_table[(unsigned char)*p];
+	for (std::vector<StarDictParseDataPlugin *>::const_iterator i = plugins.begin(); i != plugins.end(); ++i) {
+		result.clear();
+		if ((*i)->parse(p, parsed_size, result, oword))
+			return true;
+	}
+	return false;
+}
+
+bool StarDictParseDataPlugins::thread_safe(unsigned char type) const
+{
+	const std::vector<StarDictParseDataPlugin *> &plugins = dispatch_table[type];
+	for (std::vector<StarDictParseDataPlugin *>::const_iterator i = plugins.begin(); i != plugins.end(); ++i) {
+		if (!(*i)->thread_safe())
+			return false;
+	}
+	return true;
+}
+
+void StarDictParseDataPlugins::build_dispatch_table(void)
+{
+	++generation;
+	for (int type = 0; type < 256; ++type) {
+		dispatch_table[type].clear();
+		for (std::vector<StarDictParseDataPlugin *>::iterator i = oPlugins.begin(); i != oPlugins.end(); ++i) {
+			if ((*i)->handles_type(type))
+				dispatch_table[type].push_back(*i);
+		}
+	}
 }
 
 //
@@ -910,6 +954,13 @@ bool StarDictParseDataPlugin::parse(const char *p, unsigned int *parsed_size, Pa
 	return obj->parse_func(p, parsed_size, result, oword);
 }
 
+bool StarDictParseDataPlugin::handles_type(unsigned char type) const
+{
+	if (!obj->types)
+		return true;
+	return type != '\0' && strchr(obj->types, type) != NULL;
+}
+
 //
 // class StarDictMiscPlugins begin.
 //
@@ -1035,6 +1086,7 @@ void StarDictTtsPlugins::reorder(const std::list<std::string>& order_list)
 void StarDictParseDataPlugins::reorder(const std::list<std::string>& order_list)
 {
 	plugins_reorder<std::vector<StarDictParseDataPlugin *>, std::vector<StarDictParseDataPlugin *>::iterator>(oPlugins, order_list);
+	build_dispatch_table();
 }
 
 void StarDictMiscPlugins::reorder(const std::list<std::string>& order_list)
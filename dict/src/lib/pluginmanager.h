@@ -57,6 +57,7 @@ public:
 	StarDictVirtualDictPlugin(StarDictPluginBaseObject *baseobj, StarDictVirtualDictPlugInObject *virtualdict_plugin_obj);
 	~StarDictVirtualDictPlugin();
 	void lookup(const char *word, char ***pppWord, char ****ppppWordData);
+	void prepare(const char *word);
 	const char *dict_name();
 	const char *dict_id();
 private:
@@ -69,6 +70,7 @@ public:
 	~StarDictVirtualDictPlugins();
 	void add(StarDictPluginBaseObject *baseobj, StarDictVirtualDictPlugInObject *virtualdict_plugin_obj);
 	void lookup(size_t iPlugin, const gchar *word, char ***pppWord, char ****ppppWordData);
+	void prepare(size_t iPlugin, const gchar *word);
 	size_t ndicts() { return oPlugins.size(); }
 	const char *dict_name(size_t iPlugin);
 	const char *dict_id(size_t iPlugin);
@@ -167,6 +169,8 @@ public:
 	StarDictParseDataPlugin(StarDictPluginBaseObject *baseobj, StarDictParseDataPlugInObject *parsedata_plugin_obj);
 	~StarDictParseDataPlugin();
 	bool parse(const char *p, unsigned int *parsed_size, ParseResult &result, const char *oword);
+	bool handles_type(unsigned char type) const;
+	bool thread_safe() const { return obj->thread_safe; }
 private:
 	StarDictParseDataPlugInObject *obj;
 };
@@ -176,13 +180,25 @@ public:
 	StarDictParseDataPlugins();
 	~StarDictParseDataPlugins();
 	void add(StarDictPluginBaseObject *baseobj, StarDictParseDataPlugInObject *parsedata_plugin_obj);
-	bool parse(size_t iPlugin, const char *p, unsigned int *parsed_size, ParseResult &result, const char *oword);
+	/* Parse the field p with plugins handling its type, in plugin order.
+	 * Returns false if no plugin accepted the field. */
+	bool parse(const char *p, unsigned int *parsed_size, ParseResult &result, const char *oword);
+	/* Whether fields of this type may be parsed outside of the main thread. */
+	bool thread_safe(unsigned char type) const;
 	size_t nplugins() { return oPlugins.size(); }
 	void unload_plugin(const char *filename);
 	void configure_plugin(const char *filename);
 	void reorder(const std::list<std::string>& order_list);
+	/* Changes each time plugins are added, removed, reordered or configured,
+	 * parse results obtained with another generation may be out of date. */
+	guint get_generation() const { return generation; }
 private:
+	void build_dispatch_table(void);
+
 	std::vector<StarDictParseDataPlugin *> oPlugins;
+	guint generation;
+	/* plugins to try for each data type identifier */
+	std::vector<StarDictParseDataPlugin *> dispatch_table[256];
 };
 
 class StarDictMiscPlugin : public StarDictPluginBase {
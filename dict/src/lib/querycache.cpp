@@ -0,0 +1,101 @@
+/*
+ * This file is part of StarDict.
+ *
+ * StarDict is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * StarDict is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with StarDict.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include "querycache.h"
+
+QueryCache::QueryCache(size_t _max_queries)
+:
+	max_queries(_max_queries)
+{
+	g_mutex_init(&mutex);
+}
+
+QueryCache::~QueryCache()
+{
+	g_mutex_clear(&mutex);
+}
+
+void QueryCache::build_key(std::string &key, const gchar *word, LookupMethod method,
+	int servercollatefunc)
+{
+	gchar buf[32];
+	g_snprintf(buf, sizeof(buf), "%d:%d:", method, servercollatefunc);
+	key = buf;
+	key += word;
+}
+
+bool QueryCache::lookup(const gchar *word, LookupMethod method, int servercollatefunc,
+	size_t iLib, QueryCacheItem &item)
+{
+	std::string key;
+	build_key(key, word, method, servercollatefunc);
+	bool found = false;
+	g_mutex_lock(&mutex);
+	EntryMap::iterator it = entry_map.find(key);
+	if (it != entry_map.end()) {
+		const Entry &entry = *it->second;
+		if (iLib < entry.cached.size() && entry.cached[iLib]) {
+			item = entry.items[iLib];
+			found = true;
+		}
+		entries.splice(entries.begin(), entries, it->second);
+	}
+	g_mutex_unlock(&mutex);
+	return found;
+}
+
+void QueryCache::store(const gchar *word, LookupMethod method, int servercollatefunc,
+	size_t iLib, const QueryCacheItem &item)
+{
+	if (max_queries == 0)
+		return;
+	std::string key;
+	build_key(key, word, method, servercollatefunc);
+	g_mutex_lock(&mutex);
+	EntryMap::iterator it = entry_map.find(key);
+	if (it == entry_map.end()) {
+		if (entries.size() >= max_queries) {
+			entry_map.erase(entries.back().key);
+			entries.pop_back();
+		}
+		entries.push_front(Entry());
+		entries.front().key = key;
+		it = entry_map.insert(std::make_pair(key, entries.begin())).first;
+	} else {
+		entries.splice(entries.begin(), entries, it->second);
+	}
+	Entry &entry = *it->second;
+	if (entry.cached.size() <= iLib) {
+		entry.items.resize(iLib + 1);
+		entry.cached.resize(iLib + 1, false);
+	}
+	entry.items[iLib] = item;
+	entry.cached[iLib] = true;
+	g_mutex_unlock(&mutex);
+}
+
+void QueryCache::clear(void)
+{
+	g_mutex_lock(&mutex);
+	entry_map.clear();
+	entries.clear();
+	g_mutex_unlock(&mutex);
+}
@@ -0,0 +1,86 @@
+/*
+ * This file is part of StarDict.
+ *
+ * StarDict is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * StarDict is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with StarDict.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _STARDICT_QUERY_CACHE_H_
+#define _STARDICT_QUERY_CACHE_H_
+
+#include <glib.h>
+#include <string>
+#include <vector>
+#include <list>
+#include <map>
+
+/* How a word is searched in the index and the synonym file. */
+enum LookupMethod {
+	/* Libs::LookupWord and Libs::LookupSynonymWord */
+	LookupMethod_EXACT = 0,
+	/* Libs::LookupSimilarWord and Libs::LookupSynonymSimilarWord */
+	LookupMethod_SIMILAR = 1,
+	/* Libs::SimpleLookupWord and Libs::SimpleLookupSynonymWord */
+	LookupMethod_SIMPLE = 2,
+};
+
+/* Result of a word lookup in one dictionary, both hits and misses are stored. */
+struct QueryCacheItem {
+	bool found_word;
+	bool found_synonym;
+	glong idx;
+	glong idx_suggest;
+	glong synidx;
+	glong synidx_suggest;
+};
+
+/* Cache of word lookup results in local dictionaries.
+ * Scan mode and the main window often look up the same word again,
+ * the smart lookup tries several variants of every word. The cache saves
+ * repeated binary searches and similar word lookups.
+ * An entry is created per query (word, method, server collate function),
+ * it holds results for each dictionary the query was run against, so any
+ * dictmask may share the entry. The least recently used entries are dropped
+ * when the cache is full.
+ * Dictionary indexes are those of Libs::oLib, the cache must be cleared
+ * when the dictionary list is changed. May be used from any thread. */
+class QueryCache {
+public:
+	explicit QueryCache(size_t max_queries);
+	~QueryCache();
+	bool lookup(const gchar *word, LookupMethod method, int servercollatefunc,
+		size_t iLib, QueryCacheItem &item);
+	void store(const gchar *word, LookupMethod method, int servercollatefunc,
+		size_t iLib, const QueryCacheItem &item);
+	void clear(void);
+private:
+	struct Entry {
+		std::string key;
+		/* indexed by dictionary, item is valid if cached[iLib] is true */
+		std::vector<QueryCacheItem> items;
+		std::vector<bool> cached;
+	};
+	/* most recently used first */
+	typedef std::list<Entry> EntryList;
+	typedef std::map<std::string, EntryList::iterator> EntryMap;
+
+	static void build_key(std::string &key, const gchar *word, LookupMethod method,
+		int servercollatefunc);
+
+	size_t max_queries;
+	EntryList entries;
+	EntryMap entry_map;
+	GMutex mutex;
+};
+
+#endif
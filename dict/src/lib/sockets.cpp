@@ -53,7 +53,17 @@ extern "C" {
 
 #include "sockets.h"
 
-std::map<std::string, in_addr_t> Socket::dns_map;
+/* the resolved addresses are used again for so long, in microseconds */
+static const gint64 DNS_CACHE_TTL = 5 * 60 * G_USEC_PER_SEC;
+/* the most threads resolving hosts at the same time */
+static const gint DNS_MAX_THREADS = 4;
+/* seconds, for each address of the host */
+static const guint CONNECT_TIMEOUT = 30;
+
+GThreadPool *Socket::dns_pool = NULL;
+std::map<std::string, Socket::DnsCacheEntry> Socket::dns_map;
+std::map<std::string, Socket::DnsQueryData *> Socket::dns_queries;
+std::map<gpointer, Socket::ConnectData *> Socket::connects;
 
 #if defined(_WIN32)
   
@@ -88,10 +98,10 @@ nonFatalError()
 
 
 int
-Socket::socket()
+Socket::socket(int family)
 {
   initWinSock();
-  return (int) ::socket(AF_INET, SOCK_STREAM, 0);
+  return (int) ::socket(family, SOCK_STREAM, 0);
 }
 
 
@@ -164,122 +174,271 @@ int Socket::accept(int fd)
 
 gboolean Socket::dns_main_thread_cb(gpointer data)
 {
-    DnsQueryData *query_data = (DnsQueryData *)data;
-    if (query_data->resolved) {
-		dns_map[query_data->host] = query_data->sa;
+	DnsQueryData *query_data = (DnsQueryData *)data;
+	dns_queries.erase(query_data->host);
+	if (query_data->resolved) {
+		DnsCacheEntry &entry = dns_map[query_data->host];
+		entry.addrs = query_data->addrs;
+		entry.expires = g_get_monotonic_time() + DNS_CACHE_TTL;
 	}
-    query_data->func(query_data->data, query_data->resolved, query_data->sa);
-    delete query_data;
-    return FALSE;
+	/* a callback may start or cancel other queries, query_data is not
+	 * reachable from dns_queries any more */
+	while (!query_data->waiters.empty()) {
+		DnsWaiter waiter = query_data->waiters.front();
+		query_data->waiters.pop_front();
+		waiter.func(waiter.data, query_data->resolved, &query_data->addrs);
+	}
+	delete query_data;
+	return FALSE;
 }
 
-gpointer Socket::dns_thread(gpointer data)
+void Socket::dns_worker(gpointer data, gpointer user_data)
 {
-    DnsQueryData *query_data = (DnsQueryData *)data;
-    struct  hostent *phost;
-#ifndef _WIN32    
-#ifdef HAVE_GETHOSTBYNAME_R
-    struct  hostent hostinfo;
-    char buf[1024];
-    int ret, ret2;
-    ret2 = gethostbyname_r(query_data->host.c_str(), &hostinfo, buf,
-        sizeof(buf), &phost, &ret);
-
-    if (ret2 == 0 && ret == 0 && phost != NULL) {   // classical code!
-        query_data->sa = ((in_addr*)(hostinfo.h_addr))->s_addr;
-        query_data->resolved = true;
-    } else {
-        query_data->resolved = false;
-    }
-#else
-	static GStaticMutex mutex = G_STATIC_MUTEX_INIT;
-	g_static_mutex_lock (&mutex);
-	phost = gethostbyname(query_data->host.c_str());
-	if (phost) {
-		query_data->sa = ((in_addr*)(phost->h_addr))->s_addr;
-		query_data->resolved = true;
-	} else {
-		query_data->resolved = false;
-	}
-	g_static_mutex_unlock (&mutex);
+	DnsQueryData *query_data = (DnsQueryData *)data;
+	struct addrinfo hints, *res = NULL;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+#ifdef AI_ADDRCONFIG
+	hints.ai_flags = AI_ADDRCONFIG;
 #endif
-#else
-	//static GStaticMutex mutex = G_STATIC_MUTEX_INIT;
-	//g_static_mutex_lock (&mutex);
-	if (isalpha(query_data->host[0])) {
-		phost = gethostbyname(query_data->host.c_str());
-	} else {
-		unsigned int addr;
-		addr = inet_addr(query_data->host.c_str());
-		phost = gethostbyaddr((char *)&addr, 4, AF_INET);
-	}
-	if (phost) {
-		query_data->sa = ((in_addr*)(phost->h_addr))->s_addr;
-		query_data->resolved = true;
-	} else {
-		query_data->resolved = false;
+	query_data->resolved = false;
+	if (getaddrinfo(query_data->host.c_str(), NULL, &hints, &res) == 0) {
+		/* all of them, a host may be unreachable over one of IPv4 and IPv6 */
+		for (struct addrinfo *ai = res; ai; ai = ai->ai_next) {
+			SocketAddress addr;
+			if (ai->ai_addrlen > sizeof(addr.addr))
+				continue;
+			memcpy(&addr.addr, ai->ai_addr, ai->ai_addrlen);
+			addr.addrlen = (socklen_t)ai->ai_addrlen;
+			query_data->addrs.push_back(addr);
+		}
+		query_data->resolved = !query_data->addrs.empty();
+		freeaddrinfo(res);
 	}
-	//g_static_mutex_unlock (&mutex);
-#endif                     
-    /* back to main thread */
-    g_idle_add(dns_main_thread_cb, query_data);
-    return NULL;
+	/* back to main thread */
+	g_idle_add(dns_main_thread_cb, query_data);
 }
 
-void Socket::resolve(std::string& host, gpointer data, on_resolved_func func)
+void Socket::resolve(const std::string& host, gpointer data, on_resolved_func func)
 {
 	initWinSock();
-	std::map<std::string, in_addr_t>::iterator iter;
-	iter = dns_map.find(host);
+	std::map<std::string, DnsCacheEntry>::iterator iter = dns_map.find(host);
 	if (iter != dns_map.end()) {
-		func(data, true, iter->second);
+		if (g_get_monotonic_time() < iter->second.expires) {
+			func(data, true, &iter->second.addrs);
+			return;
+		}
+		dns_map.erase(iter);
+	}
+	DnsWaiter waiter;
+	waiter.data = data;
+	waiter.func = func;
+	std::map<std::string, DnsQueryData *>::iterator query = dns_queries.find(host);
+	if (query != dns_queries.end()) {
+		query->second->waiters.push_back(waiter);
 		return;
 	}
+	if (!dns_pool)
+		dns_pool = g_thread_pool_new(dns_worker, NULL, DNS_MAX_THREADS, FALSE, NULL);
 	DnsQueryData *query_data = new DnsQueryData();
 	query_data->host = host;
-	query_data->data = data;
-	query_data->func = func;
-	g_thread_unref(g_thread_new("dns_thread", dns_thread, query_data));
+	query_data->waiters.push_back(waiter);
+	query_data->resolved = false;
+	dns_queries[host] = query_data;
+	g_thread_pool_push(dns_pool, query_data, NULL);
+}
+
+void Socket::cancel_resolve(gpointer data)
+{
+	std::map<std::string, DnsQueryData *>::iterator query;
+	for (query = dns_queries.begin(); query != dns_queries.end(); ++query) {
+		std::list<DnsWaiter> &waiters = query->second->waiters;
+		for (std::list<DnsWaiter>::iterator it = waiters.begin(); it != waiters.end(); ) {
+			if (it->data == data)
+				it = waiters.erase(it);
+			else
+				++it;
+		}
+	}
+}
+
+void Socket::set_error_code(int error)
+{
+#if defined(_WIN32)
+	WSASetLastError(error);
+#else
+	errno = error;
+#endif
 }
 
-void Socket::connect(int socket, in_addr_t sa, int port, gpointer data, on_connected_func func)
+void Socket::connect(const SocketAddressList &addrs, int port, gpointer data, on_connected_func func)
 {
+	/* one connection per data at a time */
+	cancel_connect(data);
 	ConnectData *connect_data = new ConnectData();
-	connect_data->sd = socket;
-	connect_data->sa = sa;
+	connect_data->addrs = addrs;
+	connect_data->addr_index = 0;
 	connect_data->port = port;
+	connect_data->sd = -1;
 	connect_data->data = data;
 	connect_data->func = func;
-	g_thread_unref(g_thread_new("connect_thread", connect_thread, connect_data));
+	connect_data->channel = NULL;
+	connect_data->source_id = 0;
+	connect_data->timeout_id = 0;
+	connect_data->error = 0;
+	connects[data] = connect_data;
+	start_connect(connect_data);
 }
 
-gpointer Socket::connect_thread(gpointer data)
+/* Start connecting to the address at addr_index, the addresses that fail at
+ * once are skipped. When none is left, the failure is reported from an idle
+ * callback with the error of the last address. */
+void Socket::start_connect(ConnectData *connect_data)
 {
-    ConnectData *connect_data = (ConnectData *)data;
-	struct sockaddr_in saddr;
-	memset(&saddr, 0, sizeof(saddr));
-	saddr.sin_family = AF_INET;
-	saddr.sin_addr.s_addr = connect_data->sa;
-	saddr.sin_port = htons((u_short) connect_data->port);
-
-	// For asynch operation, this will return EWOULDBLOCK (windows) or
-	// EINPROGRESS (linux) and we just need to wait for the socket to be writable...
-	int result = ::connect(connect_data->sd, (struct sockaddr *)&saddr, sizeof(saddr));
-	connect_data->succeeded = (result == 0);
-
-    /* back to main thread */
-    g_idle_add(connect_main_thread_cb, connect_data);
-    return NULL;
+	for (; connect_data->addr_index < connect_data->addrs.size(); connect_data->addr_index++) {
+		const SocketAddress &addr = connect_data->addrs[connect_data->addr_index];
+		struct sockaddr_storage saddr;
+		memcpy(&saddr, &addr.addr, addr.addrlen);
+		if (saddr.ss_family == AF_INET6)
+			((struct sockaddr_in6 *)&saddr)->sin6_port = htons((u_short) connect_data->port);
+		else
+			((struct sockaddr_in *)&saddr)->sin_port = htons((u_short) connect_data->port);
+
+		connect_data->sd = socket(saddr.ss_family);
+		if (connect_data->sd == -1) {
+			connect_data->error = get_error_code();
+			continue;
+		}
+		if (!set_non_blocking(connect_data->sd)) {
+			connect_data->error = get_error_code();
+			stop_connect(connect_data);
+			continue;
+		}
+		// This returns EWOULDBLOCK (windows) or EINPROGRESS (linux) and we just
+		// need to wait for the socket to be writable...
+		if (::connect(connect_data->sd, (struct sockaddr *)&saddr, addr.addrlen) == 0) {
+			connect_data->error = 0;
+			connect_data->source_id = g_idle_add(on_connect_idle, connect_data);
+			return;
+		}
+		const int err = get_error_code();
+		if (err != EINPROGRESS && err != EWOULDBLOCK && err != EINTR) {
+			connect_data->error = err;
+			stop_connect(connect_data);
+			continue;
+		}
+		connect_data->error = 0;
+#ifdef _WIN32
+		connect_data->channel = g_io_channel_win32_new_socket(connect_data->sd);
+#else
+		connect_data->channel = g_io_channel_unix_new(connect_data->sd);
+#endif
+		connect_data->source_id = g_io_add_watch(connect_data->channel,
+			GIOCondition(G_IO_OUT | G_IO_ERR | G_IO_HUP), on_connect_event, connect_data);
+		connect_data->timeout_id = g_timeout_add_seconds(CONNECT_TIMEOUT,
+			on_connect_timeout, connect_data);
+		return;
+	}
+	connect_data->source_id = g_idle_add(on_connect_idle, connect_data);
 }
 
-gboolean Socket::connect_main_thread_cb(gpointer data)
+/* Close the socket being connected and remove its sources. */
+void Socket::stop_connect(ConnectData *connect_data)
 {
-    ConnectData *connect_data = (ConnectData *)data;
-	connect_data->func(connect_data->data, connect_data->succeeded);
-    delete connect_data;
-    return FALSE;
+	if (connect_data->source_id) {
+		g_source_remove(connect_data->source_id);
+		connect_data->source_id = 0;
+	}
+	if (connect_data->timeout_id) {
+		g_source_remove(connect_data->timeout_id);
+		connect_data->timeout_id = 0;
+	}
+	if (connect_data->channel) {
+		g_io_channel_unref(connect_data->channel);
+		connect_data->channel = NULL;
+	}
+	if (connect_data->sd != -1) {
+		close(connect_data->sd);
+		connect_data->sd = -1;
+	}
 }
-    
+
+void Socket::cancel_connect(gpointer data)
+{
+	std::map<gpointer, ConnectData *>::iterator iter = connects.find(data);
+	if (iter != connects.end())
+		free_connect(iter->second);
+}
+
+gboolean Socket::on_connect_event(GIOChannel *, GIOCondition, gpointer data)
+{
+	ConnectData *connect_data = (ConnectData *)data;
+	int error = 0;
+#if defined(_WIN32)
+	int
+#else
+	socklen_t
+#endif
+		len = sizeof(error);
+	if (getsockopt(connect_data->sd, SOL_SOCKET, SO_ERROR, (char *)&error, &len) != 0)
+		error = get_error_code();
+	connect_data->error = error;
+	/* the watch is removed by returning FALSE */
+	connect_data->source_id = 0;
+	finish_connect(connect_data);
+	return FALSE;
+}
+
+gboolean Socket::on_connect_idle(gpointer data)
+{
+	ConnectData *connect_data = (ConnectData *)data;
+	connect_data->source_id = 0;
+	finish_connect(connect_data);
+	return FALSE;
+}
+
+gboolean Socket::on_connect_timeout(gpointer data)
+{
+	ConnectData *connect_data = (ConnectData *)data;
+	connect_data->timeout_id = 0;
+	connect_data->error = ETIMEDOUT;
+	finish_connect(connect_data);
+	return FALSE;
+}
+
+/* On failure the next address is tried, func is called when there is none. */
+void Socket::finish_connect(ConnectData *connect_data)
+{
+	if (connect_data->error && connect_data->sd != -1
+		&& connect_data->addr_index + 1 < connect_data->addrs.size()) {
+		stop_connect(connect_data);
+		connect_data->addr_index++;
+		start_connect(connect_data);
+		return;
+	}
+	gpointer data = connect_data->data;
+	on_connected_func func = connect_data->func;
+	const int error = connect_data->error;
+	int sd = -1;
+	if (!error && connect_data->sd != -1) {
+		/* the caller owns the socket now */
+		sd = connect_data->sd;
+		connect_data->sd = -1;
+	}
+	free_connect(connect_data);
+	if (error)
+		set_error_code(error);
+	func(data, sd);
+}
+
+void Socket::free_connect(ConnectData *connect_data)
+{
+	stop_connect(connect_data);
+	connects.erase(connect_data->data);
+	delete connect_data;
+}
+
 // Read available text from the specified socket. Returns false on error.
 bool Socket::nb_read(int fd, std::string& s, bool *eof)
 {
@@ -22,19 +22,31 @@
 
 #include <glib.h>
 #include <string>
+#include <list>
 #include <map>
+#include <vector>
 #ifndef _WIN32
+#  include <sys/types.h>
+#  include <sys/socket.h>
 #  include <netdb.h>
 #else
-#  include <WinSock.h>
-typedef unsigned long in_addr_t;
+#  include <winsock2.h>
+#  include <ws2tcpip.h>
 #endif
 
+//! An IPv4 or IPv6 address of a host.
+struct SocketAddress {
+	struct sockaddr_storage addr;
+	socklen_t addrlen;
+};
+//! All addresses of a host, in the order getaddrinfo() prefers them.
+typedef std::vector<SocketAddress> SocketAddressList;
+
 //! A platform-independent socket API.
 class Socket {
 public:
 	//! Creates a stream (TCP) socket. Returns -1 on failure.
-	static int socket();
+	static int socket(int family = AF_INET);
 
 	//! Closes a socket.
 	static void close(int socket);
@@ -63,13 +75,22 @@ public:
 	//! Accept a client connection request
 	static int accept(int socket);
 
-	typedef void (*on_resolved_func)(gpointer data, bool resolved, in_addr_t sa);
-	static void resolve(std::string& host, gpointer data, on_resolved_func func);
-
-	//! Connect a socket to a server (from a client)
-	typedef void (*on_connected_func)(gpointer data, bool succeeded);
-	static void connect(int socket, in_addr_t sa, int port, gpointer data, on_connected_func func);
-
+	//! Resolve the host in a pool of threads, func is called in the main loop,
+	//! at once if the host was resolved a short time ago. addrs is valid
+	//! during the call and is not empty if resolved.
+	typedef void (*on_resolved_func)(gpointer data, bool resolved, const SocketAddressList *addrs);
+	static void resolve(const std::string& host, gpointer data, on_resolved_func func);
+	//! func is not called for data any more.
+	static void cancel_resolve(gpointer data);
+
+	//! Connect to a server (from a client). The addresses are tried in turn
+	//! till a connection is made, func is called in the main loop with the
+	//! connected non-blocking socket or with -1 if all have failed.
+	typedef void (*on_connected_func)(gpointer data, int socket);
+	static void connect(const SocketAddressList &addrs, int port, gpointer data, on_connected_func func);
+	//! func is not called for data any more, the socket being connected
+	//! is closed.
+	static void cancel_connect(gpointer data);
 
 	//! Returns last errno
 	static int get_error_code();
@@ -77,26 +98,53 @@ public:
 	//! Returns message corresponding to last error
 	static std::string get_error_msg();
 private:
-	struct DnsQueryData {
-		std::string host;
+	static void set_error_code(int error);
+
+	struct DnsWaiter {
 		gpointer data;
 		on_resolved_func func;
+	};
+	struct DnsQueryData {
+		std::string host;
+		std::list<DnsWaiter> waiters;
 		bool resolved;
-		in_addr_t sa;
-    };
-    static gpointer dns_thread(gpointer data);
-    static gboolean dns_main_thread_cb(gpointer data);
-	static std::map<std::string, in_addr_t> dns_map;
+		SocketAddressList addrs;
+	};
+	struct DnsCacheEntry {
+		SocketAddressList addrs;
+		/* g_get_monotonic_time() */
+		gint64 expires;
+	};
+	static void dns_worker(gpointer data, gpointer user_data);
+	static gboolean dns_main_thread_cb(gpointer data);
+	static GThreadPool *dns_pool;
+	static std::map<std::string, DnsCacheEntry> dns_map;
+	/* queries in the pool by host, the waiters of a host share its query */
+	static std::map<std::string, DnsQueryData *> dns_queries;
+
 	struct ConnectData {
-		int sd;
-		in_addr_t sa;
+		SocketAddressList addrs;
+		/* the address being tried */
+		size_t addr_index;
 		int port;
+		/* the socket being connected, -1 if none */
+		int sd;
 		gpointer data;
 		on_connected_func func;
-		bool succeeded;
-    };
-    static gpointer connect_thread(gpointer data);
-    static gboolean connect_main_thread_cb(gpointer data);
+		GIOChannel *channel;
+		guint source_id;
+		guint timeout_id;
+		int error;
+	};
+	static void start_connect(ConnectData *connect_data);
+	static void stop_connect(ConnectData *connect_data);
+	static gboolean on_connect_event(GIOChannel *, GIOCondition, gpointer);
+	static gboolean on_connect_idle(gpointer data);
+	static gboolean on_connect_timeout(gpointer data);
+	static void finish_connect(ConnectData *connect_data);
+	static void free_connect(ConnectData *connect_data);
+	/* by data */
+	static std::map<gpointer, ConnectData *> connects;
 };
 
 
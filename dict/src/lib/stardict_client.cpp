@@ -46,6 +46,11 @@
 #define CODE_DENIED                  521
 #define CODE_DICTMASK_NOTSET         522
 
+/* commands written ahead of their replies */
+static const size_t MAX_PIPELINED_COMMANDS = 8;
+/* default idle timeout of the connection, in seconds */
+static const guint DEFAULT_IDLE_TIMEOUT = 30;
+
 unsigned int STARDICT::Cmd::next_seq = 1;
 
 sigc::signal<void, const char *> StarDictClient::on_error_;
@@ -173,6 +178,22 @@ STARDICT::Cmd::Cmd(int cmd, ...)
 		this->lookup_response = NULL;
 		break;
 	}
+	case CMD_BATCH_QUERY:
+	{
+		int all = va_arg( ap, int );
+		const std::vector<std::string> *words = va_arg( ap, const std::vector<std::string> * );
+		std::string line = all ? "batchquery all" : "batchquery first";
+		for (size_t i = 0; i < words->size(); i++) {
+			std::string earg;
+			arg_escape(earg, (*words)[i].c_str());
+			line += ' ';
+			line += earg;
+		}
+		line += '\n';
+		this->data = g_strdup(line.c_str());
+		this->lookup_response = NULL;
+		break;
+	}
 	case CMD_DEFINE:
 	{
 		std::string earg;
@@ -325,7 +346,7 @@ STARDICT::Cmd::~Cmd()
     } else {
         g_free(this->data);
     }
-    if (this->command == CMD_LOOKUP || this->command == CMD_DEFINE || this->command == CMD_SELECT_QUERY || this->command == CMD_SMART_QUERY) {
+    if (this->command == CMD_LOOKUP || this->command == CMD_DEFINE || this->command == CMD_SELECT_QUERY || this->command == CMD_SMART_QUERY || this->command == CMD_BATCH_QUERY) {
         delete this->lookup_response;
     } else if (this->command == CMD_PREVIOUS || this->command == CMD_NEXT) {
         if (this->wordlist_response) {
@@ -337,111 +358,86 @@ STARDICT::Cmd::~Cmd()
     }
 }
 
-StarDictCache::StarDictCache()
+/* the most bytes of cached replies */
+static const size_t STR_CACHE_SIZE = 256 * 1024;
+static const size_t LOOKUP_RESPONSE_CACHE_SIZE = 4 * 1024 * 1024;
+
+static void free_lookup_response(gpointer data)
 {
-    str_pool.resize(str_pool_size);
-    for (size_t i = 0; i< str_pool_size; i++) {
-        str_pool[i] = NULL;
-    }
-    cur_str_pool_pos = 0;
+    delete static_cast<STARDICT::LookupResponse *>(data);
+}
 
-    lookup_response_pool.resize(lookup_response_pool_size);
-    for (size_t i = 0; i< lookup_response_pool_size; i++) {
-        lookup_response_pool[i] = NULL;
+/* Approximate size of the response in memory. */
+static size_t lookup_response_size(const STARDICT::LookupResponse *lookup_response)
+{
+    const STARDICT::LookupResponse::DictResponse &dict_response = lookup_response->dict_response;
+    size_t size = sizeof(*lookup_response);
+    if (dict_response.oword)
+        size += strlen(dict_response.oword);
+    for (std::list<STARDICT::LookupResponse::DictResponse::DictResult *>::const_iterator i = dict_response.dict_result_list.begin(); i != dict_response.dict_result_list.end(); ++i) {
+        size += sizeof(**i) + strlen((*i)->bookname);
+        for (std::list<STARDICT::LookupResponse::DictResponse::DictResult::WordResult *>::const_iterator j = (*i)->word_result_list.begin(); j != (*i)->word_result_list.end(); ++j) {
+            size += sizeof(**j) + strlen((*j)->word);
+            for (std::list<char *>::const_iterator k = (*j)->datalist.begin(); k != (*j)->datalist.end(); ++k)
+                size += sizeof(guint32) + get_uint32(*k);
+        }
+    }
+    if (lookup_response->listtype == STARDICT::LookupResponse::ListType_List) {
+        for (std::list<char *>::const_iterator i = lookup_response->wordlist->begin(); i != lookup_response->wordlist->end(); ++i)
+            size += strlen(*i) + 1;
+    } else if (lookup_response->listtype == STARDICT::LookupResponse::ListType_Tree) {
+        for (std::list<STARDICT::LookupResponse::WordTreeElement *>::const_iterator i = lookup_response->wordtree->begin(); i != lookup_response->wordtree->end(); ++i) {
+            size += sizeof(**i) + strlen((*i)->bookname);
+            for (std::list<char *>::const_iterator j = (*i)->wordlist.begin(); j != (*i)->wordlist.end(); ++j)
+                size += strlen(*j) + 1;
+        }
     }
-    cur_lookup_response_pool_pos = 0;
+    return size;
 }
 
-StarDictCache::~StarDictCache()
+StarDictCache::StarDictCache()
+:
+    str_cache("StarDict server string", STR_CACHE_SIZE, g_free),
+    lookup_response_cache("StarDict server lookup", LOOKUP_RESPONSE_CACHE_SIZE, free_lookup_response)
 {
-    clean_all_cache();
 }
 
 void StarDictCache::clean_all_cache()
 {
-    for (std::vector<StrElement *>::iterator i = str_pool.begin(); i != str_pool.end(); ++i) {
-        if (*i) {
-            g_free((*i)->data);
-            delete *i;
-            *i = NULL;
-        }
-    }
+    str_cache.clear();
     clean_cache_lookup_response();
 }
 
 void StarDictCache::clean_cache_lookup_response()
 {
-    for (std::vector<LookupResponseElement *>::iterator i = lookup_response_pool.begin(); i != lookup_response_pool.end(); ++i) {
-        if (*i) {
-            delete ((*i)->lookup_response);
-            delete *i;
-            *i = NULL;
-        }
-    }
+    lookup_response_cache.clear();
 }
 
 char *StarDictCache::get_cache_str(const char *key_str)
 {
-    for (std::vector<StrElement *>::iterator i = str_pool.begin(); i != str_pool.end(); ++i) {
-        if (*i) {
-            if ((*i)->key == key_str)
-                return (*i)->data;
-        }
-    }
-    return NULL;
+    return static_cast<char *>(str_cache.lookup(key_str));
 }
 
 STARDICT::LookupResponse *StarDictCache::get_cache_lookup_response(const char *key_str)
 {
-    for (std::vector<LookupResponseElement *>::iterator i = lookup_response_pool.begin(); i != lookup_response_pool.end(); ++i) {
-        if (*i) {
-            if ((*i)->key == key_str)
-                return (*i)->lookup_response;
-        }
-    }
-    return NULL;
+    return static_cast<STARDICT::LookupResponse *>(lookup_response_cache.lookup(key_str));
 }
 
 void StarDictCache::clean_cache_str(const char *key_str)
 {
-    for (std::vector<StrElement *>::iterator i = str_pool.begin(); i != str_pool.end(); ++i) {
-        if (*i) {
-            if ((*i)->key == key_str) {
-                g_free((*i)->data);
-                delete *i;
-                *i = NULL;
-                //return;
-            }
-        }
-    }
+    str_cache.remove(key_str);
 }
 
 void StarDictCache::save_cache_str(const char *key_str, char *data)
 {
-    if (str_pool[cur_str_pool_pos]) {
-        g_free(str_pool[cur_str_pool_pos]->data);
-        delete str_pool[cur_str_pool_pos];
-    }
-    str_pool[cur_str_pool_pos] = new StrElement();
-    str_pool[cur_str_pool_pos]->key = key_str;
-    str_pool[cur_str_pool_pos]->data = data;
-    cur_str_pool_pos++;
-    if (cur_str_pool_pos == str_pool_size)
-        cur_str_pool_pos = 0;
+    str_cache.store(key_str, data, strlen(data) + 1, true);
 }
 
 void StarDictCache::save_cache_lookup_response(const char *key_str, STARDICT::LookupResponse *lookup_response)
 {
-    if (lookup_response_pool[cur_lookup_response_pool_pos]) {
-        delete lookup_response_pool[cur_lookup_response_pool_pos]->lookup_response;
-        delete lookup_response_pool[cur_lookup_response_pool_pos];
-    }
-    lookup_response_pool[cur_lookup_response_pool_pos] = new LookupResponseElement();
-    lookup_response_pool[cur_lookup_response_pool_pos]->key = key_str;
-    lookup_response_pool[cur_lookup_response_pool_pos]->lookup_response = lookup_response;
-    cur_lookup_response_pool_pos++;
-    if (cur_lookup_response_pool_pos == lookup_response_pool_size)
-        cur_lookup_response_pool_pos = 0;
+    lookup_response_cache.store(key_str, lookup_response,
+        lookup_response_size(lookup_response),
+        !lookup_response->dict_response.dict_result_list.empty());
 }
 
 StarDictClient::StarDictClient()
@@ -451,6 +447,11 @@ StarDictClient::StarDictClient()
     in_source_id_ = 0;
     out_source_id_ = 0;
     is_connected_ = false;
+    connecting_ = false;
+    sent_count_ = 0;
+    idle_timeout_ = DEFAULT_IDLE_TIMEOUT;
+    idle_source_id_ = 0;
+    retried_ = false;
 }
 
 StarDictClient::~StarDictClient()
@@ -463,8 +464,9 @@ void StarDictClient::set_server(const char *host, int port)
     if (host_ != host || port_ != port) {
         host_ = host;
         port_ = port;
-	host_resolved = false;
         clean_all_cache();
+        /* the connection is to the old server */
+        disconnect();
     }
 }
 
@@ -474,17 +476,24 @@ void StarDictClient::set_auth(const char *user, const char *md5passwd)
         user_ = user;
         md5passwd_ = md5passwd;
         clean_all_cache();
+        /* logged in as the old user */
+        disconnect();
     }
 }
 
+void StarDictClient::set_idle_timeout(guint seconds)
+{
+    idle_timeout_ = seconds;
+}
+
 bool StarDictClient::try_cache(STARDICT::Cmd *c)
 {
-    if (c->command == STARDICT::CMD_LOOKUP || c->command == STARDICT::CMD_DEFINE || c->command == STARDICT::CMD_SELECT_QUERY || c->command == STARDICT::CMD_SMART_QUERY) {
+    if (c->command == STARDICT::CMD_LOOKUP || c->command == STARDICT::CMD_DEFINE || c->command == STARDICT::CMD_SELECT_QUERY || c->command == STARDICT::CMD_SMART_QUERY || c->command == STARDICT::CMD_BATCH_QUERY) {
         STARDICT::LookupResponse *res = get_cache_lookup_response(c->data);
         if (res) {
             if (c->command == STARDICT::CMD_LOOKUP || c->command == STARDICT::CMD_DEFINE)
                 on_lookup_end_.emit(res, 0);
-            else if (c->command == STARDICT::CMD_SELECT_QUERY || c->command == STARDICT::CMD_SMART_QUERY)
+            else
                 on_floatwin_lookup_end_.emit(res, 0);
             delete c;
             return true;
@@ -524,30 +533,13 @@ bool StarDictClient::try_cache(STARDICT::Cmd *c)
 
 void StarDictClient::send_commands(int num, ...)
 {
-    STARDICT::Cmd *c;
-    if (!is_connected_) {
-#ifdef _WIN32
-        c = new STARDICT::Cmd(STARDICT::CMD_CLIENT, "StarDict Windows");
-#else
-        c = new STARDICT::Cmd(STARDICT::CMD_CLIENT, "StarDict Linux");
-#endif
-        cmdlist.push_back(c);
-        if (!user_.empty() && !md5passwd_.empty()) {
-            c = new STARDICT::Cmd(STARDICT::CMD_AUTH, user_.c_str(), md5passwd_.c_str());
-            cmdlist.push_back(c);
-        }
-    }
+    std::list<STARDICT::Cmd *> send_cmdlist;
     va_list    ap;
     va_start( ap, num);
-    for (int i = 0; i< num; i++) {
-        c = va_arg( ap, STARDICT::Cmd *);
-	    cmdlist.push_back(c);
-    }
+    for (int i = 0; i< num; i++)
+        send_cmdlist.push_back(va_arg( ap, STARDICT::Cmd *));
     va_end( ap );
-    if (!is_connected_) {
-        waiting_banner_ = true;
-        connect();
-    }
+    queue_commands(send_cmdlist);
 }
 
 void StarDictClient::try_cache_or_send_commands(int num, ...)
@@ -565,29 +557,80 @@ void StarDictClient::try_cache_or_send_commands(int num, ...)
     va_end( ap );
     if (send_cmdlist.empty())
         return;
+    queue_commands(send_cmdlist);
+}
 
-    if (!is_connected_) {
-#ifdef _WIN32
-        c = new STARDICT::Cmd(STARDICT::CMD_CLIENT, "StarDict Windows");
-#else
-        c = new STARDICT::Cmd(STARDICT::CMD_CLIENT, "StarDict Linux");
-#endif
-        cmdlist.push_back(c);
-        if (!user_.empty() && !md5passwd_.empty()) {
-            c = new STARDICT::Cmd(STARDICT::CMD_AUTH, user_.c_str(), md5passwd_.c_str());
-            cmdlist.push_back(c);
+/* The main window shows the reply to the last lookup, the floating window
+ * the reply to the last query. Returns 0 for other commands. */
+static int lookup_target(int command)
+{
+    switch (command) {
+        case STARDICT::CMD_LOOKUP:
+        case STARDICT::CMD_DEFINE:
+            return 1;
+        case STARDICT::CMD_SELECT_QUERY:
+        case STARDICT::CMD_SMART_QUERY:
+        case STARDICT::CMD_BATCH_QUERY:
+            return 2;
+        default:
+            return 0;
+    }
+}
+
+void StarDictClient::cancel_superseded(const STARDICT::Cmd *c)
+{
+    const int target = lookup_target(c->command);
+    if (target == 0)
+        return;
+    std::list<STARDICT::Cmd *>::iterator i = cmdlist.begin();
+    for (size_t n = 0; n < sent_count_; n++)
+        ++i;
+    while (i != cmdlist.end()) {
+        if (lookup_target((*i)->command) == target) {
+            delete *i;
+            i = cmdlist.erase(i);
+        } else {
+            ++i;
         }
     }
-    for (std::list<STARDICT::Cmd *>::iterator i = send_cmdlist.begin(); i!= send_cmdlist.end(); ++i) {
-	    cmdlist.push_back(*i);
+}
+
+void StarDictClient::queue_commands(std::list<STARDICT::Cmd *> &cmds)
+{
+    for (std::list<STARDICT::Cmd *>::iterator i = cmds.begin(); i != cmds.end(); ++i) {
+        cancel_superseded(*i);
+        cmdlist.push_back(*i);
     }
-    if (!is_connected_) {
-        waiting_banner_ = true;
-        connect();
+    if (idle_source_id_) {
+        g_source_remove(idle_source_id_);
+        idle_source_id_ = 0;
     }
+    if (is_connected_) {
+        /* otherwise they are written when the banner comes */
+        if (!waiting_banner_)
+            write_commands();
+        return;
+    }
+    if (connecting_)
+        return;
+    STARDICT::Cmd *c;
+    if (!user_.empty() && !md5passwd_.empty()) {
+        c = new STARDICT::Cmd(STARDICT::CMD_AUTH, user_.c_str(), md5passwd_.c_str());
+        cmdlist.push_front(c);
+    }
+#ifdef _WIN32
+    c = new STARDICT::Cmd(STARDICT::CMD_CLIENT, "StarDict Windows");
+#else
+    c = new STARDICT::Cmd(STARDICT::CMD_CLIENT, "StarDict Linux");
+#endif
+    cmdlist.push_front(c);
+    sent_count_ = 0;
+    connecting_ = true;
+    waiting_banner_ = true;
+    connect();
 }
 
-void StarDictClient::write_str(const char *str, GError **err)
+bool StarDictClient::write_str(const char *str, GError **err)
 {
     int len = strlen(str);
     int left_byte = len;
@@ -597,25 +640,43 @@ void StarDictClient::write_str(const char *str, GError **err)
         res = g_io_channel_write_chars(channel_, str+(len - left_byte), left_byte, &bytes_written, err);
         if (res == G_IO_STATUS_ERROR) {
             disconnect();
-            return;
+            return false;
         }
         left_byte -= bytes_written;
     }
     res = g_io_channel_flush(channel_, err);
     if (res == G_IO_STATUS_ERROR) {
         disconnect();
+        return false;
     }
 	if (out_source_id_ == 0)
 		out_source_id_ = g_io_add_watch(channel_, GIOCondition(G_IO_OUT), on_io_out_event, this);
+    return true;
 }
 
-void StarDictClient::request_command()
+void StarDictClient::write_commands()
 {
-    reading_type_ = READ_LINE;
-    if (cmdlist.empty()) {
-        cmdlist.push_back(new STARDICT::Cmd(STARDICT::CMD_QUIT));
+    std::list<STARDICT::Cmd *>::iterator i = cmdlist.begin();
+    for (size_t n = 0; n < sent_count_; n++) {
+        /* the server closes the connection after quit, the rest is sent
+         * over the next one */
+        if ((*i)->command == STARDICT::CMD_QUIT)
+            return;
+        ++i;
+    }
+    while (i != cmdlist.end() && sent_count_ < MAX_PIPELINED_COMMANDS) {
+        STARDICT::Cmd *c = *i;
+        ++i;
+        sent_count_++;
+        /* cmdlist is cleaned on error */
+        if (!write_command(c))
+            return;
     }
-    STARDICT::Cmd *c = cmdlist.front();
+}
+
+bool StarDictClient::write_command(STARDICT::Cmd *c)
+{
+    GError *err = NULL;
 	switch (c->command) {
         case STARDICT::CMD_AUTH:
 		{
@@ -634,29 +695,81 @@ void StarDictClient::request_command()
 			arg_escape(earg1, c->auth->user.c_str());
 			arg_escape(earg2, hex);
 			char *data = g_strdup_printf("auth %s %s\n", earg1.c_str(), earg2.c_str());
-            GError *err = NULL;
             write_str(data, &err);
 			g_free(data);
-			if (err) {
-                on_error_.emit(err->message);
-                g_error_free(err);
-				return;
-			}
 			break;
 		}
 		default:
-        {
-            GError *err = NULL;
             write_str(c->data, &err);
-			if (err) {
-                on_error_.emit(err->message);
-                g_error_free(err);
-				return;
-            }
 			break;
-        }
 	}
-	return;
+    if (err) {
+        on_error_.emit(err->message);
+        g_error_free(err);
+        return false;
+    }
+	return true;
+}
+
+/* The reply to the first command is read. */
+void StarDictClient::on_command_done()
+{
+    delete cmdlist.front();
+    cmdlist.pop_front();
+    sent_count_--;
+    retried_ = false;
+    reading_type_ = READ_LINE;
+    if (!cmdlist.empty()) {
+        write_commands();
+    } else if (idle_timeout_ == 0) {
+        cmdlist.push_back(new STARDICT::Cmd(STARDICT::CMD_QUIT));
+        write_commands();
+    } else {
+        idle_source_id_ = g_timeout_add_seconds(idle_timeout_, on_idle_timeout, this);
+    }
+}
+
+gboolean StarDictClient::on_idle_timeout(gpointer data)
+{
+    StarDictClient *stardict_client = static_cast<StarDictClient *>(data);
+    stardict_client->idle_source_id_ = 0;
+    if (stardict_client->cmdlist.empty()) {
+        stardict_client->cmdlist.push_back(new STARDICT::Cmd(STARDICT::CMD_QUIT));
+        stardict_client->write_commands();
+    }
+    return FALSE;
+}
+
+/* Close the connection, the commands without reply are sent again over a
+ * new connection. */
+void StarDictClient::reconnect()
+{
+    std::list<STARDICT::Cmd *> pending;
+    for (std::list<STARDICT::Cmd *>::iterator i=cmdlist.begin(); i!=cmdlist.end(); ++i) {
+        STARDICT::Cmd *c = *i;
+        if (c->command == STARDICT::CMD_CLIENT || c->command == STARDICT::CMD_AUTH || c->command == STARDICT::CMD_QUIT) {
+            delete c;
+            continue;
+        }
+        /* drop a partly read reply */
+        c->reading_status = 0;
+        if (lookup_target(c->command) != 0) {
+            delete c->lookup_response;
+            c->lookup_response = NULL;
+        } else if (c->command == STARDICT::CMD_PREVIOUS || c->command == STARDICT::CMD_NEXT) {
+            if (c->wordlist_response) {
+                for (std::list<char *>::iterator j = c->wordlist_response->begin(); j != c->wordlist_response->end(); ++j)
+                    g_free(*j);
+                delete c->wordlist_response;
+                c->wordlist_response = NULL;
+            }
+        }
+        pending.push_back(c);
+    }
+    cmdlist.clear();
+    disconnect();
+    if (!pending.empty())
+        queue_commands(pending);
 }
 
 void StarDictClient::clean_command()
@@ -665,18 +778,15 @@ void StarDictClient::clean_command()
 		delete *i;
 	}
 	cmdlist.clear();
+	sent_count_ = 0;
 }
 
 void StarDictClient::connect()
 {
-    if (host_resolved) {
-	    on_resolved(this, true, sa);
-    } else {
-        Socket::resolve(host_, this, on_resolved);
-    }
+    Socket::resolve(host_, this, on_resolved);
 }
 
-void StarDictClient::on_resolved(gpointer data, bool resolved, in_addr_t sa_)
+void StarDictClient::on_resolved(gpointer data, bool resolved, const SocketAddressList *addrs)
 {
     StarDictClient *oStarDictClient = (StarDictClient *)data;
     if (!resolved) {
@@ -688,28 +798,17 @@ void StarDictClient::on_resolved(gpointer data, bool resolved, in_addr_t sa_)
         	on_error_.emit(mes);
 	        g_free(mes);
 	}
+        oStarDictClient->disconnect();
         return;
     }
 
-    if (oStarDictClient->host_resolved == false) {
-            oStarDictClient->sa = sa_;
-	    oStarDictClient->host_resolved = true;
-    }
-
-    oStarDictClient->sd_ = Socket::socket();
-
-    if (oStarDictClient->sd_ == -1) {
-        std::string str = "Can not create socket: " + Socket::get_error_msg();
-        on_error_.emit(str.c_str());
-        return;
-    }
-    Socket::connect(oStarDictClient->sd_, sa_, oStarDictClient->port_, oStarDictClient, on_connected);
+    Socket::connect(*addrs, oStarDictClient->port_, oStarDictClient, on_connected);
 }
 
-void StarDictClient::on_connected(gpointer data, bool succeeded)
+void StarDictClient::on_connected(gpointer data, int socket)
 {
     StarDictClient *oStarDictClient = (StarDictClient *)data;
-    if (!succeeded) {
+    if (socket == -1) {
 	static bool showed_once = false;
 	if (!showed_once) {
 		showed_once = true;
@@ -718,8 +817,10 @@ void StarDictClient::on_connected(gpointer data, bool succeeded)
         	on_error_.emit(mes);
 	        g_free(mes);
 	}
+        oStarDictClient->disconnect();
         return;
     }
+    oStarDictClient->sd_ = socket;
 #ifdef _WIN32
     oStarDictClient->channel_ = g_io_channel_win32_new_socket(oStarDictClient->sd_);
 #else
@@ -740,9 +841,11 @@ void StarDictClient::on_connected(gpointer data, bool succeeded)
         on_error_.emit(str);
         g_free(str);
         g_error_free(err);
+        oStarDictClient->disconnect();
         return;
     }
 
+    oStarDictClient->connecting_ = false;
     oStarDictClient->is_connected_ = true;
     oStarDictClient->waiting_banner_ = true;
     oStarDictClient->reading_type_ = READ_LINE;
@@ -760,17 +863,36 @@ void StarDictClient::disconnect()
         g_source_remove(out_source_id_);
         out_source_id_ = 0;
     }
+    if (idle_source_id_) {
+        g_source_remove(idle_source_id_);
+        idle_source_id_ = 0;
+    }
 
     if (channel_) {
         g_io_channel_shutdown(channel_, TRUE, NULL);
         g_io_channel_unref(channel_);
         channel_ = NULL;
     }
+    Socket::cancel_resolve(this);
+    Socket::cancel_connect(this);
 	if (sd_ != -1) {
 		Socket::close(sd_);
 		sd_ = -1;
 	}
     is_connected_ = false;
+    connecting_ = false;
+}
+
+/* The connection is lost while reading. The server may have closed an idle
+ * connection just as commands were written, they are sent once more. */
+void StarDictClient::on_read_failed()
+{
+    if (!cmdlist.empty() && !retried_) {
+        retried_ = true;
+        reconnect();
+    } else {
+        disconnect();
+    }
 }
 
 gboolean StarDictClient::on_io_out_event(GIOChannel *ch, GIOCondition cond,
@@ -804,7 +926,7 @@ gboolean StarDictClient::on_io_in_event(GIOChannel *ch, GIOCondition cond,
                     stardict_client->host_.c_str(), stardict_client->port_);
         on_error_.emit(mes);
         g_free(mes);*/
-        stardict_client->disconnect();
+        stardict_client->on_read_failed();
         return FALSE;
     }
     GError *err = NULL;
@@ -826,7 +948,7 @@ gboolean StarDictClient::on_io_in_event(GIOChannel *ch, GIOCondition cond,
                     g_free(str);
                     g_error_free(err);
                 }
-                stardict_client->disconnect();
+                stardict_client->on_read_failed();
 
                 return FALSE;
             }
@@ -850,7 +972,7 @@ gboolean StarDictClient::on_io_in_event(GIOChannel *ch, GIOCondition cond,
                     g_free(str);
                     g_error_free(err);
                 }
-                stardict_client->disconnect();
+                stardict_client->on_read_failed();
 
                 return FALSE;
             }
@@ -866,6 +988,9 @@ gboolean StarDictClient::on_io_in_event(GIOChannel *ch, GIOCondition cond,
             stardict_client->disconnect();
             return FALSE;
         }
+        /* the reply to quit closed the connection */
+        if (stardict_client->channel_ != ch)
+            return FALSE;
     }
 
     return TRUE;
@@ -1127,7 +1252,7 @@ int StarDictClient::parse_dict_result(STARDICT::Cmd* cmd, gchar *buf)
                 save_cache_lookup_response(cmd->data, cmd->lookup_response);
                 cmd->lookup_response = NULL;
                 return 1;
-            } else if ( cmd->command == STARDICT::CMD_SELECT_QUERY || cmd->command == STARDICT::CMD_SMART_QUERY) {
+            } else if ( cmd->command == STARDICT::CMD_SELECT_QUERY || cmd->command == STARDICT::CMD_SMART_QUERY || cmd->command == STARDICT::CMD_BATCH_QUERY) {
                 on_floatwin_lookup_end_.emit(cmd->lookup_response, cmd->seq);
                 save_cache_lookup_response(cmd->data, cmd->lookup_response);
                 cmd->lookup_response = NULL;
@@ -1233,9 +1358,13 @@ bool StarDictClient::parse(gchar *line)
         g_free(line);
         if (!result)
             return false;
-        request_command();
+        write_commands();
         return true;
     }
+    if (cmdlist.empty()) {
+        g_free(line);
+        return false;
+    }
     STARDICT::Cmd* cmd = cmdlist.front();
     switch (cmd->command) {
         case STARDICT::CMD_CLIENT:
@@ -1269,6 +1398,7 @@ bool StarDictClient::parse(gchar *line)
         case STARDICT::CMD_LOOKUP:
         case STARDICT::CMD_SELECT_QUERY:
         case STARDICT::CMD_SMART_QUERY:
+        case STARDICT::CMD_BATCH_QUERY:
             result = parse_dict_result(cmd, line);
             break;
         case STARDICT::CMD_PREVIOUS:
@@ -1290,12 +1420,10 @@ bool StarDictClient::parse(gchar *line)
     if (result == 0)
         return false;
     if (result == 1) {
-        delete cmd;
-        cmdlist.pop_front();
-        if (cmdlist.empty()) {
-            cmdlist.push_back(new STARDICT::Cmd(STARDICT::CMD_QUIT));
-        }
-        request_command();
+        if (cmd->command == STARDICT::CMD_QUIT)
+            reconnect();
+        else
+            on_command_done();
     }
     return true;
 }
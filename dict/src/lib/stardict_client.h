@@ -22,16 +22,15 @@
 
 #include <glib.h>
 #include <list>
+#include <string>
 #include <vector>
 
-#ifndef _WIN32
-#  include <netdb.h>
-#else
-typedef unsigned long in_addr_t;
-#endif
-
 #include "stardict-sigc++.h"
+#include "netcache.h"
+
 
+struct SocketAddress;
+typedef std::vector<SocketAddress> SocketAddressList;
 
 namespace STARDICT {
 	enum {
@@ -43,6 +42,7 @@ namespace STARDICT {
 		//CMD_QUERY,
 		CMD_SELECT_QUERY,
 		CMD_SMART_QUERY,
+		CMD_BATCH_QUERY,
 		CMD_DEFINE,
 		CMD_REGISTER,
 		//CMD_CHANGE_PASSWD,
@@ -125,10 +125,10 @@ namespace STARDICT {
 	};
 };
 
+/* Replies of the server, see NetCache. */
 class StarDictCache {
 public:
 	StarDictCache();
-	~StarDictCache();
 	char *get_cache_str(const char *key);
 	void save_cache_str(const char *key, char *str);
 	void clean_cache_str(const char *key);
@@ -137,21 +137,9 @@ public:
 	void clean_cache_lookup_response();
 	void clean_all_cache();
 private:
-	static const unsigned int str_pool_size = 30;
-	size_t cur_str_pool_pos;
-	struct StrElement {
-		std::string key;
-		char *data;
-	};
-	std::vector<StrElement *> str_pool;
-
-	static const unsigned int lookup_response_pool_size = 60;
-	size_t cur_lookup_response_pool_pos;
-	struct LookupResponseElement {
-		std::string key;
-		struct STARDICT::LookupResponse *lookup_response;
-	};
-	std::vector<LookupResponseElement *> lookup_response_pool;
+	/* info, dict mask and other string replies */
+	NetCache str_cache;
+	NetCache lookup_response_cache;
 };
 
 class StarDictClient : private StarDictCache {
@@ -173,7 +161,14 @@ public:
 
 	void set_server(const char *host, int port = 2628);
 	void set_auth(const char *user, const char *md5passwd);
+	/* The connection is kept open for seconds after the last reply,
+	 * 0 - it is closed as soon as all commands are answered. */
+	void set_idle_timeout(guint seconds);
 	bool try_cache(STARDICT::Cmd *c);
+	/* Commands are written without waiting for the replies to the earlier
+	 * ones, the replies come in the same order. A queued lookup that is not
+	 * written yet is dropped when a newer lookup for the same window comes,
+	 * its seq never gets a reply then. */
 	void send_commands(int num, ...);
 	void try_cache_or_send_commands(int num, ...);
 private:
@@ -183,13 +178,20 @@ private:
 	guint out_source_id_;
 	std::string host_;
 	int port_;
-	bool host_resolved;
-	in_addr_t sa;
 	std::string user_;
 	std::string md5passwd_;
 	bool is_connected_;
+	/* resolving or connecting */
+	bool connecting_;
 	bool waiting_banner_;
+	/* commands waiting for replies, then commands not written yet */
 	std::list<STARDICT::Cmd *> cmdlist;
+	/* the number of written commands at the front of cmdlist */
+	size_t sent_count_;
+	guint idle_timeout_;
+	guint idle_source_id_;
+	/* the commands were sent again after the connection was lost */
+	bool retried_;
 	struct reply {
 		std::string daemonStamp;
 	} cmd_reply;
@@ -203,14 +205,21 @@ private:
 	gsize size_left;
 
 	void clean_command();
-	void request_command();
+	void queue_commands(std::list<STARDICT::Cmd *> &cmds);
+	void cancel_superseded(const STARDICT::Cmd *c);
+	void write_commands();
+	bool write_command(STARDICT::Cmd *c);
+	void on_command_done();
+	void reconnect();
+	void on_read_failed();
+	static gboolean on_idle_timeout(gpointer data);
 	void disconnect();
 	static gboolean on_io_in_event(GIOChannel *, GIOCondition, gpointer);
 	static gboolean on_io_out_event(GIOChannel *, GIOCondition, gpointer);
 	void connect();
-	static void on_resolved(gpointer data, bool resolved, in_addr_t sa);
-	static void on_connected(gpointer data, bool succeeded);
-	void write_str(const char *str, GError **err);
+	static void on_resolved(gpointer data, bool resolved, const SocketAddressList *addrs);
+	static void on_connected(gpointer data, int socket);
+	bool write_str(const char *str, GError **err);
 	bool parse(gchar *line);
 	int parse_banner(gchar *line);
 	int parse_command_client(gchar *line);
@@ -21,9 +21,11 @@
 #define _STARDICT_LIBCONFIG_H_
 
 //stardict
+#ifndef SD_SERVER_EDITION
 #define SD_STANDARD_EDITION
+#endif
 
-//stardictd
+//stardictd, libstardictd.la is built with -DSD_SERVER_EDITION
 //#define SD_SERVER_EDITION
 
 
@@ -36,6 +36,7 @@
 #include <memory>
 
 #include "ifo_file.h"
+#include "lib_index_cache.h"
 #include "edit-distance.h"
 //#include "kmp.h"
 #include "mapfile.h"
@@ -302,6 +303,17 @@ cache_file::~cache_file()
 
 #define OFFSETFILE_MAGIC_DATA "StarDict's oft file\nversion=2.4.8\n"
 #define COLLATIONFILE_MAGIC_DATA "StarDict's clt file\nversion=2.4.8\n"
+#define RHASHFILE_MAGIC_DATA "StarDict's rhash file\nversion=4.0.1\n"
+
+const gchar *cache_file::get_magic_data(void) const
+{
+	if (cachefiletype == CacheFileType_oft)
+		return OFFSETFILE_MAGIC_DATA;
+	else if (cachefiletype == CacheFileType_rhash)
+		return RHASHFILE_MAGIC_DATA;
+	else
+		return COLLATIONFILE_MAGIC_DATA;
+}
 
 MapFile* cache_file::find_and_load_cache_file(const gchar *filename,
 	const std::string &url, const std::string &saveurl,
@@ -319,17 +331,20 @@ MapFile* cache_file::find_and_load_cache_file(const gchar *filename,
 		return NULL;
 
 	gchar *p = mf->begin() + word_off_size;
-	gboolean has_prefix;
-	if (cachefiletype == CacheFileType_oft)
-		has_prefix = g_str_has_prefix(p, OFFSETFILE_MAGIC_DATA);
-	else
-		has_prefix = g_str_has_prefix(p, COLLATIONFILE_MAGIC_DATA);
-	if (!has_prefix)
+	if (cachefiletype != CacheFileType_rhash && is_index_cache(p)) {
+		/* made with the dictionary, see lib_index_cache.h */
+		stardict_stat_t idxstat;
+		if (g_stat(url.c_str(), &idxstat)!=0)
+			return NULL;
+		if (!check_index_cache(mf->begin(), cachestat.st_size,
+			filedatasize/sizeof(guint32), cltfunc, url, idxstat.st_size))
+			return NULL;
+		return mf.release();
+	}
+	const gchar *magic_data = get_magic_data();
+	if (!g_str_has_prefix(p, magic_data))
 		return NULL;
-	if (cachefiletype == CacheFileType_oft)
-		p+= sizeof(OFFSETFILE_MAGIC_DATA)-1-1;
-	else
-		p+= sizeof(COLLATIONFILE_MAGIC_DATA)-1-1;
+	p+= strlen(magic_data)-1;
 	gchar *p2;
 	p2 = strstr(p, "\nurl=");
 	if (!p2)
@@ -439,18 +454,11 @@ FILE* cache_file::find_and_open_for_overwrite_cache_file(const gchar *filename,
 		return fopen(filename, "wb");
 
 	gchar *p = mf.begin() + word_off_size;
-	bool has_prefix;
-	if (cachefiletype == CacheFileType_oft)
-		has_prefix = g_str_has_prefix(p, OFFSETFILE_MAGIC_DATA);
-	else
-		has_prefix = g_str_has_prefix(p, COLLATIONFILE_MAGIC_DATA);
-	if (!has_prefix) {
+	const gchar *magic_data = get_magic_data();
+	if (!g_str_has_prefix(p, magic_data)) {
 		return fopen(filename, "wb");
 	}
-	if (cachefiletype == CacheFileType_oft)
-		p+= sizeof(OFFSETFILE_MAGIC_DATA)-1-1;
-	else
-		p+= sizeof(COLLATIONFILE_MAGIC_DATA)-1-1;
+	p+= strlen(magic_data)-1;
 	gchar *p2;
 	p2 = strstr(p, "\nurl=");
 	if (!p2) {
@@ -498,10 +506,8 @@ bool cache_file::save_cache(const std::string& saveurl) const
 		guint32 nentries = npages;
 		fwrite(&nentries, sizeof(nentries), 1, out);
 		fwrite(wordoffset, sizeof(guint32), npages, out);
-		if (cachefiletype == CacheFileType_oft)
-			fwrite(OFFSETFILE_MAGIC_DATA, 1, sizeof(OFFSETFILE_MAGIC_DATA)-1, out);
-		else
-			fwrite(COLLATIONFILE_MAGIC_DATA, 1, sizeof(COLLATIONFILE_MAGIC_DATA)-1, out);
+		const gchar *magic_data = get_magic_data();
+		fwrite(magic_data, 1, strlen(magic_data), out);
 		fwrite("url=", 1, sizeof("url=")-1, out);
 #ifdef _WIN32
 		const std::string url_rel(rel_path_to_data_dir(saveurl));
@@ -535,6 +541,17 @@ void cache_file::allocate_wordoffset(size_t _npages)
 	npages = _npages;
 }
 
+void cache_file::clear(void)
+{
+	if (mf) {
+		delete mf;
+		mf = NULL;
+	} else
+		g_free(wordoffset);
+	wordoffset = NULL;
+	npages = 0;
+}
+
 gchar *cache_file::get_next_filename(
 	const gchar *dirname, const gchar *basename, int num,
 	const gchar *extendname) const
@@ -543,6 +560,8 @@ gchar *cache_file::get_next_filename(
 		return g_strdup_printf("%s" G_DIR_SEPARATOR_S "%s(%d).%s.oft", dirname, basename, num, extendname);
 	else if (cachefiletype == CacheFileType_clt)
 		return g_strdup_printf("%s" G_DIR_SEPARATOR_S "%s(%d).%s.clt", dirname, basename, num, extendname);
+	else if (cachefiletype == CacheFileType_rhash)
+		return g_strdup_printf("%s" G_DIR_SEPARATOR_S "%s(%d).%s.rhash", dirname, basename, num, extendname);
 	else
 		return g_strdup_printf("%s" G_DIR_SEPARATOR_S "%s(%d).%s.%d.clt", dirname, basename, num, extendname, cltfunc);
 }
@@ -554,6 +573,8 @@ void cache_file::build_primary_cache_filename(const std::string &url,
 		filename=url+".oft";
 	} else if (cachefiletype == CacheFileType_clt) {
 		filename=url+".clt";
+	} else if (cachefiletype == CacheFileType_rhash) {
+		filename=url+".rhash";
 	} else {
 		gchar *func = g_strdup_printf("%d", cltfunc);
 		filename=url+'.'+func+".clt";
@@ -1279,6 +1300,7 @@ bool synonym_file::lookup(const char *str, glong &idx, glong &idx_suggest)
 Dict::Dict()
 {
 	storage = NULL;
+	lookup_stats = NULL;
 }
 
 Dict::~Dict()
@@ -1336,6 +1358,7 @@ bool Dict::load_ifofile(const std::string& ifofilename, gulong &idxfilesize, glo
 
 	ifo_file_name=dict_info.ifo_file_name;
 	bookname=dict_info.get_bookname();
+	lookup_stats = lookup_stats_get_entry(ifo_file_name, bookname);
 
 	idxfilesize=dict_info.get_index_file_size();
 	wordcount=dict_info.get_wordcount();
@@ -1449,6 +1472,7 @@ bool Dict::LookupSynonym(const char *str, glong &synidx, glong &synidx_suggest,
 		synidx_suggest = UNSET_INDEX;
 		return false;
 	}
+	LookupStageTimer timer(lookup_stats, LookupStage_Synonym);
 	return syn_file->Lookup(str, synidx, synidx_suggest, CollationLevel, servercollatefunc);
 }
 
@@ -1507,11 +1531,14 @@ Libs::Libs(show_progress_t *sp, bool create_cache_files, CollationLevelType leve
 :
 	iMaxFuzzyDistance(MAX_FUZZY_DISTANCE),
 	show_progress(NULL),
-	CreateCacheFile(create_cache_files)
+	CreateCacheFile(create_cache_files),
+	query_cache(QUERY_CACHE_SIZE),
+	active_lookups(0)
 {
 #ifdef SD_SERVER_CODE
 	root_info_item = NULL;
 #endif
+	g_mutex_init(&retired_mutex);
 	ValidateCollateParams(level, func);
 	CollationLevel = level;
 	CollateFunction = func;
@@ -1527,29 +1554,79 @@ Libs::~Libs()
 #endif
 	for (std::vector<Dict *>::iterator p=oLib.begin(); p!=oLib.end(); ++p)
 		delete *p;
+	for (std::list<Dict *>::iterator p=retired_dicts.begin(); p!=retired_dicts.end(); ++p)
+		delete *p;
+	g_mutex_clear(&retired_mutex);
 	free_collations();
 }
 
 bool Libs::load_dict(const std::string& url, show_progress_t *sp)
 {
-	Dict *lib=new Dict;
-	if (lib->load(url, CreateCacheFile, CollationLevel, CollateFunction, sp)) {
-		oLib.push_back(lib);
-		return true;
-	} else {
-		delete lib;
+	Dict *lib = create_dict(url, sp);
+	if (!lib)
 		return false;
+	oLib.push_back(lib);
+	return true;
+}
+
+Dict *Libs::create_dict(const std::string& url, show_progress_t *sp) const
+{
+	Dict *lib=new Dict;
+	if (lib->load(url, CreateCacheFile, CollationLevel, CollateFunction, sp))
+		return lib;
+	delete lib;
+	return NULL;
+}
+
+bool Libs::replace_dict(Dict *dict)
+{
+	for (std::vector<Dict *>::iterator it = oLib.begin(); it != oLib.end(); ++it) {
+		if ((*it)->ifofilename() == dict->ifofilename()) {
+			Dict *old_dict = *it;
+			*it = dict;
+			query_cache.clear();
+			g_mutex_lock(&retired_mutex);
+			retired_dicts.push_back(old_dict);
+			g_mutex_unlock(&retired_mutex);
+			free_retired_dicts();
+			return true;
+		}
 	}
+	return false;
+}
+
+void Libs::begin_lookup(void)
+{
+	g_atomic_int_inc(&active_lookups);
+}
+
+void Libs::end_lookup(void)
+{
+	if (g_atomic_int_dec_and_test(&active_lookups))
+		free_retired_dicts();
+}
+
+/* A lookup started after a Dict was retired can not see it,
+ * so the dictionaries are free once the counter drops to zero. */
+void Libs::free_retired_dicts(void)
+{
+	std::list<Dict *> dicts;
+	g_mutex_lock(&retired_mutex);
+	if (g_atomic_int_get(&active_lookups) == 0)
+		dicts.swap(retired_dicts);
+	g_mutex_unlock(&retired_mutex);
+	for (std::list<Dict *>::iterator it = dicts.begin(); it != dicts.end(); ++it)
+		delete *it;
 }
 
 #ifdef SD_SERVER_CODE
-void Libs::LoadFromXML()
+void Libs::LoadFromXML(const char *dicdir)
 {
 	root_info_item = new DictInfoItem();
 	root_info_item->isdir = 1;
 	root_info_item->dir = new DictInfoDirItem();
 	root_info_item->dir->name='/';
-	LoadXMLDir("/usr/share/stardict/dic", root_info_item);
+	LoadXMLDir(dicdir, root_info_item);
 	GenLinkDict(root_info_item);
 }
 
@@ -1898,6 +1975,25 @@ int Libs::get_dict_level(const char *uid)
 	return uid_iter->second->level;
 }
 
+std::string Libs::get_dict_uids(int userLevel)
+{
+	std::vector<const std::string *> by_id(oLib.size(), (const std::string *)NULL);
+	for (std::map<std::string, DictInfoDictItem *>::iterator i = uidmap.begin(); i!= uidmap.end(); ++i) {
+		if (userLevel>=0 && (unsigned int)userLevel< i->second->level)
+			continue;
+		by_id[i->second->id] = &(i->second->uid);
+	}
+	std::string uids;
+	for (size_t i = 0; i < by_id.size(); ++i) {
+		if (!by_id[i])
+			continue;
+		if (!uids.empty())
+			uids += ' ';
+		uids += *by_id[i];
+	}
+	return uids;
+}
+
 std::string Libs::get_dicts_list(const char *dictmask, int max_dict_count, int userLevel)
 {
 	std::list<std::string> uid_list;
@@ -1968,39 +2064,39 @@ const std::string *Libs::get_dict_info(const char *uid, bool is_short)
 				DictInfoType_NormDict))
 				return NULL;
 			dict->info_string += "<dictinfo><bookname>";
-			etext = g_markup_escape_text(dict_info.bookname.c_str(), -1);
+			etext = g_markup_escape_text(dict_info.get_bookname().c_str(), -1);
 			dict->info_string += etext;
 			g_free(etext);
 			dict->info_string += "</bookname><wordcount>";
-			gchar *wc = g_strdup_printf("%u", dict_info.wordcount);
+			gchar *wc = g_strdup_printf("%u", dict_info.get_wordcount());
 			dict->info_string += wc;
 			g_free(wc);
 			dict->info_string += "</wordcount>";
-			if (dict_info.synwordcount!=0) {
+			if (dict_info.get_synwordcount()!=0) {
 				dict->info_string += "<synwordcount>";
-				wc = g_strdup_printf("%u", dict_info.synwordcount);
+				wc = g_strdup_printf("%u", dict_info.get_synwordcount());
 				dict->info_string += wc;
 				g_free(wc);
 				dict->info_string += "</synwordcount>";
 			}
 			dict->info_string += "<author>";
-			etext = g_markup_escape_text(dict_info.author.c_str(), -1);
+			etext = g_markup_escape_text(dict_info.get_author().c_str(), -1);
 			dict->info_string += etext;
 			g_free(etext);
 			dict->info_string += "</author><email>";
-			etext = g_markup_escape_text(dict_info.email.c_str(), -1);
+			etext = g_markup_escape_text(dict_info.get_email().c_str(), -1);
 			dict->info_string += etext;
 			g_free(etext);
 			dict->info_string += "</email><website>";
-			etext = g_markup_escape_text(dict_info.website.c_str(), -1);
+			etext = g_markup_escape_text(dict_info.get_website().c_str(), -1);
 			dict->info_string += etext;
 			g_free(etext);
 			dict->info_string += "</website><description>";
-			etext = g_markup_escape_text(dict_info.description.c_str(), -1);
+			etext = g_markup_escape_text(dict_info.get_description().c_str(), -1);
 			dict->info_string += etext;
 			g_free(etext);
 			dict->info_string += "</description><date>";
-			etext = g_markup_escape_text(dict_info.date.c_str(), -1);
+			etext = g_markup_escape_text(dict_info.get_date().c_str(), -1);
 			dict->info_string += etext;
 			g_free(etext);
 			dict->info_string += "</date><download>";
@@ -2104,10 +2200,12 @@ void Libs::reload(const std::list<std::string> &load_list, CollationLevelType Ne
 		for (std::vector<Dict *>::iterator it=prev.begin(); it!=prev.end(); ++it) {
 			delete *it;
 		}
+		query_cache.clear();
 	} else {
 		for (std::vector<Dict *>::iterator it = oLib.begin(); it != oLib.end(); ++it)
 			delete *it;
 		oLib.clear();
+		query_cache.clear();
 		free_collations();
 		CollationLevel = NewCollationLevel;
 		CollateFunction = CollateFunctions(collf);
@@ -2991,6 +3089,33 @@ bool Libs::LookupSimilarWord(const gchar* sWord, glong & iWordIndex, glong &idx_
 	return bFound;
 }
 
+void Libs::LookupWordAndSynonym(const gchar* sWord, LookupMethod method, size_t iLib, int servercollatefunc,
+	CurrentIndex &index, bool &bLookupWord, bool &bLookupSynonymWord)
+{
+	QueryCacheItem item;
+	if (!query_cache.lookup(sWord, method, servercollatefunc, iLib, item)) {
+		item.idx = item.idx_suggest = UNSET_INDEX;
+		item.synidx = item.synidx_suggest = UNSET_INDEX;
+		if (method == LookupMethod_EXACT) {
+			item.found_word = LookupWord(sWord, item.idx, item.idx_suggest, iLib, servercollatefunc);
+			item.found_synonym = LookupSynonymWord(sWord, item.synidx, item.synidx_suggest, iLib, servercollatefunc);
+		} else if (method == LookupMethod_SIMILAR) {
+			item.found_word = LookupSimilarWord(sWord, item.idx, item.idx_suggest, iLib, servercollatefunc);
+			item.found_synonym = LookupSynonymSimilarWord(sWord, item.synidx, item.synidx_suggest, iLib, servercollatefunc);
+		} else {
+			item.found_word = SimpleLookupWord(sWord, item.idx, item.idx_suggest, iLib, servercollatefunc);
+			item.found_synonym = SimpleLookupSynonymWord(sWord, item.synidx, item.synidx_suggest, iLib, servercollatefunc);
+		}
+		query_cache.store(sWord, method, servercollatefunc, iLib, item);
+	}
+	index.idx = item.idx;
+	index.idx_suggest = item.idx_suggest;
+	index.synidx = item.synidx;
+	index.synidx_suggest = item.synidx_suggest;
+	bLookupWord = item.found_word;
+	bLookupSynonymWord = item.found_synonym;
+}
+
 bool Libs::SimpleLookupWord(const gchar* sWord, glong & iWordIndex, glong &idx_suggest, size_t iLib, int servercollatefunc)
 {
 	bool bFound = oLib[iLib]->Lookup(sWord, iWordIndex, idx_suggest, CollationLevel, servercollatefunc);
@@ -3248,6 +3373,8 @@ gint Libs::LookupWithRegex(const gchar *word, gchar **ppMatchWord, std::vector<I
 
 bool Libs::LookupData(const gchar *sWord, std::vector<gchar *> *reslist, updateSearchDialog_func search_func, gpointer search_data, bool *cancel, std::vector<InstantDictIndex> &dictmask)
 {
+	/* search_func lets the main loop run */
+	LookupLock lookup_lock(*this);
 	std::vector<std::string> SearchWords;
 	std::string SearchWord;
 	const char *p=sWord;
@@ -3305,6 +3432,7 @@ bool Libs::LookupData(const gchar *sWord, std::vector<gchar *> *reslist, updateS
 		iRealLib = dictmask[i].index;
 		if (!oLib[iRealLib]->containSearchData())
 			continue;
+		LookupStageTimer timer(oLib[iRealLib]->get_lookup_stats(), LookupStage_FullText);
 		const gulong iwords = narticles(iRealLib);
 		const gchar *key;
 		guint32 offset, size;
@@ -34,9 +34,12 @@
 #include "storage.h"
 #include "libcommon.h"
 #include "dictitemid.h"
+#include "lookupstats.h"
+#include "querycache.h"
 
 const int MAX_FUZZY_DISTANCE= 3; // at most MAX_FUZZY_DISTANCE-1 differences allowed when find similar words
 const int MAX_MATCH_ITEM_PER_LIB=100;
+const size_t QUERY_CACHE_SIZE=256; // number of queries kept in Libs query cache
 
 /* Collation support. Effects word list sort order. */
 enum CollationLevelType {
@@ -74,6 +77,8 @@ enum CacheFileType {
 	CacheFileType_oft,
 	CacheFileType_clt,
 	CacheFileType_server_clt,
+	/* hash table of resource keys, see rindex_hash */
+	CacheFileType_rhash,
 };
 
 /* url and saveurl parameters that appear on the same level, function parameters,
@@ -117,6 +122,8 @@ public:
 	bool save_cache(const std::string& saveurl) const;
 	// datasize in bytes
 	void allocate_wordoffset(size_t _npages);
+	/* Forget the loaded or allocated data, as if load_cache had failed. */
+	void clear(void);
 	guint32& get_wordoffset(size_t ind)
 	{
 		return wordoffset[ind];
@@ -141,6 +148,7 @@ private:
 	CollateFunctions cltfunc;
 	/* The following functions do not change member data, they return result though parameters. */
 	bool build_primary_cache_filename_in_user_cache(const std::string& url, std::string &cachefilename, bool create) const;
+	const gchar *get_magic_data(void) const;
 	MapFile* find_and_load_cache_file(const gchar *filename, const std::string &url, const std::string &saveurl, glong filedatasize, int next) const;
 	FILE* find_and_open_for_overwrite_cache_file(const gchar *filename, const std::string &saveurl, int next, std::string &cfilename) const;
 	gchar *get_next_filename(
@@ -285,6 +293,9 @@ private:
 	std::string bookname; // in utf-8
 	std::string dicttype; // in utf-8
 
+	/* statistics of lookups in this dictionary */
+	LookupStatsEntry *lookup_stats;
+
 	/* ifofilename in file name encoding */
 	bool load_ifofile(const std::string& ifofilename, gulong &idxfilesize, glong &wordcount, glong &synwordcount);
 public:
@@ -305,9 +316,11 @@ public:
 	const std::string& dict_type() const { return dicttype; }
 	const std::string& ifofilename() const { return ifo_file_name; }
 	DictItemId id() const { return DictItemId(ifo_file_name); }
+	LookupStatsEntry *get_lookup_stats() const { return lookup_stats; }
 
 	gchar *get_data(glong index)
 	{
+		LookupStageTimer timer(lookup_stats, LookupStage_Data);
 		idx_file->get_data(index);
 		return DictBase::GetWordData(idx_file->wordentry_offset, idx_file->wordentry_size);
 	}
@@ -319,6 +332,8 @@ public:
 	}
 	bool Lookup(const char *str, glong &idx, glong &idx_suggest, CollationLevelType CollationLevel, int servercollatefunc)
 	{
+		LookupStageTimer timer(lookup_stats,
+			CollationLevel == CollationLevel_NONE ? LookupStage_Index : LookupStage_Collation);
 		return idx_file->Lookup(str, idx, idx_suggest, CollationLevel, servercollatefunc);
 	}
 	bool LookupSynonym(const char *str, glong &synidx, glong &synidx_suggest, CollationLevelType CollationLevel, int servercollatefunc);
@@ -357,8 +372,29 @@ public:
 	CollationLevelType get_CollationLevel() const { return CollationLevel; }
 	CollateFunctions get_CollateFunction() const { return CollateFunction; }
 	bool load_dict(const std::string& url, show_progress_t *sp);
+	/* Load the dictionary without adding it to the list.
+	 * Libs is not changed, so this may be called from any thread
+	 * as long as the collation parameters are not changed meanwhile. */
+	Dict *create_dict(const std::string& url, show_progress_t *sp) const;
+	/* Replace the loaded dictionary with the same ifo file by dict.
+	 * The old Dict object is deleted when no LookupLock is held.
+	 * Returns false if there is no such dictionary,
+	 * the caller owns dict in this case. */
+	bool replace_dict(Dict *dict);
+	/* Held by lookups that run in other threads or let the main loop run,
+	 * Dict objects replaced meanwhile stay alive till the last lock is released. */
+	class LookupLock {
+	public:
+		explicit LookupLock(Libs &_libs) : libs(_libs) { libs.begin_lookup(); }
+		~LookupLock() { libs.end_lookup(); }
+	private:
+		Libs &libs;
+	};
+	void begin_lookup(void);
+	void end_lookup(void);
 #ifdef SD_SERVER_CODE
-	void LoadFromXML();
+	/* Load the dictionaries listed in stardictd.xml of dicdir and its subdirs. */
+	void LoadFromXML(const char *dicdir);
 	void SetServerDictMask(std::vector<InstantDictIndex> &dictmask, const char *dicts, int max, int level);
 	void LoadCollateFile(std::vector<InstantDictIndex> &dictmask, CollateFunctions cltfuc);
 	const std::string *get_dir_info(const char *path);
@@ -366,6 +402,8 @@ public:
 	const std::string &get_fromto_info();
 	std::string get_dicts_list(const char *dicts, int max_dict_count, int userLevel);
 	int get_dict_level(const char *uid);
+	/* Space separated uids of the dictionaries up to userLevel, in load order. */
+	std::string get_dict_uids(int userLevel);
 #endif
 #ifdef SD_CLIENT_CODE
 	bool find_lib_by_id(const DictItemId& filename, size_t &iLib);
@@ -377,7 +415,10 @@ public:
 	glong nsynarticles(size_t idict) const { return oLib[idict]->nsynarticles(); }
 	const std::string& dict_name(size_t idict) const { return oLib[idict]->dict_name(); }
 	const std::string& dict_type(size_t idict) const { return oLib[idict]->dict_type(); }
+	const std::string& dict_ifofilename(size_t idict) const { return oLib[idict]->ifofilename(); }
+	LookupStatsEntry *get_lookup_stats(size_t idict) const { return oLib[idict]->get_lookup_stats(); }
 	bool has_dict() const { return !oLib.empty(); }
+	size_t ndicts() const { return oLib.size(); }
 
 	const gchar * poGetWord(glong iIndex,size_t iLib, int servercollatefunc) const {
 		return oLib[iLib]->idx_file->getWord(iIndex, CollationLevel, servercollatefunc);
@@ -416,6 +457,10 @@ public:
 	bool LookupSynonymSimilarWord(const gchar* sWord, glong &iSynonymWordIndex, glong &synidx_suggest, size_t iLib, int servercollatefunc);
 	bool SimpleLookupWord(const gchar* sWord, glong &iWordIndex, glong &idx_suggest, size_t iLib, int servercollatefunc);
 	bool SimpleLookupSynonymWord(const gchar* sWord, glong &iWordIndex, glong &synidx_suggest, size_t iLib, int servercollatefunc);
+	/* Look up the word both in the index and in the synonym file.
+	 * Results, including misses, are cached till the dictionary list changes. */
+	void LookupWordAndSynonym(const gchar* sWord, LookupMethod method, size_t iLib, int servercollatefunc,
+		CurrentIndex &index, bool &bLookupWord, bool &bLookupSynonymWord);
 	gint GetOrigWordCount(glong& iWordIndex, size_t iLib, bool isidx) {
 		return oLib[iLib]->GetOrigWordCount(iWordIndex, isidx);
 	}
@@ -443,13 +488,21 @@ private:
 		glong &iIndex, glong &idx_suggest, gint &best_match);
 	/* Validate and fix collate parameters */
 	static void ValidateCollateParams(CollationLevelType& level, CollateFunctions& func);
+	void free_retired_dicts(void);
 
 	std::vector<Dict *> oLib;
+	/* replaced dictionaries waiting for the lookups to end,
+	 * protected by retired_mutex */
+	std::list<Dict *> retired_dicts;
+	GMutex retired_mutex;
+	/* number of LookupLock objects */
+	volatile gint active_lookups;
 	int iMaxFuzzyDistance;
 	show_progress_t *show_progress;
 	bool CreateCacheFile;
 	CollationLevelType CollationLevel;
 	CollateFunctions CollateFunction;
+	QueryCache query_cache;
 	static show_progress_t default_show_progress;
 
 #ifdef SD_SERVER_CODE
@@ -343,6 +343,12 @@ bool offset_rindex::lookup(const char *str, glong &idx)
 	}
 }
 
+const gchar *offset_rindex::get_entry(glong idx, guint32 &entry_offset, guint32 &entry_size)
+{
+	get_data(idx, entry_offset, entry_size);
+	return get_key(idx);
+}
+
 const gchar *offset_rindex::read_first_on_page_key(glong page_idx)
 {
 	fseek(idxfile, oft_file.get_wordoffset(page_idx), SEEK_SET);
@@ -519,6 +525,12 @@ bool compressed_rindex::lookup(const char *str, glong &idx)
 	return bFound;
 }
 
+const gchar *compressed_rindex::get_entry(glong idx, guint32 &entry_offset, guint32 &entry_size)
+{
+	get_data(idx, entry_offset, entry_size);
+	return get_key(idx);
+}
+
 const gchar *compressed_rindex::get_key(glong idx)
 {
 	return filelist[idx];
@@ -532,6 +544,126 @@ void compressed_rindex::get_data(glong idx, guint32 &entry_offset, guint32 &entr
 	entry_size = g_ntohl(get_uint32(p1));
 }
 
+rindex_hash::rindex_hash(void)
+:
+	rhash_file(CacheFileType_rhash, COLLATE_FUNC_NONE),
+	nslots(0),
+	keys_size(0)
+{
+
+}
+
+bool rindex_hash::load(const std::string& url, rindex_file *ridx_file,
+	gulong fsize, bool CreateCacheFile)
+{
+	const gulong filecount = ridx_file->get_filecount();
+	/* each index entry is the key, '\0' and two guint32 values */
+	if (fsize < filecount*2*sizeof(guint32))
+		return false;
+	nslots = get_slot_count(filecount);
+	keys_size = (fsize - filecount*2*sizeof(guint32) + sizeof(guint32) - 1)
+		/ sizeof(guint32) * sizeof(guint32);
+	if (rhash_file.load_cache(url, url, nslots*RHASH_SLOT_SIZE*sizeof(guint32) + keys_size)) {
+		if (check(filecount))
+			return true;
+		rhash_file.clear();
+	}
+	if (!build(ridx_file))
+		return false;
+	if (CreateCacheFile) {
+		if (!rhash_file.save_cache(url))
+			g_printerr("Cache update failed.\n");
+	}
+	return true;
+}
+
+bool rindex_hash::lookup(const char *str, guint32 &entry_offset, guint32 &entry_size)
+{
+	const guint32 h = get_hash(str);
+	const guint32 *slots = rhash_file.get_wordoffset();
+	const gchar *keys = get_keys();
+	for (gulong i = h & (nslots-1); ; i = (i+1) & (nslots-1)) {
+		const guint32 *slot = slots + i*RHASH_SLOT_SIZE;
+		if (slot[0] == 0)
+			return false;
+		if (slot[0] == h && strcmp(keys + slot[1], str) == 0) {
+			entry_offset = slot[2];
+			entry_size = slot[3];
+			return true;
+		}
+	}
+}
+
+/* FNV-1a hash of the string.
+ * Do not replace it with g_str_hash & Co, hash values are saved in cache files. */
+guint32 rindex_hash::get_hash(const char *str)
+{
+	guint32 h = 2166136261U;
+	for (const guchar *p = reinterpret_cast<const guchar *>(str); *p; ++p)
+		h = (h ^ *p) * 16777619U;
+	return h == 0 ? 1 : h;
+}
+
+gulong rindex_hash::get_slot_count(gulong filecount)
+{
+	gulong n = 16;
+	while (n < 2*filecount)
+		n <<= 1;
+	return n;
+}
+
+bool rindex_hash::build(rindex_file *ridx_file)
+{
+	const gulong nvalues = nslots*RHASH_SLOT_SIZE + keys_size/sizeof(guint32);
+	rhash_file.allocate_wordoffset(nvalues);
+	guint32 *slots = rhash_file.get_wordoffset();
+	memset(slots, 0, nvalues*sizeof(guint32));
+	gchar *keys = reinterpret_cast<gchar *>(slots + nslots*RHASH_SLOT_SIZE);
+	const gulong filecount = ridx_file->get_filecount();
+	gulong key_offset = 0;
+	guint32 entry_offset, entry_size;
+	for (gulong idx = 0; idx < filecount; ++idx) {
+		const gchar *key = ridx_file->get_entry(idx, entry_offset, entry_size);
+		if (!key)
+			return false;
+		const gulong len = strlen(key) + 1;
+		/* the index does not match its size in the .rifo file */
+		if (len > keys_size - key_offset)
+			return false;
+		memcpy(keys + key_offset, key, len);
+		const guint32 h = get_hash(key);
+		gulong i = h & (nslots-1);
+		while (slots[i*RHASH_SLOT_SIZE] != 0)
+			i = (i+1) & (nslots-1);
+		guint32 *slot = slots + i*RHASH_SLOT_SIZE;
+		slot[0] = h;
+		slot[1] = key_offset;
+		slot[2] = entry_offset;
+		slot[3] = entry_size;
+		key_offset += len;
+	}
+	return true;
+}
+
+bool rindex_hash::check(gulong filecount)
+{
+	const guint32 *slots = rhash_file.get_wordoffset();
+	/* the last key ends in the key block */
+	if (keys_size > 0 && get_keys()[keys_size-1] != '\0')
+		return false;
+	/* nslots > filecount, so lookups stop at an empty slot */
+	gulong nkeys = 0;
+	for (gulong i = 0; i < nslots; ++i) {
+		const guint32 *slot = slots + i*RHASH_SLOT_SIZE;
+		if (slot[0] == 0)
+			continue;
+		if (slot[1] >= keys_size)
+			return false;
+		++nkeys;
+	}
+	return nkeys == filecount;
+}
+
 ResDict::ResDict(void)
 :
 	dictfile(NULL),
@@ -742,12 +874,14 @@ Database_ResourceStorage::Database_ResourceStorage(void)
 :
 cur_cache_ind(0),
 ridx_file(NULL),
+ridx_hash(NULL),
 dict(NULL)
 {
 }
 
 Database_ResourceStorage::~Database_ResourceStorage(void)
 {
+	delete ridx_hash;
 	delete ridx_file;
 	delete dict;
 }
@@ -774,9 +908,24 @@ bool Database_ResourceStorage::load(const std::string& rifofilename,
 	ridx_file = rindex_file::Create(filebasename, "ridx", fullfilename);
 	if (!ridx_file->load(fullfilename, filecount, indexfilesize, CreateCacheFile))
 		return false;
+
+	delete ridx_hash;
+	ridx_hash = new rindex_hash;
+	if (!ridx_hash->load(fullfilename, ridx_file, indexfilesize, CreateCacheFile)) {
+		delete ridx_hash;
+		ridx_hash = NULL;
+	}
 	return true;
 }
 
+bool Database_ResourceStorage::lookup(const std::string& key,
+	guint32 &entry_offset, guint32 &entry_size)
+{
+	if (ridx_hash)
+		return ridx_hash->lookup(key.c_str(), entry_offset, entry_size);
+	return ridx_file->lookup(key.c_str(), entry_offset, entry_size);
+}
+
 FileHolder Database_ResourceStorage::get_file_path(const std::string& key)
 {
 	int ind = find_in_cache(key);
@@ -784,7 +933,7 @@ FileHolder Database_ResourceStorage::get_file_path(const std::string& key)
 		return FileCache[ind].file;
 
 	guint32 entry_offset, entry_size;
-	if(!ridx_file->lookup(key.c_str(), entry_offset, entry_size))
+	if(!lookup(key, entry_offset, entry_size))
 		return FileHolder(); // key not found
 	gchar *data = dict->GetData(entry_offset, entry_size);
 	if(!data)
@@ -826,7 +975,7 @@ FileHolder Database_ResourceStorage::get_file_path(const std::string& key)
 const char *Database_ResourceStorage::get_file_content(const std::string &key)
 {
 	guint32 entry_offset, entry_size;
-	if(!ridx_file->lookup(key.c_str(), entry_offset, entry_size))
+	if(!lookup(key, entry_offset, entry_size))
 		return NULL; // key not found
 	return dict->GetData(entry_offset, entry_size);
 }
@@ -38,6 +38,10 @@ public:
 		bool CreateCacheFile) = 0;
 	/* str in utf-8 */
 	virtual bool lookup(const char *str, guint32 &entry_offset, guint32 &entry_size) = 0;
+	/* Get the idx-th entry of the index. 0 <= idx < filecount.
+	 * return value in utf-8, valid till the next call to any method of the class */
+	virtual const gchar *get_entry(glong idx, guint32 &entry_offset, guint32 &entry_size) = 0;
+	gulong get_filecount(void) const { return filecount; }
 protected:
 	// number of files in the index
 	gulong filecount;
@@ -53,6 +57,7 @@ public:
 		bool CreateCacheFile);
 	/* str in utf-8 */
 	bool lookup(const char *str, guint32 &entry_offset, guint32 &entry_size);
+	const gchar *get_entry(glong idx, guint32 &entry_offset, guint32 &entry_size);
 private:
 	/* str in utf-8 */
 	bool lookup(const char *str, glong &idx);
@@ -124,6 +129,7 @@ public:
 		bool CreateCacheFile);
 	/* str in utf-8 */
 	bool lookup(const char *str, guint32 &entry_offset, guint32 &entry_size);
+	const gchar *get_entry(glong idx, guint32 &entry_offset, guint32 &entry_size);
 private:
 	/* str in utf-8 */
 	bool lookup(const char *str, glong &idx);
@@ -139,6 +145,47 @@ private:
 	std::vector<gchar *> filelist;
 };
 
+/* Open addressing hash table over the keys of a resource index.
+ * Maps a key to (offset, size) of the file in the resource dictionary without
+ * touching the index file. The table is built once from rindex_file and saved
+ * in a .rhash cache file, see cache_file for the file search algorithm.
+ *
+ * The table has nslots slots, nslots is a power of 2 at least twice as large
+ * as the number of files. Each slot consists of RHASH_SLOT_SIZE guint32 values:
+ * the hash of the key, the offset of the key in the key block, the offset and
+ * the size of the file. A slot with zero hash is empty, the hash function
+ * never returns 0.
+ * The slots are followed by the key block: the '\0'-terminated keys in the
+ * order of the index, padded with '\0' to a multiple of sizeof(guint32).
+ * The key of a slot is compared with the looked up string when hashes match. */
+class rindex_hash
+{
+public:
+	rindex_hash(void);
+	/* url in file name encoding - resource index file the table is built for,
+	 * fsize - size of the uncompressed index */
+	bool load(const std::string& url, rindex_file *ridx_file, gulong fsize,
+		bool CreateCacheFile);
+	/* str in utf-8 */
+	bool lookup(const char *str, guint32 &entry_offset, guint32 &entry_size);
+private:
+	static guint32 get_hash(const char *str);
+	static gulong get_slot_count(gulong filecount);
+	bool build(rindex_file *ridx_file);
+	/* false if a loaded table does not fit the index */
+	bool check(gulong filecount);
+	const gchar *get_keys(void)
+	{
+		return reinterpret_cast<const gchar *>(rhash_file.get_wordoffset() + nslots*RHASH_SLOT_SIZE);
+	}
+
+	static const size_t RHASH_SLOT_SIZE=4;
+	cache_file rhash_file;
+	gulong nslots;
+	/* size of the key block in bytes, including the padding */
+	gulong keys_size;
+};
+
 class File_ResourceStorage {
 public:
 	/* resdir in file name encoding */
@@ -170,6 +217,8 @@ private:
 	/* rifofilename in file name encoding */
 	bool load_rifofile(const std::string& rifofilename, gulong& filecount,
 		gulong& indexfilesize);
+	/* key in utf-8, DB_DIR_SEPARATOR path separator */
+	bool lookup(const std::string& key, guint32 &entry_offset, guint32 &entry_size);
 	void clear_cache(void);
 	/* key in utf-8 */
 	int find_in_cache(const std::string& key) const;
@@ -186,6 +235,8 @@ private:
 	FileCacheEntity FileCache[FILE_CACHE_SIZE];
 	size_t cur_cache_ind; // index to be reused
 	rindex_file *ridx_file;
+	/* NULL if the hash table is not available, use ridx_file then */
+	rindex_hash *ridx_hash;
 	ResDict *dict;
 };
 
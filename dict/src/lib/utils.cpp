@@ -27,6 +27,7 @@
 #include <glib/gi18n.h>
 #include <glib/gstdio.h>
 #include <cstdlib>
+#include <algorithm>
 #include <gtk/gtk.h>
 #include <fcntl.h>
 #include <cerrno>
@@ -756,3 +757,56 @@ gboolean is_not_lower(gunichar c)
 {
 	return !g_unichar_islower(c);
 }
+
+static void add_candidate(std::vector<std::string> &candidates, const char *word)
+{
+	if (word[0] && std::find(candidates.begin(), candidates.end(), word) == candidates.end())
+		candidates.push_back(word);
+}
+
+/* The text between spaces and punctuation, the letters only, the letters of
+ * the same case, a capitalized word, then the last of these cut by one more
+ * character each time. A word that is tried already is left out. */
+void smart_lookup_candidates(const char *sWord, int BeginPos, std::vector<std::string> &candidates)
+{
+	candidates.clear();
+	if (sWord == NULL || sWord[0] == '\0')
+		return;
+	char *SearchWord = (char *)g_malloc(strlen(sWord)+1);
+	std::string TriedSearchWord;
+
+	extract_word(SearchWord, sWord, BeginPos, is_space_or_punct);
+	TriedSearchWord = SearchWord;
+	add_candidate(candidates, SearchWord);
+	extract_word(SearchWord, sWord, BeginPos, is_not_alpha);
+	if (SearchWord[0]) {
+		TriedSearchWord = SearchWord;
+		add_candidate(candidates, SearchWord);
+	}
+	gunichar c = g_utf8_get_char(sWord + BeginPos);
+	if (g_unichar_islower(c) || g_unichar_isupper(c)) {
+		extract_word(SearchWord, sWord, BeginPos,
+			g_unichar_islower(c) ? is_not_lower : is_not_upper);
+		if (SearchWord[0]) {
+			TriedSearchWord = SearchWord;
+			add_candidate(candidates, SearchWord);
+		}
+	}
+	extract_capitalized_word(SearchWord, sWord, BeginPos,
+		g_unichar_isupper, g_unichar_islower);
+	if (SearchWord[0]) {
+		TriedSearchWord = SearchWord;
+		add_candidate(candidates, SearchWord);
+	}
+	/* the word cut by one character has never been tried */
+	strcpy(SearchWord, TriedSearchWord.c_str());
+	char *end = SearchWord + strlen(SearchWord);
+	if (end > SearchWord)
+		end = g_utf8_prev_char(end);
+	while (end > SearchWord) {
+		end = g_utf8_prev_char(end);
+		*end = '\0';
+		add_candidate(candidates, SearchWord);
+	}
+	g_free(SearchWord);
+}
@@ -108,6 +108,9 @@ gboolean is_space_or_punct(gunichar c);
 gboolean is_not_alpha(gunichar c);
 gboolean is_not_upper(gunichar c);
 gboolean is_not_lower(gunichar c);
+/* The words to look up for the word at BeginPos of a scanned text, in the
+ * order to try them. */
+void smart_lookup_candidates(const char *sWord, int BeginPos, std::vector<std::string> &candidates);
 
 #ifdef _WIN32
 #define bzero(p, l) memset(p, 0, l)
@@ -33,54 +33,6 @@
 #include "utils.h"
 #include "stddict.h"
 
-struct dict_file_timestamp
-{
-	dict_file_timestamp(void)
-	:
-		mtime(0),
-		present(false)
-	{
-	}
-	/* Contains copy of the st_mtime field of the stat structure.
-	 * Note. Do not name this field st_mtime!
-	 * It is a macro in Linux that is expanded to st_mtim.tv_sec. */
-	std::time_t mtime;
-	/* true if the file is present and mtime contains meaningful value. */
-	bool present;
-	bool operator==(const dict_file_timestamp& right)
-	{
-		if(!present)
-			return present == right.present;
-		return present == right.present && mtime == right.mtime;
-	}
-};
-
-/* encapsulate timestamp information about one dictionary */
-struct dict_timestamp
-{
-	std::string ifofilename;
-	bool valid;
-	// dictionary files
-	dict_file_timestamp ts_ifo;
-	dict_file_timestamp ts_idx;
-	dict_file_timestamp ts_idx_gz;
-	dict_file_timestamp ts_dict;
-	dict_file_timestamp ts_dict_dz;
-	dict_file_timestamp ts_syn;
-	// resource database
-	dict_file_timestamp ts_res_rifo;
-	dict_file_timestamp ts_res_ridx;
-	dict_file_timestamp ts_res_ridx_gz;
-	dict_file_timestamp ts_res_rdic;
-	dict_file_timestamp ts_res_rdic_dz;
-	// resource directory
-	dict_file_timestamp ts_res;
-
-	bool load(const std::string& ifofilename);
-	std::string serialize() const;
-	bool is_dict_changed(const dict_timestamp& right);
-};
-
 /* return value: true - OK */
 bool dict_timestamp::load(const std::string& _ifofilename)
 {
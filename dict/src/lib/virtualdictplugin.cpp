@@ -23,6 +23,7 @@
 StarDictVirtualDictPlugInObject::StarDictVirtualDictPlugInObject()
 :
 lookup_func(NULL),
-dict_name(NULL)
+dict_name(NULL),
+prepare_func(NULL)
 {
 }
@@ -26,6 +26,11 @@ struct StarDictVirtualDictPlugInObject{
 	typedef void (*lookup_func_t)(const char *text, char ***pppWord, char ****ppppWordData);
 	lookup_func_t lookup_func;
 	const char *dict_name;
+	// Optional. Called before the local dictionaries are searched for text,
+	// lookup_func follows with the same text. The plugin may start slow work
+	// in background threads here.
+	typedef void (*prepare_func_t)(const char *text);
+	prepare_func_t prepare_func;
 };
 
 #endif
@@ -1397,6 +1397,8 @@ void ResultWin::on_selection_changed(GtkTreeSelection *selection, ResultWin *oRe
 	{
 		gchar *markstr;
 		gtk_tree_model_get(model, &iter, 1, &markstr, -1);
+		/* articles above the dictionary must be in place */
+		gpAppFrame->oMidWin.oTextWin.view->RenderDeferredArticles(markstr);
 		GtkTextView *textview = GTK_TEXT_VIEW(gpAppFrame->oMidWin.oTextWin.view->widget());
 		GtkTextBuffer *buffer = gtk_text_view_get_buffer(textview);
 		GtkTextMark *mark = gtk_text_buffer_get_mark(buffer, markstr);
@@ -2103,7 +2105,6 @@ void TextWin::Show(const gchar *orig_word, gchar ***Word, gchar ****WordData)
 	view->clear();
 	view->goto_begin();
 
-	int j,k;
 	for (size_t i=0; i<gpAppFrame->query_dictmask.size(); i++) {
 		if (Word[i]) {
 			view->SetDictIndex(gpAppFrame->query_dictmask[i]);
@@ -2131,22 +2132,7 @@ void TextWin::Show(const gchar *orig_word, gchar ***Word, gchar ****WordData)
 			} else if (gpAppFrame->query_dictmask[i].type == InstantDictType_NET) {
 				view->AppendHeader(gpAppFrame->oStarDictPlugins->NetDictPlugins.dict_name(gpAppFrame->query_dictmask[i].index), gpAppFrame->oStarDictPlugins->NetDictPlugins.dict_link(gpAppFrame->query_dictmask[i].index));
 			}
-			j=0;
-			do {
-				view->AppendWord(Word[i][j]);
-				view->AppendData(WordData[i][j][0], Word[i][j],
-						 orig_word);
-				view->AppendNewline();
-				k=1;
-				while (WordData[i][j][k]) {
-					view->AppendDataSeparate();
-					view->AppendData(WordData[i][j][k],
-							 Word[i][j], orig_word);
-					view->AppendNewline();
-					k++;
-				}
-				j++;
-			} while (Word[i][j]);
+			view->AppendArticles(orig_word, Word[i], WordData[i]);
 		}
 	}
 	view->end_update();
@@ -2259,6 +2245,7 @@ void TextWin::ShowTreeDictData(gchar *data)
 
 gboolean TextWin::Find (const gchar *text, gboolean start)
 {
+  view->RenderDeferredArticles();
   GtkTextBuffer *buffer =
     gtk_text_view_get_buffer(GTK_TEXT_VIEW(view->widget()));
 
@@ -74,6 +74,8 @@ public:
 	void indent_region(const char *mark_begin, int char_offset_begin = 0, 
 		const char *mark_end = NULL, int char_offset_end = 0);
 	void reindent(void);
+	void set_append_mark(const char *where_mark_name);
+	bool is_mark_visible(const char *mark_name, gint margin);
 protected:
 	void do_set_text(const char *str);
 	void do_append_text(const char *str);
@@ -156,6 +158,8 @@ private:
 	 * find_link member. */
 	TextBufLinks tb_links_;
 	GtkTextIter iter_;
+	/* text is appended here if not NULL, see set_append_mark */
+	GtkTextMark *append_mark_;
 	SkinCursor hand_cursor_, regular_cursor_;
 	typedef std::vector<GtkTextTag*> IndentTags;
 	/* An array of tags that indent text by the specified amount. 
@@ -642,6 +646,31 @@ void PangoWidgetBase::end_update()
 	}
 }
 
+const char PangoWidgetBase::PLACEHOLDER[] = "\xE2\x80\x8B";
+
+void PangoWidgetBase::append_placeholder(const char *mark_name)
+{
+	append_mark(mark_name, true);
+	append_text(PLACEHOLDER);
+}
+
+void PangoWidgetBase::begin_fill_placeholder(const char *mark_name)
+{
+	begin_update();
+	set_append_mark(mark_name);
+}
+
+void PangoWidgetBase::end_fill_placeholder(const char *mark_name)
+{
+	/* move the mark to the placeholder that follows the new text */
+	delete_mark(mark_name);
+	append_mark(mark_name, true);
+	set_append_mark(NULL);
+	end_update();
+	delete_text(mark_name, 1, 0);
+	delete_mark(mark_name);
+}
+
 void PangoWidgetBase::append_text(const char *str)
 {
 	if (update_) {
@@ -710,6 +739,7 @@ TextPangoWidget::TextPangoWidget()
 	gtk_container_add(GTK_CONTAINER(scroll_win_), GTK_WIDGET(textview_));
 	gtk_scrolled_window_set_shadow_type(scroll_win_, GTK_SHADOW_IN);
 	buffer_user_action_cnt = 0;
+	append_mark_ = NULL;
 }
 
 #if GTK_MAJOR_VERSION >= 3
@@ -960,6 +990,10 @@ void TextPangoWidget::clear()
 		gtk_text_buffer_delete_mark(buffer, *it);
 
 	marklist_.clear();
+	if (append_mark_) {
+		gtk_text_buffer_delete_mark(buffer, append_mark_);
+		append_mark_ = NULL;
+	}
 	tb_links_.clear();
 	GtkTextIter start, end;
 	gtk_text_buffer_get_bounds(buffer, &start, &end);
@@ -1021,8 +1055,48 @@ void TextPangoWidget::goto_begin()
 
 void TextPangoWidget::goto_end()
 {
-	gtk_text_buffer_get_iter_at_offset(gtk_text_view_get_buffer(textview_), 
-		&iter_, -1);
+	if (append_mark_)
+		gtk_text_buffer_get_iter_at_mark(gtk_text_view_get_buffer(textview_),
+			&iter_, append_mark_);
+	else
+		gtk_text_buffer_get_iter_at_offset(gtk_text_view_get_buffer(textview_), 
+			&iter_, -1);
+}
+
+void TextPangoWidget::set_append_mark(const char *where_mark_name)
+{
+	flush();
+	GtkTextBuffer *buffer = gtk_text_view_get_buffer(textview_);
+	if (append_mark_) {
+		gtk_text_buffer_delete_mark(buffer, append_mark_);
+		append_mark_ = NULL;
+	}
+	if (!where_mark_name)
+		return;
+	GtkTextMark *tm_where = gtk_text_buffer_get_mark(buffer, where_mark_name);
+	if (!tm_where) {
+		g_warning("Mark \"%s\" not found", where_mark_name);
+		return;
+	}
+	GtkTextIter iter;
+	gtk_text_buffer_get_iter_at_mark(buffer, &iter, tm_where);
+	/* right gravity, the mark moves past the text appended at it */
+	append_mark_ = gtk_text_buffer_create_mark(buffer, NULL, &iter, FALSE);
+}
+
+bool TextPangoWidget::is_mark_visible(const char *mark_name, gint margin)
+{
+	GtkTextBuffer *buffer = gtk_text_view_get_buffer(textview_);
+	GtkTextMark *mark = gtk_text_buffer_get_mark(buffer, mark_name);
+	if (!mark)
+		return false;
+	GdkRectangle rect;
+	gtk_text_view_get_visible_rect(textview_, &rect);
+	GtkTextIter iter;
+	gtk_text_buffer_get_iter_at_mark(buffer, &iter, mark);
+	gint y, height;
+	gtk_text_view_get_line_yrange(textview_, &iter, &y, &height);
+	return y < rect.y + rect.height + margin;
 }
 
 std::string TextPangoWidget::get_text()
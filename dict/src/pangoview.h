@@ -101,9 +101,30 @@ public:
 	virtual void indent_region(const char *mark_begin, int char_offset_begin = 0, 
 		const char *mark_end = NULL, int char_offset_end = 0) {}
 	virtual void reindent(void) {}
+	/* Append text at the mark where_mark_name instead of the end of the
+	 * buffer, each append goes after the text appended before. NULL restores
+	 * appending at the end. */
+	virtual void set_append_mark(const char *where_mark_name) {}
+	/* Whether the mark is above the bottom of the visible region extended
+	 * by margin pixels. */
+	virtual bool is_mark_visible(const char *mark_name, gint margin) { return true; }
 	/* flush cache_ */
 	virtual void flush(void);
 
+	/* Zero width space standing for the content not inserted yet, a picture
+	 * being decoded or deferred articles. */
+	static const char PLACEHOLDER[];
+	/* Reserve a place at the end for text filled in later. The mark
+	 * mark_name has left gravity, text appended after the placeholder
+	 * stays after it. */
+	void append_placeholder(const char *mark_name);
+	/* Text appended between begin_fill_placeholder and end_fill_placeholder
+	 * goes to the place reserved by append_placeholder, then the placeholder
+	 * and its mark are deleted. Marks appended after the placeholder stay
+	 * after the new text. */
+	void begin_fill_placeholder(const char *mark_name);
+	void end_fill_placeholder(const char *mark_name);
+
 	GtkWidget *vscroll_bar() { return gtk_scrolled_window_get_vscrollbar(GTK_SCROLLED_WINDOW(scroll_win_)); }
 	void set_size(gint w, gint h) {
 		gtk_widget_set_size_request(GTK_WIDGET(scroll_win_), w, h);
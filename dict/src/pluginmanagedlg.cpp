@@ -61,7 +61,9 @@ void PluginManageDlg::response_handler (GtkDialog *dialog, gint res_id, PluginMa
 			gchar *filename;
 			StarDictPlugInType plugin_type;
 			gtk_tree_model_get (model, &iter, 4, &filename, 5, &plugin_type, -1);
+			gpAppFrame->oParsePipeline->suspend();
 			gpAppFrame->oStarDictPlugins->configure_plugin(filename, plugin_type);
+			gpAppFrame->oParsePipeline->resume();
 			g_free(filename);
 		}
 	}
@@ -97,11 +99,13 @@ void PluginManageDlg::on_plugin_enable_toggled (GtkCellRendererToggle *cell, gch
 	gtk_tree_model_get (model, &iter, 1, &enable, 4, &filename, 5, &plugin_type, 6, &can_configure, -1);
 	enable = !enable;
 	gtk_tree_store_set (GTK_TREE_STORE (model), &iter, 1, enable, -1);
+	gpAppFrame->oParsePipeline->suspend();
 	if (enable) {
 		gpAppFrame->oStarDictPlugins->load_plugin(filename);
 	} else {
 		gpAppFrame->oStarDictPlugins->unload_plugin(filename, plugin_type);
 	}
+	gpAppFrame->oParsePipeline->resume();
 	g_free(filename);
 	if (enable)
 		gtk_widget_set_sensitive(oPluginManageDlg->pref_button, can_configure);
@@ -64,6 +64,9 @@
 #  include <io.h>
 #  include <fcntl.h>
 #  include "win32/intl.h"
+#else
+#  include <signal.h>
+#  include <glib-unix.h>
 #endif
 
 #include "desktop.h"
@@ -79,6 +82,7 @@
 #include "prefsdlg.h"
 #include "lib/netdictcache.h"
 #include "lib/full_text_trans.h"
+#include "lib/lookupstats.h"
 #include "log.h"
 #include "cmdlineopts.h"
 
@@ -129,7 +133,9 @@ AppCore::AppCore() :
 	oLibs(&gtk_show_progress,
 	      conf->get_bool_at("dictionary/create_cache_file"),
 	      conf->get_bool_at("dictionary/enable_collation") ? CollationLevel_SINGLE : CollationLevel_NONE,
-	      int_to_colate_func(conf->get_int_at("dictionary/collate_function")))
+	      int_to_colate_func(conf->get_int_at("dictionary/collate_function"))),
+	oDictReloader(&oLibs),
+	oArticleCache(ARTICLE_CACHE_SIZE)
 {
 	iCurrentIndex = NULL;
 	word_change_timeout_id = 0;
@@ -138,6 +144,8 @@ AppCore::AppCore() :
 	plugin_manage_dlg = NULL;
 	prefs_dlg = NULL;
 	oStarDictPlugins = NULL;
+	oParsePipeline = NULL;
+	oImageLoader = NULL;
 }
 
 AppCore::~AppCore()
@@ -147,6 +155,10 @@ AppCore::~AppCore()
 	delete plugin_manage_dlg;
 	delete prefs_dlg;
 	g_free(iCurrentIndex);
+	delete oParsePipeline;
+	oParsePipeline = NULL;
+	delete oImageLoader;
+	oImageLoader = NULL;
 	delete oStarDictPlugins;
 	// window?
 }
@@ -278,6 +290,7 @@ void AppCore::Create(const gchar *queryword)
 #endif
 
 // Init oStarDictPlugins after we get window.
+	netdict_set_disk_cache(conf->get_bool_at("network/netdict_disk_cache"));
 	oStarDictPluginSystemInfo.datadir = conf_dirs->get_data_dir();
 	oStarDictPluginSystemInfo.mainwin = window;
 	oStarDictPluginSystemService.send_http_request = do_send_http_request;
@@ -311,6 +324,9 @@ void AppCore::Create(const gchar *queryword)
 	oStarDictPlugins = new StarDictPlugins(conf_dirs->get_plugin_dir(),
 		plugin_order_list,
 		plugin_disable_list);
+	oParsePipeline = new ParsePipeline(&oStarDictPlugins->ParseDataPlugins,
+		PARSE_PIPELINE_THREADS);
+	oImageLoader = new ImageLoader(IMAGE_LOADER_THREADS, IMAGE_CACHE_SIZE);
 
 	oLibs.set_show_progress(&load_show_progress);
 	std::list<DictItemId> dict_new_install_list;
@@ -326,6 +342,8 @@ void AppCore::Create(const gchar *queryword)
 		oLibs.load(s_load_list);
 	}
 	oLibs.set_show_progress(&gtk_show_progress);
+	oDictReloader.on_reloaded_.connect(sigc::mem_fun(this, &AppCore::on_dicts_reloaded));
+	oDictReloader.set_interval(conf->get_int_at("dictionary/auto_reload_interval"));
 
 	oStarDictClient.set_server(conf->get_string_at("network/server").c_str(), conf->get_int_at("network/port"));
 	const std::string &user = conf->get_string_at("network/user");
@@ -716,6 +734,7 @@ bool AppCore::SimpleLookupToFloatLocal(const char* sWord)
 		EndPointer = delete_trailing_spaces_ASCII(SearchWord, EndPointer);
 
 		bool bFound = false;
+		PrepareVirtualDictData(scan_dictmask, SearchWord);
 		for (size_t iLib=0;iLib<scan_dictmask.size();iLib++)
 			BuildResultData(scan_dictmask, SearchWord, iIndex, NULL, iLib, pppWord, ppppWordData, bFound, 2);
 		for (size_t iLib=0; iLib<scan_dictmask.size(); iLib++)
@@ -745,83 +764,36 @@ void AppCore::SmartLookupToFloat(const gchar* sWord, int BeginPos, bool IgnoreSc
 {
 	oFloatWin.StartLookup(sWord, IgnoreScanModifierKey);
 	composite_lookup_float_win.new_lookup();
-	LocalSmartLookupToFloat(sWord, BeginPos);
+	std::vector<std::string> candidates;
+	smart_lookup_candidates(sWord, BeginPos, candidates);
+	LocalSmartLookupToFloat(candidates);
+	bool enable_netdict = conf->get_bool_at("network/enable_netdict");
+	if (enable_netdict && !candidates.empty()) {
+		/* one round trip, the server replies with the first candidate found */
+		STARDICT::Cmd *c = new STARDICT::Cmd(STARDICT::CMD_BATCH_QUERY, 0, &candidates);
+		if (!oStarDictClient.try_cache(c)) {
+			composite_lookup_float_win.send_StarDict_net_request(c->seq);
+			oStarDictClient.send_commands(1, c);
+		}
+	}
 	/* sWord is not a candidate to search in net dictionaries */
 	composite_lookup_float_win.done_lookup();
 	if(composite_lookup_float_win.is_got_all_responses())
 		oFloatWin.EndLookup();
 }
 
-bool AppCore::LocalSmartLookupToFloat(const gchar* sWord, int BeginPos)
+bool AppCore::LocalSmartLookupToFloat(const std::vector<std::string> &candidates)
 {
-	if (sWord==NULL || sWord[0]=='\0')
+	if (candidates.empty())
 		return false;
-	char *SearchWord = (char *)g_malloc(strlen(sWord)+1);
-	std::string TriedSearchWord;
-
 	gchar ***pppWord = (gchar ***)g_malloc(sizeof(gchar **) * scan_dictmask.size());
 	gchar ****ppppWordData = (gchar ****)g_malloc(sizeof(gchar ***) * scan_dictmask.size());
 	CurrentIndex *iIndex = (CurrentIndex *)g_malloc(sizeof(CurrentIndex) * scan_dictmask.size());
 
-	int try_cnt = 0;
-	while(true) {
-		bool skip_try = false;
-		switch(try_cnt)
-		{
-			case 0:
-				extract_word(SearchWord, sWord, BeginPos, is_space_or_punct);
-				TriedSearchWord = SearchWord;
-				++try_cnt;
-				break;
-			case 1:
-				extract_word(SearchWord, sWord, BeginPos, is_not_alpha);
-				if(SearchWord[0])
-					TriedSearchWord = SearchWord;
-				++try_cnt;
-				break;
-			case 2:
-				{
-					gunichar c = g_utf8_get_char(sWord + BeginPos);
-					if(g_unichar_islower(c))
-						extract_word(SearchWord, sWord, BeginPos, is_not_lower);
-					else if(g_unichar_isupper(c))
-						extract_word(SearchWord, sWord, BeginPos, is_not_upper);
-					else
-						skip_try = true;
-					if(SearchWord[0])
-						TriedSearchWord = SearchWord;
-					++try_cnt;
-					break;
-				}
-			case 3:
-				extract_capitalized_word(SearchWord, sWord, BeginPos,
-					g_unichar_isupper, g_unichar_islower);
-				if(SearchWord[0])
-					TriedSearchWord = SearchWord;
-				++try_cnt;
-				break;
-			case 4:
-				strcpy(SearchWord, TriedSearchWord.c_str());
-				++try_cnt;
-				skip_try = true;
-			case 5:
-				{ // cut last char
-					char *end = SearchWord + strlen(SearchWord);
-					end = g_utf8_prev_char(end);
-					*end = '\0';
-					if(!SearchWord[0]) {
-						++try_cnt;
-						skip_try = true;
-					}
-					break;
-				}
-			default:
-				goto loop_end;
-		}
-		if(!SearchWord[0] || skip_try)
-			continue;
-		
+	for (size_t i = 0; i < candidates.size(); i++) {
+		const char *SearchWord = candidates[i].c_str();
 		bool bFound = false;
+		PrepareVirtualDictData(scan_dictmask, SearchWord);
 		for (size_t iLib=0;iLib<scan_dictmask.size();iLib++)
 			BuildResultData(scan_dictmask, SearchWord, iIndex, false, iLib, pppWord, ppppWordData, bFound, 2);
 		for (size_t iLib=0; iLib<scan_dictmask.size(); iLib++)
@@ -832,18 +804,23 @@ bool AppCore::LocalSmartLookupToFloat(const gchar* sWord, int BeginPos)
 			oTopWin.InsertHisList(SearchWord);
 			FreeResultData(scan_dictmask.size(), pppWord, ppppWordData);
 			g_free(iIndex);
-			g_free(SearchWord);
 			return true;
 		}
 	}
-loop_end:
 	FreeResultData(scan_dictmask.size(), pppWord, ppppWordData);
 	g_free(iIndex);
-	g_free(SearchWord);
 	return false;
 }
 #endif
 
+/* Let virtual dictionaries start on sWord while local dictionaries are searched. */
+void AppCore::PrepareVirtualDictData(std::vector<InstantDictIndex> &dictmask, const char* sWord)
+{
+	for (size_t iLib=0; iLib<dictmask.size(); iLib++)
+		if (dictmask[iLib].type == InstantDictType_VIRTUAL)
+			oStarDictPlugins->VirtualDictPlugins.prepare(dictmask[iLib].index, sWord);
+}
+
 void AppCore::BuildVirtualDictData(std::vector<InstantDictIndex> &dictmask, const char* sWord, int iLib, gchar ***pppWord, gchar ****ppppWordData, bool &bFound)
 {
 	if (dictmask[iLib].type == InstantDictType_NET) {
@@ -891,16 +868,8 @@ void AppCore::BuildResultData(std::vector<InstantDictIndex> &dictmask, const cha
 			bLookupSynonymWord = false;
 		}
 	} else {
-		if (Method==0) {
-			bLookupWord = oLibs.LookupWord(sWord, iIndex[iLib].idx, iIndex[iLib].idx_suggest, iRealLib, 0);
-			bLookupSynonymWord = oLibs.LookupSynonymWord(sWord, iIndex[iLib].synidx, iIndex[iLib].synidx_suggest, iRealLib, 0);
-		} else if (Method==1) {
-			bLookupWord = oLibs.LookupSimilarWord(sWord, iIndex[iLib].idx, iIndex[iLib].idx_suggest, iRealLib, 0);
-			bLookupSynonymWord = oLibs.LookupSynonymSimilarWord(sWord, iIndex[iLib].synidx, iIndex[iLib].synidx_suggest, iRealLib, 0);
-		} else {
-			bLookupWord = oLibs.SimpleLookupWord(sWord, iIndex[iLib].idx, iIndex[iLib].idx_suggest, iRealLib, 0);
-			bLookupSynonymWord = oLibs.SimpleLookupSynonymWord(sWord, iIndex[iLib].synidx, iIndex[iLib].synidx_suggest, iRealLib, 0);
-		}
+		oLibs.LookupWordAndSynonym(sWord, LookupMethod(Method), iRealLib, 0,
+			iIndex[iLib], bLookupWord, bLookupSynonymWord);
 	}
 	if (bLookupWord || bLookupSynonymWord) {
 		glong orig_idx, orig_synidx;
@@ -991,6 +960,7 @@ bool AppCore::SimpleLookupToTextWin(const char* sWord, CurrentIndex *piIndex, co
 	else
 		iIndex = piIndex;
 
+	PrepareVirtualDictData(query_dictmask, piIndexValidStr?piIndexValidStr:sWord);
 	for (size_t iLib=0; iLib<query_dictmask.size(); iLib++)
 		BuildResultData(query_dictmask, sWord, iIndex, piIndexValidStr, iLib, pppWord, ppppWordData, bFound, 0);
 	if (!bFound && !piIndexValidStr) {
@@ -1011,6 +981,7 @@ bool AppCore::SimpleLookupToTextWin(const char* sWord, CurrentIndex *piIndex, co
 					if (bShowNotfound)
 						ShowNotFoundToTextWin(sWord,_("<Not Found!>"), TEXT_WIN_NOT_FOUND);
 				} else {
+					PrepareVirtualDictData(query_dictmask, hword);
 					for (size_t iLib=0;iLib<query_dictmask.size();iLib++)
 						BuildResultData(query_dictmask, hword, iIndex, NULL, iLib, pppWord, ppppWordData, bFound, 0);
 					if (!bFound) {
@@ -1231,7 +1202,6 @@ void AppCore::LookupDataWithDictMask(const gchar *sWord, std::vector<InstantDict
 	g_signal_connect (G_OBJECT (search_window), "delete_event", G_CALLBACK (on_fulltext_search_window_delete_event), &cancel);
 	gtk_widget_show_all(search_window);
 
-	//clock_t t=clock();
 	std::vector< std::vector<gchar *> > reslist(dictmask.size());
 	if (oLibs.LookupData(sWord, &reslist[0], updateSearchDialog, &Dialog, &cancel, dictmask)) {
 		for (size_t i=0; i<dictmask.size(); i++) {
@@ -1245,8 +1215,6 @@ void AppCore::LookupDataWithDictMask(const gchar *sWord, std::vector<InstantDict
 	} else {
 		ShowNotFoundToTextWin(sWord, _("There are no dictionary articles containing this word. :-("), TEXT_WIN_FUZZY_NOT_FOUND);
 	}
-	//t=clock()-t;
-	//g_message("Time: %.3lf sec\n", double(t)/CLOCKS_PER_SEC);
 	gtk_widget_destroy(search_window);
 }
 
@@ -1313,6 +1281,7 @@ void AppCore::LookupWithFuzzyToFloatWin(const gchar *sWord)
 			ppppWordData = (gchar ****)g_malloc(sizeof(gchar ***) * scan_dictmask.size());
 
 			ppOriginWord[i] = fuzzy_reslist[i];
+			PrepareVirtualDictData(scan_dictmask, fuzzy_reslist[i]);
 			for (size_t iLib=0; iLib<scan_dictmask.size(); iLib++)
 				BuildResultData(scan_dictmask, fuzzy_reslist[i], iIndex, NULL, iLib, pppWord, ppppWordData, bFound, 2);
 			for (size_t iLib=0; iLib<scan_dictmask.size(); iLib++)
@@ -1947,9 +1916,15 @@ void AppCore::reload_dicts()
 	GetUsedDictList(load_list);
 	std::list<std::string> s_load_list;
 	DictItemId::convert(s_load_list, load_list);
+	oDictReloader.wait();
 	oLibs.reload(s_load_list,
 		conf->get_bool_at("dictionary/enable_collation") ? CollationLevel_SINGLE : CollationLevel_NONE,
 		int_to_colate_func(conf->get_int_at("dictionary/collate_function")));
+	on_dicts_reloaded();
+}
+
+void AppCore::on_dicts_reloaded()
+{
 	UpdateDictMask();
 
 	const gchar *sWord = oTopWin.get_text();
@@ -2056,6 +2031,8 @@ void AppCore::Init(const gchar *queryword)
 			 sigc::mem_fun(this, &AppCore::on_dict_scan_select_changed));
 	conf->notify_add("/apps/stardict/preferences/dictionary/scan_modifier_key",
 			 sigc::mem_fun(this, &AppCore::on_scan_modifier_key_changed));
+	conf->notify_add("/apps/stardict/preferences/dictionary/auto_reload_interval",
+			 sigc::mem_fun(this, &AppCore::on_auto_reload_interval_changed));
 
 	g_debug(_("Loading skin..."));
 #ifdef _WIN32
@@ -2157,6 +2134,12 @@ void AppCore::on_scan_modifier_key_changed(const baseconfval* keyval)
 	unlock_keys->set_comb(combnum2str(key));
 }
 
+void AppCore::on_auto_reload_interval_changed(const baseconfval* intervalval)
+{
+	int interval = static_cast<const confval<int> *>(intervalval)->val_;
+	oDictReloader.set_interval(interval > 0 ? interval : 0);
+}
+
 gchar* GetPureEnglishAlpha(gchar *str)
 {
 	while (*str && (!((*str >= 'a' && *str <='z')||(*str >= 'A' && *str <='Z'))))
@@ -2302,6 +2285,23 @@ void synchronize_crt_enviroment(void)
 }
 #endif
 
+static LookupStatsFormat lookup_stats_format = LookupStatsFormat_TEXT;
+
+static void print_lookup_stats(void)
+{
+	std::string stats;
+	lookup_stats_dump(stats, lookup_stats_format);
+	g_print("%s", stats.c_str());
+}
+
+#ifndef _WIN32
+static gboolean on_dump_lookup_stats_signal(gpointer user_data)
+{
+	print_lookup_stats();
+	return TRUE;
+}
+#endif
+
 #ifdef _WIN32
 DLLIMPORT int stardict_main(HINSTANCE hInstance, int argc, char **argv)
 #else
@@ -2370,6 +2370,18 @@ int main(int argc,char **argv)
 	logger->set_console_message_level(CmdLineOptions::get_console_message_level());
 	logger->set_log_message_level(CmdLineOptions::get_log_message_level());
 
+	const char *lookup_stats_option = CmdLineOptions::get_lookup_stats();
+	if (lookup_stats_option) {
+		if (!lookup_stats_parse_format(lookup_stats_option, lookup_stats_format)) {
+			g_warning(_("Unknown lookup statistics format: %s"), lookup_stats_option);
+			return EXIT_FAILURE;
+		}
+		lookup_stats_enable();
+#ifndef _WIN32
+		g_unix_signal_add(SIGUSR1, on_dump_lookup_stats_signal, NULL);
+#endif
+	}
+
 #ifndef CONFIG_GNOME
 #ifdef _WIN32
 	if (CmdLineOptions::get_newinstance() == FALSE) {
@@ -2418,6 +2430,8 @@ int main(int argc,char **argv)
 	AppCore oAppCore;
 	gpAppFrame = &oAppCore;
 	oAppCore.Init(query_word);
+	if (lookup_stats_option)
+		print_lookup_stats();
 
 	return EXIT_SUCCESS;
 }
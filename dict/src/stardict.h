@@ -38,6 +38,9 @@ class AppCore;
 #include "lib/utils.h"
 #include "lib/stardict_client.h"
 #include "lib/pluginmanager.h"
+#include "lib/parsepipeline.h"
+#include "lib/articlecache.h"
+#include "imageloader.h"
 #include "lib/httpmanager.h"
 #include "skin.h"
 #include "mainwin.h"
@@ -56,6 +59,7 @@ class AppCore;
 #include "lib/compositelookup.h"
 #include "lib/full_text_trans.h"
 #include "lib/stddict.h"
+#include "lib/dictreloader.h"
 #include "lib/treedict.h"
 
 extern AppCore *gpAppFrame;
@@ -66,6 +70,10 @@ const int MAX_FUZZY_MATCH_ITEM=100;
 const int MAX_FLOAT_WINDOW_FUZZY_MATCH_ITEM=5;
 
 const int LIST_WIN_ROW_NUM = 30; //how many words show in the list win.
+const int PARSE_PIPELINE_THREADS = 2;
+const size_t ARTICLE_CACHE_SIZE = 8 * 1024 * 1024;
+const int IMAGE_LOADER_THREADS = 2;
+const size_t IMAGE_CACHE_SIZE = 32 * 1024 * 1024;
 
 class DictManageDlg;
 class PluginManageDlg;
@@ -86,9 +94,11 @@ private:
 	static gboolean on_window_state_event(GtkWidget * window, GdkEventWindowState *event , AppCore *oAppCore);
 	static gboolean vKeyPressReleaseCallback(GtkWidget * window, GdkEventKey *event , AppCore *oAppCore);
 	void reload_dicts();
+	void on_dicts_reloaded();
 	void on_main_win_hide_list_changed(const baseconfval*);
 	void on_dict_scan_select_changed(const baseconfval*);
 	void on_scan_modifier_key_changed(const baseconfval*);
+	void on_auto_reload_interval_changed(const baseconfval*);
 	static gboolean on_word_change_timeout(gpointer data);
 	void stop_word_change_timer();
 	void on_change_scan(bool val);
@@ -96,7 +106,7 @@ private:
 	void on_docklet_middle_button_click();
 	bool SimpleLookupToFloatLocal(const gchar* sWord);
 #ifdef _WIN32
-	bool LocalSmartLookupToFloat(const gchar* sWord, int BeginPos);
+	bool LocalSmartLookupToFloat(const std::vector<std::string> &candidates);
 #endif
 public:
 	CurrentIndex *iCurrentIndex;
@@ -119,9 +129,16 @@ public:
 	std::auto_ptr<TrayBase> oDockLet;
 
 	Libs oLibs;
+	DictReloader oDictReloader;
 	TreeDicts oTreeDicts;
 	StarDictClient oStarDictClient;
 	StarDictPlugins *oStarDictPlugins;
+	/* parses large articles of the main window in the background */
+	ParsePipeline *oParsePipeline;
+	/* parsed articles shown recently in any window */
+	ArticleCache oArticleCache;
+	/* decodes and caches pictures of articles */
+	ImageLoader *oImageLoader;
 	HttpManager oHttpManager;
 	std::auto_ptr<hotkeys> unlock_keys;
 	AppSkin oAppSkin;
@@ -144,6 +161,7 @@ public:
 	void End();
 	void Query(const gchar *word);
 	void BuildResultData(std::vector<InstantDictIndex> &dictmask, const char* sWord, CurrentIndex *iIndex, const gchar *piIndexValidStr, int iLib, gchar ***pppWord, gchar ****ppppWordData, bool &bFound, gint Method);
+	void PrepareVirtualDictData(std::vector<InstantDictIndex> &dictmask, const char* sWord);
 	void BuildVirtualDictData(std::vector<InstantDictIndex> &dictmask, const char* sWord, int iLib, gchar ***pppWord, gchar ****ppppWordData, bool &bFound);
 	static void FreeResultData(size_t dictmask_size, gchar ***pppWord, gchar ****ppppWordData);
 	void SimpleLookupToFloat(const char* sToken, bool IgnoreScanModifierKey = false);
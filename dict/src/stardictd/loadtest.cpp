@@ -0,0 +1,143 @@
+/*
+ * This file is part of StarDict.
+ *
+ * StarDict is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * StarDict is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with StarDict.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include "loadtest.h"
+
+/* the test is given up when no reply comes for this long */
+static const guint STALL_SECONDS = 10;
+
+LoadTest::LoadTest(const std::vector<std::string> &_words, int clients, int requests)
+:
+	words(_words),
+	nclients(clients),
+	nrequests(requests),
+	sent(0),
+	hits(0),
+	errors(0),
+	last_done(0),
+	elapsed(0),
+	loop(NULL),
+	stalled(false)
+{
+}
+
+LoadTest::~LoadTest()
+{
+	for (size_t i = 0; i < clients.size(); i++)
+		delete clients[i];
+}
+
+bool LoadTest::run(const char *host, int port)
+{
+	if (words.empty() || nclients <= 0)
+		return true;
+	loop = g_main_loop_new(NULL, FALSE);
+	for (int i = 0; i < nclients; i++) {
+		StarDictClient *client = new StarDictClient();
+		client->set_server(host, port);
+		clients.push_back(client);
+	}
+	/* the signals are shared by all clients */
+	sigc::connection lookup_conn = StarDictClient::on_lookup_end_.connect(
+		sigc::mem_fun(this, &LoadTest::on_lookup_end));
+	sigc::connection error_conn = StarDictClient::on_error_.connect(
+		sigc::mem_fun(this, &LoadTest::on_error));
+	gint64 start = g_get_monotonic_time();
+	for (size_t i = 0; i < clients.size(); i++)
+		send_lookup(i);
+	guint check_id = g_timeout_add_seconds(STALL_SECONDS, on_check, this);
+	if (!pending.empty())
+		g_main_loop_run(loop);
+	elapsed = g_get_monotonic_time() - start;
+	if (!stalled)
+		g_source_remove(check_id);
+	lookup_conn.disconnect();
+	error_conn.disconnect();
+	g_main_loop_unref(loop);
+	loop = NULL;
+	return !stalled;
+}
+
+void LoadTest::send_lookup(size_t client)
+{
+	if (sent >= nrequests)
+		return;
+	STARDICT::Cmd *c = new STARDICT::Cmd(STARDICT::CMD_LOOKUP, words[sent % words.size()].c_str());
+	Pending p;
+	p.client = client;
+	p.start = g_get_monotonic_time();
+	pending[c->seq] = p;
+	sent++;
+	clients[client]->send_commands(1, c);
+}
+
+void LoadTest::on_lookup_end(const struct STARDICT::LookupResponse *lookup_response, unsigned int seq)
+{
+	std::map<unsigned int, Pending>::iterator it = pending.find(seq);
+	if (it == pending.end())
+		return;
+	latency.record(g_get_monotonic_time() - it->second.start);
+	if (!lookup_response->dict_response.dict_result_list.empty())
+		hits++;
+	size_t client = it->second.client;
+	pending.erase(it);
+	send_lookup(client);
+	if (pending.empty())
+		g_main_loop_quit(loop);
+}
+
+void LoadTest::on_error(const char *error)
+{
+	if (errors == 0)
+		g_print("Error: %s\n", error);
+	errors++;
+}
+
+gboolean LoadTest::on_check(gpointer data)
+{
+	LoadTest *test = static_cast<LoadTest *>(data);
+	if (test->latency.get_count() == test->last_done) {
+		test->stalled = true;
+		g_main_loop_quit(test->loop);
+		return FALSE;
+	}
+	test->last_done = test->latency.get_count();
+	return TRUE;
+}
+
+void LoadTest::print_results() const
+{
+	const guint64 done = latency.get_count();
+	g_print("clients: %d, requests: %d, done: %" G_GUINT64_FORMAT ", hits: %"
+		G_GUINT64_FORMAT ", errors: %" G_GUINT64_FORMAT "\n",
+		nclients, sent, done, hits, errors);
+	g_print("time: %.1f ms, qps: %.1f\n", elapsed / 1000.0,
+		elapsed > 0 ? double(done) * G_USEC_PER_SEC / elapsed : 0.0);
+	g_print("%10s %10s %10s %10s %10s\n",
+		"mean,us", "p50,us", "p90,us", "p99,us", "max,us");
+	g_print("%10.1f %10" G_GUINT64_FORMAT " %10" G_GUINT64_FORMAT " %10"
+		G_GUINT64_FORMAT " %10" G_GUINT64_FORMAT "\n",
+		latency.get_mean(), latency.get_percentile(50), latency.get_percentile(90),
+		latency.get_percentile(99), latency.get_max());
+	if (stalled)
+		g_print("the server stopped answering, %lu requests are lost\n",
+			(unsigned long)pending.size());
+}
@@ -0,0 +1,67 @@
+/*
+ * This file is part of StarDict.
+ *
+ * StarDict is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * StarDict is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with StarDict.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _STARDICTD_LOADTEST_H_
+#define _STARDICTD_LOADTEST_H_
+
+#include <glib.h>
+#include <string>
+#include <vector>
+#include <map>
+
+#include "lib/stardict_client.h"
+#include "lib/lookupstats.h"
+
+/* Load test of a StarDict server.
+ * Several StarDictClient objects, the client of the net dictionaries, each
+ * with its own connection, look up words in a main loop. A client sends the
+ * next lookup when it gets the reply to the previous one. */
+class LoadTest : public sigc::trackable {
+public:
+	LoadTest(const std::vector<std::string> &words, int clients, int requests);
+	~LoadTest();
+	/* Returns false if the server stopped answering before all requests
+	 * were done. */
+	bool run(const char *host, int port);
+	void print_results() const;
+private:
+	struct Pending {
+		size_t client;
+		gint64 start;
+	};
+	void send_lookup(size_t client);
+	void on_lookup_end(const struct STARDICT::LookupResponse *lookup_response, unsigned int seq);
+	void on_error(const char *error);
+	static gboolean on_check(gpointer data);
+
+	const std::vector<std::string> &words;
+	int nclients;
+	int nrequests;
+	std::vector<StarDictClient *> clients;
+	/* by Cmd seq */
+	std::map<unsigned int, Pending> pending;
+	int sent;
+	guint64 hits;
+	guint64 errors;
+	guint64 last_done;
+	LatencyHistogram latency;
+	gint64 elapsed;
+	GMainLoop *loop;
+	bool stalled;
+};
+
+#endif
@@ -0,0 +1,372 @@
+/*
+ * This file is part of StarDict.
+ *
+ * StarDict is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * StarDict is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with StarDict.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <cerrno>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include "lib/sockets.h"
+
+#include "server.h"
+
+/* a longer command line closes the connection */
+static const std::string::size_type MAX_LINE_LENGTH = 4096;
+/* no new command of a connection is started while more than this is
+ * waiting to be sent, a client that does not read cannot make the server
+ * buffer its replies without bound */
+static const std::string::size_type MAX_PENDING_OUTPUT = 1024 * 1024;
+/* the connection is not read while this many commands are waiting, the
+ * rest stays in the socket */
+static const std::list<std::string>::size_type MAX_QUEUED_LINES = 32;
+/* recv calls per wakeup, so a fast client does not hold up the others */
+static const int MAX_READS_PER_WAKEUP = 16;
+static const int MAX_EVENTS = 64;
+static const int LISTEN_BACKLOG = 128;
+
+Server::Server(ServerData &_data, gint max_threads)
+:
+	data(_data),
+	listen_fd(-1),
+	stopping(0)
+{
+	pool = g_thread_pool_new(worker_func, this, max_threads, FALSE, NULL);
+	done = g_async_queue_new();
+	epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	struct epoll_event ev;
+	ev.events = EPOLLIN;
+	ev.data.ptr = &wake_fd;
+	epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wake_fd, &ev);
+}
+
+Server::~Server()
+{
+	for (std::set<Connection *>::iterator it = connections.begin(); it != connections.end(); ++it) {
+		Socket::close((*it)->fd);
+		(*it)->closed = true;
+		if (!(*it)->busy) {
+			delete (*it)->session;
+			delete *it;
+		}
+	}
+	connections.clear();
+	free_closed_connections();
+	g_thread_pool_free(pool, FALSE, TRUE);
+	/* only the jobs of closed connections remain */
+	Job *job;
+	while ((job = static_cast<Job *>(g_async_queue_try_pop(done))) != NULL) {
+		delete job->conn->session;
+		delete job->conn;
+		delete job;
+	}
+	g_async_queue_unref(done);
+	if (listen_fd != -1)
+		Socket::close(listen_fd);
+	close(wake_fd);
+	close(epoll_fd);
+}
+
+bool Server::listen(int port)
+{
+	listen_fd = Socket::socket();
+	if (listen_fd == -1) {
+		g_print("Create socket failed: %s\n", Socket::get_error_msg().c_str());
+		return false;
+	}
+	Socket::set_reuse_addr(listen_fd);
+	if (!Socket::bind(listen_fd, port) || !Socket::listen(listen_fd, LISTEN_BACKLOG)) {
+		g_print("Listen on port %d failed: %s\n", port, Socket::get_error_msg().c_str());
+		return false;
+	}
+	Socket::set_non_blocking(listen_fd);
+	struct epoll_event ev;
+	ev.events = EPOLLIN;
+	ev.data.ptr = &listen_fd;
+	epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &ev);
+	return true;
+}
+
+void Server::stop()
+{
+	g_atomic_int_set(&stopping, 1);
+	guint64 one = 1;
+	if (write(wake_fd, &one, sizeof(one)) < 0) {
+		/* the counter is already set */
+	}
+}
+
+void Server::run()
+{
+	struct epoll_event events[MAX_EVENTS];
+	while (!g_atomic_int_get(&stopping)) {
+		int n = epoll_wait(epoll_fd, events, MAX_EVENTS, -1);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			g_print("epoll_wait failed: %s\n", Socket::get_error_msg().c_str());
+			break;
+		}
+		for (int i = 0; i < n; i++) {
+			if (events[i].data.ptr == &listen_fd) {
+				on_accept();
+			} else if (events[i].data.ptr == &wake_fd) {
+				on_jobs_done();
+			} else {
+				Connection *conn = static_cast<Connection *>(events[i].data.ptr);
+				/* closed by an earlier event of this round */
+				if (conn->closed)
+					continue;
+				/* the replies cannot be delivered any more */
+				if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+					close_connection(conn);
+					continue;
+				}
+				if ((events[i].events & EPOLLIN) && !on_read(conn))
+					continue;
+				if ((events[i].events & EPOLLOUT) && flush(conn))
+					dispatch(conn);
+			}
+		}
+		free_closed_connections();
+	}
+}
+
+void Server::on_accept()
+{
+	for (;;) {
+		int fd = Socket::accept(listen_fd);
+		if (fd == -1)
+			return;
+		Socket::set_non_blocking(fd);
+		int on = 1;
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+		Connection *conn = new Connection;
+		conn->fd = fd;
+		conn->session = new Session(data);
+		conn->out_pos = 0;
+		conn->busy = false;
+		conn->closing = false;
+		conn->eof = false;
+		conn->closed = false;
+		conn->want_out = false;
+		conn->events = EPOLLIN;
+		struct epoll_event ev;
+		ev.events = EPOLLIN;
+		ev.data.ptr = conn;
+		if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+			Socket::close(fd);
+			delete conn->session;
+			delete conn;
+			continue;
+		}
+		connections.insert(conn);
+		conn->out = conn->session->banner();
+		flush(conn);
+	}
+}
+
+bool Server::on_read(Connection *conn)
+{
+	char buf[4096];
+	for (int i = 0; i < MAX_READS_PER_WAKEUP; i++) {
+		ssize_t len = recv(conn->fd, buf, sizeof(buf), 0);
+		if (len > 0) {
+			conn->in.append(buf, len);
+			continue;
+		}
+		if (len < 0 && errno == EINTR)
+			continue;
+		if (len < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			break;
+		if (len < 0) {
+			close_connection(conn);
+			return false;
+		}
+		conn->eof = true;
+		break;
+	}
+	if (conn->closing)
+		conn->in.clear();
+	split_lines(conn);
+	/* the first line not taken yet */
+	const std::string::size_type eol = conn->in.find('\n');
+	if ((eol == std::string::npos ? conn->in.length() : eol) > MAX_LINE_LENGTH) {
+		close_connection(conn);
+		return false;
+	}
+	dispatch(conn);
+	/* an idle connection was shut down */
+	if (conn->eof && !conn->busy && conn->out.empty()) {
+		close_connection(conn);
+		return false;
+	}
+	return true;
+}
+
+/* Move the complete lines of the received text to the commands waiting,
+ * at most MAX_QUEUED_LINES of them. */
+void Server::split_lines(Connection *conn)
+{
+	std::string::size_type start = 0, end;
+	while (conn->lines.size() < MAX_QUEUED_LINES
+		&& (end = conn->in.find('\n', start)) != std::string::npos) {
+		std::string::size_type len = end - start;
+		if (len > 0 && conn->in[end-1] == '\r')
+			len--;
+		conn->lines.push_back(conn->in.substr(start, len));
+		start = end + 1;
+	}
+	conn->in.erase(0, start);
+}
+
+/* Start the next command and watch the socket for reading only while the
+ * connection is not throttled. */
+void Server::dispatch(Connection *conn)
+{
+	if (!conn->busy && !conn->closing
+		&& conn->out.length() - conn->out_pos <= MAX_PENDING_OUTPUT) {
+		split_lines(conn);
+		if (!conn->lines.empty()) {
+			Job *job = new Job;
+			job->conn = conn;
+			job->line = conn->lines.front();
+			job->keep = true;
+			conn->lines.pop_front();
+			conn->busy = true;
+			g_thread_pool_push(pool, job, NULL);
+		}
+	}
+	update_events(conn);
+}
+
+void Server::worker_func(gpointer data, gpointer user_data)
+{
+	Job *job = static_cast<Job *>(data);
+	Server *server = static_cast<Server *>(user_data);
+	/* the loop thread does not touch the session while busy is set */
+	job->keep = job->conn->session->execute(job->line, job->reply);
+	g_async_queue_push(server->done, job);
+	guint64 one = 1;
+	if (write(server->wake_fd, &one, sizeof(one)) < 0) {
+		/* the counter is already set */
+	}
+}
+
+void Server::on_jobs_done()
+{
+	guint64 count;
+	if (read(wake_fd, &count, sizeof(count)) < 0) {
+		/* spurious wakeup */
+	}
+	Job *job;
+	while ((job = static_cast<Job *>(g_async_queue_try_pop(done))) != NULL) {
+		Connection *conn = job->conn;
+		conn->busy = false;
+		if (conn->closed) {
+			closed_connections.push_back(conn);
+			delete job;
+			continue;
+		}
+		conn->out += job->reply;
+		if (!job->keep) {
+			conn->closing = true;
+			conn->lines.clear();
+			conn->in.clear();
+		}
+		delete job;
+		if (flush(conn))
+			dispatch(conn);
+	}
+}
+
+bool Server::flush(Connection *conn)
+{
+	while (conn->out_pos < conn->out.length()) {
+		ssize_t len = send(conn->fd, conn->out.data() + conn->out_pos,
+			conn->out.length() - conn->out_pos, MSG_NOSIGNAL);
+		if (len > 0) {
+			conn->out_pos += len;
+			continue;
+		}
+		if (len < 0 && errno == EINTR)
+			continue;
+		if (len < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			if (!conn->want_out) {
+				conn->want_out = true;
+				update_events(conn);
+			}
+			return true;
+		}
+		close_connection(conn);
+		return false;
+	}
+	conn->out.clear();
+	conn->out_pos = 0;
+	if (conn->want_out) {
+		conn->want_out = false;
+		update_events(conn);
+	}
+	if (!conn->busy && (conn->closing || (conn->eof && conn->lines.empty()))) {
+		close_connection(conn);
+		return false;
+	}
+	return true;
+}
+
+void Server::update_events(Connection *conn)
+{
+	/* a shut down socket is always readable, a throttled connection is
+	 * read when its commands and replies are done */
+	const bool throttled = conn->lines.size() >= MAX_QUEUED_LINES
+		|| conn->out.length() - conn->out_pos > MAX_PENDING_OUTPUT;
+	const guint32 events = (conn->eof || throttled ? 0 : EPOLLIN)
+		| (conn->want_out ? EPOLLOUT : 0);
+	if (events == conn->events)
+		return;
+	conn->events = events;
+	struct epoll_event ev;
+	ev.events = events;
+	ev.data.ptr = conn;
+	epoll_ctl(epoll_fd, EPOLL_CTL_MOD, conn->fd, &ev);
+}
+
+void Server::close_connection(Connection *conn)
+{
+	epoll_ctl(epoll_fd, EPOLL_CTL_DEL, conn->fd, NULL);
+	Socket::close(conn->fd);
+	conn->closed = true;
+	connections.erase(conn);
+	if (!conn->busy)
+		closed_connections.push_back(conn);
+}
+
+void Server::free_closed_connections()
+{
+	for (size_t i = 0; i < closed_connections.size(); i++) {
+		delete closed_connections[i]->session;
+		delete closed_connections[i];
+	}
+	closed_connections.clear();
+}
@@ -0,0 +1,105 @@
+/*
+ * This file is part of StarDict.
+ *
+ * StarDict is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * StarDict is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with StarDict.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _STARDICTD_SERVER_H_
+#define _STARDICTD_SERVER_H_
+
+#include <glib.h>
+#include <string>
+#include <list>
+#include <set>
+#include <vector>
+
+#include "session.h"
+
+/* StarDict protocol server.
+ * One thread runs an epoll loop over the listening socket and all client
+ * sockets, commands are executed by a pool of worker threads. A connection
+ * has at most one command in a worker, so the replies come in the order of
+ * the commands, further commands that the client sent without waiting wait
+ * in the connection. A worker hands the reply back through a queue and
+ * wakes the loop with an eventfd. */
+class Server {
+public:
+	Server(ServerData &data, gint max_threads);
+	~Server();
+	/* Returns false and prints the reason on failure. */
+	bool listen(int port);
+	/* Serve till stop() is called. */
+	void run();
+	/* May be called from any thread. */
+	void stop();
+private:
+	struct Connection {
+		int fd;
+		Session *session;
+		/* received text not yet split into lines */
+		std::string in;
+		/* commands waiting for the running one */
+		std::list<std::string> lines;
+		std::string out;
+		std::string::size_type out_pos;
+		/* a command of the connection is in a worker */
+		bool busy;
+		/* close when out is sent */
+		bool closing;
+		/* the client has shut down its side, close when the commands
+		 * are done and out is sent */
+		bool eof;
+		/* the socket is closed, the connection is freed when the
+		 * worker returns */
+		bool closed;
+		/* EPOLLOUT is wanted */
+		bool want_out;
+		/* the events watched now */
+		guint32 events;
+	};
+	struct Job {
+		Connection *conn;
+		std::string line;
+		std::string reply;
+		bool keep;
+	};
+
+	static void worker_func(gpointer data, gpointer user_data);
+	void on_accept();
+	/* on_read() and flush() return false if the connection is closed. */
+	bool on_read(Connection *conn);
+	void on_jobs_done();
+	void split_lines(Connection *conn);
+	void dispatch(Connection *conn);
+	bool flush(Connection *conn);
+	void update_events(Connection *conn);
+	void close_connection(Connection *conn);
+	void free_closed_connections();
+
+	ServerData &data;
+	GThreadPool *pool;
+	/* finished jobs */
+	GAsyncQueue *done;
+	int epoll_fd;
+	int listen_fd;
+	int wake_fd;
+	gint stopping;
+	std::set<Connection *> connections;
+	/* Closed connections are freed when the events of the round of
+	 * epoll_wait are handled. Till then a connection accepted in the round
+	 * cannot get the address the later events of a closed one point to. */
+	std::vector<Connection *> closed_connections;
+};
+
+#endif
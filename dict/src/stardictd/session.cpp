@@ -0,0 +1,464 @@
+/*
+ * This file is part of StarDict.
+ *
+ * StarDict is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * StarDict is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with StarDict.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+
+#include "lib/utils.h"
+
+#include "session.h"
+
+/* the reply codes of stardict_client.cpp */
+#define CODE_HELLO                   220 /* text msg-id */
+#define CODE_GOODBYE                 221 /* Closing Connection */
+#define CODE_OK                      250 /* ok */
+#define CODE_SYNTAX_ERROR            500 /* syntax, command not recognized */
+#define CODE_DENIED                  521
+#define CODE_DICTMASK_NOTSET         522
+#define CODE_NOT_FOUND               550 /* no such dir or dict */
+
+/* the most words in a list reply */
+static const int MAX_LIST_COUNT = 100;
+
+DictLocks::DictLocks(size_t count)
+:
+	count(count)
+{
+	locks = g_new(GMutex, count);
+	for (size_t i = 0; i < count; i++)
+		g_mutex_init(&locks[i]);
+	g_mutex_init(&info_mutex);
+}
+
+DictLocks::~DictLocks()
+{
+	for (size_t i = 0; i < count; i++)
+		g_mutex_clear(&locks[i]);
+	g_free(locks);
+	g_mutex_clear(&info_mutex);
+}
+
+void DictLocks::lock(const std::vector<InstantDictIndex> &dictmask, std::vector<size_t> &locked)
+{
+	locked.clear();
+	for (size_t i = 0; i < dictmask.size(); i++)
+		if (dictmask[i].type == InstantDictType_LOCAL)
+			locked.push_back(dictmask[i].index);
+	std::sort(locked.begin(), locked.end());
+	locked.erase(std::unique(locked.begin(), locked.end()), locked.end());
+	for (size_t i = 0; i < locked.size(); i++)
+		lock(locked[i]);
+}
+
+void DictLocks::unlock(const std::vector<size_t> &locked)
+{
+	for (size_t i = locked.size(); i > 0; i--)
+		unlock(locked[i-1]);
+}
+
+ServerData::ServerData(Libs &libs, int max_dict_count)
+:
+	oLibs(libs),
+	locks(libs.ndicts()),
+	max_dict_count(max_dict_count)
+{
+	default_dicts = oLibs.get_dict_uids(0);
+}
+
+static void reply_status(std::string &reply, int code, const char *text)
+{
+	gchar *line = g_strdup_printf("%d %s\n", code, text);
+	reply += line;
+	g_free(line);
+}
+
+/* A string reply ends with '\0'. */
+static void reply_string(std::string &reply, const char *str)
+{
+	reply += str;
+	reply += '\0';
+}
+
+static void reply_size(std::string &reply, guint32 size)
+{
+	guint32 nsize = g_htonl(size);
+	reply.append((const char *)&nsize, sizeof(guint32));
+}
+
+/* data is a StarDict data block, it starts with its size in host order,
+ * the size is sent in network order. */
+static void reply_data(std::string &reply, const gchar *data)
+{
+	if (!data)
+		return;
+	guint32 size = get_uint32(data);
+	reply_size(reply, size);
+	reply.append(data + sizeof(guint32), size);
+}
+
+static int get_count(const std::string &arg, int def)
+{
+	int count = atoi(arg.c_str());
+	if (count <= 0)
+		return def;
+	if (count > MAX_LIST_COUNT)
+		return MAX_LIST_COUNT;
+	return count;
+}
+
+/* Split the line into arguments, undo the escaping of arg_escape() in
+ * stardict_client.cpp. Returns false on a bad escape sequence. */
+static bool split_args(const std::string &line, std::vector<std::string> &args)
+{
+	std::string arg;
+	args.clear();
+	for (std::string::size_type i = 0; i < line.length(); i++) {
+		char c = line[i];
+		if (c == '\\') {
+			if (++i == line.length())
+				return false;
+			c = line[i];
+			if (c == 'n')
+				arg += '\n';
+			else if (c == '\\' || c == ' ')
+				arg += c;
+			else
+				return false;
+		} else if (c == ' ') {
+			if (!arg.empty()) {
+				args.push_back(arg);
+				arg.clear();
+			}
+		} else {
+			arg += c;
+		}
+	}
+	if (!arg.empty())
+		args.push_back(arg);
+	return true;
+}
+
+Session::Session(ServerData &_data)
+:
+	data(_data),
+	collatefunc(0)
+{
+	gchar *str = g_strdup_printf("<%08x.%08x@stardictd>", g_random_int(), g_random_int());
+	stamp = str;
+	g_free(str);
+	set_dict_mask(data.default_dicts.c_str());
+}
+
+std::string Session::banner() const
+{
+	std::string line;
+	reply_status(line, CODE_HELLO, ("stardictd " VERSION " " + stamp).c_str());
+	return line;
+}
+
+bool Session::execute(const std::string &line, std::string &reply)
+{
+	std::vector<std::string> args;
+	if (!split_args(line, args) || args.empty()) {
+		reply_status(reply, CODE_SYNTAX_ERROR, "syntax error");
+		return true;
+	}
+	Libs::LookupLock lookup_lock(data.oLibs);
+	const std::string &cmd = args[0];
+	if (cmd == "quit") {
+		reply_status(reply, CODE_GOODBYE, "bye");
+		return false;
+	} else if (cmd == "client") {
+		reply_status(reply, CODE_OK, "ok");
+	} else if (cmd == "auth" || cmd == "register" || cmd == "change_password") {
+		reply_status(reply, CODE_DENIED, "user accounts are not supported");
+	} else if (cmd == "lookup" && args.size() >= 2) {
+		lookup(args[1].c_str(), args.size() >= 3 ? get_count(args[2], 30) : 30, reply);
+	} else if (cmd == "define" && args.size() >= 2) {
+		define(args[1].c_str(), reply);
+	} else if (cmd == "selectquery" && args.size() >= 2) {
+		select_query(args[1].c_str(), reply);
+	} else if (cmd == "smartquery" && args.size() >= 3) {
+		smart_query(args[1].c_str(), atoi(args[2].c_str()), reply);
+	} else if (cmd == "batchquery" && args.size() >= 3 && (args[1] == "first" || args[1] == "all")) {
+		batch_query(std::vector<std::string>(args.begin() + 2, args.end()), args[1] == "all", reply);
+	} else if (cmd == "previous" && args.size() >= 2) {
+		list_words(args[1].c_str(), true, args.size() >= 3 ? get_count(args[2], 15) : 15, reply);
+	} else if (cmd == "next" && args.size() >= 2) {
+		list_words(args[1].c_str(), false, args.size() >= 3 ? get_count(args[2], 30) : 30, reply);
+	} else if (cmd == "setdictmask") {
+		set_dict_mask(args.size() >= 2 ? args[1].c_str() : "");
+		reply_status(reply, CODE_OK, "ok");
+	} else if (cmd == "getdictmask") {
+		g_mutex_lock(&data.locks.info_mutex);
+		std::string list = data.oLibs.get_dicts_list(dicts.c_str(), data.max_dict_count, 0);
+		g_mutex_unlock(&data.locks.info_mutex);
+		reply_status(reply, CODE_OK, "ok");
+		reply_string(reply, list.c_str());
+	} else if (cmd == "maxdictcount") {
+		gchar *count = g_strdup_printf("%d", data.max_dict_count);
+		reply_status(reply, CODE_OK, "ok");
+		reply_string(reply, count);
+		g_free(count);
+	} else if ((cmd == "dirinfo" || cmd == "dictinfo") && args.size() >= 2) {
+		g_mutex_lock(&data.locks.info_mutex);
+		const std::string *info;
+		if (cmd == "dirinfo")
+			info = data.oLibs.get_dir_info(args[1].c_str());
+		else
+			info = data.oLibs.get_dict_info(args[1].c_str(), false);
+		if (info) {
+			reply_status(reply, CODE_OK, "ok");
+			reply_string(reply, info->c_str());
+		} else {
+			reply_status(reply, CODE_NOT_FOUND, "not found");
+		}
+		g_mutex_unlock(&data.locks.info_mutex);
+	} else if (cmd == "setcollatefunc" && args.size() >= 2) {
+		int func = atoi(args[1].c_str());
+		if (func < 0 || func > COLLATE_FUNC_NUMS) {
+			reply_status(reply, CODE_SYNTAX_ERROR, "bad collate function");
+			return true;
+		}
+		collatefunc = func;
+		set_dict_mask(dicts.c_str());
+		reply_status(reply, CODE_OK, "ok");
+	} else if (cmd == "getcollatefunc") {
+		gchar *func = g_strdup_printf("%d", collatefunc);
+		reply_status(reply, CODE_OK, "ok");
+		reply_string(reply, func);
+		g_free(func);
+	} else if (cmd == "getadinfo") {
+		reply_status(reply, CODE_OK, "ok");
+		reply_string(reply, "");
+	} else {
+		reply_status(reply, CODE_SYNTAX_ERROR, "unknown command");
+	}
+	return true;
+}
+
+void Session::set_dict_mask(const char *_dicts)
+{
+	dicts = _dicts;
+	data.oLibs.SetServerDictMask(dictmask, _dicts, data.max_dict_count, 0);
+	if (collatefunc == 0)
+		return;
+	/* getWord() loads the collation on first use too, but then the first
+	 * lookup of the session pays for it. */
+	std::vector<InstantDictIndex> one(1);
+	for (size_t i = 0; i < dictmask.size(); i++) {
+		one[0] = dictmask[i];
+		data.locks.lock(dictmask[i].index);
+		data.oLibs.LoadCollateFile(one, CollateFunctions(collatefunc-1));
+		data.locks.unlock(dictmask[i].index);
+	}
+}
+
+/* Append the dictionary results part of a lookup reply: for each dictionary
+ * with the word, the bookname, then the words with their data. Works like
+ * AppCore::BuildResultData(). iIndex receives the positions of sWord. */
+bool Session::append_articles(const char *sWord, LookupMethod method,
+	CurrentIndex *iIndex, std::string &articles)
+{
+	Libs &oLibs = data.oLibs;
+	bool bFound = false;
+	for (size_t iLib = 0; iLib < dictmask.size(); iLib++) {
+		if (dictmask[iLib].type != InstantDictType_LOCAL)
+			continue;
+		size_t iRealLib = dictmask[iLib].index;
+		bool bLookupWord, bLookupSynonymWord;
+		data.locks.lock(iRealLib);
+		oLibs.LookupWordAndSynonym(sWord, method, iRealLib, collatefunc,
+			iIndex[iLib], bLookupWord, bLookupSynonymWord);
+		if (bLookupWord || bLookupSynonymWord) {
+			glong orig_idx = oLibs.CltIndexToOrig(iIndex[iLib].idx, iRealLib, collatefunc);
+			glong orig_synidx = oLibs.CltSynIndexToOrig(iIndex[iLib].synidx, iRealLib, collatefunc);
+			gint count = 0;
+			reply_string(articles, oLibs.dict_name(iRealLib).c_str());
+			if (bLookupWord) {
+				count = oLibs.GetOrigWordCount(orig_idx, iRealLib, true);
+				reply_string(articles, oLibs.poGetOrigWord(orig_idx, iRealLib));
+				for (gint i = 0; i < count; i++)
+					reply_data(articles, oLibs.poGetOrigWordData(orig_idx+i, iRealLib));
+				reply_size(articles, 0);
+			}
+			if (bLookupSynonymWord) {
+				gint syncount = oLibs.GetOrigWordCount(orig_synidx, iRealLib, false);
+				for (gint j = 0; j < syncount; j++) {
+					glong iWordIdx = oLibs.poGetOrigSynonymWordIdx(orig_synidx+j, iRealLib);
+					if (bLookupWord && iWordIdx>=orig_idx && iWordIdx<orig_idx+count)
+						continue;
+					reply_string(articles, oLibs.poGetOrigWord(iWordIdx, iRealLib));
+					reply_data(articles, oLibs.poGetOrigWordData(iWordIdx, iRealLib));
+					reply_size(articles, 0);
+				}
+			}
+			reply_string(articles, "");
+			bFound = true;
+		}
+		data.locks.unlock(iRealLib);
+	}
+	return bFound;
+}
+
+void Session::lookup(const char *sWord, int list_count, std::string &reply)
+{
+	if (dictmask.empty()) {
+		reply_status(reply, CODE_DICTMASK_NOTSET, "dict mask not set");
+		return;
+	}
+	std::vector<CurrentIndex> iIndex(dictmask.size());
+	std::string articles;
+	if (!append_articles(sWord, LookupMethod_EXACT, &iIndex[0], articles))
+		append_articles(sWord, LookupMethod_SIMILAR, &iIndex[0], articles);
+	reply_status(reply, CODE_OK, "ok");
+	reply_string(reply, sWord);
+	reply += articles;
+	reply_string(reply, "");
+
+	/* the word list starts at the word, or where it would be */
+	for (size_t iLib = 0; iLib < iIndex.size(); iLib++) {
+		if (iIndex[iLib].idx == INVALID_INDEX)
+			iIndex[iLib].idx = iIndex[iLib].idx_suggest;
+		if (iIndex[iLib].synidx == INVALID_INDEX)
+			iIndex[iLib].synidx = iIndex[iLib].synidx_suggest;
+	}
+	reply_string(reply, "l");
+	std::vector<size_t> locked;
+	data.locks.lock(dictmask, locked);
+	const gchar *word = data.oLibs.poGetCurrentWord(&iIndex[0], dictmask, collatefunc);
+	for (int i = 0; word && i < list_count; i++) {
+		reply_string(reply, word);
+		word = data.oLibs.poGetNextWord(NULL, &iIndex[0], dictmask, collatefunc);
+	}
+	data.locks.unlock(locked);
+	reply_string(reply, "");
+}
+
+void Session::define(const char *sWord, std::string &reply)
+{
+	if (dictmask.empty()) {
+		reply_status(reply, CODE_DICTMASK_NOTSET, "dict mask not set");
+		return;
+	}
+	std::vector<CurrentIndex> iIndex(dictmask.size());
+	reply_status(reply, CODE_OK, "ok");
+	reply_string(reply, sWord);
+	append_articles(sWord, LookupMethod_EXACT, &iIndex[0], reply);
+	reply_string(reply, "");
+}
+
+/* Look up the selected text, if it is not found, drop the trailing words
+ * one by one, as a selection often catches more than the phrase. */
+void Session::select_query(const char *sText, std::string &reply)
+{
+	if (dictmask.empty()) {
+		reply_status(reply, CODE_DICTMASK_NOTSET, "dict mask not set");
+		return;
+	}
+	std::vector<CurrentIndex> iIndex(dictmask.size());
+	std::string text(sText), articles;
+	for (;;) {
+		std::string::size_type end = text.find_last_not_of(" \t\n");
+		if (end == std::string::npos)
+			break;
+		text.resize(end + 1);
+		if (append_articles(text.c_str(), LookupMethod_SIMPLE, &iIndex[0], articles))
+			break;
+		std::string::size_type space = text.find_last_of(" \t\n");
+		if (space == std::string::npos)
+			break;
+		text.resize(space);
+	}
+	reply_status(reply, CODE_OK, "ok");
+	reply_string(reply, text.c_str());
+	reply += articles;
+	reply_string(reply, "");
+}
+
+void Session::smart_query(const char *sText, int BeginPos, std::string &reply)
+{
+	glong len = g_utf8_strlen(sText, -1);
+	if (BeginPos < 0 || BeginPos > len)
+		BeginPos = 0;
+	select_query(g_utf8_offset_to_pointer(sText, BeginPos), reply);
+}
+
+/* The candidates of a scan lookup, see smart_lookup_candidates(), in one
+ * round trip. The reply is that of selectquery for the first word found.
+ * With all, the articles of the other words found follow. */
+void Session::batch_query(const std::vector<std::string> &words, bool all, std::string &reply)
+{
+	if (dictmask.empty()) {
+		reply_status(reply, CODE_DICTMASK_NOTSET, "dict mask not set");
+		return;
+	}
+	std::vector<CurrentIndex> iIndex(dictmask.size());
+	std::string articles;
+	const char *oword = words[0].c_str();
+	bool bFound = false;
+	for (size_t i = 0; i < words.size(); i++) {
+		if (!append_articles(words[i].c_str(), LookupMethod_SIMPLE, &iIndex[0], articles))
+			continue;
+		if (!bFound)
+			oword = words[i].c_str();
+		bFound = true;
+		if (!all)
+			break;
+	}
+	reply_status(reply, CODE_OK, "ok");
+	reply_string(reply, oword);
+	reply += articles;
+	reply_string(reply, "");
+}
+
+/* Works like AppCore::ListPreWords() and AppCore::ListNextWords(). */
+void Session::list_words(const char *sWord, bool previous, int count, std::string &reply)
+{
+	reply_status(reply, CODE_OK, "ok");
+	if (dictmask.empty()) {
+		reply_string(reply, "");
+		return;
+	}
+	std::vector<CurrentIndex> iIndex(dictmask.size());
+	std::vector<std::string> words;
+	std::vector<size_t> locked;
+	data.locks.lock(dictmask, locked);
+	const gchar *word;
+	if (previous)
+		word = data.oLibs.poGetPreWord(sWord, &iIndex[0], dictmask, collatefunc);
+	else
+		word = data.oLibs.poGetNextWord(sWord, &iIndex[0], dictmask, collatefunc);
+	while (word && (int)words.size() < count) {
+		words.push_back(word);
+		if (previous)
+			word = data.oLibs.poGetPreWord(NULL, &iIndex[0], dictmask, collatefunc);
+		else
+			word = data.oLibs.poGetNextWord(NULL, &iIndex[0], dictmask, collatefunc);
+	}
+	data.locks.unlock(locked);
+	if (previous)
+		std::reverse(words.begin(), words.end());
+	for (size_t i = 0; i < words.size(); i++)
+		reply_string(reply, words[i].c_str());
+	reply_string(reply, "");
+}
@@ -0,0 +1,87 @@
+/*
+ * This file is part of StarDict.
+ *
+ * StarDict is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * StarDict is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with StarDict.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _STARDICTD_SESSION_H_
+#define _STARDICTD_SESSION_H_
+
+#include <glib.h>
+#include <string>
+#include <vector>
+
+#include "lib/stddict.h"
+
+/* Libs keeps the index pages, the data cache and the loaded collation in
+ * the Dict objects, so a dictionary may be used by one thread at a time.
+ * Each dictionary has its own lock, lookups in different dictionaries run
+ * in parallel. Several dictionaries are always locked in ascending order. */
+class DictLocks {
+public:
+	explicit DictLocks(size_t count);
+	~DictLocks();
+	void lock(size_t iLib) { g_mutex_lock(&locks[iLib]); }
+	void unlock(size_t iLib) { g_mutex_unlock(&locks[iLib]); }
+	/* Lock all local dictionaries of the mask, locked receives them. */
+	void lock(const std::vector<InstantDictIndex> &dictmask, std::vector<size_t> &locked);
+	void unlock(const std::vector<size_t> &locked);
+	/* protects the dir and dict info strings that Libs builds on demand */
+	GMutex info_mutex;
+private:
+	GMutex *locks;
+	size_t count;
+};
+
+/* State shared by all sessions. */
+struct ServerData {
+	ServerData(Libs &libs, int max_dict_count);
+	Libs &oLibs;
+	DictLocks locks;
+	int max_dict_count;
+	/* the dictionaries of a new session, there are no user accounts, so
+	 * these are all dictionaries of level 0 */
+	std::string default_dicts;
+};
+
+/* One client connection. A session executes one command at a time,
+ * but different sessions may execute commands in parallel. */
+class Session {
+public:
+	explicit Session(ServerData &data);
+	/* Text of the 220 banner line. */
+	std::string banner() const;
+	/* Execute the command line, the reply is appended to reply.
+	 * Returns false if the connection must be closed after the reply. */
+	bool execute(const std::string &line, std::string &reply);
+private:
+	void set_dict_mask(const char *dicts);
+	void lookup(const char *sWord, int list_count, std::string &reply);
+	void define(const char *sWord, std::string &reply);
+	void select_query(const char *sText, std::string &reply);
+	void smart_query(const char *sText, int BeginPos, std::string &reply);
+	void batch_query(const std::vector<std::string> &words, bool all, std::string &reply);
+	void list_words(const char *sWord, bool previous, int count, std::string &reply);
+	bool append_articles(const char *sWord, LookupMethod method,
+		CurrentIndex *iIndex, std::string &articles);
+
+	ServerData &data;
+	std::vector<InstantDictIndex> dictmask;
+	std::string dicts;
+	/* 0 - none, the index collation, otherwise CollateFunctions + 1 */
+	int collatefunc;
+	std::string stamp;
+};
+
+#endif
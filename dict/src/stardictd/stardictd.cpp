@@ -0,0 +1,208 @@
+/*
+ * This file is part of StarDict.
+ *
+ * StarDict is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * StarDict is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with StarDict.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* stardictd, the StarDict protocol server.
+ * Serves the dictionaries listed in the stardictd.xml files of the
+ * dictionary directory to the net dictionaries of StarDict.
+ * With --load-test the server is started in the background and loaded
+ * by StarDictClient connections, with --host another server is loaded. */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <cstdlib>
+#include <csignal>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include <glib.h>
+
+#include "lib/iappdirs.h"
+#include "lib/stddict.h"
+
+#include "session.h"
+#include "server.h"
+#include "loadtest.h"
+
+namespace {
+	class ServerAppDirs : public IAppDirs {
+	public:
+		virtual std::string get_user_config_dir(void) const {
+			return g_get_tmp_dir();
+		}
+		virtual std::string get_user_cache_dir(void) const {
+			return g_get_tmp_dir();
+		}
+		virtual std::string get_data_dir(void) const {
+			return STARDICT_DATA_DIR;
+		}
+		ServerAppDirs() {
+			app_dirs = this;
+		}
+	} g_server_app_dirs;
+}
+
+static gint port = 2628;
+static gchar *dicdir = NULL;
+static gint threads = 0;
+static gint max_dict_count = 20;
+static gboolean load_test = FALSE;
+static gchar *load_test_host = NULL;
+static gint load_test_clients = 16;
+static gint load_test_requests = 10000;
+static gchar *load_test_words = NULL;
+
+static const GOptionEntry entries[] = {
+	{ "port", 'p', 0, G_OPTION_ARG_INT, &port,
+		"Listen on port N (default 2628)", "N" },
+	{ "dicdir", 'd', 0, G_OPTION_ARG_FILENAME, &dicdir,
+		"Dictionary directory with stardictd.xml (default " STARDICT_DATA_DIR "/dic)", "DIR" },
+	{ "threads", 't', 0, G_OPTION_ARG_INT, &threads,
+		"Number of lookup threads (default the number of processors)", "N" },
+	{ "max-dict-count", 'm', 0, G_OPTION_ARG_INT, &max_dict_count,
+		"Most dictionaries in the dict mask of a client (default 20)", "N" },
+	{ "load-test", 'l', 0, G_OPTION_ARG_NONE, &load_test,
+		"Run a load test against the server and exit", NULL },
+	{ "host", 'H', 0, G_OPTION_ARG_STRING, &load_test_host,
+		"Load test the server on HOST instead of starting one", "HOST" },
+	{ "clients", 'c', 0, G_OPTION_ARG_INT, &load_test_clients,
+		"Number of load test connections (default 16)", "N" },
+	{ "requests", 'n', 0, G_OPTION_ARG_INT, &load_test_requests,
+		"Number of load test lookups (default 10000)", "N" },
+	{ "words", 'w', 0, G_OPTION_ARG_FILENAME, &load_test_words,
+		"Look up the words of FILE, one word per line, in the load test. "
+		"By default the words are taken from the served dictionaries", "FILE" },
+	{ NULL },
+};
+
+static Server *the_server = NULL;
+
+static void on_signal(int)
+{
+	if (the_server)
+		the_server->stop();
+}
+
+static gpointer server_thread(gpointer data)
+{
+	static_cast<Server *>(data)->run();
+	return NULL;
+}
+
+static bool load_words(const char *filename, std::vector<std::string> &words)
+{
+	gchar *contents;
+	if (!g_file_get_contents(filename, &contents, NULL, NULL))
+		return false;
+	gchar **lines = g_strsplit(contents, "\n", -1);
+	g_free(contents);
+	for (gchar **p = lines; *p; ++p) {
+		g_strchomp(*p);
+		if (**p)
+			words.push_back(*p);
+	}
+	g_strfreev(lines);
+	return true;
+}
+
+/* Words of random entries, every fourth word is likely not found. */
+static void sample_words(Libs &libs, gint count, std::vector<std::string> &words)
+{
+	GRand *rnd = g_rand_new_with_seed(1);
+	for (gint i = 0; i < count; ++i) {
+		const size_t iLib = g_rand_int_range(rnd, 0, libs.ndicts());
+		if (i % 4 == 3 || libs.narticles(iLib) == 0) {
+			words.push_back(std::string(libs.poGetOrigWord(0, iLib)) + "zzq");
+			continue;
+		}
+		const glong idx = g_rand_int_range(rnd, 0, libs.narticles(iLib));
+		words.push_back(libs.poGetOrigWord(idx, iLib));
+	}
+	g_rand_free(rnd);
+}
+
+static int run_load_test(const char *host, const std::vector<std::string> &words)
+{
+	LoadTest test(words, load_test_clients, load_test_requests);
+	const bool res = test.run(host, port);
+	test.print_results();
+	return res ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int main(int argc, char *argv[])
+{
+	GOptionContext *context = g_option_context_new("- StarDict protocol server");
+	g_option_context_add_main_entries(context, entries, NULL);
+	GError *error = NULL;
+	if (!g_option_context_parse(context, &argc, &argv, &error)) {
+		g_printerr("%s\n", error->message);
+		g_error_free(error);
+		return EXIT_FAILURE;
+	}
+	g_option_context_free(context);
+
+	std::vector<std::string> words;
+	if (load_test && load_test_words && !load_words(load_test_words, words)) {
+		g_printerr("Unable to read %s\n", load_test_words);
+		return EXIT_FAILURE;
+	}
+	if (load_test && load_test_host) {
+		if (words.empty()) {
+			g_printerr("Use --words to load test another server.\n");
+			return EXIT_FAILURE;
+		}
+		return run_load_test(load_test_host, words);
+	}
+
+	const std::string dir = dicdir ? dicdir : STARDICT_DATA_DIR "/dic";
+	/* collation functions are chosen per session */
+	Libs libs(NULL, false, CollationLevel_MULTI, COLLATE_FUNC_NONE);
+	libs.LoadFromXML(dir.c_str());
+	if (!libs.has_dict()) {
+		g_printerr("No dictionaries in %s\n", dir.c_str());
+		return EXIT_FAILURE;
+	}
+	if (threads <= 0) {
+		long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+		threads = ncpu > 0 ? ncpu : 4;
+	}
+	ServerData data(libs, max_dict_count);
+	Server server(data, threads);
+	if (!server.listen(port))
+		return EXIT_FAILURE;
+
+	if (load_test) {
+		if (words.empty())
+			sample_words(libs, 1000, words);
+		GThread *thread = g_thread_new("server", server_thread, &server);
+		const int res = run_load_test("127.0.0.1", words);
+		server.stop();
+		g_thread_join(thread);
+		return res;
+	}
+
+	the_server = &server;
+	signal(SIGINT, on_signal);
+	signal(SIGTERM, on_signal);
+	signal(SIGPIPE, SIG_IGN);
+	g_print("stardictd: %lu dictionaries, listening on port %d\n",
+		(unsigned long)libs.ndicts(), port);
+	server.run();
+	the_server = NULL;
+	return EXIT_SUCCESS;
+}
@@ -704,6 +704,8 @@ DLLIMPORT void stardict_plugin_exit(void)
 DLLIMPORT bool stardict_parsedata_plugin_init(StarDictParseDataPlugInObject *obj)
 {
 	obj->parse_func = parse;
+	obj->types = "k";
+	obj->thread_safe = true;
 	g_print(_("PowerWord data parsing plug-in loaded.\n"));
 	return false;
 }
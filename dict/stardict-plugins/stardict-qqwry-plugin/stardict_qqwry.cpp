@@ -28,6 +28,10 @@
 #include <cstdlib>
 #include <stdlib.h>
 #include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <algorithm>
 
 #ifdef _WIN32
 #include <windows.h>
@@ -69,74 +73,208 @@ static char *build_dictdata(char type, const char *definition)
 #define REDIRECT_MODE_1 0x01
 #define REDIRECT_MODE_2 0x02
 
-static unsigned long getValue(FILE *fp, unsigned long start, int length)
+/* Most addresses resolved for one lookup. */
+static const size_t MAX_LOOKUP_IPS = 64;
+/* Most resolved addresses kept in memory. */
+static const size_t MAX_CACHED_ADDRESSES = 4096;
+
+/* QQWry.Dat mapped into memory.
+ * The file starts with offsets of the first and the last index entries. An
+ * index entry is 7 bytes: the first IP of a range and a 3-byte offset of the
+ * range record. All numbers are little-endian. The record is the last IP of
+ * the range followed by the country and the location strings in GB18030,
+ * either of the strings may be replaced with a redirection.
+ * The index is loaded into a flat array once, then each address is found with
+ * a binary search in memory. The addresses are converted to UTF-8 once per
+ * record, many IPs of a log usually fall into the same few ranges. */
+class QQWry {
+public:
+	QQWry();
+	~QQWry();
+	/* Map the file, unless it is mapped already and has not changed. */
+	bool open(const std::string &filename);
+	void close();
+	/* Find the address of each ip, as UTF-8.
+	 * The strings are owned by QQWry and valid till the next call. */
+	void lookup(const std::vector<guint32> &ips, std::vector<const std::string *> &addresses);
+private:
+	struct IndexEntry {
+		guint32 start_ip;
+		guint32 record;
+		bool operator<(guint32 ip) const { return start_ip < ip; }
+	};
+	typedef std::map<guint32, std::string> AddressMap;
+
+	guint32 get_value(guint32 offset, int length) const;
+	guint32 get_string(guint32 offset, std::string &str) const;
+	void get_address(guint32 record, std::string &country, std::string &location) const;
+	const std::string *find(guint32 ip);
+
+	GMappedFile *mf;
+	const guchar *data;
+	gsize size;
+	std::string filename;
+	time_t mtime;
+	std::vector<IndexEntry> index;
+	/* record offset -> address */
+	AddressMap addresses;
+};
+
+QQWry::QQWry()
+:
+	mf(NULL),
+	data(NULL),
+	size(0),
+	mtime(0)
 {
-	unsigned long variable=0;
-	long *val = (long *)malloc(sizeof(long) *length);
-	long i;
-	fseek(fp,start,SEEK_SET);
-	for(i=0;i<length;i++) {
-		val[i]=fgetc(fp)&0x000000FF;
+}
+
+QQWry::~QQWry()
+{
+	close();
+}
+
+bool QQWry::open(const std::string &_filename)
+{
+	struct stat stats;
+	if (g_stat(_filename.c_str(), &stats) != 0) {
+		close();
+		return false;
+	}
+	if (mf && filename == _filename && mtime == stats.st_mtime && size == gsize(stats.st_size))
+		return true;
+	close();
+	mf = g_mapped_file_new(_filename.c_str(), FALSE, NULL);
+	if (!mf)
+		return false;
+	data = (const guchar *)g_mapped_file_get_contents(mf);
+	size = g_mapped_file_get_length(mf);
+	filename = _filename;
+	mtime = stats.st_mtime;
+	guint32 index_start = get_value(0, 4), index_end = get_value(4, 4);
+	if (size < 8 || index_end < index_start || gsize(index_end) + 7 > size) {
+		close();
+		return false;
 	}
-	for(i=length-1;i>=0;i--) {
-		variable=variable*0x100+val[i];
+	index.resize((index_end - index_start)/7 + 1);
+	const guchar *p = data + index_start;
+	for (size_t i = 0; i < index.size(); ++i, p += 7) {
+		index[i].start_ip = p[0] | (p[1] << 8) | (p[2] << 16) | (guint32(p[3]) << 24);
+		index[i].record = p[4] | (p[5] << 8) | (p[6] << 16);
 	}
-	free(val);
-	return variable;
+	return true;
+}
+
+void QQWry::close()
+{
+	if (mf)
+		g_mapped_file_unref(mf);
+	mf = NULL;
+	data = NULL;
+	size = 0;
+	filename.clear();
+	mtime = 0;
+	index.clear();
+	addresses.clear();
 }
 
-static int getString(FILE *fp, unsigned long start, std::string &string)
+void QQWry::lookup(const std::vector<guint32> &ips, std::vector<const std::string *> &result)
 {
-	unsigned long i=0;
-	char val;
-	fseek(fp,start,SEEK_SET);
-	do {
-		val=fgetc(fp);
-		string += val;
-		i++;
-	} while(val!=0x00);
-	return i;
+	if (addresses.size() + ips.size() > MAX_CACHED_ADDRESSES)
+		addresses.clear();
+	result.resize(ips.size());
+	for (size_t i = 0; i < ips.size(); ++i)
+		result[i] = find(ips[i]);
 }
 
-static void getAddress(FILE *fp, unsigned long start, std::string &country, std::string &location)
+/* Bytes past the end of the file read as zeros, a damaged file yields empty
+ * strings instead of a crash. */
+guint32 QQWry::get_value(guint32 offset, int length) const
 {
-	unsigned long redirect_address,counrty_address,location_address;
-	char val;
-	start+=4;
-	fseek(fp,start,SEEK_SET);
-	val=(fgetc(fp)&0x000000FF);
-	if(val==REDIRECT_MODE_1) {
-		redirect_address=getValue(fp,start+1,3);
-		fseek(fp,redirect_address,SEEK_SET);
-		if((fgetc(fp)&0x000000FF)==REDIRECT_MODE_2) {
-			counrty_address=getValue(fp,redirect_address+1,3);
-			location_address=redirect_address+4;
-			getString(fp,counrty_address,country);
+	guint32 value = 0;
+	for (int i = length - 1; i >= 0; --i) {
+		value <<= 8;
+		if (gsize(offset) + i < size)
+			value |= data[offset + i];
+	}
+	return value;
+}
+
+/* Return the length of the string with the terminating zero. */
+guint32 QQWry::get_string(guint32 offset, std::string &str) const
+{
+	if (offset >= size)
+		return 1;
+	const guchar *p = data + offset;
+	const guchar *end = (const guchar *)memchr(p, 0, size - offset);
+	if (!end)
+		end = data + size;
+	str.assign((const char *)p, end - p);
+	return guint32(end - p) + 1;
+}
+
+void QQWry::get_address(guint32 record, std::string &country, std::string &location) const
+{
+	guint32 country_address, location_address;
+	const guint32 start = record + 4;
+	const guint32 mode = get_value(start, 1);
+	if (mode == REDIRECT_MODE_1) {
+		const guint32 redirect_address = get_value(start + 1, 3);
+		if (get_value(redirect_address, 1) == REDIRECT_MODE_2) {
+			country_address = get_value(redirect_address + 1, 3);
+			location_address = redirect_address + 4;
+			get_string(country_address, country);
 		} else {
-			counrty_address=redirect_address;
-			location_address=redirect_address+getString(fp,counrty_address,country);
+			country_address = redirect_address;
+			location_address = redirect_address + get_string(country_address, country);
 		}
-	} else if (val==REDIRECT_MODE_2) {
-		counrty_address=getValue(fp,start+1,3);
-		location_address=start+4;
-		getString(fp,counrty_address,country);
+	} else if (mode == REDIRECT_MODE_2) {
+		country_address = get_value(start + 1, 3);
+		location_address = start + 4;
+		get_string(country_address, country);
 	} else {
-		counrty_address=start;
-		location_address=counrty_address+getString(fp,counrty_address,country);
-	}
-	fseek(fp,location_address,SEEK_SET);
-	if((fgetc(fp)&0x000000FF)==REDIRECT_MODE_2||(fgetc(fp)&0x000000FF)==REDIRECT_MODE_1) {
-		location_address=getValue(fp,location_address+1,3);
+		country_address = start;
+		location_address = country_address + get_string(country_address, country);
 	}
-	getString(fp,location_address,location);
+	const guint32 location_mode = get_value(location_address, 1);
+	if (location_mode == REDIRECT_MODE_1 || location_mode == REDIRECT_MODE_2)
+		location_address = get_value(location_address + 1, 3);
+	get_string(location_address, location);
 }
 
-static void getHead(FILE *fp,unsigned long *start,unsigned long *end)
+const std::string *QQWry::find(guint32 ip)
 {
-	*start=getValue(fp,0L,4);
-	*end=getValue(fp,4L,4);
+	if (index.empty())
+		return NULL;
+	/* the last range starting at or before ip */
+	std::vector<IndexEntry>::const_iterator it = std::lower_bound(index.begin(), index.end(), ip);
+	if (it == index.end() || it->start_ip > ip) {
+		if (it == index.begin())
+			return NULL;
+		--it;
+	}
+	AddressMap::iterator ait = addresses.find(it->record);
+	if (ait != addresses.end())
+		return &ait->second;
+	std::string country, location, address;
+	get_address(it->record, country, location);
+	gchar *c = g_convert(country.c_str(), -1, "UTF-8", "GB18030", NULL, NULL, NULL);
+	if (c) {
+		address += c;
+		address += ' ';
+		g_free(c);
+	}
+	gchar *l = g_convert(location.c_str(), -1, "UTF-8", "GB18030", NULL, NULL, NULL);
+	if (l) {
+		address += l;
+		g_free(l);
+	}
+	return &(addresses[it->record] = address);
 }
 
+static QQWry *qqwry = NULL;
+static GRegex *ip_regex = NULL;
+
 static int beNumber(char c)
 {
 	if(c>='0'&&c<='9')
@@ -145,9 +283,9 @@ static int beNumber(char c)
 		return 1;
 }
 
-static unsigned long getIP(const char *ip_addr)
+static guint32 getIP(const char *ip_addr)
 {
-	unsigned long ip=0;
+	guint32 ip=0;
 	size_t i;
 	int j=0;
 	for(i=0;i<strlen(ip_addr);i++) {
@@ -166,82 +304,73 @@ static unsigned long getIP(const char *ip_addr)
 	return ip;
 }
 
-static unsigned long searchIP(FILE *fp, unsigned long index_start, unsigned long index_end, unsigned long ip)
-{
-	unsigned long index_current,index_top,index_bottom;
-	unsigned long record;
-	index_bottom=index_start;
-	index_top=index_end;
-	index_current=((index_top-index_bottom)/7/2)*7+index_bottom;
-	do {
-		record=getValue(fp,index_current,4);
-		if(record>ip) {
-			index_top=index_current;
-		} else {
-			index_bottom=index_current;
-		}
-		index_current=((index_top-index_bottom)/14)*7+index_bottom;
-	} while(index_bottom<index_current);
-	return index_current;
-}
-
-static void get_address_from_ip(const char *text, std::string &ipstr, std::string &address)
+/* Find the addresses of all IPs in the text, e.g. a piece of a log.
+ * Each IP is reported once, in the order of appearance. */
+static void get_addresses_from_ips(const char *text, std::vector<std::string> &ipstrs,
+	std::vector<std::string> &addresses)
 {
+	if (!ip_regex)
+		ip_regex = g_regex_new ("(((\\d{1,2})|(1\\d{2})|(2[0-4]\\d)|(25[0-5]))\\.){3}((\\d{1,2})|(1\\d{2})|(2[0-4]\\d)|(25[0-5]))", G_REGEX_OPTIMIZE, (GRegexMatchFlags)0, NULL);
+	std::vector<guint32> ips;
+	std::set<guint32> seen;
 	GMatchInfo *match_info;
-	GRegex *regex = g_regex_new ("(((\\d{1,2})|(1\\d{2})|(2[0-4]\\d)|(25[0-5]))\\.){3}((\\d{1,2})|(1\\d{2})|(2[0-4]\\d)|(25[0-5]))", (GRegexCompileFlags)0, (GRegexMatchFlags)0, NULL);
-	g_regex_match (regex, text, (GRegexMatchFlags)0, &match_info);
-	if (g_match_info_matches(match_info)) {
+	g_regex_match (ip_regex, text, (GRegexMatchFlags)0, &match_info);
+	while (g_match_info_matches(match_info) && ips.size() < MAX_LOOKUP_IPS) {
 		gchar *word = g_match_info_fetch (match_info, 0);
-		ipstr = word;
+		const guint32 ip = getIP(word);
+		if (seen.insert(ip).second) {
+			ipstrs.push_back(word);
+			ips.push_back(ip);
+		}
 		g_free (word);
+		g_match_info_next (match_info, NULL);
 	}
 	g_match_info_free (match_info);
-	g_regex_unref (regex);
-	if (ipstr.empty())
+	if (ips.empty())
 		return;
 	std::string datafilename = build_path(plugin_info->datadir, "data" G_DIR_SEPARATOR_S "QQWry.Dat");
-	FILE *fp = g_fopen(datafilename.c_str(), "rb");
-	if (!fp) {
+	if (!qqwry)
+		qqwry = new QQWry;
+	if (!qqwry->open(datafilename)) {
 		gchar *msg = g_strdup_printf(_("Error: Open file %s failed!"), datafilename.c_str());
-		address = msg;
+		ipstrs.resize(1);
+		addresses.assign(1, msg);
 		g_free(msg);
 		return;
 	}
-	unsigned long index_start,index_end;
-	getHead(fp,&index_start,&index_end);
-	unsigned long ip = getIP(ipstr.c_str());
-	unsigned long current=searchIP(fp,index_start,index_end,ip);
-	std::string country,location;
-	getAddress(fp,getValue(fp,current+4,3),country,location);
-	gchar *c = g_convert(country.c_str(), -1, "UTF-8", "GB18030", NULL, NULL, NULL);
-	if (c) {
-		address += c;
-		address += ' ';
-		g_free(c);
-	}
-	gchar *l = g_convert(location.c_str(), -1, "UTF-8", "GB18030", NULL, NULL, NULL);
-	if (l) {
-		address += l;
-		g_free(l);
-	}
-	fclose(fp);
+	std::vector<const std::string *> found;
+	qqwry->lookup(ips, found);
+	addresses.resize(found.size());
+	for (size_t i = 0; i < found.size(); ++i)
+		if (found[i])
+			addresses[i] = *found[i];
 }
 
 static void lookup(const char *text, char ***pppWord, char ****ppppWordData)
 {
-	std::string ipstr, address;
-	get_address_from_ip(text, ipstr, address);
-	if (address.empty()) {
+	std::vector<std::string> ipstrs, addresses;
+	get_addresses_from_ips(text, ipstrs, addresses);
+	size_t count = 0;
+	for (size_t i = 0; i < addresses.size(); ++i)
+		if (!addresses[i].empty())
+			++count;
+	if (count == 0) {
 		*pppWord = NULL;
-	} else {
-		*pppWord = (gchar **)g_malloc(sizeof(gchar *)*2);
-		(*pppWord)[0] = g_strdup(ipstr.c_str());
-		(*pppWord)[1] = NULL;
-		*ppppWordData = (gchar ***)g_malloc(sizeof(gchar **)*(1));
-		(*ppppWordData)[0] = (gchar **)g_malloc(sizeof(gchar *)*2);
-		(*ppppWordData)[0][0] =  build_dictdata('m', address.c_str());
-		(*ppppWordData)[0][1] = NULL;
+		return;
+	}
+	*pppWord = (gchar **)g_malloc(sizeof(gchar *)*(count+1));
+	*ppppWordData = (gchar ***)g_malloc(sizeof(gchar **)*count);
+	size_t n = 0;
+	for (size_t i = 0; i < addresses.size(); ++i) {
+		if (addresses[i].empty())
+			continue;
+		(*pppWord)[n] = g_strdup(ipstrs[i].c_str());
+		(*ppppWordData)[n] = (gchar **)g_malloc(sizeof(gchar *)*2);
+		(*ppppWordData)[n][0] = build_dictdata('m', addresses[i].c_str());
+		(*ppppWordData)[n][1] = NULL;
+		++n;
 	}
+	(*pppWord)[count] = NULL;
 }
 
 static void configure()
@@ -289,6 +418,11 @@ DLLIMPORT bool stardict_plugin_init(StarDictPlugInObject *obj, IAppDirs* appDirs
 
 DLLIMPORT void stardict_plugin_exit(void)
 {
+	delete qqwry;
+	qqwry = NULL;
+	if (ip_regex)
+		g_regex_unref(ip_regex);
+	ip_regex = NULL;
 }
 
 DLLIMPORT bool stardict_virtualdict_plugin_init(StarDictVirtualDictPlugInObject *obj)
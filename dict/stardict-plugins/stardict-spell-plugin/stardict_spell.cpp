@@ -25,16 +25,254 @@
 #include <cstring>
 #include <string>
 #include <vector>
+#include <list>
+#include <map>
+#include <set>
 #include <string.h>
 
+/* Most words kept in the cache of each language. */
+static const size_t SPELL_CACHE_SIZE = 2048;
+/* Most languages making suggestions at once. */
+static const gint SUGGEST_THREADS = 4;
+
 static const StarDictPluginSystemInfo *plugin_info = NULL;
 static EnchantBroker *broker = NULL;
-static std::list<EnchantDict *> dictlist;
 static PangoLayout *layout = NULL;
 static gboolean use_custom;
 static std::string custom_langs;
+/* Make suggestions for a text of several words only when the user asks,
+ * the misspelled words are shown as links. */
+static gboolean suggest_on_demand;
 static IAppDirs* gpAppDirs = NULL;
 
+/* A spellchecking dictionary and the recent results of it.
+ * Checking a word is fast, making suggestions is not. The results are cached,
+ * the least recently used words are dropped.
+ * Suggestions are made in worker threads, a thread per language. An enchant
+ * dictionary must not be used by two threads at once, dict_mutex guards it. */
+class SpellLang {
+public:
+	explicit SpellLang(EnchantDict *dict);
+	~SpellLang();
+	/* Return true if the word is misspelled. */
+	bool check(const std::string &word);
+	void suggest(const std::string &word, std::vector<std::string> &suggestions);
+	bool has_suggestions(const std::string &word);
+private:
+	struct Entry {
+		std::string word;
+		bool checked;
+		bool misspelled;
+		bool suggested;
+		std::vector<std::string> suggestions;
+	};
+	/* most recently used first */
+	typedef std::list<Entry *> EntryList;
+	typedef std::map<std::string, EntryList::iterator> EntryMap;
+
+	Entry *get_entry(const std::string &word);
+
+	EnchantDict *dict;
+	GMutex dict_mutex;
+	/* protects entries */
+	GMutex cache_mutex;
+	EntryList entries;
+	EntryMap entry_map;
+};
+
+static std::list<SpellLang *> dictlist;
+
+/* Suggestions for the words in one language. */
+struct SuggestJob {
+	SpellLang *lang;
+	std::vector<std::string> words;
+};
+
+static GThreadPool *suggest_pool = NULL;
+/* protects n_jobs and pending_words */
+static GMutex jobs_mutex;
+static GCond jobs_cond;
+static gint n_jobs = 0;
+/* words in the jobs not finished yet */
+typedef std::set<std::pair<SpellLang *, std::string> > PendingWords;
+static PendingWords pending_words;
+
+SpellLang::SpellLang(EnchantDict *_dict)
+:
+	dict(_dict)
+{
+	g_mutex_init(&dict_mutex);
+	g_mutex_init(&cache_mutex);
+}
+
+SpellLang::~SpellLang()
+{
+	for (EntryList::iterator it = entries.begin(); it != entries.end(); ++it)
+		delete *it;
+	enchant_broker_free_dict(broker, dict);
+	g_mutex_clear(&cache_mutex);
+	g_mutex_clear(&dict_mutex);
+}
+
+/* Find the cached entry of the word, add it if missing.
+ * cache_mutex must be locked. */
+SpellLang::Entry *SpellLang::get_entry(const std::string &word)
+{
+	EntryMap::iterator it = entry_map.find(word);
+	if (it != entry_map.end()) {
+		entries.splice(entries.begin(), entries, it->second);
+		return *it->second;
+	}
+	while (entries.size() >= SPELL_CACHE_SIZE) {
+		Entry *last = entries.back();
+		entry_map.erase(last->word);
+		entries.pop_back();
+		delete last;
+	}
+	Entry *entry = new Entry;
+	entry->word = word;
+	entry->checked = false;
+	entry->misspelled = false;
+	entry->suggested = false;
+	entries.push_front(entry);
+	entry_map[word] = entries.begin();
+	return entry;
+}
+
+bool SpellLang::check(const std::string &word)
+{
+	g_mutex_lock(&cache_mutex);
+	EntryMap::iterator it = entry_map.find(word);
+	if (it != entry_map.end() && (*it->second)->checked) {
+		const bool misspelled = (*it->second)->misspelled;
+		g_mutex_unlock(&cache_mutex);
+		return misspelled;
+	}
+	g_mutex_unlock(&cache_mutex);
+	g_mutex_lock(&dict_mutex);
+	const bool misspelled = enchant_dict_check(dict, word.c_str(), word.length()) > 0;
+	g_mutex_unlock(&dict_mutex);
+	g_mutex_lock(&cache_mutex);
+	Entry *entry = get_entry(word);
+	entry->checked = true;
+	entry->misspelled = misspelled;
+	g_mutex_unlock(&cache_mutex);
+	return misspelled;
+}
+
+void SpellLang::suggest(const std::string &word, std::vector<std::string> &suggestions)
+{
+	g_mutex_lock(&cache_mutex);
+	EntryMap::iterator it = entry_map.find(word);
+	if (it != entry_map.end() && (*it->second)->suggested) {
+		suggestions = (*it->second)->suggestions;
+		g_mutex_unlock(&cache_mutex);
+		return;
+	}
+	g_mutex_unlock(&cache_mutex);
+	suggestions.clear();
+	g_mutex_lock(&dict_mutex);
+	size_t n = 0;
+	char **list = enchant_dict_suggest(dict, word.c_str(), word.length(), &n);
+	if (list) {
+		for (size_t i = 0; i < n; ++i)
+			suggestions.push_back(list[i]);
+		enchant_dict_free_string_list(dict, list);
+	}
+	g_mutex_unlock(&dict_mutex);
+	g_mutex_lock(&cache_mutex);
+	Entry *entry = get_entry(word);
+	entry->suggested = true;
+	entry->suggestions = suggestions;
+	g_mutex_unlock(&cache_mutex);
+}
+
+bool SpellLang::has_suggestions(const std::string &word)
+{
+	g_mutex_lock(&cache_mutex);
+	EntryMap::iterator it = entry_map.find(word);
+	const bool suggested = it != entry_map.end() && (*it->second)->suggested;
+	g_mutex_unlock(&cache_mutex);
+	return suggested;
+}
+
+static void suggest_worker(gpointer data, gpointer user_data)
+{
+	SuggestJob *job = static_cast<SuggestJob *>(data);
+	std::vector<std::string> suggestions;
+	for (size_t i = 0; i < job->words.size(); ++i)
+		job->lang->suggest(job->words[i], suggestions);
+	g_mutex_lock(&jobs_mutex);
+	for (size_t i = 0; i < job->words.size(); ++i)
+		pending_words.erase(std::make_pair(job->lang, job->words[i]));
+	delete job;
+	--n_jobs;
+	g_cond_broadcast(&jobs_cond);
+	g_mutex_unlock(&jobs_mutex);
+}
+
+/* Start making suggestions in all languages at once, one job per language.
+ * Words suggested already or being suggested by an earlier job are skipped. */
+static void start_suggestions(const std::list<std::string> &words)
+{
+	if (!suggest_pool)
+		return;
+	for (std::list<SpellLang *>::iterator i = dictlist.begin(); i != dictlist.end(); ++i) {
+		SuggestJob *job = NULL;
+		g_mutex_lock(&jobs_mutex);
+		for (std::list<std::string>::const_iterator w = words.begin(); w != words.end(); ++w) {
+			if ((*i)->has_suggestions(*w)
+				|| !pending_words.insert(std::make_pair(*i, *w)).second)
+				continue;
+			if (!job) {
+				job = new SuggestJob;
+				job->lang = *i;
+			}
+			job->words.push_back(*w);
+		}
+		if (job)
+			++n_jobs;
+		g_mutex_unlock(&jobs_mutex);
+		if (job)
+			g_thread_pool_push(suggest_pool, job, NULL);
+	}
+}
+
+static bool is_pending(const std::list<std::string> &words)
+{
+	for (std::list<SpellLang *>::iterator i = dictlist.begin(); i != dictlist.end(); ++i)
+		for (std::list<std::string>::const_iterator w = words.begin(); w != words.end(); ++w)
+			if (pending_words.find(std::make_pair(*i, *w)) != pending_words.end())
+				return true;
+	return false;
+}
+
+/* Wait for the jobs making suggestions for the words, jobs started for other
+ * texts may go on. */
+static void wait_suggestions(const std::list<std::string> &words)
+{
+	g_mutex_lock(&jobs_mutex);
+	while (is_pending(words))
+		g_cond_wait(&jobs_cond, &jobs_mutex);
+	g_mutex_unlock(&jobs_mutex);
+}
+
+static void wait_all_suggestions()
+{
+	g_mutex_lock(&jobs_mutex);
+	while (n_jobs > 0)
+		g_cond_wait(&jobs_cond, &jobs_mutex);
+	g_mutex_unlock(&jobs_mutex);
+}
+
+static void free_dicts()
+{
+	wait_all_suggestions();
+	for (std::list<SpellLang *>::iterator i = dictlist.begin(); i != dictlist.end(); ++i)
+		delete *i;
+	dictlist.clear();
+}
+
 /* concatenate path1 and path2 inserting a path separator in between if needed. */
 static std::string build_path(const std::string& path1, const std::string& path2)
 {
@@ -114,7 +352,10 @@ static void stardict_strsplit_utf8(const gchar *text, gchar ***set, gint **start
 	g_free (log_attrs);
 }
 
-static void lookup(const char *text, char ***pppWord, char ****ppppWordData)
+/* Find the misspelled words of the text, underline_str gets the text with
+ * them underlined if there are several words. Return the number of words. */
+static int find_misspelled(const char *text, std::list<std::string> &misspelled_wordlist,
+	std::string &underline_str)
 {
 	size_t len = strlen(text);
 	pango_layout_set_text(layout, text, len);
@@ -122,7 +363,6 @@ static void lookup(const char *text, char ***pppWord, char ****ppppWordData)
 	gint *word_starts;
 	gint *word_ends;
 	stardict_strsplit_utf8(text, &words, &word_starts, &word_ends);
-	std::list<std::string> misspelled_wordlist;
 	gchar *spellword;
 	int start, end;
 	bool misspelled;
@@ -142,9 +382,9 @@ static void lookup(const char *text, char ***pppWord, char ****ppppWordData)
 			misspelled = false;
 		} else {
 			misspelled = true;
-			size_t wordlen = strlen(spellword);
-			for (std::list<EnchantDict *>::iterator iter = dictlist.begin(); iter != dictlist.end(); ++iter) {
-				if (enchant_dict_check(*iter, spellword, wordlen) <= 0) {
+			const std::string word(spellword);
+			for (std::list<SpellLang *>::iterator iter = dictlist.begin(); iter != dictlist.end(); ++iter) {
+				if (!(*iter)->check(word)) {
 					misspelled = false;
 					break;
 				}
@@ -157,7 +397,6 @@ static void lookup(const char *text, char ***pppWord, char ****ppppWordData)
 		}
 		g_free(spellword);
 	}
-	std::string underline_str;
 	int n_misspelled = misspelled_wordlist.size();
 	if (n_misspelled !=0 && n_words != 1) {
 		underline_str += "<big>";
@@ -195,35 +434,59 @@ static void lookup(const char *text, char ***pppWord, char ****ppppWordData)
 	g_strfreev(words);
 	g_free(word_starts);
 	g_free(word_ends);
+	return n_words;
+}
+
+/* Start making suggestions while the local dictionaries are searched. */
+static void prepare(const char *text)
+{
+	std::list<std::string> misspelled_wordlist;
+	std::string underline_str;
+	int n_words = find_misspelled(text, misspelled_wordlist, underline_str);
+	if (suggest_on_demand && n_words != 1)
+		return;
+	start_suggestions(misspelled_wordlist);
+}
+
+static void lookup(const char *text, char ***pppWord, char ****ppppWordData)
+{
+	std::list<std::string> misspelled_wordlist;
+	std::string underline_str;
+	int n_words = find_misspelled(text, misspelled_wordlist, underline_str);
+	const bool on_demand = suggest_on_demand && n_words != 1;
+	if (!on_demand) {
+		start_suggestions(misspelled_wordlist);
+		wait_suggestions(misspelled_wordlist);
+	}
 
 	std::vector< std::pair<char *, char *> > result;
-	char **suggestion;
+	std::vector<std::string> suggestion;
 	for (std::list<std::string>::iterator iter = misspelled_wordlist.begin(); iter != misspelled_wordlist.end(); ++iter) {
-		std::list<char **> suggestions;
-		for (std::list<EnchantDict *>::iterator i = dictlist.begin(); i != dictlist.end(); ++i) {
-			suggestion = enchant_dict_suggest(*i, (*iter).c_str(), -1, NULL);
-			if (suggestion)
-				suggestions.push_back(suggestion);
-		}
-		if (suggestions.empty())
-			continue;
 		std::string definition;
-		for (std::list<char **>::iterator it = suggestions.begin(); it != suggestions.end(); ++it) {
-			if (it != suggestions.begin()) {
+		if (on_demand) {
+			/* looking the word up makes the suggestions */
+			definition += "<kref>";
+			definition += *iter;
+			definition += "</kref>";
+		}
+		for (std::list<SpellLang *>::iterator i = dictlist.begin(); i != dictlist.end() && !on_demand; ++i) {
+			(*i)->suggest(*iter, suggestion);
+			if (suggestion.empty())
+				continue;
+			if (!definition.empty()) {
 				definition += "\n\n";
 			}
-			suggestion = *it;
 			definition += "<kref>";
 			definition += suggestion[0];
 			definition += "</kref>";
-			int i = 1;
-			while (suggestion[i]) {
+			for (size_t j = 1; j < suggestion.size(); j++) {
 				definition += "\t<kref>";
-				definition += suggestion[i];
+				definition += suggestion[j];
 				definition += "</kref>";
-				i++;
 			}
 		}
+		if (definition.empty())
+			continue;
 		result.push_back(std::pair<char *, char *>(g_strdup((*iter).c_str()), build_dictdata('x', definition.c_str())));
 	}
 	if (result.empty()) {
@@ -254,10 +517,7 @@ static void lookup(const char *text, char ***pppWord, char ****ppppWordData)
 
 static bool load_custom_langs()
 {
-	for (std::list<EnchantDict *>::iterator i = dictlist.begin(); i != dictlist.end(); ++i) {
-		enchant_broker_free_dict(broker, *i);
-	}
-	dictlist.clear();
+	free_dicts();
 	std::list<std::string> langlist;
 	std::string lang;
 	const gchar *p = custom_langs.c_str();
@@ -276,7 +536,7 @@ static bool load_custom_langs()
 	for (std::list<std::string>::iterator i = langlist.begin(); i != langlist.end(); ++i) {
 		dict = enchant_broker_request_dict(broker, i->c_str());
 		if (dict) {
-			dictlist.push_back(dict);
+			dictlist.push_back(new SpellLang(dict));
 		} else {
 			g_print(_("Warning: failure when requesting a spellchecking dictionary for %s language.\n"), i->c_str());
 		}
@@ -293,10 +553,7 @@ static bool load_custom_langs()
 
 static bool load_auto_lang()
 {
-	for (std::list<EnchantDict *>::iterator i = dictlist.begin(); i != dictlist.end(); ++i) {
-		enchant_broker_free_dict(broker, *i);
-	}
-	dictlist.clear();
+	free_dicts();
 	bool no_dict = false;
 	const gchar* const *languages = g_get_language_names();
 	int i = 0;
@@ -330,7 +587,7 @@ static bool load_auto_lang()
 		g_print(_("Error, no spellchecking dictionary available!\n"));
 		return true;
 	} else {
-		dictlist.push_back(dict);
+		dictlist.push_back(new SpellLang(dict));
 		return false;
 	}
 }
@@ -366,11 +623,19 @@ static void configure()
 	GtkWidget *entry = gtk_entry_new();
 	gtk_entry_set_text(GTK_ENTRY(entry), custom_langs.c_str());
 	gtk_box_pack_start(GTK_BOX(hbox), entry, false, false, 0);
+	GtkWidget *on_demand_button = gtk_check_button_new_with_mnemonic(_("_Suggest for several words only on demand."));
+	gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(on_demand_button), suggest_on_demand);
+	gtk_box_pack_start(GTK_BOX(vbox), on_demand_button, false, false, 0);
 	gtk_widget_show_all(vbox);
 	gtk_container_add (GTK_CONTAINER (gtk_dialog_get_content_area(GTK_DIALOG(window))), vbox);
 	gtk_dialog_run(GTK_DIALOG(window));
 	gboolean new_use_custom = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(check_button));
 	bool cfgchanged = false;
+	gboolean new_suggest_on_demand = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(on_demand_button));
+	if (new_suggest_on_demand != suggest_on_demand) {
+		cfgchanged = true;
+		suggest_on_demand = new_suggest_on_demand;
+	}
 	if (new_use_custom != use_custom) {
 		cfgchanged = true;
 		use_custom = new_use_custom;
@@ -396,7 +661,7 @@ static void configure()
 			tmp = "true";
 		else
 			tmp = "false";
-		gchar *data = g_strdup_printf("[spell]\nuse_custom=%s\ncustom_langs=%s\n", tmp, custom_langs.c_str());
+		gchar *data = g_strdup_printf("[spell]\nuse_custom=%s\ncustom_langs=%s\nsuggest_on_demand=%s\n", tmp, custom_langs.c_str(), suggest_on_demand ? "true" : "false");
 		std::string res = get_cfg_filename();
 		g_file_set_contents(res.c_str(), data, -1, NULL);
 		g_free(data);
@@ -422,10 +687,15 @@ bool stardict_plugin_init(StarDictPlugInObject *obj, IAppDirs* appDirs)
 
 void stardict_plugin_exit(void)
 {
+	if (suggest_pool) {
+		wait_all_suggestions();
+		g_thread_pool_free(suggest_pool, FALSE, TRUE);
+		suggest_pool = NULL;
+		g_cond_clear(&jobs_cond);
+		g_mutex_clear(&jobs_mutex);
+	}
 	if (broker) {
-		for (std::list<EnchantDict *>::iterator i = dictlist.begin(); i != dictlist.end(); ++i) {
-			enchant_broker_free_dict(broker, *i);
-		}
+		free_dicts();
 		enchant_broker_free(broker);
 	}
 	if (layout) {
@@ -437,13 +707,14 @@ void stardict_plugin_exit(void)
 bool stardict_virtualdict_plugin_init(StarDictVirtualDictPlugInObject *obj)
 {
 	obj->lookup_func = lookup;
+	obj->prepare_func = prepare;
 	obj->dict_name = _("Spelling Suggestion");
 	broker = enchant_broker_init();
 	layout = pango_layout_new(gtk_widget_get_pango_context(plugin_info->mainwin));
 
 	std::string res = get_cfg_filename();
 	if (!g_file_test(res.c_str(), G_FILE_TEST_EXISTS)) {
-		g_file_set_contents(res.c_str(), "[spell]\nuse_custom=false\ncustom_langs=\n", -1, NULL);
+		g_file_set_contents(res.c_str(), "[spell]\nuse_custom=false\ncustom_langs=\nsuggest_on_demand=false\n", -1, NULL);
 	}
 	GKeyFile *keyfile = g_key_file_new();
 	g_key_file_load_from_file(keyfile, res.c_str(), G_KEY_FILE_NONE, NULL);
@@ -451,8 +722,14 @@ bool stardict_virtualdict_plugin_init(StarDictVirtualDictPlugInObject *obj)
 	use_custom = g_key_file_get_boolean(keyfile, "spell", "use_custom", &err);
 	if (err) {
 		g_error_free (err);
+		err = NULL;
 		use_custom = false;
 	}
+	suggest_on_demand = g_key_file_get_boolean(keyfile, "spell", "suggest_on_demand", &err);
+	if (err) {
+		g_error_free (err);
+		suggest_on_demand = false;
+	}
 	gchar *str = g_key_file_get_string(keyfile, "spell", "custom_langs", NULL);
 	if (str) {
 		custom_langs = str;
@@ -467,6 +744,9 @@ bool stardict_virtualdict_plugin_init(StarDictVirtualDictPlugInObject *obj)
 	}
 	if (failed)
 		return true;
+	g_mutex_init(&jobs_mutex);
+	g_cond_init(&jobs_cond);
+	suggest_pool = g_thread_pool_new(suggest_worker, NULL, SUGGEST_THREADS, FALSE, NULL);
 	g_print(_("Spelling plugin loaded.\n"));
 	return false;
 }
@@ -0,0 +1,783 @@
+/*
+ * This file is part of StarDict.
+ *
+ * StarDict is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * StarDict is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with StarDict.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* One pass wiki to pango converter.
+ * wiki2xml turns wiki markup into XML and wikixml2pango keeps only the text
+ * of that XML, with internal and external links underlined. This renderer
+ * follows the rules of wiki2xml, but outputs the text right away. The rules
+ * are kept as they are, even odd ones: all parameters of a link are shown,
+ * link parameters are not unescaped, etc.
+ * Where wiki2xml produces broken XML, the old way loses the rest of the
+ * article, while the text is shown here. Links nested in link parameters
+ * are shown as links, not as XML text. */
+
+#include "stardict_wiki2pango.h"
+#include <cstring>
+#include <vector>
+#include <map>
+#include <glib.h>
+
+namespace {
+
+/* HTML elements passed through by wiki2xml, other ones are shown as text */
+const char * const allowed_html[] = {
+	"b", "i", "p", "br", "hr", "tt", "pre", "nowiki", "math", "strike", "u",
+	"table", "caption", "tr", "td", "th", "li", "ul", "ol", "dl", "dd", "dt",
+	"div", "h1", "h2", "h3", "h4", "h5", "h6", "h7", "h8", "h9", "small", "center",
+	NULL
+};
+
+const char link_span[] = "<span foreground=\"blue\" underline=\"single\">";
+
+enum {
+	/* parse links, templates, bold and italic */
+	RenderFlag_WIKI = 1,
+	/* Show the text as is, do not interpret entities and HTML elements.
+	 * wiki2xml escapes link parameters, so they are shown literally. */
+	RenderFlag_LITERAL = 2,
+};
+
+inline bool is_text_char(char ch)
+{
+	return (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z');
+}
+
+inline bool is_url_char(char ch)
+{
+	return ch == ':' || ch == '/' || ch == '.' || (ch >= '0' && ch <= '9') || is_text_char(ch);
+}
+
+/* characters that end a run of plain text */
+inline bool is_special_char(char ch)
+{
+	switch (ch) {
+	case '[': case '{': case ':': case '\'': case '<': case '>': case '&': case '"':
+		return true;
+	default:
+		return false;
+	}
+}
+
+void trim(const char *&b, const char *&e)
+{
+	while (b < e && *b == ' ')
+		++b;
+	while (e > b && *(e - 1) == ' ')
+		--e;
+}
+
+/* The same as find_next_unquoted. */
+const char *find_unquoted(char c, const char *b, const char *e)
+{
+	char lastquote = ' ';
+	for (const char *p = b; p < e; ++p) {
+		if (*p == c && lastquote == ' ')
+			return p;
+		if (*p != '\'' && *p != '"')
+			continue;
+		if (p > b && *(p - 1) == '\\')
+			continue;
+		if (lastquote == ' ')
+			lastquote = *p;
+		else if (lastquote == *p)
+			lastquote = ' ';
+	}
+	return NULL;
+}
+
+/* Whether the element between '<' and '>' is passed through. */
+bool is_allowed_tag(const char *b, const char *e)
+{
+	trim(b, e);
+	const char *space = static_cast<const char *>(memchr(b, ' ', e - b));
+	if (space)
+		e = space;
+	if (b < e && *b == '/')
+		++b;
+	if (b < e && *(e - 1) == '/')
+		--e;
+	trim(b, e);
+	const size_t len = e - b;
+	for (int i = 0; allowed_html[i]; ++i)
+		if (strlen(allowed_html[i]) == len && g_ascii_strncasecmp(allowed_html[i], b, len) == 0)
+			return true;
+	return false;
+}
+
+bool is_link_protocol(const char *b, const char *e)
+{
+	static const char * const protocols[] = { "http", "ftp", "mailto", NULL };
+	const size_t len = e - b;
+	for (int i = 0; protocols[i]; ++i)
+		if (strlen(protocols[i]) == len && g_ascii_strncasecmp(protocols[i], b, len) == 0)
+			return true;
+	return false;
+}
+
+void append_escaped(std::string &res, const char *b, const char *e)
+{
+	const char *run = b;
+	for (const char *p = b; p < e; ++p) {
+		const char *entity;
+		switch (*p) {
+		case '&': entity = "&amp;"; break;
+		case '<': entity = "&lt;"; break;
+		case '>': entity = "&gt;"; break;
+		case '\'': entity = "&apos;"; break;
+		case '"': entity = "&quot;"; break;
+		default: continue;
+		}
+		res.append(run, p - run);
+		res += entity;
+		run = p + 1;
+	}
+	res.append(run, e - run);
+}
+
+/* Find c outside of nested links. Links in link parameters are converted
+ * before the parameters are split, so their separators do not count. */
+const char *find_in_link(char c, const char *b, const char *e, char mode)
+{
+	int depth = 0;
+	for (const char *q = b; q < e; ++q) {
+		if (mode == 'L' && q + 1 < e && q[0] == '[' && q[1] == '[') {
+			++depth;
+			++q;
+		} else if (mode == 'L' && depth > 0 && q + 1 < e && q[0] == ']' && q[1] == ']') {
+			--depth;
+			++q;
+		} else if (*q == c && depth == 0)
+			return q;
+	}
+	return NULL;
+}
+
+class WikiRenderer {
+public:
+	explicit WikiRenderer(std::string &res)
+		: res_(res), tables_(0), link_closes_end_(NULL),
+		line_end_(NULL), tag_start_(NULL), tag_end_(NULL), resume_(NULL) {}
+	void render_text(const char *str, const char *end);
+private:
+	void find_html_tags(const char *b, const char *e);
+	void begin_line(const char *e);
+	void render_line(const char *b, const char *e);
+	void render_table_line(const char *b, const char *e);
+	void render_cell(const char *b, const char *e);
+	void render_params(const char *b, const char *e);
+	void render(const char *p, const char *e, const char *line_start, int flags);
+	void render_trimmed(const char *b, const char *e, const char *line_start, int flags);
+	const char *render_link(const char *p, const char *e, char mode);
+	const char *render_external_link(const char *p, const char *e);
+	const char *render_freelink(const char *p, const char *e,
+		const char *text_start, const char *line_start);
+	const char *render_quotes(const char *p, const char *e);
+	const char *render_tag(const char *p, const char *e, int flags);
+	const char *render_entity(const char *p, const char *e, int flags);
+	bool quotes_at(const char *p, const char *e, size_t n) const;
+	const char *skip_closer(const char *p);
+	bool is_brace_link(const char *p) const;
+	bool in_text_tag(const char *p) const
+	{
+		return tag_start_ < p && p < tag_end_;
+	}
+	const char *find_link_close(const char *p, const char *e, char mode);
+	const char *find_cell_params_end(const char *b, const char *e);
+
+	std::string &res_;
+	/* list characters of the previous line */
+	std::string list_;
+	/* number of open tables */
+	int tables_;
+	/* Closing '' and ''' matched with opening ones in the current line,
+	 * they are dropped when reached. */
+	std::vector<std::pair<const char *, const char *> > closers_;
+	/* {{ opening links in unclosed templates of the current line */
+	std::vector<const char *> brace_links_;
+	/* closing ]] of links in the current line, NULL for unclosed links */
+	std::map<const char *, const char *> link_closes_;
+	const char *link_closes_end_;
+	const char *line_end_;
+	/* < and > of the last element shown as text */
+	const char *tag_start_;
+	const char *tag_end_;
+	/* < and > of all HTML elements of the article */
+	std::map<const char *, const char *> html_tags_;
+	/* the text after an element spanning several lines */
+	const char *resume_;
+};
+
+/* Find the closing brackets of a link (mode 'L') or a template (mode 'T')
+ * opened at p, return NULL if the link is not closed.
+ * wiki2xml converts nested links as soon as they are found, even if the
+ * outer link is not closed, and takes {{ in a template for a link opening.
+ * Such links are added to brace_links_. */
+const char *WikiRenderer::find_link_close(const char *p, const char *e, char mode)
+{
+	if (mode == 'L') {
+		if (link_closes_end_ != e) {
+			link_closes_.clear();
+			link_closes_end_ = e;
+		}
+		std::map<const char *, const char *>::const_iterator it = link_closes_.find(p);
+		if (it != link_closes_.end())
+			return it->second;
+	}
+	const char open = mode == 'L' ? '[' : '{';
+	const char close = mode == 'L' ? ']' : '}';
+	const char *res = NULL;
+	for (const char *q = p + 1; q + 1 < e; ) {
+		if ((q[0] == open && q[1] == open) || (q[0] == '{' && q[1] == '{' && is_brace_link(q))) {
+			const char *link_close = find_link_close(q, e, 'L');
+			if (link_close) {
+				if (q[0] == '{' && !is_brace_link(q))
+					brace_links_.push_back(q);
+			} else if (mode == 'L' && q + 2 < e && q[2] == '[') {
+				/* the link nested in the unclosed one is skipped */
+				link_close = find_link_close(q + 1, e, 'L');
+			}
+			if (!link_close) {
+				q += 2;
+				continue;
+			}
+			q = link_close + 2;
+			while (q < e && is_text_char(*q))
+				++q;
+		} else if (q[0] == close && q[1] == close) {
+			res = q;
+			break;
+		} else
+			++q;
+	}
+	if (mode == 'L')
+		link_closes_[p] = res;
+	return res;
+}
+
+/* Find the '|' separating table cell parameters from the cell content.
+ * wiki2xml looks for it after converting the cell, so links, templates,
+ * bold and italic do not count. */
+const char *WikiRenderer::find_cell_params_end(const char *b, const char *e)
+{
+	char lastquote = ' ';
+	for (const char *p = b; p < e; ++p) {
+		if (p + 1 < e && (p[0] == '[' || p[0] == '{') && p[1] == p[0]) {
+			const char *close = find_link_close(p, e, p[0] == '[' ? 'L' : 'T');
+			if (close) {
+				p = close + 1;
+				continue;
+			}
+		}
+		if (*p == '|' && lastquote == ' ')
+			return p;
+		if (*p == '\'' && p + 1 < e && p[1] == '\'') {
+			while (p + 1 < e && p[1] == '\'')
+				++p;
+			continue;
+		}
+		if (*p != '\'' && *p != '"')
+			continue;
+		if (p > b && *(p - 1) == '\\')
+			continue;
+		if (lastquote == ' ')
+			lastquote = *p;
+		else if (lastquote == *p)
+			lastquote = ' ';
+	}
+	return NULL;
+}
+
+/* The same as make_tag_list, wiki2xml finds elements in the whole article
+ * before splitting it into lines, so an element may span several lines. */
+void WikiRenderer::find_html_tags(const char *b, const char *e)
+{
+	html_tags_.clear();
+	for (const char *p = b; p < e; ++p) {
+		if (*p != '<')
+			continue;
+		const char *close = find_unquoted('>', p, e);
+		if (!close)
+			continue;
+		html_tags_[p] = close;
+		p = close;
+	}
+}
+
+void WikiRenderer::render_text(const char *str, const char *end)
+{
+	find_html_tags(str, end);
+	const char *b = str;
+	while (true) {
+		const char *nl = static_cast<const char *>(memchr(b, '\n', end - b));
+		render_line(b, nl ? nl : end);
+		/* An element ended in one of the next lines, the text after it
+		 * continues the current line. */
+		while (resume_) {
+			const char *p = resume_;
+			resume_ = NULL;
+			nl = static_cast<const char *>(memchr(p, '\n', end - p));
+			begin_line(nl ? nl : end);
+			render(p, nl ? nl : end, NULL, RenderFlag_WIKI);
+		}
+		if (!nl)
+			break;
+		res_ += '\n';
+		b = nl + 1;
+	}
+	/* wiki2xml closes lists and tables in an extra line */
+	if (!list_.empty())
+		res_ += '\n';
+	if (tables_ > 0)
+		res_ += '\n';
+}
+
+void WikiRenderer::begin_line(const char *e)
+{
+	closers_.clear();
+	brace_links_.clear();
+	link_closes_.clear();
+	tag_start_ = tag_end_ = NULL;
+	line_end_ = e;
+}
+
+void WikiRenderer::render_line(const char *b, const char *e)
+{
+	begin_line(e);
+	const char *p = b;
+	while (p < e && (*p == '*' || *p == '#' || *p == ':'))
+		++p;
+	list_.assign(b, p - b);
+	if (p > b)
+		while (p < e && *p == ' ')
+			++p;
+	if (p == e)
+		return;
+
+	const size_t len = e - p;
+	if (len >= 4 && memcmp(p, "----", 4) == 0) {
+		const char *q = p;
+		while (q < e && *q == '-')
+			++q;
+		render(q, e, q, RenderFlag_WIKI);
+	} else if (*p == '=') {
+		size_t a = 0;
+		while (a < len && p[a] == '=' && p[len - a - 1] == '=')
+			++a;
+		if (a >= len || a < 1 || a > 9) {
+			render(p, e, p, RenderFlag_WIKI);
+		} else {
+			/* the heading element is before the text */
+			render_trimmed(p + a, e - a, NULL, RenderFlag_WIKI);
+		}
+	} else if (*p == ' ') {
+		while (p < e && *p == ' ')
+			++p;
+		render(p, e, p, 0);
+	} else if ((len >= 2 && p[0] == '{' && p[1] == '|')
+		|| (len >= 2 && p[0] == '|' && p[1] == '}' && (len == 2 || p[2] != '}'))
+		|| (tables_ > 0 && (*p == '|' || *p == '!'))) {
+		render_table_line(p, e);
+	} else
+		render(p, e, p, RenderFlag_WIKI);
+}
+
+void WikiRenderer::render_table_line(const char *p, const char *e)
+{
+	if (e - p >= 2 && p[0] == '{' && p[1] == '|') {
+		render_trimmed(p + 2, e, p + 2, 0);
+		++tables_;
+		return;
+	}
+	if (e - p >= 2 && p[0] == '|' && p[1] == '}') {
+		if (tables_ > 0)
+			--tables_;
+		return;
+	}
+	if (e - p >= 2 && p[0] == '|' && p[1] == '-') {
+		const char *q = p + 1;
+		while (q < e && *q == '-')
+			++q;
+		render_params(q, e);
+		return;
+	}
+	if (e - p >= 2 && p[0] == '|' && p[1] == '+')
+		p += 2;
+	else if (*p == '!' || *p == '|')
+		++p;
+	while (true) {
+		const char *sep = NULL;
+		for (const char *q = p; q + 1 < e; ++q)
+			if (q[0] == '|' && q[1] == '|') {
+				sep = q;
+				break;
+			}
+		if (!sep) {
+			if (p < e)
+				render_cell(p, e);
+			break;
+		}
+		render_cell(p, sep);
+		p = sep + 2;
+	}
+}
+
+void WikiRenderer::render_cell(const char *b, const char *e)
+{
+	const char *params_end = find_cell_params_end(b, e);
+	if (params_end) {
+		render_params(b, params_end);
+		render(params_end + 1, e, b, RenderFlag_WIKI);
+	} else
+		render(b, e, b, RenderFlag_WIKI);
+}
+
+/* The same as xml_params, keys and values are shown. */
+void WikiRenderer::render_params(const char *b, const char *e)
+{
+	while (b < e) {
+		const char *space = find_unquoted(' ', b, e);
+		const char *first = b, *first_end = space ? space : e;
+		b = first_end;
+		trim(first, first_end);
+		trim(b, e);
+		if (first == first_end)
+			continue;
+		const char *eq = find_unquoted('=', first, first_end);
+		if (eq) {
+			render_trimmed(first, eq, first, 0);
+			render_trimmed(eq + 1, first_end, eq + 1, 0);
+		} else
+			render_trimmed(first, first_end, first, 0);
+	}
+}
+
+void WikiRenderer::render_trimmed(const char *b, const char *e, const char *line_start, int flags)
+{
+	trim(b, e);
+	render(b, e, line_start, flags);
+}
+
+/* Render text between p and e. line_start is the beginning of the string
+ * wiki2xml would parse, NULL if the string starts with an element. */
+void WikiRenderer::render(const char *p, const char *e, const char *line_start, int flags)
+{
+	/* beginning of the text after the last converted construct */
+	const char *text_start = p;
+	while (p < e) {
+		const char *q = p;
+		while (q < e && !is_special_char(*q))
+			++q;
+		res_.append(p, q - p);
+		p = q;
+		if (p == e)
+			break;
+
+		const char *next = NULL;
+		switch (*p) {
+		case '[':
+			if (!(flags & RenderFlag_WIKI))
+				break;
+			if (p + 1 < e && p[1] == '[') {
+				next = render_link(p, e, 'L');
+				if (!next) {
+					res_ += '[';
+					++p;
+					/* the link nested in the unclosed one starts at p */
+					if (!(p + 1 < e && p[1] == '[' && find_link_close(p, e, 'L'))) {
+						res_ += '[';
+						++p;
+					}
+					continue;
+				}
+			} else
+				next = render_external_link(p, e);
+			break;
+		case '{':
+			if (!(flags & RenderFlag_WIKI) || p + 1 >= e || p[1] != '{')
+				break;
+			next = render_link(p, e, is_brace_link(p) ? 'L' : 'T');
+			if (!next) {
+				res_ += '{';
+				++p;
+				if (!is_brace_link(p)) {
+					res_ += '{';
+					++p;
+				}
+				continue;
+			}
+			break;
+		case ':':
+			if ((flags & RenderFlag_WIKI) && p + 2 < e && p[1] == '/' && p[2] == '/')
+				next = render_freelink(p, e, text_start, line_start);
+			break;
+		case '\'':
+			next = skip_closer(p);
+			if (!next && (flags & RenderFlag_WIKI))
+				next = render_quotes(p, e);
+			break;
+		case '<':
+			if (!in_text_tag(p))
+				next = render_tag(p, e, flags);
+			break;
+		case '&':
+			p = render_entity(p, e, flags);
+			continue;
+		}
+		if (next) {
+			p = next;
+			text_start = p;
+			continue;
+		}
+
+		/* < and > of elements shown as text are converted to entities,
+		 * the text inside the element is not. */
+		switch (*p) {
+		case '<':
+			res_ += (flags & RenderFlag_LITERAL) && !in_text_tag(p) ? "&amp;lt;" : "&lt;";
+			break;
+		case '>':
+			res_ += (flags & RenderFlag_LITERAL) && !in_text_tag(p) ? "&amp;gt;" : "&gt;";
+			break;
+		case '\'':
+			res_ += "&apos;";
+			break;
+		case '"':
+			res_ += "&quot;";
+			break;
+		default:
+			res_ += *p;
+			break;
+		}
+		++p;
+	}
+}
+
+/* [[link|parameters]]trail or {{template|parameters}}.
+ * Return NULL if the brackets are not closed. */
+const char *WikiRenderer::render_link(const char *p, const char *e, char mode)
+{
+	const size_t nbrace_links = brace_links_.size();
+	const char *close = find_link_close(p, e, mode);
+	if (!close)
+		return NULL;
+	brace_links_.resize(nbrace_links);
+	const char *next = close + 2;
+	if (mode == 'L') {
+		while (next < e && is_text_char(*next))
+			++next;
+		res_ += link_span;
+	}
+
+	const char *part = p + 2;
+	for (int a = 0; ; ++a) {
+		const char *sep = mode == 'L' ? find_in_link('|', part, close, mode)
+			: static_cast<const char *>(memchr(part, '|', close - part));
+		const bool last = sep == NULL;
+		const char *part_end = last ? close : sep;
+		const char *eq = NULL;
+		if (a > 0 && (mode != 'L' || !last)) {
+			eq = mode == 'L' ? find_in_link('=', part, part_end, mode)
+				: static_cast<const char *>(memchr(part, '=', part_end - part));
+		}
+		/* Parameters are parsed once more inside the link element, so
+		 * line_start is NULL. */
+		if (eq) {
+			/* the key is not escaped, unlike the value */
+			render_trimmed(part, eq, NULL, RenderFlag_WIKI);
+			render_trimmed(eq + 1, part_end, NULL, RenderFlag_WIKI | RenderFlag_LITERAL);
+		} else
+			render_trimmed(part, part_end, NULL, RenderFlag_WIKI | RenderFlag_LITERAL);
+		if (last)
+			break;
+		part = sep + 1;
+	}
+
+	if (mode == 'L') {
+		res_.append(close + 2, next - (close + 2));
+		res_ += "</span>";
+	}
+	return next;
+}
+
+/* [http://url title] */
+const char *WikiRenderer::render_external_link(const char *p, const char *e)
+{
+	const char *colon = static_cast<const char *>(memchr(p + 1, ':', e - (p + 1)));
+	if (!is_link_protocol(p + 1, colon ? colon : e))
+		return NULL;
+	const char *close = static_cast<const char *>(memchr(p + 1, ']', e - (p + 1)));
+	if (!close)
+		return NULL;
+	const char *url = p + 1, *url_end = close;
+	const char *space = static_cast<const char *>(memchr(url, ' ', url_end - url));
+	res_ += link_span;
+	if (space) {
+		render_trimmed(url, space, url, 0);
+		render_trimmed(space + 1, url_end, space + 1, 0);
+	} else
+		render_trimmed(url, url_end, url, 0);
+	res_ += "</span>";
+	return close + 1;
+}
+
+/* http://url, p points to ':'. The url is shown twice, as the url and as the
+ * title. */
+const char *WikiRenderer::render_freelink(const char *p, const char *e,
+	const char *text_start, const char *line_start)
+{
+	const char *protocol = p;
+	while (protocol > text_start && is_text_char(*(protocol - 1)))
+		--protocol;
+	/* wiki2xml does not look for a url at the beginning of the string */
+	if (protocol == line_start || !is_link_protocol(protocol, p))
+		return NULL;
+	const char *url_end = p;
+	while (url_end < e && is_url_char(*url_end))
+		++url_end;
+	/* the protocol is already in res_ */
+	res_.append(p, url_end - p);
+	res_.append(protocol, url_end - protocol);
+	return url_end;
+}
+
+/* Opening ''' and '' of bold and italic, the text is not formatted, the
+ * quotes are just removed. Return NULL if there is no closing quotes. */
+const char *WikiRenderer::render_quotes(const char *p, const char *e)
+{
+	if (quotes_at(p, e, 3)) {
+		for (const char *q = p + 3; q + 3 <= e; ++q) {
+			if (!quotes_at(q, e, 3))
+				continue;
+			/* the last ''' of a longer sequence closes */
+			while (quotes_at(q + 1, e, 3))
+				++q;
+			closers_.push_back(std::make_pair(q, q + 3));
+			return p + 3;
+		}
+	}
+	if (quotes_at(p, e, 2)) {
+		for (const char *q = p + 2; q + 2 <= e; ++q) {
+			if (!quotes_at(q, e, 2))
+				continue;
+			closers_.push_back(std::make_pair(q, q + 2));
+			return p + 2;
+		}
+	}
+	return NULL;
+}
+
+/* Whether there are n quotes at p, not matched before. */
+bool WikiRenderer::quotes_at(const char *p, const char *e, size_t n) const
+{
+	if (static_cast<size_t>(e - p) < n)
+		return false;
+	for (size_t i = 0; i < n; ++i)
+		if (p[i] != '\'')
+			return false;
+	for (size_t i = 0; i < closers_.size(); ++i)
+		if (p < closers_[i].second && closers_[i].first < p + n)
+			return false;
+	return true;
+}
+
+const char *WikiRenderer::skip_closer(const char *p)
+{
+	for (size_t i = 0; i < closers_.size(); ++i)
+		if (closers_[i].first == p) {
+			const char *next = closers_[i].second;
+			closers_.erase(closers_.begin() + i);
+			return next;
+		}
+	return NULL;
+}
+
+bool WikiRenderer::is_brace_link(const char *p) const
+{
+	for (size_t i = 0; i < brace_links_.size(); ++i)
+		if (brace_links_[i] == p)
+			return true;
+	return false;
+}
+
+/* Allowed HTML elements are skipped, in link parameters they are shown.
+ * Return NULL if the element must be shown as text. */
+const char *WikiRenderer::render_tag(const char *p, const char *e, int flags)
+{
+	std::map<const char *, const char *>::const_iterator it = html_tags_.find(p);
+	if (it == html_tags_.end())
+		return NULL;
+	const char *close = it->second;
+	if (!is_allowed_tag(p + 1, close)) {
+		tag_start_ = p;
+		tag_end_ = close;
+		return NULL;
+	}
+	if (close >= line_end_ && e == line_end_ && !(flags & RenderFlag_LITERAL)) {
+		/* the element spans several lines, the lines it takes are dropped */
+		resume_ = close + 1;
+		return e;
+	}
+	if (close >= e) {
+		/* the element is split by wiki markup, it is shown with > */
+		tag_start_ = p;
+		tag_end_ = close + 1;
+		return NULL;
+	}
+	if (flags & RenderFlag_LITERAL)
+		append_escaped(res_, p, close + 1);
+	return close + 1;
+}
+
+const char *WikiRenderer::render_entity(const char *p, const char *e, int flags)
+{
+	static const char * const entities[] = { "lt;", "gt;", "amp;", "quot;", "apos;", NULL };
+	if (!(flags & RenderFlag_LITERAL)) {
+		for (int i = 0; entities[i]; ++i) {
+			const size_t len = strlen(entities[i]);
+			if (static_cast<size_t>(e - (p + 1)) >= len && memcmp(p + 1, entities[i], len) == 0) {
+				res_.append(p, len + 1);
+				return p + len + 1;
+			}
+		}
+		if (p + 2 < e && p[1] == '#') {
+			const bool hex = p[2] == 'x';
+			const char *q = hex ? p + 3 : p + 2;
+			const char *digits = q;
+			gunichar ch = 0;
+			for (; q < e && (hex ? g_ascii_isxdigit(*q) : g_ascii_isdigit(*q)) && q - digits < 8; ++q)
+				ch = ch * (hex ? 16 : 10) + (hex ? g_ascii_xdigit_value(*q) : g_ascii_digit_value(*q));
+			if (q > digits && q < e && *q == ';' && ch && g_unichar_validate(ch)) {
+				gchar buf[6];
+				const gint n = g_unichar_to_utf8(ch, buf);
+				append_escaped(res_, buf, buf + n);
+				return q + 1;
+			}
+		}
+	}
+	/* wiki2xml leaves unknown entities as they are, that breaks the XML */
+	res_ += "&amp;";
+	return p + 1;
+}
+
+}
+
+void wiki2pango(const char *str, size_t len, std::string &res)
+{
+	res.reserve(res.length() + len + len / 8);
+	WikiRenderer renderer(res);
+	renderer.render_text(str, str + len);
+}
@@ -0,0 +1,28 @@
+/*
+ * This file is part of StarDict.
+ *
+ * StarDict is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * StarDict is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with StarDict.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _STARDICT_WIKI2PANGO_H_
+#define _STARDICT_WIKI2PANGO_H_
+
+#include <string>
+
+/* Convert wiki markup to pango markup and append it to res.
+ * The result is what wikixml2pango(wiki2xml(str)) gives for well-formed
+ * articles, but the markup is converted in one pass without building XML. */
+extern void wiki2pango(const char *str, size_t len, std::string &res);
+
+#endif
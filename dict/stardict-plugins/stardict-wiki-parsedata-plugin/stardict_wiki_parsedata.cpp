@@ -18,7 +18,7 @@
  */
 
 #include "stardict_wiki_parsedata.h"
-#include "stardict_wiki2xml.h"
+#include "stardict_wiki2pango.h"
 #include <cstring>
 #include <glib/gi18n.h>
 
@@ -36,9 +36,7 @@ static bool parse(const char *p, unsigned int *parsed_size, ParseResult &result,
 		ParseResultItem item;
 		item.type = ParseResultItemType_mark;
 		item.mark = new ParseResultMarkItem;
-		std::string res(p, len);
-		std::string xml = wiki2xml(res);
-		item.mark->pango = wikixml2pango(xml);
+		wiki2pango(p, len, item.mark->pango);
 		result.item_list.push_back(item);
 	}
 	*parsed_size = 1 + len + 1;
@@ -65,6 +63,8 @@ DLLIMPORT void stardict_plugin_exit(void)
 DLLIMPORT bool stardict_parsedata_plugin_init(StarDictParseDataPlugInObject *obj)
 {
 	obj->parse_func = parse;
+	obj->types = "w";
+	obj->thread_safe = true;
 	g_print(_("Wiki data parsing plug-in loaded.\n"));
 	return false;
 }
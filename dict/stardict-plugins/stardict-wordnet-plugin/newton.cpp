@@ -30,24 +30,45 @@ void newton_t::update(single t) {
 }
 
 void newton_t::calculate_new_position(single t) {
-	_statchanged = false;
-	for(vector<partic_t *>::iterator it = _scene.get_partics().begin();
-		it != _scene.get_partics().end(); ++it) {
-			if (!(*it)->get_anchor()) {
-				vector_t v2 = (*it)->getV() + (*it)->getA().mul(t);
-				// 这里做了限速，让我很担忧
-				if (v2.powerlength() > _env.max_limt_powner_v*_env.max_limt_powner_v)
-					v2.scaleto(_env.max_limt_powner_v);
+	vector<partic_t *> & partics = _scene.get_partics();
+	_d.resize(partics.size());
+	single max_dd = 0;
+	for (size_t i = 0; i < partics.size(); ++i) {
+		partic_t *p = partics[i];
+		if (p->get_anchor())
+			continue;
+		vector_t v2 = p->getV() + p->getA().mul(t);
+		// 这里做了限速，让我很担忧
+		if (v2.powerlength() > _env.max_limt_powner_v*_env.max_limt_powner_v)
+			v2.scaleto(_env.max_limt_powner_v);
 
-				vector_t avgv = ((*it)->getV() + v2).div(2);
-				vector_t d = avgv.mul(t);
-				if (d.powerlength() > 0.5f) {
-					/// todo matic number, avoid tiny motion/ thread
-					(*it)->getP().add(d);
-					if (!_statchanged) _statchanged = true;
-				}
-				(*it)->getV() = v2;
-			}
+		vector_t avgv = (p->getV() + v2).div(2);
+		_d[i] = avgv.mul(t);
+		const single dd = _d[i].powerlength();
+		if (dd > max_dd)
+			max_dd = dd;
+		p->getV() = v2;
+	}
+	// Springs and repulsion often balance only roughly, then the particles
+	// tremble by a pixel till the friction grows enough to stop them. The
+	// scene looks still by then, the particles stay where they are.
+	if (max_dd < _env.settle_distance*_env.settle_distance) {
+		if (_quiet_steps < _env.settle_steps)
+			++_quiet_steps;
+	} else {
+		_quiet_steps = 0;
+	}
+	_statchanged = false;
+	if (_quiet_steps >= _env.settle_steps)
+		return;
+	for (size_t i = 0; i < partics.size(); ++i) {
+		if (partics[i]->get_anchor())
+			continue;
+		if (_d[i].powerlength() > 0.5f) {
+			/// todo matic number, avoid tiny motion/ thread
+			partics[i]->getP().add(_d[i]);
+			_statchanged = true;
+		}
 	}
 }
 
@@ -74,22 +95,46 @@ void newton_t::init_newton_calculate() {
 
 //--------------------------------------------------
 // 万有斥力的计算，让整个场景有一个较好的分布
+// Large scenes use the Barnes-Hut approximation.
 //--------------------------------------------------
 void newton_t::calculate_repulsion_factor() {
-	for(size_t i = 0; i < _scene.get_partics().size(); ++i) {
-		partic_t * a = _scene.get_partics()[i];//outloop.cur();
-		for(size_t j = 0; j < _scene.get_partics().size(); ++j ) {
-			partic_t * b = _scene.get_partics()[j]; // innerloop.cur();
-			// 每次都需要把两个球都算好, 分别计算
-			vector_t f = a->getP() - b->getP();
-			single dd = f.powerlength();
-			dd = dd > _env.min_repulsion_distance ? dd : _env.min_repulsion_distance;
-			single g = _env.G * a->getM()*b->getM()/dd;
-			f.set_length(g);
-			a->getF().add(f);
-			f.mul(-1);
-			b->getF().add(f);
+	vector<partic_t *> & partics = _scene.get_partics();
+	const size_t n = partics.size();
+	if (n == 0)
+		return;
+	_px.resize(n);
+	_py.resize(n);
+	_m.resize(n);
+	_fx.assign(n, 0);
+	_fy.assign(n, 0);
+	for (size_t i = 0; i < n; ++i) {
+		_px[i] = partics[i]->getP().x;
+		_py[i] = partics[i]->getP().y;
+		_m[i] = partics[i]->getM();
+	}
+	// the all-pairs loop used to count each pair twice, keep the strength
+	const single g = 2*_env.G;
+	const single min_dd = _env.min_repulsion_distance;
+	if (n < _env.barnes_hut_min_count) {
+		for (size_t i = 0; i < n; ++i) {
+			for (size_t j = i+1; j < n; ++j) {
+				single fx = 0, fy = 0;
+				add_repulsion(_px[i] - _px[j], _py[i] - _py[j], g*_m[i]*_m[j],
+					min_dd, fx, fy);
+				_fx[i] += fx;
+				_fy[i] += fy;
+				_fx[j] -= fx;
+				_fy[j] -= fy;
+			}
 		}
+	} else {
+		_tree.build(&_px[0], &_py[0], &_m[0], n);
+		for (size_t i = 0; i < n; ++i)
+			_tree.repulsion(i, g, min_dd, _env.barnes_hut_theta, _fx[i], _fy[i]);
+	}
+	for (size_t i = 0; i < n; ++i) {
+		partics[i]->getF().x += _fx[i];
+		partics[i]->getF().y += _fy[i];
 	}
 }
 
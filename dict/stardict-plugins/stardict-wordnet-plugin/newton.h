@@ -32,12 +32,20 @@
 #include "scene.h"
 #include "vector_t.h"
 #include "newton_env.h"
+#include "quadtree.h"
 
 class newton_t {
 private:
 	scene_t & _scene;
 	newton_env_t & _env;
 	bool _statchanged;
+	// steps in a row no particle moved farther than env.settle_distance
+	int _quiet_steps;
+	// positions, masses and repulsion of particles, an array per component
+	vector<single> _px, _py, _m, _fx, _fy;
+	// displacement of particles in this step
+	vector<vector_t> _d;
+	quadtree_t _tree;
 private:
 	void init_newton_calculate();
 	void calculate_spring_factor();	
@@ -46,7 +54,8 @@ private:
 	void calculate_collide_factor();
 	void calculate_new_position(single t);
 public:
-	newton_t(scene_t & s, newton_env_t & env): _scene(s), _env(env) { }
+	newton_t(scene_t & s, newton_env_t & env): _scene(s), _env(env),
+		_statchanged(false), _quiet_steps(0) { }
 	void set_scene(scene_t & s) { _scene = s; }
 	void update(single t);
 	newton_env_t & get_env() { return _env; }
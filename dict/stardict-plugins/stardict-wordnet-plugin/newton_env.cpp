@@ -24,7 +24,11 @@ min_friction_factor(0.3f),
 max_friction_factor(6.5f),
 max_limt_powner_v(6.0f),
 min_repulsion_distance(0.01f),
-G(9.8f)
+G(9.8f),
+barnes_hut_theta(0.5f),
+barnes_hut_min_count(64),
+settle_distance(1.5f),
+settle_steps(8)
 {
 	reset();
 }
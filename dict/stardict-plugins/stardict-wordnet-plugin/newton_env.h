@@ -20,6 +20,8 @@
 #ifndef __NEWTON_ENV_H__
 #define __NEWTON_ENV_H__
 
+#include <cstddef>
+
 #include "utils.h"
 
 // 牛顿环境的系数. 一个数据类.
@@ -33,6 +35,15 @@ struct newton_env_t {
 	** 万有斥力系数
 	*/
 	single G;		
+	// Barnes-Hut accuracy, a group of particles acts as one particle when its
+	// size divided by the distance is less than this
+	single barnes_hut_theta;
+	// with less particles the repulsion is computed exactly
+	size_t barnes_hut_min_count;
+	// The scene is settled when no particle moves farther than this in
+	// settle_steps steps in a row.
+	single settle_distance;
+	int settle_steps;
 	// init value
 	newton_env_t();
 	virtual ~newton_env_t() {}
@@ -0,0 +1,134 @@
+/*
+ * This file is part of StarDict.
+ *
+ * StarDict is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * StarDict is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with StarDict.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "quadtree.h"
+
+// Particles closer than the cell of this depth share a leaf.
+static const int max_depth = 16;
+
+void quadtree_t::build(const single *x, const single *y, const single *m, size_t count) {
+	_x = x;
+	_y = y;
+	_m = m;
+	_nodes.clear();
+	_next.assign(count, -1);
+	if (count == 0)
+		return;
+	single minx = x[0], maxx = x[0], miny = y[0], maxy = y[0];
+	for (size_t i = 1; i < count; ++i) {
+		if (x[i] < minx) minx = x[i];
+		if (x[i] > maxx) maxx = x[i];
+		if (y[i] < miny) miny = y[i];
+		if (y[i] > maxy) maxy = y[i];
+	}
+	node_t root;
+	root.x0 = minx;
+	root.y0 = miny;
+	// a little larger, so the particles on the far edges are inside
+	root.size = (maxx - minx > maxy - miny ? maxx - minx : maxy - miny) + 1;
+	root.cx = root.cy = root.m = 0;
+	root.child = 0;
+	root.first = -1;
+	_nodes.push_back(root);
+	for (size_t i = 0; i < count; ++i)
+		insert(0, int(i), 0);
+	// cx, cy hold mass-weighted sums till now
+	for (size_t n = 0; n < _nodes.size(); ++n) {
+		node_t & node = _nodes[n];
+		if (node.m > 0) {
+			node.cx /= node.m;
+			node.cy /= node.m;
+		} else {
+			node.cx = node.x0 + node.size/2;
+			node.cy = node.y0 + node.size/2;
+		}
+	}
+}
+
+void quadtree_t::insert(size_t node, int i, int depth) {
+	for (;;) {
+		_nodes[node].m += _m[i];
+		_nodes[node].cx += _m[i]*_x[i];
+		_nodes[node].cy += _m[i]*_y[i];
+		if (_nodes[node].child == 0) {
+			if (_nodes[node].first < 0 || depth >= max_depth) {
+				_next[i] = _nodes[node].first;
+				_nodes[node].first = i;
+				return;
+			}
+			split(node);
+		}
+		const node_t & n = _nodes[node];
+		const single half = n.size/2;
+		node = n.child + (_x[i] >= n.x0 + half ? 1 : 0) + (_y[i] >= n.y0 + half ? 2 : 0);
+		++depth;
+	}
+}
+
+// Turn a leaf with one particle into a node with four leaves.
+void quadtree_t::split(size_t node) {
+	const size_t child = _nodes.size();
+	const single half = _nodes[node].size/2;
+	for (int k = 0; k < 4; ++k) {
+		node_t c;
+		c.x0 = _nodes[node].x0 + (k & 1 ? half : 0);
+		c.y0 = _nodes[node].y0 + (k & 2 ? half : 0);
+		c.size = half;
+		c.cx = c.cy = c.m = 0;
+		c.child = 0;
+		c.first = -1;
+		_nodes.push_back(c);
+	}
+	node_t & n = _nodes[node];
+	n.child = child;
+	const int j = n.first;
+	n.first = -1;
+	node_t & c = _nodes[child + (_x[j] >= n.x0 + half ? 1 : 0) + (_y[j] >= n.y0 + half ? 2 : 0)];
+	c.m = _m[j];
+	c.cx = _m[j]*_x[j];
+	c.cy = _m[j]*_y[j];
+	c.first = j;
+}
+
+void quadtree_t::repulsion(size_t i, single g, single min_dd, single theta,
+	single & fx, single & fy) {
+	if (_nodes.empty())
+		return;
+	const single xi = _x[i], yi = _y[i], gmi = g*_m[i];
+	const single theta2 = theta*theta;
+	_stack.clear();
+	_stack.push_back(0);
+	while (!_stack.empty()) {
+		const node_t & n = _nodes[_stack.back()];
+		_stack.pop_back();
+		if (n.child == 0) {
+			for (int j = n.first; j >= 0; j = _next[j])
+				if (j != int(i))
+					add_repulsion(xi - _x[j], yi - _y[j], gmi*_m[j], min_dd, fx, fy);
+			continue;
+		}
+		const single dx = xi - n.cx, dy = yi - n.cy;
+		if (n.size*n.size < theta2*(dx*dx + dy*dy)) {
+			add_repulsion(dx, dy, gmi*n.m, min_dd, fx, fy);
+			continue;
+		}
+		const size_t child = n.child;
+		for (size_t k = 0; k < 4; ++k)
+			if (_nodes[child + k].m > 0)
+				_stack.push_back(child + k);
+	}
+}
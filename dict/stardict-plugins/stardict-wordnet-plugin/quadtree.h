@@ -0,0 +1,77 @@
+/*
+ * This file is part of StarDict.
+ *
+ * StarDict is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * StarDict is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with StarDict.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __QUADTREE_H__
+#define __QUADTREE_H__
+
+#include <vector>
+
+#include "utils.h"
+
+// Barnes-Hut quadtree of point masses.
+// Distant groups of particles act as one particle placed at their center of
+// mass, so the repulsion on all particles is found in O(n log n) instead of
+// O(n^2). A group is distant when its cell size divided by the distance to
+// its center of mass is less than theta.
+// Positions and masses are passed as separate arrays, the tree keeps
+// pointers to them, they must not change till the next build.
+class quadtree_t {
+public:
+	quadtree_t(): _x(NULL), _y(NULL), _m(NULL) {}
+	void build(const single *x, const single *y, const single *m, size_t count);
+	// Repulsion on particle i: g*m[i]*m[j]/d^2 from each other particle j,
+	// d^2 is at least min_dd. The result is added to fx, fy.
+	void repulsion(size_t i, single g, single min_dd, single theta,
+		single & fx, single & fy);
+private:
+	struct node_t {
+		// the cell, a square
+		single x0, y0, size;
+		// center of mass and total mass
+		single cx, cy, m;
+		// first child, children are 4 consecutive nodes, 0 - a leaf
+		size_t child;
+		// first particle of a leaf, the rest are linked by _next
+		int first;
+	};
+	void insert(size_t node, int i, int depth);
+	void split(size_t node);
+
+	const single *_x, *_y, *_m;
+	std::vector<node_t> _nodes;
+	// next particle in the same leaf, -1 - the last one
+	std::vector<int> _next;
+	std::vector<size_t> _stack;
+};
+
+// Add the repulsion gm/d^2 of a particle at distance (dx, dy) to fx, fy.
+// d^2 is at least min_dd.
+inline void add_repulsion(single dx, single dy, single gm, single min_dd,
+	single & fx, single & fy) {
+	// coincident particles do not push each other, as with vector_t::norm
+	if (tabs(dx) + tabs(dy) < con_tol)
+		return;
+	single dd = dx*dx + dy*dy;
+	const single len = sqrt(dd);
+	if (dd < min_dd)
+		dd = min_dd;
+	const single f = gm/dd/len;
+	fx += f*dx;
+	fy += f*dy;
+}
+
+#endif // __QUADTREE_H__
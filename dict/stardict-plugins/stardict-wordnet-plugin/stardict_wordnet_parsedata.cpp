@@ -159,6 +159,7 @@ DLLIMPORT void stardict_plugin_exit(void)
 DLLIMPORT bool stardict_parsedata_plugin_init(StarDictParseDataPlugInObject *obj)
 {
 	obj->parse_func = parse;
+	obj->types = "n";
 	g_print(_("WordNet data parsing plug-in loaded.\n"));
 	return false;
 }
@@ -45,7 +45,9 @@ struct ColorScheme {
 
 ColorScheme color_scheme;
 
-static size_t xml_strlen(const std::string& str)
+/* Number of characters in the text between str and end as displayed by pango,
+ * entities count as one character, tags are not counted. */
+static size_t xml_strlen(const char *str, const char *end)
 {
 	const char *q;
 	static const char* xml_entrs[] = { "lt;", "gt;", "amp;", "apos;", "quot;", 0 };
@@ -53,18 +55,18 @@ static size_t xml_strlen(const std::string& str)
 	size_t cur_pos;
 	int i;
 
-	for (cur_pos = 0, q = str.c_str(); *q; ++cur_pos) {
+	for (cur_pos = 0, q = str; q < end; ++cur_pos) {
 		if (*q == '&') {
 			for (i = 0; xml_entrs[i]; ++i)
-				if (strncmp(xml_entrs[i], q + 1,
-					    xml_ent_len[i]) == 0) {
+				if (end - (q + 1) >= xml_ent_len[i]
+					&& memcmp(xml_entrs[i], q + 1, xml_ent_len[i]) == 0) {
 					q += xml_ent_len[i] + 1;
 					break;
 				}
 			if (xml_entrs[i] == NULL)
 				++q;
 		} else if (*q == '<') {
-			const char *p = strchr(q+1, '>');
+			const char *p = static_cast<const char *>(memchr(q + 1, '>', end - (q + 1)));
 			if (p)
 				q = p + 1;
 			else
@@ -77,7 +79,8 @@ static size_t xml_strlen(const std::string& str)
 	return cur_pos;
 }
 
-static void xml_decode(const char *str, std::string& decoded)
+/* Decode the text between str and end and append it to decoded. */
+static void xml_decode(const char *str, const char *end, std::string& decoded)
 {
 	static const char raw_entrs[] = { 
 		'<',   '>',   '&',    '\'',    '\"',    0 
@@ -89,19 +92,19 @@ static void xml_decode(const char *str, std::string& decoded)
 		3,     3,     4,      5,       5 
 	};
 	int ient;
-	const char *amp = strchr(str, '&');
+	const char *amp = static_cast<const char *>(memchr(str, '&', end - str));
 
 	if (amp == NULL) {
-	decoded = str;
+		decoded.append(str, end - str);
 		return;
 	}
-	decoded.assign(str, amp - str);
+	decoded.append(str, amp - str);
 
-	while (*amp)
+	while (amp < end)
 		if (*amp == '&') {
 			for (ient = 0; xml_entrs[ient] != 0; ++ient)
-				if (strncmp(amp + 1, xml_entrs[ient],
-						xml_ent_len[ient]) == 0) {
+				if (end - (amp + 1) >= xml_ent_len[ient]
+					&& memcmp(amp + 1, xml_entrs[ient], xml_ent_len[ient]) == 0) {
 					decoded += raw_entrs[ient];
 					amp += xml_ent_len[ient]+1;
 					break;
@@ -113,6 +116,42 @@ static void xml_decode(const char *str, std::string& decoded)
 		}
 }
 
+/* Find str of length len between b and end. */
+static const char *find_str(const char *b, const char *end, const char *str, size_t len)
+{
+	while (static_cast<size_t>(end - b) >= len) {
+		const char *q = static_cast<const char *>(memchr(b, str[0], end - b - len + 1));
+		if (!q)
+			return NULL;
+		if (memcmp(q, str, len) == 0)
+			return q;
+		b = q + 1;
+	}
+	return NULL;
+}
+
+/* Find the value of attribute attr, for example 'k="', in the element
+ * between b and end. A value without the closing quote lasts till the end. */
+static bool find_attr(const char *b, const char *end, const char *attr,
+	const char *&val, const char *&val_end)
+{
+	const size_t attr_len = strlen(attr);
+	const char *pos = find_str(b, end, attr, attr_len);
+	if (!pos)
+		return false;
+	val = pos + attr_len;
+	val_end = static_cast<const char *>(memchr(val, '\"', end - val));
+	if (!val_end)
+		val_end = end;
+	return true;
+}
+
+static bool has_suffix(const char *b, const char *end, const char *suffix)
+{
+	const size_t len = strlen(suffix);
+	return static_cast<size_t>(end - b) >= len && memcmp(end - len, suffix, len) == 0;
+}
+
 /* concatenate path1 and path2 inserting a path separator in between if needed. */
 static std::string build_path(const std::string& path1, const std::string& path2)
 {
@@ -230,26 +269,114 @@ static void set_default_color_scheme(void)
 	color_scheme.ref = 0x00007F;
 }
 
-struct ReplaceTag {
-	ReplaceTag(const char* match, int match_len, const std::string& replace, int char_len)
-	:
-		match_(match),
-		match_len_(match_len),
-		replace_(replace),
-		char_len_(char_len)
-	{
+/* XDXF elements known to the parser */
+enum XDXFTag {
+	XDXFTag_unknown,
+	XDXFTag_abr,
+	XDXFTag_b,
+	XDXFTag_i,
+	XDXFTag_sub,
+	XDXFTag_sup,
+	XDXFTag_tt,
+	XDXFTag_big,
+	XDXFTag_small,
+	XDXFTag_tr,
+	XDXFTag_ex,
+	XDXFTag_k,
+	XDXFTag_c,
+	XDXFTag_rref,
+	XDXFTag_kref,
+	XDXFTag_iref,
+	XDXFTag_blockquote,
+	XDXFTag_NUMS,
+};
+
+/* Map an element name to XDXFTag. The length and the first letter leave
+ * at most one candidate, so at most one comparison is made. */
+static XDXFTag find_tag(const char *name, size_t len)
+{
+	switch (len) {
+	case 1:
+		switch (name[0]) {
+		case 'b': return XDXFTag_b;
+		case 'i': return XDXFTag_i;
+		case 'k': return XDXFTag_k;
+		case 'c': return XDXFTag_c;
+		}
+		break;
+	case 2:
+		if (name[0] == 't' && name[1] == 't')
+			return XDXFTag_tt;
+		if (name[0] == 't' && name[1] == 'r')
+			return XDXFTag_tr;
+		if (name[0] == 'e' && name[1] == 'x')
+			return XDXFTag_ex;
+		break;
+	case 3:
+		switch (name[0]) {
+		case 'a':
+			if (name[1] == 'b' && name[2] == 'r')
+				return XDXFTag_abr;
+			break;
+		case 'b':
+			if (name[1] == 'i' && name[2] == 'g')
+				return XDXFTag_big;
+			break;
+		case 's':
+			if (name[1] == 'u' && name[2] == 'b')
+				return XDXFTag_sub;
+			if (name[1] == 'u' && name[2] == 'p')
+				return XDXFTag_sup;
+			break;
+		}
+		break;
+	case 4:
+		if (memcmp(name + 1, "ref", 3) != 0)
+			break;
+		switch (name[0]) {
+		case 'r': return XDXFTag_rref;
+		case 'k': return XDXFTag_kref;
+		case 'i': return XDXFTag_iref;
+		}
+		break;
+	case 5:
+		if (memcmp(name, "small", 5) == 0)
+			return XDXFTag_small;
+		break;
+	case 10:
+		if (memcmp(name, "blockquote", 10) == 0)
+			return XDXFTag_blockquote;
+		break;
 	}
-	const char *match_;
-	int match_len_;
-	std::string replace_;
-	int char_len_;
+	return XDXFTag_unknown;
+}
+
+/* Pango markup replacing an element without attributes.
+ * Elements with empty markup need special handling or are dropped. */
+struct TagMarkup {
+	std::string open;
+	std::string close;
+	/* number of characters added to the text */
+	int open_chars;
+	int close_chars;
 };
 
+/* Converts XDXF to pango markup in one pass over the article. Text between
+ * elements is appended to the markup as is, only the length of the text is
+ * counted for link positions. */
 class XDXFParser {
 public:
-	XDXFParser(const char *p, ParseResult &result);
-	static void fill_replace_arr(void);
+	XDXFParser(const char *p, size_t len, ParseResult &result);
+	/* Build the markup of elements, must be called when the color scheme
+	 * changes. */
+	static void fill_tag_table(void);
 private:
+	void append_text(const char *b, const char *end);
+	const char *parse_k(const char *p, const char *end, bool &is_first_k);
+	const char *parse_c(const char *p, const char *end);
+	const char *parse_rref(const char *p, const char *end);
+	const char *parse_ref(const char *p, const char *end, bool is_kref);
+	void append_format_item(bool beg);
 	void flush(void);
 private:
 	ParseResult& result_;
@@ -257,247 +384,263 @@ private:
 	std::string res_;
 	std::string::size_type cur_pos_;
 
-	static std::vector<ReplaceTag> replace_arr_;
+	static TagMarkup tag_table_[XDXFTag_NUMS];
+	static std::string k_span_;
+	static std::string c_span_;
+	static std::string ref_span_;
 };
 
-std::vector<ReplaceTag> XDXFParser::replace_arr_;
+TagMarkup XDXFParser::tag_table_[XDXFTag_NUMS];
+std::string XDXFParser::k_span_;
+std::string XDXFParser::c_span_;
+std::string XDXFParser::ref_span_;
 
-void XDXFParser::fill_replace_arr(void)
+static void set_tag_markup(TagMarkup &markup, const std::string &open,
+	const std::string &close, int open_chars = 0, int close_chars = 0)
 {
-	replace_arr_.clear();
-	std::string value;
-	replace_arr_.push_back(ReplaceTag("abr>", 4,
+	markup.open = open;
+	markup.close = close;
+	markup.open_chars = open_chars;
+	markup.close_chars = close_chars;
+}
+
+void XDXFParser::fill_tag_table(void)
+{
+	for (int i = 0; i < XDXFTag_NUMS; ++i)
+		set_tag_markup(tag_table_[i], "", "");
+	set_tag_markup(tag_table_[XDXFTag_abr],
 		std::string("<span foreground=\"") + print_pango_color(color_scheme.abr) + "\" style=\"italic\">",
-		0));
-	replace_arr_.push_back(ReplaceTag("/abr>", 5, "</span>", 0));
-	replace_arr_.push_back(ReplaceTag("b>", 2, "<b>", 0));
-	replace_arr_.push_back(ReplaceTag("/b>", 3, "</b>", 0));
-	replace_arr_.push_back(ReplaceTag("i>", 2, "<i>", 0));
-	replace_arr_.push_back(ReplaceTag("/i>", 3, "</i>", 0));
-	replace_arr_.push_back(ReplaceTag("sub>", 4, "<sub>", 0));
-	replace_arr_.push_back(ReplaceTag("/sub>", 5, "</sub>", 0));
-	replace_arr_.push_back(ReplaceTag("sup>", 4, "<sup>", 0));
-	replace_arr_.push_back(ReplaceTag("/sup>", 5, "</sup>", 0));
-	replace_arr_.push_back(ReplaceTag("tt>", 3, "<tt>", 0));
-	replace_arr_.push_back(ReplaceTag("/tt>", 4, "</tt>", 0));
-	replace_arr_.push_back(ReplaceTag("big>", 4, "<big>", 0));
-	replace_arr_.push_back(ReplaceTag("/big>", 5, "</big>", 0));
-	replace_arr_.push_back(ReplaceTag("small>", 6, "<small>", 0));
-	replace_arr_.push_back(ReplaceTag("/small>", 7, "</small>", 0));
-	replace_arr_.push_back(ReplaceTag("tr>", 3, "<b>[", 1));
-	replace_arr_.push_back(ReplaceTag("/tr>", 4, "]</b>", 1));
-	replace_arr_.push_back(ReplaceTag("ex>", 3,
+		"</span>");
+	set_tag_markup(tag_table_[XDXFTag_b], "<b>", "</b>");
+	set_tag_markup(tag_table_[XDXFTag_i], "<i>", "</i>");
+	set_tag_markup(tag_table_[XDXFTag_sub], "<sub>", "</sub>");
+	set_tag_markup(tag_table_[XDXFTag_sup], "<sup>", "</sup>");
+	set_tag_markup(tag_table_[XDXFTag_tt], "<tt>", "</tt>");
+	set_tag_markup(tag_table_[XDXFTag_big], "<big>", "</big>");
+	set_tag_markup(tag_table_[XDXFTag_small], "<small>", "</small>");
+	set_tag_markup(tag_table_[XDXFTag_tr], "<b>[", "]</b>", 1, 1);
+	set_tag_markup(tag_table_[XDXFTag_ex],
 		std::string("<span foreground=\"") + print_pango_color(color_scheme.ex) + "\">",
-		0));
-	replace_arr_.push_back(ReplaceTag("/ex>", 4, "</span>", 0));
-	replace_arr_.push_back(ReplaceTag("/c>", 3, "</span>", 0));
+		"</span>");
+	/* <c> may have attributes, only the closing tag is simple */
+	set_tag_markup(tag_table_[XDXFTag_c], "", "</span>");
+	k_span_ = std::string("<span foreground=\"") + print_pango_color(color_scheme.k) + "\">";
+	c_span_ = std::string("<span foreground=\"") + print_pango_color(color_scheme.c) + "\">";
+	ref_span_ = std::string("<span foreground=\"") + print_pango_color(color_scheme.ref) + "\" underline=\"single\">";
 }
 
-XDXFParser::XDXFParser(const char *p, ParseResult &result) :
-	result_(result)
+XDXFParser::XDXFParser(const char *p, size_t len, ParseResult &result) :
+	result_(result),
+	cur_pos_(0)
 {
+	const char *end = p + len;
 	const char *tag, *next;
-	std::string name;
-	int i;
-
 	bool is_first_k = true;
-	for (cur_pos_ = 0; *p && (tag = strchr(p, '<')) != NULL;) {
-		//TODO: do not create chunk
-		std::string chunk(p, tag - p);
-		res_ += chunk;
-		cur_pos_ += xml_strlen(chunk);
 
+	/* markup is longer than the source, avoid growing the buffer */
+	res_.reserve(len + len / 2);
+	while (p < end && (tag = static_cast<const char *>(memchr(p, '<', end - p))) != NULL) {
+		append_text(p, tag);
 		p = tag;
-		for (i = 0; i < static_cast<int>(replace_arr_.size()); ++i)
-			if (strncmp(replace_arr_[i].match_, p + 1,
-						replace_arr_[i].match_len_) == 0) {
-				res_ += replace_arr_[i].replace_;
-				p += 1 + replace_arr_[i].match_len_;
-				cur_pos_ += replace_arr_[i].char_len_;
-				goto cycle_end;
-			}
 
-		if (strncmp("k>", p + 1, 2) == 0) {
-			next = strstr(p + 3, "</k>");
-			if (next) {
-				if (is_first_k) {
-					is_first_k = false;
-					if (*(next + 4) == '\n')
-						next++;
-				} else {
-					res_ += std::string("<span foreground=\"") + print_pango_color(color_scheme.k) + "\">";
-					std::string chunk(p+3, next-(p+3));
-					res_ += chunk;
-					size_t xml_len = xml_strlen(chunk);
-					cur_pos_ += xml_len;
-					res_ += "</span>";
-				}
-				p = next + sizeof("</k>") - 1;
-			} else
-				p += sizeof("<k>") - 1;
-		} else if (*(p + 1) == 'c' && (*(p + 2) == ' ' || *(p + 2) == '>')) {
-			next = strchr(p, '>');
-			if (!next) {
-				++p;
+		const bool closing = p[1] == '/';
+		const char *name = closing ? p + 2 : p + 1;
+		const char *name_end = name;
+		while (*name_end >= 'a' && *name_end <= 'z')
+			++name_end;
+		const XDXFTag id = find_tag(name, name_end - name);
+		const char term = *name_end;
+
+		if (term == '>') {
+			const TagMarkup &markup = tag_table_[id];
+			const std::string &replace = closing ? markup.close : markup.open;
+			if (!replace.empty()) {
+				res_ += replace;
+				cur_pos_ += closing ? markup.close_chars : markup.open_chars;
+				p = name_end + 1;
 				continue;
 			}
-			name.assign(p + 1, next - p - 1);
-			std::string::size_type pos = name.find("c=\"");
-			if (pos != std::string::npos) {
-				pos += sizeof("c=\"") - 1;
-				std::string::size_type end_pos = name.find("\"", pos);
-				if (end_pos == std::string::npos)
-					end_pos = name.length();
-
-				std::string color(name, pos, end_pos - pos);
-				if (pango_color_parse(NULL, color.c_str()))
-					res_ += "<span foreground=\"" + color + "\">";
-				else
-					res_ += "<span>";
-			} else
-				res_ += std::string("<span foreground=\"") + print_pango_color(color_scheme.c) + "\">";
-			p = next + 1;
-		} else if (*(p + 1) == 'r' && *(p + 2) == 'r' && *(p + 3) == 'e' 
-			&& *(p + 4) == 'f' && (*(p + 5) == ' ' || *(p + 5) == '>')) {
-			next = strchr(p, '>');
-			if (!next) {
-				++p;
+		}
+
+		if (closing) {
+			if (id == XDXFTag_blockquote && term == '>') {
+				p = name_end + 1;
+				append_format_item(false);
 				continue;
 			}
-			name.assign(p + 1, next - p - 1);
-			std::string type;
-			std::string::size_type pos = name.find("type=\"");
-			if (pos != std::string::npos) {
-				pos += sizeof("type=\"") - 1;
-				std::string::size_type end_pos = name.find("\"", pos);
-				if (end_pos == std::string::npos)
-					end_pos = name.length();
-				type.assign(name, pos, end_pos - pos);
-			}
-			p = next + 1;
-			next = strstr(p, "</rref>");
-			if (!next)
+		} else if (term == ' ' || term == '>') {
+			switch (id) {
+			case XDXFTag_k:
+				if (term == '>') {
+					p = parse_k(p, end, is_first_k);
+					continue;
+				}
+				break;
+			case XDXFTag_c:
+				p = parse_c(p, end);
+				continue;
+			case XDXFTag_rref:
+				p = parse_rref(p, end);
+				continue;
+			case XDXFTag_kref:
+			case XDXFTag_iref:
+				p = parse_ref(p, end, id == XDXFTag_kref);
 				continue;
-			std::string chunk(p, next - p);
-			p = next + sizeof("</rref>") - 1;
-			if (type.empty()) {
-				if (g_str_has_suffix(chunk.c_str(), ".jpg") 
-					|| g_str_has_suffix(chunk.c_str(), ".png")
-					|| g_str_has_suffix(chunk.c_str(), ".bmp")) {
-					type = "image";
-				} else if (g_str_has_suffix(chunk.c_str(), ".wav") 
-					|| g_str_has_suffix(chunk.c_str(), ".mp3") 
-					|| g_str_has_suffix(chunk.c_str(), ".ogg")) {
-					type = "sound";
-				} else if (g_str_has_suffix(chunk.c_str(), ".avi") 
-					|| g_str_has_suffix(chunk.c_str(), ".mpeg")
-					|| g_str_has_suffix(chunk.c_str(), ".mpg")) {
-					type = "video";
-				} else {
-					type = "attach";
+			case XDXFTag_blockquote:
+				next = static_cast<const char *>(memchr(p, '>', end - p));
+				if (!next) {
+					++p;
+					continue;
 				}
-			}
-			flush();
-			ParseResultItem item;
-			item.type = ParseResultItemType_res;
-			item.res = new ParseResultResItem;
-			item.res->type = type;
-			item.res->key = chunk;
-			result_.item_list.push_back(item);
-		} else if ((*(p + 1) == 'k' || *(p + 1) == 'i') && *(p + 2) == 'r' 
-			&& *(p + 3) == 'e' && *(p + 4) == 'f' && (*(p + 5) == ' ' 
-			|| *(p + 5) == '>')) {
-			// kref and iref
-			bool is_k_or_i = (*(p + 1) == 'k');
-			next = strchr(p, '>');
-			if (!next) {
-				++p;
+				p = next + 1;
+				append_format_item(true);
 				continue;
+			default:
+				break;
 			}
-			name.assign(p + 1, next - p - 1);
-			std::string key;
-			std::string::size_type pos;
-			if (is_k_or_i)
-				pos = name.find("k=\"");
-			else
-				pos = name.find("href=\"");
-			if (pos != std::string::npos) {
-				if (is_k_or_i)
-					pos += sizeof("k=\"") - 1;
-				else
-					pos += sizeof("href=\"") - 1;
-				std::string::size_type end_pos = name.find("\"", pos);
-				if (end_pos == std::string::npos)
-					end_pos = name.length();
-				key.assign(name, pos, end_pos - pos);
-			}
+		}
 
-			p = next + 1;
-			if (is_k_or_i)
-				next = strstr(p, "</kref>");
-			else
-				next = strstr(p, "</iref>");
-			if (!next)
-				continue;
+		/* unknown element, drop it */
+		next = static_cast<const char *>(memchr(p + 1, '>', end - (p + 1)));
+		if (!next) {
+			p++;
+			res_ += "&lt;";
+			cur_pos_++;
+			continue;
+		}
+		p = next + 1;
+	}
+	if (p < end)
+		res_.append(p, end - p);
+	flush();
+}
 
-			res_ += std::string("<span foreground=\"") + print_pango_color(color_scheme.ref) + "\" underline=\"single\">";
-			std::string::size_type link_len = next - p;
-			std::string chunk(p, link_len);
-			size_t xml_len = xml_strlen(chunk);
-			std::string xml_enc;
-			if (key.empty())
-				xml_decode(chunk.c_str(), xml_enc);
-			else
-				xml_decode(key.c_str(), xml_enc);
-			std::string link;
-			if (is_k_or_i)
-				link = "query://";
-			link += xml_enc;
-			links_list_.push_back(LinkDesc(cur_pos_, xml_len, link));
-			res_ += chunk;
-			cur_pos_ += xml_len;
-			res_ += "</span>";
-			if (is_k_or_i)
-				p = next + sizeof("</kref>") - 1;
-			else
-				p = next + sizeof("</iref>") - 1;
-		} else if (strncmp("blockquote", p + 1, 10) == 0 && (*(p + 11) == ' '
-				|| *(p + 11) == '>')) {
-			next = strchr(p, '>');
-			if (!next) {
-				++p;
-				continue;
-			}
-			p = next + 1;
-			flush();
-			ParseResultItem item;
-			item.type = ParseResultItemType_FormatBeg;
-			item.format_beg = new ParseResultFormatBegItem;
-			item.format_beg->type = ParseResultItemFormatType_Indent;
-			result_.item_list.push_back(item);
-		} else if (strncmp("/blockquote>", p + 1, 12) == 0) {
-			p += sizeof("/blockquote>");
-			flush();
-			ParseResultItem item;
-			item.type = ParseResultItemType_FormatEnd;
-			item.format_end = new ParseResultFormatEndItem;
-			item.format_end->type = ParseResultItemFormatType_Indent;
-			result_.item_list.push_back(item);
+void XDXFParser::append_text(const char *b, const char *end)
+{
+	res_.append(b, end - b);
+	cur_pos_ += xml_strlen(b, end);
+}
+
+/* The first <k> repeats the headword, it is dropped. */
+const char *XDXFParser::parse_k(const char *p, const char *end, bool &is_first_k)
+{
+	const char *next = find_str(p + 3, end, "</k>", 4);
+	if (!next)
+		return p + sizeof("<k>") - 1;
+	if (is_first_k) {
+		is_first_k = false;
+		if (next + 4 < end && *(next + 4) == '\n')
+			next++;
+	} else {
+		res_ += k_span_;
+		append_text(p + 3, next);
+		res_ += "</span>";
+	}
+	return next + sizeof("</k>") - 1;
+}
+
+const char *XDXFParser::parse_c(const char *p, const char *end)
+{
+	const char *next = static_cast<const char *>(memchr(p, '>', end - p));
+	if (!next)
+		return p + 1;
+	const char *val, *val_end;
+	if (find_attr(p + 1, next, "c=\"", val, val_end)) {
+		std::string color(val, val_end - val);
+		if (pango_color_parse(NULL, color.c_str())) {
+			res_ += "<span foreground=\"";
+			res_ += color;
+			res_ += "\">";
+		} else
+			res_ += "<span>";
+	} else
+		res_ += c_span_;
+	return next + 1;
+}
+
+const char *XDXFParser::parse_rref(const char *p, const char *end)
+{
+	const char *next = static_cast<const char *>(memchr(p, '>', end - p));
+	if (!next)
+		return p + 1;
+	const char *val, *val_end;
+	std::string type;
+	if (find_attr(p + 1, next, "type=\"", val, val_end))
+		type.assign(val, val_end - val);
+	p = next + 1;
+	next = find_str(p, end, "</rref>", 7);
+	if (!next)
+		return p;
+	if (type.empty()) {
+		if (has_suffix(p, next, ".jpg")
+			|| has_suffix(p, next, ".png")
+			|| has_suffix(p, next, ".bmp")) {
+			type = "image";
+		} else if (has_suffix(p, next, ".wav")
+			|| has_suffix(p, next, ".mp3")
+			|| has_suffix(p, next, ".ogg")) {
+			type = "sound";
+		} else if (has_suffix(p, next, ".avi")
+			|| has_suffix(p, next, ".mpeg")
+			|| has_suffix(p, next, ".mpg")) {
+			type = "video";
 		} else {
-			next = strchr(p+1, '>');
-			if (!next) {
-				p++;
-				res_ += "&lt;";
-				cur_pos_++;
-				continue;
-			}
-			p = next + 1;
+			type = "attach";
 		}
-cycle_end:
-		;
 	}
-	res_ += p;
 	flush();
+	ParseResultItem item;
+	item.type = ParseResultItemType_res;
+	item.res = new ParseResultResItem;
+	item.res->type = type;
+	item.res->key.assign(p, next - p);
+	result_.item_list.push_back(item);
+	return next + sizeof("</rref>") - 1;
+}
+
+/* kref and iref */
+const char *XDXFParser::parse_ref(const char *p, const char *end, bool is_kref)
+{
+	const char *next = static_cast<const char *>(memchr(p, '>', end - p));
+	if (!next)
+		return p + 1;
+	const char *key = NULL, *key_end = NULL;
+	find_attr(p + 1, next, is_kref ? "k=\"" : "href=\"", key, key_end);
+	p = next + 1;
+	next = find_str(p, end, is_kref ? "</kref>" : "</iref>", 7);
+	if (!next)
+		return p;
+
+	std::string link;
+	if (is_kref)
+		link = "query://";
+	if (key == key_end)
+		xml_decode(p, next, link);
+	else
+		xml_decode(key, key_end, link);
+	const size_t xml_len = xml_strlen(p, next);
+	links_list_.push_back(LinkDesc(cur_pos_, xml_len, link));
+	res_ += ref_span_;
+	res_.append(p, next - p);
+	cur_pos_ += xml_len;
+	res_ += "</span>";
+	return next + sizeof("</kref>") - 1;
+}
+
+void XDXFParser::append_format_item(bool beg)
+{
+	flush();
+	ParseResultItem item;
+	if (beg) {
+		item.type = ParseResultItemType_FormatBeg;
+		item.format_beg = new ParseResultFormatBegItem;
+		item.format_beg->type = ParseResultItemFormatType_Indent;
+	} else {
+		item.type = ParseResultItemType_FormatEnd;
+		item.format_end = new ParseResultFormatEndItem;
+		item.format_end->type = ParseResultItemFormatType_Indent;
+	}
+	result_.item_list.push_back(item);
 }
 
 void XDXFParser::flush(void) 
@@ -511,12 +654,12 @@ void XDXFParser::flush(void)
 	if(links_list_.empty()) {
 		item.type = ParseResultItemType_mark;
 		item.mark = new ParseResultMarkItem;
-		item.mark->pango = res_;
+		item.mark->pango.swap(res_);
 	} else {
 		item.type = ParseResultItemType_link;
 		item.link = new ParseResultLinkItem;
-		item.link->pango = res_;
-		item.link->links_list = links_list_;
+		item.link->pango.swap(res_);
+		item.link->links_list.swap(links_list_);
 	}
 	result_.item_list.push_back(item);
 	res_.clear();
@@ -532,7 +675,7 @@ static bool parse(const char *p, unsigned int *parsed_size, ParseResult &result,
 	p++;
 	size_t len = strlen(p);
 	if (len) {
-		XDXFParser(p, result);
+		XDXFParser(p, len, result);
 	}
 	*parsed_size = 1 + len + 1;
 	return true;
@@ -627,7 +770,7 @@ static void configure()
 		color_scheme.c = gdkcolor_2_guint32(color);
 		gtk_color_button_get_color(GTK_COLOR_BUTTON(colorbutton_ref), &color);
 		color_scheme.ref = gdkcolor_2_guint32(color);
-		XDXFParser::fill_replace_arr();
+		XDXFParser::fill_tag_table();
 		const std::string confPath = get_cfg_filename();
 		const std::string contents(generate_config_content(color_scheme));
 		g_file_set_contents(confPath.c_str(), contents.c_str(), -1, NULL);
@@ -665,8 +808,10 @@ DLLIMPORT bool stardict_parsedata_plugin_init(StarDictParseDataPlugInObject *obj
 		g_file_set_contents(confPath.c_str(), contents.c_str(), -1, NULL);
 	} else
 		load_config_file(color_scheme);
-	XDXFParser::fill_replace_arr();
+	XDXFParser::fill_tag_table();
 	obj->parse_func = parse;
+	obj->types = "x";
+	obj->thread_safe = true;
 	g_print(_("XDXF data parsing plug-in loaded.\n"));
 	return false;
 }
@@ -0,0 +1,288 @@
+/*
+ * This file is part of StarDict.
+ *
+ * StarDict is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * StarDict is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with StarDict.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Parse-data plugin benchmark.
+ * Loads a parse-data plugin, collects the fields it handles from real
+ * dictionaries and converts them to pango markup over and over again.
+ * Reports articles and megabytes converted per second. Use --json to get
+ * output suitable for comparing results across commits. */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <glib.h>
+#include <gmodule.h>
+#ifndef _WIN32
+#  include <sys/resource.h>
+#endif
+
+#include "file-utils.h"
+#include "utils.h"
+#include "iappdirs.h"
+#include "stddict.h"
+#include "plugin.h"
+#include "parsedata_plugin.h"
+
+namespace {
+	class TestAppDirs : public IAppDirs {
+	public:
+		virtual std::string get_user_config_dir(void) const {
+			return g_get_tmp_dir();
+		}
+		virtual std::string get_user_cache_dir(void) const {
+			return g_get_tmp_dir();
+		}
+		virtual std::string get_data_dir(void) const {
+			return g_get_tmp_dir();
+		}
+		TestAppDirs() {
+			app_dirs = this;
+		}
+	} g_test_app_dirs;
+}
+
+typedef bool (*stardict_plugin_init_func_t)(StarDictPlugInObject *obj, IAppDirs* appDirs);
+typedef bool (*stardict_parsedata_plugin_init_func_t)(StarDictParseDataPlugInObject *obj);
+typedef void (*stardict_plugin_exit_func_t)(void);
+
+/* an article field in the format passed to parse_func */
+struct Field {
+	std::string data;
+	std::string oword;
+};
+
+static gchar *plugin_file = NULL;
+static gint iterations = 10;
+static gint max_fields = 0;
+static gboolean json_output = FALSE;
+static gchar **dict_paths = NULL;
+
+static const GOptionEntry entries[] = {
+	{ "plugin", 'p', 0, G_OPTION_ARG_FILENAME, &plugin_file,
+		"Parse-data plugin to benchmark", "FILE" },
+	{ "iterations", 'i', 0, G_OPTION_ARG_INT, &iterations,
+		"Convert the collected fields N times (default 10)", "N" },
+	{ "limit", 'l', 0, G_OPTION_ARG_INT, &max_fields,
+		"Collect at most N fields, 0 - no limit (default 0)", "N" },
+	{ "json", 'j', 0, G_OPTION_ARG_NONE, &json_output,
+		"Print results in JSON", NULL },
+	{ G_OPTION_REMAINING, 0, 0, G_OPTION_ARG_FILENAME_ARRAY, &dict_paths,
+		NULL, "[DICT.ifo|DIR...]" },
+	{ NULL },
+};
+
+class dict_collector {
+public:
+	dict_collector(List &dl) : dict_list(dl) {}
+	void operator()(const std::string &url, bool) {
+		dict_list.push_back(url);
+	}
+private:
+	List &dict_list;
+};
+
+/* Returns NULL on failure. */
+static GModule *load_plugin(const char *filename, StarDictParseDataPlugInObject &obj)
+{
+	GModule *module = g_module_open(filename, G_MODULE_BIND_LAZY);
+	if (!module) {
+		g_printerr("Unable to load %s: %s\n", filename, g_module_error());
+		return NULL;
+	}
+	union {
+		stardict_plugin_init_func_t stardict_plugin_init;
+		gpointer stardict_plugin_init_avoid_warning;
+	} func;
+	union {
+		stardict_parsedata_plugin_init_func_t stardict_parsedata_plugin_init;
+		gpointer stardict_parsedata_plugin_init_avoid_warning;
+	} func2;
+	func.stardict_plugin_init = 0;
+	func2.stardict_parsedata_plugin_init = 0;
+	if (!g_module_symbol(module, "stardict_plugin_init",
+			(gpointer *)&(func.stardict_plugin_init_avoid_warning))
+		|| !g_module_symbol(module, "stardict_parsedata_plugin_init",
+			(gpointer *)&(func2.stardict_parsedata_plugin_init_avoid_warning))) {
+		g_printerr("%s is not a parse-data plugin\n", filename);
+		g_module_close(module);
+		return NULL;
+	}
+	StarDictPlugInObject plugin_obj;
+	if (func.stardict_plugin_init(&plugin_obj, &g_test_app_dirs)
+		|| plugin_obj.type != StarDictPlugInType_PARSEDATA
+		|| func2.stardict_parsedata_plugin_init(&obj)) {
+		g_printerr("Unable to initialize %s\n", filename);
+		g_module_close(module);
+		return NULL;
+	}
+	return module;
+}
+
+static void unload_plugin(GModule *module)
+{
+	union {
+		stardict_plugin_exit_func_t stardict_plugin_exit;
+		gpointer stardict_plugin_exit_avoid_warning;
+	} func;
+	func.stardict_plugin_exit = 0;
+	if (g_module_symbol(module, "stardict_plugin_exit",
+			(gpointer *)&(func.stardict_plugin_exit_avoid_warning)))
+		func.stardict_plugin_exit();
+	g_module_close(module);
+}
+
+/* size of the field starting with the type identifier p[0] */
+static guint32 field_size(const gchar *p)
+{
+	if (g_ascii_isupper(*p))
+		return 1 + sizeof(guint32) + g_ntohl(get_uint32(p + 1));
+	return strlen(p + 1) + 2;
+}
+
+/* Collect fields of types handled by the plugin from all articles. */
+static void collect_fields(Libs &libs, const char *types, std::vector<Field> &fields)
+{
+	for (size_t iLib = 0; iLib < libs.ndicts(); ++iLib) {
+		for (glong idx = 0; idx < libs.narticles(iLib); ++idx) {
+			gchar *data = libs.poGetOrigWordData(idx, iLib);
+			if (!data)
+				continue;
+			const guint32 data_size = get_uint32(data);
+			const gchar *p = data + sizeof(guint32);
+			const gchar *end = p + data_size;
+			while (p < end) {
+				const guint32 size = field_size(p);
+				if (strchr(types, *p)) {
+					fields.push_back(Field());
+					fields.back().data.assign(p, size);
+					fields.back().oword = libs.poGetOrigWord(idx, iLib);
+					if (max_fields > 0 && fields.size() >= size_t(max_fields)) {
+						g_free(data);
+						return;
+					}
+				}
+				p += size;
+			}
+			g_free(data);
+		}
+	}
+}
+
+static glong get_max_rss_kb(void)
+{
+#ifndef _WIN32
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) == 0)
+		return usage.ru_maxrss;
+#endif
+	return -1;
+}
+
+int main(int argc, char *argv[])
+{
+	GOptionContext *context = g_option_context_new("- StarDict parse-data plugin benchmark");
+	g_option_context_add_main_entries(context, entries, NULL);
+	GError *error = NULL;
+	if (!g_option_context_parse(context, &argc, &argv, &error)) {
+		g_printerr("%s\n", error->message);
+		g_error_free(error);
+		return EXIT_FAILURE;
+	}
+	g_option_context_free(context);
+	if (!plugin_file) {
+		g_printerr("Specify the plugin with --plugin.\n");
+		return EXIT_FAILURE;
+	}
+	if (iterations < 1)
+		iterations = 1;
+
+	List dict_list;
+	if (dict_paths) {
+		List dirs;
+		for (gchar **p = dict_paths; *p; ++p) {
+			if (g_file_test(*p, G_FILE_TEST_IS_DIR))
+				dirs.push_back(*p);
+			else
+				dict_list.push_back(*p);
+		}
+		for_each_file_restricted(dirs, ".ifo", List(), List(), dict_collector(dict_list));
+	}
+	if (dict_list.empty()) {
+		g_printerr("No dictionaries, specify dictionary files or directories.\n");
+		return EXIT_FAILURE;
+	}
+
+	StarDictParseDataPlugInObject obj;
+	GModule *module = load_plugin(plugin_file, obj);
+	if (!module)
+		return EXIT_FAILURE;
+
+	Libs libs(NULL, false, CollationLevel_NONE, COLLATE_FUNC_NONE);
+	libs.load(dict_list);
+	std::vector<Field> fields;
+	collect_fields(libs, obj.types, fields);
+	if (fields.empty()) {
+		g_printerr("No fields of types \"%s\" found.\n", obj.types);
+		unload_plugin(module);
+		return EXIT_FAILURE;
+	}
+	guint64 nbytes = 0;
+	for (size_t i = 0; i < fields.size(); ++i)
+		nbytes += fields[i].data.size();
+
+	guint64 nitems = 0;
+	const gint64 start = g_get_monotonic_time();
+	for (gint it = 0; it < iterations; ++it) {
+		for (size_t i = 0; i < fields.size(); ++i) {
+			ParseResult result;
+			unsigned int parsed_size;
+			if (obj.parse_func(fields[i].data.c_str(), &parsed_size, result,
+					fields[i].oword.c_str()))
+				nitems += result.item_list.size();
+		}
+	}
+	const gint64 elapsed = g_get_monotonic_time() - start;
+
+	const double seconds = elapsed > 0 ? double(elapsed) / G_USEC_PER_SEC : 1e-6;
+	const double fields_per_sec = double(fields.size()) * iterations / seconds;
+	const double mb_per_sec = double(nbytes) * iterations / (1024 * 1024) / seconds;
+	if (json_output) {
+		gchar num1[G_ASCII_DTOSTR_BUF_SIZE], num2[G_ASCII_DTOSTR_BUF_SIZE],
+			num3[G_ASCII_DTOSTR_BUF_SIZE];
+		g_ascii_formatd(num1, sizeof(num1), "%.1f", elapsed / 1000.0);
+		g_ascii_formatd(num2, sizeof(num2), "%.1f", fields_per_sec);
+		g_ascii_formatd(num3, sizeof(num3), "%.2f", mb_per_sec);
+		g_print("{\"types\":\"%s\",\"fields\":%lu,\"bytes\":%" G_GUINT64_FORMAT
+			",\"iterations\":%d,\"items\":%" G_GUINT64_FORMAT ",\"elapsed_ms\":%s"
+			",\"fields_per_sec\":%s,\"mb_per_sec\":%s,\"max_rss_kb\":%ld}\n",
+			obj.types, (unsigned long)fields.size(), nbytes, iterations, nitems,
+			num1, num2, num3, get_max_rss_kb());
+	} else {
+		g_print("types: %s, fields: %lu, bytes: %" G_GUINT64_FORMAT ", iterations: %d\n",
+			obj.types, (unsigned long)fields.size(), nbytes, iterations);
+		g_print("items: %" G_GUINT64_FORMAT ", elapsed: %.1f ms\n", nitems, elapsed / 1000.0);
+		g_print("%.1f fields/s, %.2f MB/s\n", fields_per_sec, mb_per_sec);
+		g_print("max rss: %ld kB\n", get_max_rss_kb());
+	}
+	unload_plugin(module);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,543 @@
+/*
+ * This file is part of StarDict.
+ *
+ * StarDict is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * StarDict is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with StarDict.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Lookup benchmark.
+ * Loads real dictionaries or generates synthetic ones, replays a list of
+ * queries through Libs and reports throughput, latency percentiles and
+ * memory usage. Use --json to get output suitable for comparing results
+ * across commits. */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include <glib.h>
+#include <glib/gstdio.h>
+#ifndef _WIN32
+#  include <sys/resource.h>
+#endif
+
+#include "file-utils.h"
+#include "utils.h"
+#include "iappdirs.h"
+#include "ifo_file.h"
+#include "stddict.h"
+#include "lookupstats.h"
+
+namespace {
+	class TestAppDirs : public IAppDirs {
+	public:
+		virtual std::string get_user_config_dir(void) const {
+			return g_get_tmp_dir();
+		}
+		virtual std::string get_user_cache_dir(void) const {
+			return g_get_tmp_dir();
+		}
+		virtual std::string get_data_dir(void) const {
+			return g_get_tmp_dir();
+		}
+		TestAppDirs() {
+			app_dirs = this;
+		}
+	} g_test_app_dirs;
+}
+
+enum BenchMode {
+	BenchMode_Simple,
+	BenchMode_Synonym,
+	BenchMode_Fuzzy,
+	BenchMode_Glob,
+	BenchMode_Regex,
+	BenchMode_FullText,
+	BenchMode_Next,
+	BenchMode_Prev,
+	BenchMode_NUMS,
+};
+
+static const char * const mode_names[BenchMode_NUMS] = {
+	"simple",
+	"synonym",
+	"fuzzy",
+	"glob",
+	"regex",
+	"fulltext",
+	"next",
+	"prev",
+};
+
+static const char default_modes[] = "simple,synonym,fuzzy,glob,regex,next,prev";
+static const int MAX_FUZZY_MATCH_ITEM = 100;
+
+struct BenchResult {
+	BenchMode mode;
+	guint64 hits;
+	gint64 elapsed;
+	LatencyHistogram latency;
+};
+
+static gint generate_words = 0;
+static gint generate_syn_percent = 25;
+static gchar *query_file = NULL;
+static gint query_count = 1000;
+static gint iterations = 1;
+static gint seed = 1;
+static gchar *modes_str = NULL;
+static gboolean json_output = FALSE;
+static gboolean keep_generated = FALSE;
+static gchar **dict_paths = NULL;
+
+static const GOptionEntry entries[] = {
+	{ "generate", 'g', 0, G_OPTION_ARG_INT, &generate_words,
+		"Generate a synthetic dictionary with N words", "N" },
+	{ "synonyms", 0, 0, G_OPTION_ARG_INT, &generate_syn_percent,
+		"Percent of generated words having a synonym (default 25)", "PERCENT" },
+	{ "keep", 0, 0, G_OPTION_ARG_NONE, &keep_generated,
+		"Do not remove the generated dictionary", NULL },
+	{ "queries", 'q', 0, G_OPTION_ARG_FILENAME, &query_file,
+		"Read queries from file, one query per line", "FILE" },
+	{ "count", 'c', 0, G_OPTION_ARG_INT, &query_count,
+		"Number of queries to sample from the index when no query file is given (default 1000)", "N" },
+	{ "iterations", 'i', 0, G_OPTION_ARG_INT, &iterations,
+		"Replay the queries N times (default 1)", "N" },
+	{ "seed", 's', 0, G_OPTION_ARG_INT, &seed,
+		"Random seed for dictionary generation and query sampling (default 1)", "N" },
+	{ "modes", 'm', 0, G_OPTION_ARG_STRING, &modes_str,
+		"Comma separated list of: simple, synonym, fuzzy, glob, regex, fulltext, next, prev. "
+		"Default is all but fulltext", "LIST" },
+	{ "json", 'j', 0, G_OPTION_ARG_NONE, &json_output,
+		"Print results in JSON", NULL },
+	{ G_OPTION_REMAINING, 0, 0, G_OPTION_ARG_FILENAME_ARRAY, &dict_paths,
+		NULL, "[DICT.ifo|DIR...]" },
+	{ NULL },
+};
+
+static void put_uint32_be(std::string &out, guint32 val)
+{
+	val = g_htonl(val);
+	out.append(reinterpret_cast<const char *>(&val), sizeof(val));
+}
+
+static std::string random_word(GRand *rnd)
+{
+	static const char letters[] = "abcdefghijklmnopqrstuvwxyz";
+	const gint len = g_rand_int_range(rnd, 3, 13);
+	std::string word;
+	for (gint i = 0; i < len; ++i)
+		word += letters[g_rand_int_range(rnd, 0, sizeof(letters) - 1)];
+	return word;
+}
+
+struct stardict_less {
+	bool operator()(const std::string &a, const std::string &b) const
+	{
+		return stardict_strcmp(a.c_str(), b.c_str()) < 0;
+	}
+};
+
+typedef std::set<std::string, stardict_less> WordSet;
+
+/* Write a dictionary in the format produced by the tools' binary dictionary
+ * generator. Returns the ifo file name or an empty string. */
+static std::string generate_dict(const std::string &dir, gint nwords, gint syn_percent, GRand *rnd)
+{
+	WordSet words;
+	while (words.size() < size_t(nwords))
+		words.insert(random_word(rnd));
+	std::map<std::string, guint32, stardict_less> synonyms;
+	std::string idx, dict;
+	guint32 index = 0;
+	for (WordSet::const_iterator i = words.begin(); i != words.end(); ++i, ++index) {
+		std::string article = *i + " - synthetic article " + random_word(rnd)
+			+ " " + random_word(rnd) + " " + random_word(rnd);
+		idx += *i;
+		idx += '\0';
+		put_uint32_be(idx, dict.size());
+		put_uint32_be(idx, article.size());
+		dict += article;
+		if (g_rand_int_range(rnd, 0, 100) < syn_percent) {
+			std::string syn = random_word(rnd);
+			if (words.find(syn) == words.end())
+				synonyms.insert(std::make_pair(syn, index));
+		}
+	}
+	std::string syn;
+	for (std::map<std::string, guint32, stardict_less>::const_iterator i = synonyms.begin();
+		i != synonyms.end(); ++i) {
+		syn += i->first;
+		syn += '\0';
+		put_uint32_be(syn, i->second);
+	}
+
+	const std::string base = build_path(dir, "bench");
+	if (!g_file_set_contents((base + ".idx").c_str(), idx.data(), idx.size(), NULL)
+		|| !g_file_set_contents((base + ".dict").c_str(), dict.data(), dict.size(), NULL))
+		return "";
+	if (!syn.empty()
+		&& !g_file_set_contents((base + ".syn").c_str(), syn.data(), syn.size(), NULL))
+		return "";
+	DictInfo dict_info;
+	dict_info.ifo_file_name = base + ".ifo";
+	dict_info.set_infotype(DictInfoType_NormDict);
+	dict_info.set_version("2.4.2");
+	dict_info.set_bookname("stardict-bench");
+	dict_info.set_wordcount(words.size());
+	if (!syn.empty())
+		dict_info.set_synwordcount(synonyms.size());
+	dict_info.set_index_file_size(idx.size());
+	dict_info.set_sametypesequence("m");
+	if (!dict_info.save_ifo_file())
+		return "";
+	return dict_info.ifo_file_name;
+}
+
+/* Remove the directory with the generated dictionary and everything in it,
+ * cache files saved next to the index or a half written dictionary included. */
+static void remove_generated(const std::string &dir)
+{
+	GDir *gdir = g_dir_open(dir.c_str(), 0, NULL);
+	if (gdir) {
+		const gchar *name;
+		while ((name = g_dir_read_name(gdir)))
+			g_remove(build_path(dir, name).c_str());
+		g_dir_close(gdir);
+	}
+	g_rmdir(dir.c_str());
+}
+
+class dict_collector {
+public:
+	dict_collector(List &dl) : dict_list(dl) {}
+	void operator()(const std::string &url, bool) {
+		dict_list.push_back(url);
+	}
+private:
+	List &dict_list;
+};
+
+static bool load_queries(const char *filename, std::vector<std::string> &queries)
+{
+	gchar *contents;
+	if (!g_file_get_contents(filename, &contents, NULL, NULL))
+		return false;
+	gchar **lines = g_strsplit(contents, "\n", -1);
+	g_free(contents);
+	for (gchar **p = lines; *p; ++p) {
+		g_strchomp(*p);
+		if (**p)
+			queries.push_back(*p);
+	}
+	g_strfreev(lines);
+	return true;
+}
+
+/* Most queries are taken from the index, every fourth one is a random
+ * string and is likely not found. */
+static void sample_queries(Libs &libs, GRand *rnd, gint count, std::vector<std::string> &queries)
+{
+	for (gint i = 0; i < count; ++i) {
+		const size_t iLib = g_rand_int_range(rnd, 0, libs.ndicts());
+		if (i % 4 == 3 || libs.narticles(iLib) == 0) {
+			queries.push_back(random_word(rnd));
+			continue;
+		}
+		const glong idx = g_rand_int_range(rnd, 0, libs.narticles(iLib));
+		queries.push_back(libs.poGetOrigWord(idx, iLib));
+	}
+}
+
+static bool parse_modes(const char *str, std::vector<BenchMode> &modes)
+{
+	gchar **names = g_strsplit(str, ",", -1);
+	bool res = true;
+	for (gchar **p = names; *p && res; ++p) {
+		int i;
+		for (i = 0; i < BenchMode_NUMS; ++i)
+			if (strcmp(*p, mode_names[i]) == 0)
+				break;
+		if (i < BenchMode_NUMS)
+			modes.push_back(BenchMode(i));
+		else {
+			g_printerr("Unknown mode: %s\n", *p);
+			res = false;
+		}
+	}
+	g_strfreev(names);
+	return res;
+}
+
+/* glob and regex queries match words beginning with the first half of the query */
+static std::string query_prefix(const std::string &query)
+{
+	const gchar *end = g_utf8_offset_to_pointer(query.c_str(),
+		(g_utf8_strlen(query.c_str(), -1) + 1) / 2);
+	return std::string(query.c_str(), end);
+}
+
+static bool run_query(Libs &libs, BenchMode mode, const std::string &query,
+	std::vector<InstantDictIndex> &dictmask)
+{
+	bool found = false;
+	switch (mode) {
+	case BenchMode_Simple:
+		for (size_t i = 0; i < dictmask.size(); ++i) {
+			glong idx, idx_suggest;
+			if (libs.SimpleLookupWord(query.c_str(), idx, idx_suggest, dictmask[i].index, 0))
+				found = true;
+		}
+		break;
+	case BenchMode_Synonym:
+		for (size_t i = 0; i < dictmask.size(); ++i) {
+			glong idx, idx_suggest;
+			if (libs.LookupSynonymWord(query.c_str(), idx, idx_suggest, dictmask[i].index, 0))
+				found = true;
+		}
+		break;
+	case BenchMode_Fuzzy: {
+		gchar *reslist[MAX_FUZZY_MATCH_ITEM];
+		found = libs.LookupWithFuzzy(query.c_str(), reslist, MAX_FUZZY_MATCH_ITEM, dictmask);
+		if (found)
+			for (int i = 0; i < MAX_FUZZY_MATCH_ITEM && reslist[i]; ++i)
+				g_free(reslist[i]);
+		break;
+	}
+	case BenchMode_Glob:
+	case BenchMode_Regex: {
+		std::vector<gchar *> reslist(MAX_MATCH_ITEM_PER_LIB * 2 * dictmask.size());
+		std::string pattern = query_prefix(query);
+		gint count;
+		if (mode == BenchMode_Glob)
+			count = libs.LookupWithRule((pattern + "*").c_str(), &reslist[0], dictmask);
+		else
+			count = libs.LookupWithRegex(("^" + pattern).c_str(), &reslist[0], dictmask);
+		for (gint i = 0; i < count; ++i)
+			g_free(reslist[i]);
+		found = count > 0;
+		break;
+	}
+	case BenchMode_FullText: {
+		std::vector< std::vector<gchar *> > reslist(dictmask.size());
+		found = libs.LookupData(query.c_str(), &reslist[0], NULL, NULL, NULL, dictmask);
+		for (size_t i = 0; i < reslist.size(); ++i)
+			for (size_t j = 0; j < reslist[i].size(); ++j)
+				g_free(reslist[i][j]);
+		break;
+	}
+	case BenchMode_Next:
+	case BenchMode_Prev: {
+		std::vector<CurrentIndex> iCurrent(dictmask.size());
+		if (mode == BenchMode_Next)
+			found = libs.poGetNextWord(query.c_str(), &iCurrent[0], dictmask, 0) != NULL;
+		else
+			found = libs.poGetPreWord(query.c_str(), &iCurrent[0], dictmask, 0) != NULL;
+		break;
+	}
+	default:
+		break;
+	}
+	return found;
+}
+
+static void run_mode(Libs &libs, const std::vector<std::string> &queries,
+	std::vector<InstantDictIndex> &dictmask, BenchResult &result)
+{
+	result.hits = 0;
+	const gint64 start = g_get_monotonic_time();
+	for (gint it = 0; it < iterations; ++it) {
+		for (size_t i = 0; i < queries.size(); ++i) {
+			const gint64 t = g_get_monotonic_time();
+			if (run_query(libs, result.mode, queries[i], dictmask))
+				++result.hits;
+			result.latency.record(g_get_monotonic_time() - t);
+		}
+	}
+	result.elapsed = g_get_monotonic_time() - start;
+}
+
+static glong get_max_rss_kb(void)
+{
+#ifndef _WIN32
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) == 0)
+		return usage.ru_maxrss;
+#endif
+	return -1;
+}
+
+static double get_qps(const BenchResult &r)
+{
+	if (r.elapsed <= 0)
+		return 0;
+	return double(r.latency.get_count()) * G_USEC_PER_SEC / r.elapsed;
+}
+
+static void print_text(const Libs &libs, gint64 load_time, size_t nqueries,
+	const std::vector<BenchResult> &results)
+{
+	glong nwords = 0;
+	for (size_t i = 0; i < libs.ndicts(); ++i)
+		nwords += libs.narticles(i);
+	g_print("dicts: %lu, words: %ld, queries: %lu, iterations: %d\n",
+		(unsigned long)libs.ndicts(), nwords, (unsigned long)nqueries, iterations);
+	g_print("load: %.1f ms\n", load_time / 1000.0);
+	g_print("%-10s %10s %10s %10s %10s %10s %10s %10s\n",
+		"mode", "queries", "hits", "qps", "p50,us", "p90,us", "p99,us", "max,us");
+	for (size_t i = 0; i < results.size(); ++i) {
+		const BenchResult &r = results[i];
+		g_print("%-10s %10" G_GUINT64_FORMAT " %10" G_GUINT64_FORMAT " %10.1f %10"
+			G_GUINT64_FORMAT " %10" G_GUINT64_FORMAT " %10" G_GUINT64_FORMAT
+			" %10" G_GUINT64_FORMAT "\n",
+			mode_names[r.mode], r.latency.get_count(), r.hits, get_qps(r),
+			r.latency.get_percentile(50), r.latency.get_percentile(90),
+			r.latency.get_percentile(99), r.latency.get_max());
+	}
+	g_print("max rss: %ld kB\n", get_max_rss_kb());
+}
+
+static void print_json(const Libs &libs, gint64 load_time, size_t nqueries,
+	const std::vector<BenchResult> &results)
+{
+	glong nwords = 0;
+	for (size_t i = 0; i < libs.ndicts(); ++i)
+		nwords += libs.narticles(i);
+	gchar num[G_ASCII_DTOSTR_BUF_SIZE];
+	g_print("{\"dicts\":%lu,\"words\":%ld,\"queries\":%lu,\"iterations\":%d,",
+		(unsigned long)libs.ndicts(), nwords, (unsigned long)nqueries, iterations);
+	g_ascii_formatd(num, sizeof(num), "%.1f", load_time / 1000.0);
+	g_print("\"load_ms\":%s,\"modes\":[", num);
+	for (size_t i = 0; i < results.size(); ++i) {
+		const BenchResult &r = results[i];
+		g_ascii_formatd(num, sizeof(num), "%.1f", get_qps(r));
+		g_print("%s{\"mode\":\"%s\",\"queries\":%" G_GUINT64_FORMAT ",\"hits\":%"
+			G_GUINT64_FORMAT ",\"qps\":%s,\"p50_us\":%" G_GUINT64_FORMAT
+			",\"p90_us\":%" G_GUINT64_FORMAT ",\"p99_us\":%" G_GUINT64_FORMAT
+			",\"max_us\":%" G_GUINT64_FORMAT "}",
+			i ? "," : "", mode_names[r.mode], r.latency.get_count(), r.hits, num,
+			r.latency.get_percentile(50), r.latency.get_percentile(90),
+			r.latency.get_percentile(99), r.latency.get_max());
+	}
+	g_print("],\"max_rss_kb\":%ld}\n", get_max_rss_kb());
+}
+
+/* generated_dir is set as soon as the directory is created,
+ * the caller removes it whatever the result is. */
+static int run_bench(const std::vector<BenchMode> &modes, GRand *rnd,
+	std::string &generated_dir)
+{
+	List dict_list;
+	if (generate_words > 0) {
+		GError *error = NULL;
+		gchar *dir = g_dir_make_tmp("stardict-bench-XXXXXX", &error);
+		if (!dir) {
+			g_printerr("%s\n", error->message);
+			g_error_free(error);
+			return EXIT_FAILURE;
+		}
+		generated_dir = dir;
+		g_free(dir);
+		const std::string ifo = generate_dict(generated_dir, generate_words,
+			generate_syn_percent, rnd);
+		if (ifo.empty()) {
+			g_printerr("Unable to generate dictionary in %s\n", generated_dir.c_str());
+			return EXIT_FAILURE;
+		}
+		dict_list.push_back(ifo);
+	}
+	if (dict_paths) {
+		List dirs;
+		for (gchar **p = dict_paths; *p; ++p) {
+			if (g_file_test(*p, G_FILE_TEST_IS_DIR))
+				dirs.push_back(*p);
+			else
+				dict_list.push_back(*p);
+		}
+		for_each_file_restricted(dirs, ".ifo", List(), List(), dict_collector(dict_list));
+	}
+	if (dict_list.empty()) {
+		g_printerr("No dictionaries, use --generate or specify dictionary files.\n");
+		return EXIT_FAILURE;
+	}
+
+	Libs libs(NULL, false, CollationLevel_NONE, COLLATE_FUNC_NONE);
+	gint64 load_time = g_get_monotonic_time();
+	libs.load(dict_list);
+	load_time = g_get_monotonic_time() - load_time;
+	if (!libs.has_dict()) {
+		g_printerr("Unable to load dictionaries.\n");
+		return EXIT_FAILURE;
+	}
+
+	std::vector<InstantDictIndex> dictmask(libs.ndicts());
+	for (size_t i = 0; i < dictmask.size(); ++i) {
+		dictmask[i].type = InstantDictType_LOCAL;
+		dictmask[i].index = i;
+	}
+
+	std::vector<std::string> queries;
+	if (query_file) {
+		if (!load_queries(query_file, queries)) {
+			g_printerr("Unable to read %s\n", query_file);
+			return EXIT_FAILURE;
+		}
+	} else
+		sample_queries(libs, rnd, query_count, queries);
+
+	std::vector<BenchResult> results(modes.size());
+	for (size_t i = 0; i < modes.size(); ++i) {
+		results[i].mode = modes[i];
+		run_mode(libs, queries, dictmask, results[i]);
+	}
+
+	if (json_output)
+		print_json(libs, load_time, queries.size(), results);
+	else
+		print_text(libs, load_time, queries.size(), results);
+	return EXIT_SUCCESS;
+}
+
+int main(int argc, char *argv[])
+{
+	GOptionContext *context = g_option_context_new("- StarDict lookup benchmark");
+	g_option_context_add_main_entries(context, entries, NULL);
+	GError *error = NULL;
+	if (!g_option_context_parse(context, &argc, &argv, &error)) {
+		g_printerr("%s\n", error->message);
+		g_error_free(error);
+		return EXIT_FAILURE;
+	}
+	g_option_context_free(context);
+
+	std::vector<BenchMode> modes;
+	if (!parse_modes(modes_str ? modes_str : default_modes, modes))
+		return EXIT_FAILURE;
+	if (iterations < 1)
+		iterations = 1;
+
+	GRand *rnd = g_rand_new_with_seed(seed);
+	std::string generated_dir;
+	const int res = run_bench(modes, rnd, generated_dir);
+	g_rand_free(rnd);
+	if (!generated_dir.empty() && !keep_generated)
+		remove_generated(generated_dir);
+	return res;
+}
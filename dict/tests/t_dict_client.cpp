@@ -1,4 +1,4 @@
-/* 
+/*
  * Copyright (C) 2006 Evgeniy <dushistov@mail.ru>
  * Copyright 2011 kubtek <kubtek@mail.com>
  *
@@ -18,86 +18,265 @@
  * along with StarDict.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+/* DictClient against a small DICT server in a thread of the test: the lookups
+ * go over one connection, the definitions are passed on before the lookup
+ * ends, a line of the text starting with a dot is unescaped. */
+
 #ifdef HAVE_CONFIG_H
 #  include "config.h"
 #endif
 
 #include <cstdlib>
-#include <clocale>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <glib.h>
 
 #include "dict_client.h"
+#include "sockets.h"
+
+/* "." and a status code in the text are a part of the definition */
+static const char MAN_DATA[] = "man\n.\n250 is not a status\n";
+static const char MEN_DATA[] = "men\n";
+
+static gint accepted = 0;
+
+static std::string definition(const char *word, const char *data)
+{
+	std::string res = std::string("151 \"") + word + "\" test \"Test dictionary\"\r\n";
+	const gchar *line = data;
+	const gchar *end;
+	while ((end = strchr(line, '\n'))) {
+		if (line[0] == '.')
+			res += '.';
+		res += std::string(line, end - line) + "\r\n";
+		line = end + 1;
+	}
+	return res + ".\r\n";
+}
+
+static std::string reply(const std::string &command)
+{
+	static const char MATCHES[] =
+		"152 2 matches found\r\ntest \"man\"\r\ntest \"men\"\r\n.\r\n250 ok\r\n";
+	if (command == "DEFINE * 'man'")
+		return "150 1 definitions retrieved\r\n" + definition("man", MAN_DATA) + "250 ok\r\n";
+	if (command == "DEFINE * 'men'")
+		return "150 1 definitions retrieved\r\n" + definition("men", MEN_DATA) + "250 ok\r\n";
+	if (command.compare(0, 7, "DEFINE ") == 0)
+		return "552 no match\r\n";
+	if (command == "MATCH * re '^m.*n'" || command == "MATCH * lev 'man'")
+		return MATCHES;
+	return "500 unknown command\r\n";
+}
+
+static gpointer serve_connection(gpointer data)
+{
+	const int sd = GPOINTER_TO_INT(data);
+	static const char BANNER[] = "220 test server <auth.mime> <1.2@test>\r\n";
+	if (send(sd, BANNER, sizeof(BANNER) - 1, 0) != ssize_t(sizeof(BANNER) - 1)) {
+		Socket::close(sd);
+		return NULL;
+	}
+	std::string in;
+	for (;;) {
+		std::string::size_type end;
+		while ((end = in.find("\r\n")) == std::string::npos) {
+			char buf[1024];
+			const ssize_t n = recv(sd, buf, sizeof(buf), 0);
+			if (n <= 0) {
+				Socket::close(sd);
+				return NULL;
+			}
+			in.append(buf, n);
+		}
+		const std::string resp = reply(in.substr(0, end));
+		in.erase(0, end + 2);
+		if (send(sd, resp.data(), resp.length(), 0) != ssize_t(resp.length()))
+			break;
+	}
+	Socket::close(sd);
+	return NULL;
+}
+
+static gpointer server_thread(gpointer data)
+{
+	const int listen_sd = GPOINTER_TO_INT(data);
+	for (;;) {
+		const int sd = Socket::accept(listen_sd);
+		if (sd == -1)
+			return NULL;
+		g_atomic_int_inc(&accepted);
+		g_thread_unref(g_thread_new("serve_connection", serve_connection, GINT_TO_POINTER(sd)));
+	}
+}
 
 class DictClientTest {
 public:
-	DictClientTest();
+	DictClientTest(int port);
 	~DictClientTest() { g_main_loop_unref(main_loop_); }
-	int run();
+	bool run();
 private:
 	DictClient dict_;
 	GMainLoop *main_loop_;
-	bool regexp_lookup_;
+	int step_;
+	bool failed_;
+	/* the definitions passed to on_definition_ in this lookup */
+	std::vector<std::string> streamed_;
 
-	void on_error(const std::string& mes);
-	void on_simple_lookup_end(const DictClient::IndexList&);	
-	void on_complex_lookup_end(const DictClient::StringList&);
+	void fail(const std::string &mes);
+	bool check_definitions(const DictClient::IndexList &ilist,
+		const char *word1, const char *data1, const char *word2, const char *data2);
+	void on_error(const std::string &mes);
+	void on_definition(size_t index);
+	void on_simple_lookup_end(const DictClient::IndexList &ilist);
+	void on_complex_lookup_end(const DictClient::StringList &slist);
 };
 
-DictClientTest::DictClientTest() : dict_("localhost")
+DictClientTest::DictClientTest(int port) : dict_("127.0.0.1", port), step_(0), failed_(false)
 {
 	main_loop_ = g_main_loop_new(NULL, FALSE);
-	dict_.on_error_.connect(sigc::mem_fun(this,
-					      &DictClientTest::on_error));
+	dict_.on_error_.connect(sigc::mem_fun(this, &DictClientTest::on_error));
+	dict_.on_definition_.connect(sigc::mem_fun(this, &DictClientTest::on_definition));
 	dict_.on_simple_lookup_end_.connect(
-		sigc::mem_fun(this,
-			      &DictClientTest::on_simple_lookup_end));
+		sigc::mem_fun(this, &DictClientTest::on_simple_lookup_end));
 	dict_.on_complex_lookup_end_.connect(
-		sigc::mem_fun(this,
-			      &DictClientTest::on_complex_lookup_end));
+		sigc::mem_fun(this, &DictClientTest::on_complex_lookup_end));
 }
 
-int DictClientTest::run()
-{	 
-	dict_.lookup_simple("man");	
-	g_main_loop_run(main_loop_);
-	return EXIT_SUCCESS;
+void DictClientTest::fail(const std::string &mes)
+{
+	std::cerr << mes << std::endl;
+	failed_ = true;
+	g_main_loop_quit(main_loop_);
 }
 
-void DictClientTest::on_error(const std::string& mes)
+/* word2 is NULL for one definition */
+bool DictClientTest::check_definitions(const DictClient::IndexList &ilist,
+	const char *word1, const char *data1, const char *word2, const char *data2)
 {
-	g_debug("%s: %s\n", __PRETTY_FUNCTION__, mes.c_str());
+	const size_t count = word2 ? 2 : 1;
+	if (ilist.size() != count || streamed_.size() != count) {
+		std::cerr << "expected " << count << " definitions, got " << ilist.size()
+			<< ", " << streamed_.size() << " passed before the end" << std::endl;
+		return false;
+	}
+	for (size_t i = 0; i < count; ++i) {
+		const char *word = i == 0 ? word1 : word2;
+		const char *data = i == 0 ? data1 : data2;
+		const gchar *res_word = dict_.get_word(ilist[i]);
+		const gchar *res_data = dict_.get_word_data(ilist[i]);
+		if (!res_word || !res_data || strcmp(res_word, word) != 0
+			|| strcmp(res_data, data) != 0 || streamed_[i] != word) {
+			std::cerr << "unexpected definition of " << word << ":" << std::endl
+				<< (res_data ? res_data : "") << std::endl;
+			return false;
+		}
+	}
+	return true;
 }
 
-void DictClientTest::on_simple_lookup_end(const DictClient::IndexList& ilist)
+void DictClientTest::on_error(const std::string &mes)
 {
-	g_debug("%s: %s\n", __PRETTY_FUNCTION__,
-		!ilist.empty() ? "found" : "not found");
-	for (size_t i = 0; i < ilist.size(); ++i)
-		g_debug("--->%s\n%s\n", dict_.get_word(ilist[i]),
-			dict_.get_word_data(ilist[i]));
-
-	regexp_lookup_ = true;
-	dict_.lookup_with_rule("m*n");
+	fail("error: " + mes);
 }
 
-void DictClientTest::on_complex_lookup_end(const DictClient::StringList& slist)
+void DictClientTest::on_definition(size_t index)
 {
-	g_debug("%s: %s\n", __PRETTY_FUNCTION__,
-		!slist.empty() ? "found" : "not found");
-	DictClient::StringList::const_iterator it;
-
-	for (it = slist.begin(); it != slist.end(); ++it)
-		g_debug("--->%s\n", it->c_str());
-	if (regexp_lookup_) {
-		regexp_lookup_ = false;
+	const gchar *word = dict_.get_word(index);
+	streamed_.push_back(word ? word : "");
+}
+
+void DictClientTest::on_simple_lookup_end(const DictClient::IndexList &ilist)
+{
+	bool res;
+	switch (step_++) {
+	case 0:
+		res = check_definitions(ilist, "man", MAN_DATA, NULL, NULL);
+		break;
+	case 1:
+		res = ilist.empty() && streamed_.empty();
+		if (!res)
+			std::cerr << "a definition of a missing word" << std::endl;
+		break;
+	case 3:
+		res = check_definitions(ilist, "man", MAN_DATA, "men", MEN_DATA);
+		break;
+	default:
+		res = false;
+		std::cerr << "unexpected end of a simple lookup" << std::endl;
+		break;
+	}
+	if (!res) {
+		fail("simple lookup failed");
+		return;
+	}
+	streamed_.clear();
+	if (step_ == 1)
+		dict_.lookup_simple("missing");
+	else if (step_ == 2)
+		dict_.lookup_with_rule("m*n");
+	else
 		dict_.lookup_with_fuzzy("man");
-	} else
+}
+
+void DictClientTest::on_complex_lookup_end(const DictClient::StringList &slist)
+{
+	if (step_ != 2 && step_ != 4) {
+		fail("unexpected end of a match lookup");
+		return;
+	}
+	DictClient::StringList expected;
+	expected.push_back("man");
+	expected.push_back("men");
+	if (slist != expected) {
+		fail("unexpected matches");
+		return;
+	}
+	if (step_++ == 2)
+		/* the definitions of the matches on the same connection */
+		dict_.define_words(slist);
+	else
 		g_main_loop_quit(main_loop_);
 }
 
+bool DictClientTest::run()
+{
+	dict_.lookup_simple("man");
+	g_main_loop_run(main_loop_);
+	if (failed_)
+		return false;
+	if (g_atomic_int_get(&accepted) != 1) {
+		std::cerr << "expected 1 connection, got " << accepted << std::endl;
+		return false;
+	}
+	return true;
+}
+
 int main()
 {
-	setlocale(LC_ALL, "");//so g_debug and so on will print not garbage
-	DictClientTest test;	
+	const int listen_sd = Socket::socket();
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	socklen_t addrlen = sizeof(addr);
+	if (listen_sd == -1 || !Socket::set_reuse_addr(listen_sd)
+		|| bind(listen_sd, (struct sockaddr *)&addr, sizeof(addr)) != 0
+		|| !Socket::listen(listen_sd, 16)
+		|| getsockname(listen_sd, (struct sockaddr *)&addr, &addrlen) != 0) {
+		std::cerr << "can not start the server: " << Socket::get_error_msg() << std::endl;
+		return EXIT_FAILURE;
+	}
+	g_thread_unref(g_thread_new("server_thread", server_thread, GINT_TO_POINTER(listen_sd)));
 
-	return test.run();
+	DictClientTest test(ntohs(addr.sin_port));
+	if (!test.run())
+		return EXIT_FAILURE;
+	return EXIT_SUCCESS;
 }
@@ -0,0 +1,181 @@
+/*
+ * This file is part of StarDict.
+ *
+ * StarDict is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * StarDict is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with StarDict.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Files written by dictzip_writer_t are read back with zlib, which checks
+ * the trailer, and with dictData, which reads random ranges through the
+ * chunk table: a file of known length, a file of more chunks than the room
+ * left for the table, so the chunks are moved, and an empty file. The
+ * writer is opened again after close. */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <zlib.h>
+
+#include "dictziplib.h"
+#include "lib_dictzip.h"
+
+/* the data of the files is the same function of the position */
+static void fill_data(guint64 pos, char *buf, size_t len)
+{
+	for (size_t i = 0; i < len; ++i) {
+		guint32 x = guint32(pos + i) * 2654435761U;
+		x ^= x >> 15;
+		buf[i] = (pos + i) % 8 == 7 ? ' ' : char('a' + x % 26);
+	}
+}
+
+static bool write_data(dictzip_writer_t& writer, guint64 total)
+{
+	/* pieces not aligned with the chunks */
+	std::vector<char> buf(100003);
+	for (guint64 pos = 0; pos < total; pos += buf.size()) {
+		const size_t len = size_t(std::min<guint64>(buf.size(), total - pos));
+		fill_data(pos, &buf[0], len);
+		if (writer.write(&buf[0], len))
+			return false;
+	}
+	return writer.tell() == total;
+}
+
+/* zlib reads the whole file and checks the crc and the length in the trailer */
+static bool check_gzip(const std::string& filename, guint64 total)
+{
+	gzFile in = gzopen(filename.c_str(), "rb");
+	if (!in) {
+		std::cerr << "can not open " << filename << std::endl;
+		return false;
+	}
+	std::vector<char> buf(65536), expected(buf.size());
+	guint64 pos = 0;
+	int len;
+	while ((len = gzread(in, &buf[0], buf.size())) > 0) {
+		fill_data(pos, &expected[0], len);
+		if (memcmp(&buf[0], &expected[0], len) != 0) {
+			std::cerr << filename << ": wrong data at " << pos << std::endl;
+			gzclose(in);
+			return false;
+		}
+		pos += len;
+	}
+	gzclose(in);
+	if (len < 0 || pos != total) {
+		std::cerr << filename << ": " << pos << " bytes read of " << total << std::endl;
+		return false;
+	}
+	return true;
+}
+
+/* random ranges through the chunk table, some of them across chunks */
+static bool check_dict_data(const std::string& filename, guint64 total)
+{
+	dictData data;
+	if (!data.open(filename, 0)) {
+		std::cerr << "dictData can not open " << filename << std::endl;
+		return false;
+	}
+	const size_t max_size = 3 * dictzip_writer_t::CHUNK_LENGTH;
+	std::vector<char> buf(max_size), expected(max_size);
+	for (int i = 0; i < 300; ++i) {
+		/* the first and the last bytes too */
+		const guint64 start = i == 0 ? 0 : i == 1 ? total - 1
+			: (guint64(rand()) * RAND_MAX + rand()) % total;
+		const size_t size = size_t(std::min<guint64>(rand() % max_size + 1, total - start));
+		data.read(&buf[0], start, size);
+		fill_data(start, &expected[0], size);
+		if (memcmp(&buf[0], &expected[0], size) != 0) {
+			std::cerr << filename << ": wrong range " << start << ", " << size << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool check_file(const std::string& filename, guint64 total)
+{
+	return check_gzip(filename, total) && check_dict_data(filename, total);
+}
+
+static bool run(const std::string& dir)
+{
+	/* the length is known, dictzip_file */
+	const std::string plain = dir + "/known.dict";
+	const guint64 known_total = 3 * dictzip_writer_t::CHUNK_LENGTH + 1234;
+	std::vector<char> contents(known_total);
+	fill_data(0, &contents[0], contents.size());
+	if (!g_file_set_contents(plain.c_str(), &contents[0], contents.size(), NULL)
+		|| dictzip_file(plain)) {
+		std::cerr << "dictzip_file failed" << std::endl;
+		return false;
+	}
+	if (g_file_test(plain.c_str(), G_FILE_TEST_EXISTS)) {
+		std::cerr << "dictzip_file left " << plain << std::endl;
+		return false;
+	}
+	if (!check_file(plain + ".dz", known_total))
+		return false;
+
+	dictzip_writer_t writer;
+	/* the length is not known, the chunks do not fit in the room left */
+	const std::string small = dir + "/small.dict.dz";
+	if (writer.open(small) || !write_data(writer, 1000) || writer.close()
+		|| !check_file(small, 1000))
+		return false;
+	const std::string large = dir + "/large.dict.dz";
+	const guint64 large_total
+		= guint64(dictzip_writer_t::RESERVED_CHUNK_COUNT + 3) * dictzip_writer_t::CHUNK_LENGTH + 777;
+	if (writer.open(large))
+		return false;
+	if (writer.tell() != 0) {
+		std::cerr << "an opened writer counts " << writer.tell() << " bytes" << std::endl;
+		return false;
+	}
+	if (!write_data(writer, large_total) || writer.close() || !check_file(large, large_total))
+		return false;
+
+	/* no data */
+	const std::string empty = dir + "/empty.dict.dz";
+	if (writer.open(empty) || writer.close() || !check_gzip(empty, 0))
+		return false;
+	return true;
+}
+
+int main()
+{
+	gchar *dir = g_dir_make_tmp("t_dictzip-XXXXXX", NULL);
+	if (!dir) {
+		std::cerr << "can not create a temporary directory" << std::endl;
+		return EXIT_FAILURE;
+	}
+	const bool res = run(dir);
+	static const char *files[] = { "known.dict", "known.dict.dz", "small.dict.dz",
+		"large.dict.dz", "empty.dict.dz" };
+	for (size_t i = 0; i < G_N_ELEMENTS(files); i++)
+		g_remove((std::string(dir) + "/" + files[i]).c_str());
+	g_rmdir(dir);
+	g_free(dir);
+	return res ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,117 @@
+/*
+ * This file is part of StarDict.
+ *
+ * StarDict is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * StarDict is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with StarDict.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* ext_sorter_t sorts the same records in memory and with a memory limit so
+ * small that a run holds two records, so there are more runs than are
+ * merged at once and they are merged in two passes. Both must return the
+ * records of std::stable_sort, records with equal keys in the order they
+ * were added, and return them again after sort() is called once more. */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+#include <glib.h>
+
+#include "libcommon.h"
+#include "lib_ext_sort.h"
+
+typedef std::pair<std::string, std::string> record_t;
+typedef std::vector<record_t> records_t;
+
+/* a run of two records, about 4500 runs */
+static const size_t SMALL_MAX_MEMORY = 64;
+static const int RECORD_COUNT = 9000;
+
+static bool record_less(const record_t& left, const record_t& right)
+{
+	return stardict_strcmp(left.first.c_str(), right.first.c_str()) < 0;
+}
+
+/* many equal keys, keys equal but for the case, data with '\0' */
+static void make_records(records_t& records)
+{
+	static const char *stems[] = { "apple", "Apple", "zebra", "Zebra", "éclair", "a" };
+	for (int i = 0; i < RECORD_COUNT; i++) {
+		gchar *key = g_strdup_printf("%s %d", stems[i % G_N_ELEMENTS(stems)], i * 7 % 31);
+		gchar *data = g_strdup_printf("%d", i);
+		records.push_back(record_t(key, std::string(data) + '\0' + "data"));
+		g_free(key);
+		g_free(data);
+	}
+}
+
+static bool read_all(ext_sorter_t& sorter, records_t& records)
+{
+	records.clear();
+	if (sorter.sort())
+		return false;
+	std::string key, data;
+	bool eof;
+	while (true) {
+		if (sorter.read(key, data, eof))
+			return false;
+		if (eof)
+			return true;
+		records.push_back(record_t(key, data));
+	}
+}
+
+static bool check_sorter(size_t max_memory, const records_t& records,
+	const records_t& expected)
+{
+	ext_sorter_t sorter;
+	sorter.set_max_memory(max_memory);
+	for (size_t i = 0; i < records.size(); i++)
+		if (sorter.add(records[i].first, records[i].second.data(),
+				records[i].second.length()))
+			return false;
+	if (sorter.size() != records.size()) {
+		std::cerr << "added " << sorter.size() << " records of " << records.size() << std::endl;
+		return false;
+	}
+	/* the second time the records are read from the start */
+	for (int pass = 0; pass < 2; pass++) {
+		records_t res;
+		if (!read_all(sorter, res))
+			return false;
+		if (res != expected) {
+			std::cerr << "max_memory " << max_memory << ", pass " << pass
+				<< ": records out of order" << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+int main()
+{
+	records_t records;
+	make_records(records);
+	records_t expected(records);
+	std::stable_sort(expected.begin(), expected.end(), record_less);
+	if (!check_sorter(0, records, expected)
+		|| !check_sorter(SMALL_MAX_MEMORY, records, expected))
+		return EXIT_FAILURE;
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,272 @@
+/*
+ * This file is part of StarDict.
+ *
+ * StarDict is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * StarDict is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with StarDict.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* HttpClient against a small web server in a thread of the test: the
+ * connections are used again, chunked and gzip encoded bodies are decoded,
+ * no more than HttpClient::MAX_CONNECTIONS_PER_HOST requests run at once. */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <zlib.h>
+#include <glib.h>
+
+#include "http_client.h"
+#include "sockets.h"
+
+static const char BODY[] = "hello, keep-alive world";
+static const int PARALLEL_REQUESTS = 6;
+
+static gint accepted = 0;
+static gint running = 0;
+static gint max_running = 0;
+
+static std::string gzip(const std::string &data)
+{
+	z_stream zs;
+	memset(&zs, 0, sizeof(zs));
+	deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 16 + MAX_WBITS, 8, Z_DEFAULT_STRATEGY);
+	std::vector<Bytef> out(deflateBound(&zs, data.length()) + 32);
+	zs.next_in = (Bytef *)data.data();
+	zs.avail_in = data.length();
+	zs.next_out = &out[0];
+	zs.avail_out = out.size();
+	deflate(&zs, Z_FINISH);
+	std::string res((const char *)&out[0], out.size() - zs.avail_out);
+	deflateEnd(&zs);
+	return res;
+}
+
+static std::string chunked(const std::string &data)
+{
+	std::string res;
+	for (size_t pos = 0; pos < data.length(); pos += 5) {
+		const std::string chunk = data.substr(pos, 5);
+		gchar *size = g_strdup_printf("%x\r\n", (unsigned)chunk.length());
+		res += size;
+		g_free(size);
+		res += chunk + "\r\n";
+	}
+	return res + "0\r\n\r\n";
+}
+
+static std::string with_length(const std::string &head, const std::string &body)
+{
+	gchar *length = g_strdup_printf("Content-Length: %u\r\n\r\n", (unsigned)body.length());
+	std::string res = head + length + body;
+	g_free(length);
+	return res;
+}
+
+/* Returns false if the connection is to be closed. */
+static bool reply(int sd, const std::string &path)
+{
+	std::string resp;
+	bool keep = true;
+	if (path == "/plain") {
+		resp = with_length("HTTP/1.1 200 OK\r\n", BODY);
+	} else if (path == "/chunked") {
+		resp = "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n" + chunked(BODY);
+	} else if (path == "/gzip") {
+		resp = with_length("HTTP/1.1 200 OK\r\nContent-Encoding: gzip\r\n", gzip(BODY));
+	} else if (path == "/gzip-chunked") {
+		resp = "HTTP/1.1 200 OK\r\nContent-Encoding: gzip\r\nTransfer-Encoding: chunked\r\n\r\n"
+			+ chunked(gzip(BODY));
+	} else if (path == "/close") {
+		resp = std::string("HTTP/1.0 200 OK\r\n\r\n") + BODY;
+		keep = false;
+	} else if (path == "/slow") {
+		g_usleep(100 * 1000);
+		resp = with_length("HTTP/1.1 200 OK\r\n", BODY);
+	} else {
+		resp = with_length("HTTP/1.1 404 Not Found\r\n", "");
+	}
+	if (send(sd, resp.data(), resp.length(), 0) != ssize_t(resp.length()))
+		return false;
+	return keep;
+}
+
+static gpointer serve_connection(gpointer data)
+{
+	const int sd = GPOINTER_TO_INT(data);
+	std::string in;
+	bool keep = true;
+	while (keep) {
+		std::string::size_type end;
+		while ((end = in.find("\r\n\r\n")) == std::string::npos) {
+			char buf[1024];
+			const ssize_t n = recv(sd, buf, sizeof(buf), 0);
+			if (n <= 0) {
+				Socket::close(sd);
+				return NULL;
+			}
+			in.append(buf, n);
+		}
+		const std::string request(in, 0, end);
+		in.erase(0, end + 4);
+		const std::string::size_type path_begin = request.find(' ') + 1;
+		const std::string path(request, path_begin, request.find(' ', path_begin) - path_begin);
+		const gint cur = g_atomic_int_add(&running, 1) + 1;
+		gint max;
+		while ((max = g_atomic_int_get(&max_running)) < cur
+			&& !g_atomic_int_compare_and_exchange(&max_running, max, cur))
+			;
+		keep = reply(sd, path);
+		g_atomic_int_add(&running, -1);
+	}
+	Socket::close(sd);
+	return NULL;
+}
+
+static gpointer server_thread(gpointer data)
+{
+	const int listen_sd = GPOINTER_TO_INT(data);
+	for (;;) {
+		const int sd = Socket::accept(listen_sd);
+		if (sd == -1)
+			return NULL;
+		g_atomic_int_inc(&accepted);
+		g_thread_unref(g_thread_new("serve_connection", serve_connection, GINT_TO_POINTER(sd)));
+	}
+}
+
+class HttpClientTest {
+public:
+	HttpClientTest(int port);
+	~HttpClientTest() { g_main_loop_unref(main_loop_); }
+	bool run();
+private:
+	int port_;
+	GMainLoop *main_loop_;
+	std::vector<std::string> paths_;
+	size_t next_;
+	int left_;
+	bool failed_;
+
+	void send(const std::string &path);
+	void on_error(HttpClient *client, const char *error_msg);
+	void on_response(HttpClient *client);
+};
+
+HttpClientTest::HttpClientTest(int port) : port_(port), next_(0), left_(0), failed_(false)
+{
+	main_loop_ = g_main_loop_new(NULL, FALSE);
+}
+
+void HttpClientTest::send(const std::string &path)
+{
+	HttpClient *client = new HttpClient();
+	client->SetPort(port_);
+	client->SetAllowAbsoluteURI(false);
+	client->on_error_.connect(sigc::mem_fun(this, &HttpClientTest::on_error));
+	client->on_response_.connect(sigc::mem_fun(this, &HttpClientTest::on_response));
+	left_++;
+	client->SendHttpGetRequest("127.0.0.1", path.c_str(), NULL);
+}
+
+void HttpClientTest::on_error(HttpClient *client, const char *error_msg)
+{
+	std::cerr << "request failed: " << error_msg << std::endl;
+	failed_ = true;
+	delete client;
+	g_main_loop_quit(main_loop_);
+}
+
+void HttpClientTest::on_response(HttpClient *client)
+{
+	const char *body = g_strstr_len(client->buffer, client->buffer_len, "\r\n\r\n");
+	if (!body || strcmp(body + 4, BODY) != 0) {
+		std::cerr << "unexpected response: " << client->buffer << std::endl;
+		failed_ = true;
+	}
+	delete client;
+	left_--;
+	if (failed_) {
+		g_main_loop_quit(main_loop_);
+	} else if (next_ < paths_.size()) {
+		send(paths_[next_++]);
+	} else if (left_ == 0) {
+		g_main_loop_quit(main_loop_);
+	}
+}
+
+bool HttpClientTest::run()
+{
+	/* one after another, all on the first connection but the last one */
+	paths_.push_back("/plain");
+	paths_.push_back("/chunked");
+	paths_.push_back("/gzip");
+	paths_.push_back("/gzip-chunked");
+	paths_.push_back("/close");
+	paths_.push_back("/plain");
+	send(paths_[next_++]);
+	g_main_loop_run(main_loop_);
+	if (failed_)
+		return false;
+	if (g_atomic_int_get(&accepted) != 2) {
+		std::cerr << "expected 2 connections, got " << accepted << std::endl;
+		return false;
+	}
+
+	paths_.clear();
+	next_ = 0;
+	for (int i = 0; i < PARALLEL_REQUESTS; i++)
+		send("/slow");
+	g_main_loop_run(main_loop_);
+	if (failed_)
+		return false;
+	if (g_atomic_int_get(&max_running) > HttpClient::MAX_CONNECTIONS_PER_HOST) {
+		std::cerr << max_running << " requests served at once, the limit is "
+			<< HttpClient::MAX_CONNECTIONS_PER_HOST << std::endl;
+		return false;
+	}
+	return true;
+}
+
+int main()
+{
+	const int listen_sd = Socket::socket();
+	/* on the loopback interface only, Socket::bind() binds all of them */
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	socklen_t addrlen = sizeof(addr);
+	if (listen_sd == -1 || !Socket::set_reuse_addr(listen_sd)
+		|| bind(listen_sd, (struct sockaddr *)&addr, sizeof(addr)) != 0
+		|| !Socket::listen(listen_sd, 16)
+		|| getsockname(listen_sd, (struct sockaddr *)&addr, &addrlen) != 0) {
+		std::cerr << "can not start the server: " << Socket::get_error_msg() << std::endl;
+		return EXIT_FAILURE;
+	}
+	g_thread_unref(g_thread_new("server_thread", server_thread, GINT_TO_POINTER(listen_sd)));
+
+	HttpClientTest test(ntohs(addr.sin_port));
+	if (!test.run())
+		return EXIT_FAILURE;
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,212 @@
+/*
+ * This file is part of StarDict.
+ *
+ * StarDict is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * StarDict is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with StarDict.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* .oft and .clt files made with build_oft_file and build_clt_file are loaded
+ * by Dict as they are, a broken one or one made for another index is replaced
+ * by the usual cache. */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "iappdirs.h"
+#include "stddict.h"
+#include "lib_index_cache.h"
+
+static const int WORD_COUNT = 200;
+
+namespace {
+	class TestAppDirs : public IAppDirs {
+	public:
+		virtual std::string get_user_config_dir(void) const {
+			return g_get_tmp_dir();
+		}
+		virtual std::string get_user_cache_dir(void) const {
+			return g_get_tmp_dir();
+		}
+		virtual std::string get_data_dir(void) const {
+			return g_get_tmp_dir();
+		}
+		TestAppDirs() {
+			app_dirs = this;
+		}
+	} g_test_app_dirs;
+}
+
+static bool stardict_less(const std::string& left, const std::string& right)
+{
+	return stardict_strcmp(left.c_str(), right.c_str()) < 0;
+}
+
+static bool write_file(const std::string& filename, const std::string& contents)
+{
+	if (!g_file_set_contents(filename.c_str(), contents.data(), contents.length(), NULL)) {
+		std::cerr << "can not write " << filename << std::endl;
+		return false;
+	}
+	return true;
+}
+
+static bool write_dict(const std::string& dir, std::vector<std::string>& words)
+{
+	static const char *stems[] = { "apple", "Apple", "éclair", "eclair", "Zebra", "zebra" };
+	for (int i = 0; i < WORD_COUNT; i++) {
+		gchar *word = g_strdup_printf("%s %d", stems[i % G_N_ELEMENTS(stems)], i);
+		words.push_back(word);
+		g_free(word);
+	}
+	std::sort(words.begin(), words.end(), stardict_less);
+	std::string idx, dict;
+	for (size_t i = 0; i < words.size(); i++) {
+		const guint32 offset = g_htonl(dict.length());
+		const guint32 size = g_htonl(words[i].length());
+		idx.append(words[i].c_str(), words[i].length() + 1);
+		idx.append(reinterpret_cast<const char *>(&offset), sizeof(offset));
+		idx.append(reinterpret_cast<const char *>(&size), sizeof(size));
+		dict += words[i];
+	}
+	gchar *ifo = g_strdup_printf("StarDict's dict ifo file\nversion=2.4.2\n"
+		"wordcount=%d\nidxfilesize=%u\nbookname=index cache\nsametypesequence=m\n",
+		WORD_COUNT, (unsigned)idx.length());
+	const bool res = write_file(dir + "/test.ifo", ifo)
+		&& write_file(dir + "/test.idx", idx)
+		&& write_file(dir + "/test.dict", dict);
+	g_free(ifo);
+	return res;
+}
+
+/* true if the file is one made by lib_index_cache */
+static bool is_sidecar(const std::string& filename)
+{
+	gchar *contents;
+	gsize size;
+	if (!g_file_get_contents(filename.c_str(), &contents, &size, NULL))
+		return false;
+	guint32 n;
+	memcpy(&n, contents, sizeof(n));
+	const bool res = (n + 1) * sizeof(guint32) < size
+		&& is_index_cache(contents + (n + 1) * sizeof(guint32));
+	g_free(contents);
+	return res;
+}
+
+static bool check_lookup(const std::string& dir, const std::vector<std::string>& words)
+{
+	show_progress_t progress;
+	Dict dict;
+	if (!dict.load(dir + "/test.ifo", true, CollationLevel_SINGLE, UTF8_GENERAL_CI, &progress)) {
+		std::cerr << "can not load the dictionary" << std::endl;
+		return false;
+	}
+	std::string prev;
+	for (glong i = 0; i < dict.narticles(); i++) {
+		const std::string word(dict.idx_file->getWord(i, CollationLevel_SINGLE, 0));
+		if (i > 0 && utf8_collate(prev.c_str(), word.c_str(), UTF8_GENERAL_CI) > 0) {
+			std::cerr << "collation order is broken: " << prev << ", " << word << std::endl;
+			return false;
+		}
+		prev = word;
+	}
+	for (size_t i = 0; i < words.size(); i++) {
+		glong idx, idx_suggest;
+		if (!dict.Lookup(words[i].c_str(), idx, idx_suggest, CollationLevel_SINGLE, 0)
+			|| words[i] != dict.idx_file->getWord(idx, CollationLevel_SINGLE, 0)) {
+			std::cerr << "lookup failed: " << words[i] << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool run(const std::string& dir)
+{
+	std::vector<std::string> words;
+	if (!write_dict(dir, words))
+		return false;
+	const std::string idxfilename = dir + "/test.idx";
+	if (build_oft_file(idxfilename) || build_clt_file(idxfilename, UTF8_GENERAL_CI))
+		return false;
+	if (!check_lookup(dir, words))
+		return false;
+	/* Dict saves its own cache over a file it does not accept */
+	if (!is_sidecar(idxfilename + ".oft") || !is_sidecar(idxfilename + ".clt")) {
+		std::cerr << "the cache files were not used" << std::endl;
+		return false;
+	}
+
+	gchar *contents;
+	gsize size;
+	if (!g_file_get_contents((idxfilename + ".clt").c_str(), &contents, &size, NULL))
+		return false;
+	std::swap_ranges(contents + sizeof(guint32), contents + 2 * sizeof(guint32),
+		contents + 2 * sizeof(guint32));
+	const bool written = write_file(idxfilename + ".clt", std::string(contents, size));
+	g_free(contents);
+	if (!written || !check_lookup(dir, words))
+		return false;
+	if (is_sidecar(idxfilename + ".clt")) {
+		std::cerr << "a broken .clt file was used" << std::endl;
+		return false;
+	}
+
+	/* a rebuilt index of the same size: the data of the first two words swapped */
+	if (build_oft_file(idxfilename) || build_clt_file(idxfilename, UTF8_GENERAL_CI))
+		return false;
+	if (!g_file_get_contents(idxfilename.c_str(), &contents, &size, NULL))
+		return false;
+	const gsize data_size = 2 * sizeof(guint32);
+	gchar *data1 = contents + words[0].length() + 1;
+	gchar *data2 = data1 + data_size + words[1].length() + 1;
+	std::swap_ranges(data1, data1 + data_size, data2);
+	const bool rebuilt = write_file(idxfilename, std::string(contents, size));
+	g_free(contents);
+	if (!rebuilt || !check_lookup(dir, words))
+		return false;
+	if (is_sidecar(idxfilename + ".oft") || is_sidecar(idxfilename + ".clt")) {
+		std::cerr << "the cache files of another index were used" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+int main()
+{
+	utf8_collate_init(UTF8_GENERAL_CI);
+	gchar *dir = g_dir_make_tmp("t_index_cache-XXXXXX", NULL);
+	if (!dir) {
+		std::cerr << "can not create a temporary directory" << std::endl;
+		return EXIT_FAILURE;
+	}
+	const bool res = run(dir);
+	static const char *files[] = { "test.ifo", "test.idx", "test.dict",
+		"test.idx.oft", "test.idx.clt" };
+	for (size_t i = 0; i < G_N_ELEMENTS(files); i++)
+		g_remove((std::string(dir) + "/" + files[i]).c_str());
+	g_rmdir(dir);
+	g_free(dir);
+	utf8_collate_end(UTF8_GENERAL_CI);
+	return res ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,106 @@
+/*
+ * This file is part of StarDict.
+ *
+ * StarDict is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * StarDict is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with StarDict.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Articles of a dictionary are deferred and rendered later at their
+ * placeholder the way ArticleView does it. The header mark of the next dictionary must point
+ * to its header after that, the result window jumps to it.
+ * Skipped without a display. */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <gtk/gtk.h>
+
+#include "pangoview.h"
+
+/* the text from the mark to the end of the line */
+static std::string text_at_mark(PangoWidgetBase *view, const char *mark_name)
+{
+	GtkTextBuffer *buffer = gtk_text_view_get_buffer(GTK_TEXT_VIEW(view->widget()));
+	GtkTextMark *mark = gtk_text_buffer_get_mark(buffer, mark_name);
+	if (!mark)
+		return std::string();
+	GtkTextIter beg, end;
+	gtk_text_buffer_get_iter_at_mark(buffer, &beg, mark);
+	end = beg;
+	gtk_text_iter_forward_to_line_end(&end);
+	gchar *text = gtk_text_buffer_get_text(buffer, &beg, &end, FALSE);
+	std::string res(text);
+	g_free(text);
+	return res;
+}
+
+static void append_header(PangoWidgetBase *view, const char *mark_name,
+	const char *dict_name)
+{
+	view->append_mark(mark_name);
+	view->append_text((std::string("<--- ") + dict_name + " --->\n").c_str());
+}
+
+static bool run(PangoWidgetBase *view)
+{
+	view->begin_update();
+	append_header(view, "0", "first");
+	view->append_text("first article\n");
+	append_header(view, "1", "second");
+	view->append_placeholder("deferred");
+	append_header(view, "2", "third");
+	view->append_text("third article\n");
+	view->end_update();
+
+	view->begin_fill_placeholder("deferred");
+	view->append_text("second article\n");
+	view->end_fill_placeholder("deferred");
+
+	static const char *expected[][2] = {
+		{ "0", "<--- first --->" },
+		{ "1", "<--- second --->" },
+		{ "2", "<--- third --->" },
+	};
+	bool res = true;
+	for (size_t i = 0; i < G_N_ELEMENTS(expected); ++i) {
+		const std::string text = text_at_mark(view, expected[i][0]);
+		if (text != expected[i][1]) {
+			std::cerr << "mark " << expected[i][0] << " points to \"" << text
+				<< "\", expected \"" << expected[i][1] << "\"" << std::endl;
+			res = false;
+		}
+	}
+	const std::string text = view->get_text();
+	if (text != "<--- first --->\nfirst article\n<--- second --->\nsecond article\n"
+		"<--- third --->\nthird article\n") {
+		std::cerr << "unexpected text:" << std::endl << text << std::endl;
+		res = false;
+	}
+	return res;
+}
+
+int main(int argc, char *argv[])
+{
+	if (!gtk_init_check(&argc, &argv)) {
+		std::cerr << "no display, skipped" << std::endl;
+		return 77;
+	}
+	PangoWidgetBase *view = PangoWidgetBase::create(false);
+	const bool res = run(view);
+	gtk_widget_destroy(view->window());
+	return res ? EXIT_SUCCESS : EXIT_FAILURE;
+}
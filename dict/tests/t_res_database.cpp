@@ -80,7 +80,8 @@ bool load_index(const std::string& ridx_url, index_vect_t &index_vect,
 	return true;
 }
 
-bool lookup_test_key(rindex_file *pindex, const std::string& key, 
+template<typename TIndex>
+bool lookup_test_key(TIndex *pindex, const std::string& key, 
 	guint32 true_offset, guint32 true_size)
 {
 	guint32 offset, size;
@@ -92,7 +93,8 @@ bool lookup_test_key(rindex_file *pindex, const std::string& key,
 	return true;
 }
 
-bool lookup_test(const index_vect_t &index_vect, rindex_file *pindex)
+template<typename TIndex>
+bool lookup_test(const index_vect_t &index_vect, TIndex *pindex)
 {
 	const size_t ntest = 1000;
 	std::vector<int> test_indexes(2+ntest);
@@ -105,6 +107,15 @@ bool lookup_test(const index_vect_t &index_vect, rindex_file *pindex)
 			index_vect[test_indexes[i]].off, index_vect[test_indexes[i]].size))
 			return false;
 	}
+	/* keys missing from the index must not be found */
+	guint32 offset, size;
+	for(size_t i=0; i<ntest; ++i) {
+		const std::string key = index_vect[test_indexes[i]].key + "~missing";
+		if(pindex->lookup(key.c_str(), offset, size)) {
+			std::cerr << "found a missing key: " << key << std::endl;
+			return false;
+		}
+	}
 	return true;
 }
 
@@ -156,6 +167,15 @@ int main(int argc, char *argv[])
 		std::cerr << "test failed" << std::endl;
 		return 1;
 	}
+	rindex_hash hindex;
+	if(!hindex.load(ridx_url, pindex.get(), indexfilesize, false)) {
+		std::cerr << "unable to build hash table: " << ridx_url << std::endl;
+		return 1;
+	}
+	if(!lookup_test(index_vect, &hindex)) {
+		std::cerr << "hash table test failed" << std::endl;
+		return 1;
+	}
 	std::cout << "test passed" << std::endl;
 	return 0;
 }
@@ -0,0 +1,106 @@
+/*
+ * This file is part of StarDict.
+ *
+ * StarDict is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * StarDict is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with StarDict.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Articles in wiki-articles are converted with wiki2pango and compared with
+ * the output of wiki2xml and wikixml2pango. Where the XML way is known to be
+ * broken, NAME.pango holds the expected output instead. */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <glib.h>
+
+#include "stardict-plugins/stardict-wiki-parsedata-plugin/stardict_wiki2xml.h"
+#include "stardict-plugins/stardict-wiki-parsedata-plugin/stardict_wiki2pango.h"
+
+/* glib versions differ in escaping of ' */
+static void normalize_apos(std::string &str)
+{
+	std::string::size_type pos = 0;
+	while ((pos = str.find("&#39;", pos)) != std::string::npos) {
+		str.replace(pos, 5, "&apos;");
+		pos += 6;
+	}
+}
+
+static bool read_file(const std::string &filename, std::string &contents)
+{
+	gchar *data;
+	gsize length;
+	if (!g_file_get_contents(filename.c_str(), &data, &length, NULL))
+		return false;
+	contents.assign(data, length);
+	g_free(data);
+	return true;
+}
+
+static bool check_article(const std::string &basename)
+{
+	std::string text;
+	if (!read_file(basename + ".wiki", text)) {
+		std::cerr << "can not read " << basename << ".wiki" << std::endl;
+		return false;
+	}
+	std::string res;
+	wiki2pango(text.data(), text.length(), res);
+	std::string expected;
+	if (!read_file(basename + ".pango", expected)) {
+		std::string str(text);
+		std::string xml = wiki2xml(str);
+		expected = wikixml2pango(xml);
+		normalize_apos(expected);
+	}
+	if (res != expected) {
+		std::cerr << basename << ".wiki is converted differently" << std::endl
+			<< "expected:" << std::endl << expected << std::endl
+			<< "result:" << std::endl << res << std::endl;
+		return false;
+	}
+	return true;
+}
+
+int main()
+{
+	GDir *dir = g_dir_open(WIKI_ARTICLES_DIR, 0, NULL);
+	if (!dir) {
+		std::cerr << "can not open " << WIKI_ARTICLES_DIR << std::endl;
+		return EXIT_FAILURE;
+	}
+	bool res = true;
+	int narticles = 0;
+	const gchar *name;
+	while ((name = g_dir_read_name(dir))) {
+		if (!g_str_has_suffix(name, ".wiki"))
+			continue;
+		const std::string filename(name);
+		const std::string basename = std::string(WIKI_ARTICLES_DIR) + G_DIR_SEPARATOR_S
+			+ filename.substr(0, filename.length() - (sizeof(".wiki") - 1));
+		if (!check_article(basename))
+			res = false;
+		++narticles;
+	}
+	g_dir_close(dir);
+	if (narticles == 0) {
+		std::cerr << "no articles in " << WIKI_ARTICLES_DIR << std::endl;
+		return EXIT_FAILURE;
+	}
+	return res ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,184 @@
+/*
+ * This file is part of StarDict.
+ *
+ * StarDict is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * StarDict is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with StarDict.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Articles in xdxf-articles are converted with the XDXF parse-data plugin
+ * in the default color scheme and the items of the result are compared
+ * with NAME.pango. An item is written as a line in brackets followed by
+ * its markup, a link item lists its links as "[link POS LEN] TARGET".
+ * The newline at the end of NAME.xdxf is not a part of the article. */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "stardict-plugins/stardict-xdxf-parsedata-plugin/stardict_xdxf_parsedata.h"
+
+/* the plugin keeps its color scheme in the user config dir */
+class TestAppDirs : public IAppDirs {
+public:
+	explicit TestAppDirs(const std::string& dir) : dir_(dir) {}
+	virtual std::string get_user_config_dir(void) const {
+		return dir_;
+	}
+	virtual std::string get_user_cache_dir(void) const {
+		return dir_;
+	}
+	virtual std::string get_data_dir(void) const {
+		return dir_;
+	}
+private:
+	std::string dir_;
+};
+
+static bool read_file(const std::string &filename, std::string &contents)
+{
+	gchar *data;
+	gsize length;
+	if (!g_file_get_contents(filename.c_str(), &data, &length, NULL))
+		return false;
+	contents.assign(data, length);
+	g_free(data);
+	return true;
+}
+
+static std::string dump_result(const ParseResult &result)
+{
+	std::ostringstream out;
+	for (std::list<ParseResultItem>::const_iterator i = result.item_list.begin();
+		i != result.item_list.end(); ++i) {
+		switch (i->type) {
+		case ParseResultItemType_mark:
+			out << "[mark]" << std::endl << i->mark->pango << std::endl;
+			break;
+		case ParseResultItemType_link:
+			out << "[link]" << std::endl << i->link->pango << std::endl;
+			for (LinksPosList::const_iterator l = i->link->links_list.begin();
+				l != i->link->links_list.end(); ++l)
+				out << "[link " << l->pos_ << " " << l->len_ << "] " << l->link_ << std::endl;
+			break;
+		case ParseResultItemType_res:
+			out << "[res " << i->res->type << "] " << i->res->key << std::endl;
+			break;
+		case ParseResultItemType_FormatBeg:
+			out << "[indent]" << std::endl;
+			break;
+		case ParseResultItemType_FormatEnd:
+			out << "[/indent]" << std::endl;
+			break;
+		default:
+			out << "[item " << i->type << "]" << std::endl;
+			break;
+		}
+	}
+	return out.str();
+}
+
+static bool check_article(const StarDictParseDataPlugInObject &obj,
+	const std::string &basename)
+{
+	std::string text;
+	if (!read_file(basename + ".xdxf", text)) {
+		std::cerr << "can not read " << basename << ".xdxf" << std::endl;
+		return false;
+	}
+	if (!text.empty() && text[text.length() - 1] == '\n')
+		text.resize(text.length() - 1);
+	std::string expected;
+	if (!read_file(basename + ".pango", expected)) {
+		std::cerr << "can not read " << basename << ".pango" << std::endl;
+		return false;
+	}
+	const std::string field = std::string(obj.types) + text;
+	ParseResult result;
+	unsigned int parsed_size = 0;
+	if (!obj.parse_func(field.c_str(), &parsed_size, result, "")) {
+		std::cerr << basename << ".xdxf is not parsed" << std::endl;
+		return false;
+	}
+	if (parsed_size != field.length() + 1) {
+		std::cerr << basename << ".xdxf: " << parsed_size << " bytes parsed of "
+			<< field.length() + 1 << std::endl;
+		return false;
+	}
+	const std::string res = dump_result(result);
+	if (res != expected) {
+		std::cerr << basename << ".xdxf is converted differently" << std::endl
+			<< "expected:" << std::endl << expected << std::endl
+			<< "result:" << std::endl << res << std::endl;
+		return false;
+	}
+	return true;
+}
+
+static bool check_articles(const StarDictParseDataPlugInObject &obj)
+{
+	GDir *dir = g_dir_open(XDXF_ARTICLES_DIR, 0, NULL);
+	if (!dir) {
+		std::cerr << "can not open " << XDXF_ARTICLES_DIR << std::endl;
+		return false;
+	}
+	bool res = true;
+	int narticles = 0;
+	const gchar *name;
+	while ((name = g_dir_read_name(dir))) {
+		if (!g_str_has_suffix(name, ".xdxf"))
+			continue;
+		const std::string filename(name);
+		const std::string basename = std::string(XDXF_ARTICLES_DIR) + G_DIR_SEPARATOR_S
+			+ filename.substr(0, filename.length() - (sizeof(".xdxf") - 1));
+		if (!check_article(obj, basename))
+			res = false;
+		++narticles;
+	}
+	g_dir_close(dir);
+	if (narticles == 0) {
+		std::cerr << "no articles in " << XDXF_ARTICLES_DIR << std::endl;
+		return false;
+	}
+	return res;
+}
+
+int main()
+{
+	gchar *dir = g_dir_make_tmp("t_xdxf2pango-XXXXXX", NULL);
+	if (!dir) {
+		std::cerr << "can not create a temporary directory" << std::endl;
+		return EXIT_FAILURE;
+	}
+	TestAppDirs test_app_dirs(dir);
+	StarDictPlugInObject plugin_obj;
+	StarDictParseDataPlugInObject obj;
+	bool res = false;
+	if (stardict_plugin_init(&plugin_obj, &test_app_dirs)
+		|| stardict_parsedata_plugin_init(&obj))
+		std::cerr << "can not initialize the plugin" << std::endl;
+	else {
+		res = check_articles(obj);
+		stardict_plugin_exit();
+	}
+	g_remove((std::string(dir) + G_DIR_SEPARATOR_S + "xdxf_parser.cfg").c_str());
+	g_rmdir(dir);
+	g_free(dir);
+	return res ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,280 @@
+/*
+ * This file is part of StarDict.
+ *
+ * StarDict is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * StarDict is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with StarDict.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Wiki parse-data benchmark.
+ * Converts wiki articles to pango markup in two ways: through XML with
+ * wiki2xml and wikixml2pango, and with wiki2pango in one pass. Articles are
+ * taken from 'w' fields of dictionaries, other files are read as one article
+ * each. Reports the speed of both ways and the number of articles converted
+ * differently, use --diff to see them. */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <glib.h>
+
+#include "file-utils.h"
+#include "utils.h"
+#include "iappdirs.h"
+#include "stddict.h"
+#include "stardict-plugins/stardict-wiki-parsedata-plugin/stardict_wiki2xml.h"
+#include "stardict-plugins/stardict-wiki-parsedata-plugin/stardict_wiki2pango.h"
+
+namespace {
+	class TestAppDirs : public IAppDirs {
+	public:
+		virtual std::string get_user_config_dir(void) const {
+			return g_get_tmp_dir();
+		}
+		virtual std::string get_user_cache_dir(void) const {
+			return g_get_tmp_dir();
+		}
+		virtual std::string get_data_dir(void) const {
+			return g_get_tmp_dir();
+		}
+		TestAppDirs() {
+			app_dirs = this;
+		}
+	} g_test_app_dirs;
+}
+
+struct Article {
+	std::string text;
+	std::string word;
+};
+
+static gint iterations = 10;
+static gint max_articles = 0;
+static gint show_diff = 0;
+static gboolean json_output = FALSE;
+static gchar **paths = NULL;
+
+static const GOptionEntry entries[] = {
+	{ "iterations", 'i', 0, G_OPTION_ARG_INT, &iterations,
+		"Convert the collected articles N times (default 10)", "N" },
+	{ "limit", 'l', 0, G_OPTION_ARG_INT, &max_articles,
+		"Collect at most N articles, 0 - no limit (default 0)", "N" },
+	{ "diff", 'd', 0, G_OPTION_ARG_INT, &show_diff,
+		"Print the first N articles converted differently", "N" },
+	{ "json", 'j', 0, G_OPTION_ARG_NONE, &json_output,
+		"Print results in JSON", NULL },
+	{ G_OPTION_REMAINING, 0, 0, G_OPTION_ARG_FILENAME_ARRAY, &paths,
+		NULL, "[DICT.ifo|DIR|FILE...]" },
+	{ NULL },
+};
+
+class dict_collector {
+public:
+	dict_collector(List &dl) : dict_list(dl) {}
+	void operator()(const std::string &url, bool) {
+		dict_list.push_back(url);
+	}
+private:
+	List &dict_list;
+};
+
+static bool enough_articles(const std::vector<Article> &articles)
+{
+	return max_articles > 0 && articles.size() >= size_t(max_articles);
+}
+
+/* size of the field starting with the type identifier p[0] */
+static guint32 field_size(const gchar *p)
+{
+	if (g_ascii_isupper(*p))
+		return 1 + sizeof(guint32) + g_ntohl(get_uint32(p + 1));
+	return strlen(p + 1) + 2;
+}
+
+static void collect_dict_articles(Libs &libs, std::vector<Article> &articles)
+{
+	for (size_t iLib = 0; iLib < libs.ndicts(); ++iLib) {
+		for (glong idx = 0; idx < libs.narticles(iLib); ++idx) {
+			gchar *data = libs.poGetOrigWordData(idx, iLib);
+			if (!data)
+				continue;
+			const guint32 data_size = get_uint32(data);
+			const gchar *p = data + sizeof(guint32);
+			const gchar *end = p + data_size;
+			while (p < end) {
+				const guint32 size = field_size(p);
+				if (*p == 'w' && size > 2) {
+					articles.push_back(Article());
+					articles.back().text.assign(p + 1, size - 2);
+					articles.back().word = libs.poGetOrigWord(idx, iLib);
+					if (enough_articles(articles)) {
+						g_free(data);
+						return;
+					}
+				}
+				p += size;
+			}
+			g_free(data);
+		}
+	}
+}
+
+static bool collect_file_article(const char *filename, std::vector<Article> &articles)
+{
+	gchar *contents;
+	gsize length;
+	GError *error = NULL;
+	if (!g_file_get_contents(filename, &contents, &length, &error)) {
+		g_printerr("%s\n", error->message);
+		g_error_free(error);
+		return false;
+	}
+	if (length > 0) {
+		articles.push_back(Article());
+		articles.back().text.assign(contents, length);
+		articles.back().word = filename;
+	}
+	g_free(contents);
+	return true;
+}
+
+/* glib versions differ in escaping of ' */
+static void normalize_apos(std::string &str)
+{
+	std::string::size_type pos = 0;
+	while ((pos = str.find("&#39;", pos)) != std::string::npos) {
+		str.replace(pos, 5, "&apos;");
+		pos += 6;
+	}
+}
+
+static std::string convert_xml(const std::string &text)
+{
+	std::string str(text);
+	std::string xml = wiki2xml(str);
+	return wikixml2pango(xml);
+}
+
+static std::string convert_direct(const std::string &text)
+{
+	std::string res;
+	wiki2pango(text.data(), text.length(), res);
+	return res;
+}
+
+/* Return elapsed time in microseconds. */
+static gint64 run(std::string (*convert)(const std::string &),
+	const std::vector<Article> &articles, guint64 &out_bytes)
+{
+	out_bytes = 0;
+	const gint64 start = g_get_monotonic_time();
+	for (gint it = 0; it < iterations; ++it)
+		for (size_t i = 0; i < articles.size(); ++i)
+			out_bytes += convert(articles[i].text).length();
+	return g_get_monotonic_time() - start;
+}
+
+static double mb_per_sec(guint64 nbytes, gint64 elapsed)
+{
+	const double seconds = elapsed > 0 ? double(elapsed) / G_USEC_PER_SEC : 1e-6;
+	return double(nbytes) * iterations / (1024 * 1024) / seconds;
+}
+
+int main(int argc, char *argv[])
+{
+	GOptionContext *context = g_option_context_new("- StarDict wiki parse-data benchmark");
+	g_option_context_add_main_entries(context, entries, NULL);
+	GError *error = NULL;
+	if (!g_option_context_parse(context, &argc, &argv, &error)) {
+		g_printerr("%s\n", error->message);
+		g_error_free(error);
+		return EXIT_FAILURE;
+	}
+	g_option_context_free(context);
+	if (iterations < 1)
+		iterations = 1;
+
+	std::vector<Article> articles;
+	List dict_list;
+	if (paths) {
+		List dirs;
+		for (gchar **p = paths; *p; ++p) {
+			if (g_file_test(*p, G_FILE_TEST_IS_DIR))
+				dirs.push_back(*p);
+			else if (g_str_has_suffix(*p, ".ifo"))
+				dict_list.push_back(*p);
+			else if (!enough_articles(articles) && !collect_file_article(*p, articles))
+				return EXIT_FAILURE;
+		}
+		for_each_file_restricted(dirs, ".ifo", List(), List(), dict_collector(dict_list));
+	}
+	if (!dict_list.empty() && !enough_articles(articles)) {
+		Libs libs(NULL, false, CollationLevel_NONE, COLLATE_FUNC_NONE);
+		libs.load(dict_list);
+		collect_dict_articles(libs, articles);
+	}
+	if (articles.empty()) {
+		g_printerr("No wiki articles, specify dictionaries or article files.\n");
+		return EXIT_FAILURE;
+	}
+	guint64 nbytes = 0;
+	for (size_t i = 0; i < articles.size(); ++i)
+		nbytes += articles[i].text.size();
+
+	size_t ndiff = 0;
+	for (size_t i = 0; i < articles.size(); ++i) {
+		std::string xml_res = convert_xml(articles[i].text);
+		normalize_apos(xml_res);
+		const std::string direct_res = convert_direct(articles[i].text);
+		if (xml_res == direct_res)
+			continue;
+		if (ndiff < size_t(show_diff) && !json_output)
+			g_print("--- %s\nxml:    %s\ndirect: %s\n", articles[i].word.c_str(),
+				xml_res.c_str(), direct_res.c_str());
+		++ndiff;
+	}
+
+	guint64 xml_out, direct_out;
+	const gint64 xml_elapsed = run(convert_xml, articles, xml_out);
+	const gint64 direct_elapsed = run(convert_direct, articles, direct_out);
+	const double xml_speed = mb_per_sec(nbytes, xml_elapsed);
+	const double direct_speed = mb_per_sec(nbytes, direct_elapsed);
+	const double speedup = direct_elapsed > 0 ? double(xml_elapsed) / direct_elapsed : 0;
+	if (json_output) {
+		gchar num1[G_ASCII_DTOSTR_BUF_SIZE], num2[G_ASCII_DTOSTR_BUF_SIZE],
+			num3[G_ASCII_DTOSTR_BUF_SIZE];
+		g_ascii_formatd(num1, sizeof(num1), "%.2f", xml_speed);
+		g_ascii_formatd(num2, sizeof(num2), "%.2f", direct_speed);
+		g_ascii_formatd(num3, sizeof(num3), "%.2f", speedup);
+		g_print("{\"articles\":%lu,\"bytes\":%" G_GUINT64_FORMAT ",\"iterations\":%d"
+			",\"xml_ms\":%" G_GINT64_FORMAT ",\"direct_ms\":%" G_GINT64_FORMAT
+			",\"xml_mb_per_sec\":%s,\"direct_mb_per_sec\":%s,\"speedup\":%s"
+			",\"different\":%lu}\n",
+			(unsigned long)articles.size(), nbytes, iterations,
+			xml_elapsed / 1000, direct_elapsed / 1000, num1, num2, num3,
+			(unsigned long)ndiff);
+	} else {
+		g_print("articles: %lu, bytes: %" G_GUINT64_FORMAT ", iterations: %d\n",
+			(unsigned long)articles.size(), nbytes, iterations);
+		g_print("xml:    %.1f ms, %.2f MB/s, %" G_GUINT64_FORMAT " bytes of markup\n",
+			xml_elapsed / 1000.0, xml_speed, xml_out / iterations);
+		g_print("direct: %.1f ms, %.2f MB/s, %" G_GUINT64_FORMAT " bytes of markup\n",
+			direct_elapsed / 1000.0, direct_speed, direct_out / iterations);
+		g_print("speedup: %.2fx, converted differently: %lu\n", speedup, (unsigned long)ndiff);
+	}
+	return EXIT_SUCCESS;
+}
@@ -20,7 +20,6 @@
 #include <string.h>
 #include <glib.h>
 
-#include "utils.h"
 #include "m_ctype.h"
 #include "collation.h"
 
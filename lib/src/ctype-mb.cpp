@@ -24,7 +24,6 @@
 
 #include <algorithm>
 
-#include "utils.h"
 #include "m_ctype.h"
 
 #ifdef _WIN32
@@ -36,7 +36,6 @@
 #  include "config.h"
 #endif
 
-#include "utils.h"
 #include "m_ctype.h"
 
 using namespace stardict_collation;
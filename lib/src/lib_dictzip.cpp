@@ -0,0 +1,425 @@
+/*
+ * This file is part of StarDict.
+ *
+ * StarDict is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * StarDict is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with StarDict.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+#include <glib/gstdio.h>
+#include <errno.h>
+#ifdef _WIN32
+#  include <windows.h>
+#else
+#  include <unistd.h>
+#endif
+#include "lib_dictzip.h"
+
+/* gzip header, RFC 1952, with the random access field of dictzip */
+#define GZ_MAGIC1	0x1f
+#define GZ_MAGIC2	0x8b
+#define GZ_FEXTRA	0x04
+#define GZ_FNAME	0x08
+#define GZ_FCOMMENT	0x10
+#define GZ_MAX		2
+#define GZ_OS_UNIX	3
+#define GZ_RND_S1	'R'
+#define GZ_RND_S2	'A'
+
+/* a compressed chunk of dictzip never exceeds it */
+#define OUT_BUFFER_SIZE 0xffff
+
+static int get_processor_count(void)
+{
+#if GLIB_CHECK_VERSION(2, 36, 0)
+	return g_get_num_processors();
+#elif defined(_WIN32)
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwNumberOfProcessors;
+#elif defined(_SC_NPROCESSORS_ONLN)
+	const long count = sysconf(_SC_NPROCESSORS_ONLN);
+	return count > 0 ? count : 1;
+#else
+	return 1;
+#endif
+}
+
+static void put_uint16(std::string& buf, guint32 val)
+{
+	buf += char(val & 0xff);
+	buf += char((val >> 8) & 0xff);
+}
+
+static void put_uint32(std::string& buf, guint32 val)
+{
+	put_uint16(buf, val & 0xffff);
+	put_uint16(buf, val >> 16);
+}
+
+static void too_large_err(const std::string& filename)
+{
+	g_critical("Unable to compress %s: dictzip format allows at most %" G_GUINT64_FORMAT " bytes.",
+		filename.c_str(), dictzip_writer_t::MAX_LENGTH);
+}
+
+dictzip_writer_t::dictzip_writer_t(void)
+:
+	file(NULL),
+	mtime(0),
+	length(0),
+	crc(0),
+	cur_chunk(NULL),
+	reserved_count(0),
+	pool(NULL),
+	max_queued(0),
+	next_index(0),
+	next_write(0)
+{
+	g_mutex_init(&mutex);
+	g_cond_init(&cond);
+}
+
+dictzip_writer_t::~dictzip_writer_t(void)
+{
+	if(is_open())
+		abort();
+	g_mutex_clear(&mutex);
+	g_cond_clear(&cond);
+}
+
+int dictzip_writer_t::open(const std::string& filename, int threads, time_t mtime,
+	guint64 expected_length)
+{
+	if(is_open())
+		abort();
+	if(expected_length > MAX_LENGTH) {
+		too_large_err(filename);
+		return EXIT_FAILURE;
+	}
+	this->filename = filename;
+	this->mtime = mtime ? mtime : time(NULL);
+	/* the chunks are read back by move_chunks() */
+	file = g_fopen(filename.c_str(), "w+b");
+	if(!file) {
+		g_critical(open_write_file_err, filename.c_str());
+		return EXIT_FAILURE;
+	}
+	reserved_count = expected_length
+		? size_t((expected_length + CHUNK_LENGTH - 1) / CHUNK_LENGTH)
+		: RESERVED_CHUNK_COUNT;
+	if(fseek(file, build_header(reserved_count, 0).length(), SEEK_SET)) {
+		g_critical(write_file_err, filename.c_str());
+		abort();
+		return EXIT_FAILURE;
+	}
+	if(threads <= 0)
+		threads = get_processor_count();
+	pool = g_thread_pool_new(compress_chunk, this, threads, TRUE, NULL);
+	max_queued = 2 * threads;
+	this->length = 0;
+	crc = crc32(0L, Z_NULL, 0);
+	chunk_sizes.clear();
+	next_index = 0;
+	next_write = 0;
+	return EXIT_SUCCESS;
+}
+
+int dictzip_writer_t::write(const void *data, size_t size)
+{
+	const char *p = static_cast<const char *>(data);
+	while(size > 0) {
+		if(!cur_chunk) {
+			cur_chunk = new chunk_t;
+			cur_chunk->in.reserve(CHUNK_LENGTH);
+		}
+		const size_t len = std::min(size, CHUNK_LENGTH - cur_chunk->in.size());
+		cur_chunk->in.insert(cur_chunk->in.end(), p, p + len);
+		p += len;
+		size -= len;
+		length += len;
+		if(cur_chunk->in.size() == CHUNK_LENGTH && submit_chunk())
+			return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
+
+/* Give the filled chunk to the pool, write the compressed chunks if too
+ * many are in memory. */
+int dictzip_writer_t::submit_chunk(void)
+{
+	chunk_t *chunk = cur_chunk;
+	cur_chunk = NULL;
+	if(next_index >= MAX_CHUNK_COUNT) {
+		delete chunk;
+		too_large_err(filename);
+		return EXIT_FAILURE;
+	}
+	chunk->index = next_index++;
+	chunk->crc = 0;
+	chunk->failed = false;
+	g_thread_pool_push(pool, chunk, NULL);
+	if(next_index - next_write >= max_queued)
+		return write_chunks(false);
+	return EXIT_SUCCESS;
+}
+
+/* Runs in the pool. A chunk is compressed as dictzip does after a full
+ * flush, so the compressor need not know the previous chunks. */
+void dictzip_writer_t::compress_chunk(gpointer data, gpointer user_data)
+{
+	chunk_t *chunk = static_cast<chunk_t *>(data);
+	dictzip_writer_t *writer = static_cast<dictzip_writer_t *>(user_data);
+	chunk->in_size = chunk->in.size();
+	chunk->crc = crc32(crc32(0L, Z_NULL, 0), (const Bytef *)&chunk->in[0], chunk->in_size);
+	chunk->out.resize(OUT_BUFFER_SIZE);
+	z_stream zStream;
+	memset(&zStream, 0, sizeof(zStream));
+	if(deflateInit2(&zStream, Z_BEST_COMPRESSION, Z_DEFLATED, -15,
+			Z_BEST_COMPRESSION, Z_DEFAULT_STRATEGY) != Z_OK) {
+		chunk->failed = true;
+	} else {
+		zStream.next_in = (Bytef *)&chunk->in[0];
+		zStream.avail_in = chunk->in_size;
+		zStream.next_out = (Bytef *)&chunk->out[0];
+		zStream.avail_out = chunk->out.size();
+		/* the output may be incomplete if it fills the buffer */
+		if(deflate(&zStream, Z_FULL_FLUSH) != Z_OK || zStream.avail_in != 0
+				|| zStream.avail_out == 0)
+			chunk->failed = true;
+		chunk->out.resize(chunk->out.size() - zStream.avail_out);
+		deflateEnd(&zStream);
+	}
+	std::vector<char>().swap(chunk->in);
+	g_mutex_lock(&writer->mutex);
+	writer->compressed[chunk->index] = chunk;
+	g_cond_signal(&writer->cond);
+	g_mutex_unlock(&writer->mutex);
+}
+
+/* Write the compressed chunks to file in order. Wait till all the
+ * chunks are written if wait_all, till fewer than max_queued are left
+ * otherwise. */
+int dictzip_writer_t::write_chunks(bool wait_all)
+{
+	int res = EXIT_SUCCESS;
+	g_mutex_lock(&mutex);
+	while(next_write < next_index
+			&& (wait_all || next_index - next_write >= max_queued)) {
+		std::map<size_t, chunk_t *>::iterator it = compressed.find(next_write);
+		if(it == compressed.end()) {
+			g_cond_wait(&cond, &mutex);
+			continue;
+		}
+		chunk_t *chunk = it->second;
+		compressed.erase(it);
+		++next_write;
+		g_mutex_unlock(&mutex);
+		if(res == EXIT_SUCCESS) {
+			if(chunk->failed) {
+				g_critical("Unable to compress %s: deflate failed.", filename.c_str());
+				res = EXIT_FAILURE;
+			} else if(fwrite(&chunk->out[0], 1, chunk->out.size(), file)
+					!= chunk->out.size()) {
+				g_critical(write_file_err, filename.c_str());
+				res = EXIT_FAILURE;
+			} else {
+				crc = crc32_combine(crc, chunk->crc, chunk->in_size);
+				chunk_sizes.push_back(guint16(chunk->out.size()));
+			}
+		}
+		delete chunk;
+		g_mutex_lock(&mutex);
+	}
+	g_mutex_unlock(&mutex);
+	return res;
+}
+
+int dictzip_writer_t::close(void)
+{
+	if(!is_open())
+		return EXIT_FAILURE;
+	if((cur_chunk && submit_chunk()) || write_chunks(true) || write_file()) {
+		abort();
+		return EXIT_FAILURE;
+	}
+	g_thread_pool_free(pool, FALSE, TRUE);
+	pool = NULL;
+	fclose(file);
+	file = NULL;
+	return EXIT_SUCCESS;
+}
+
+/* The gzip header with the sizes of count chunks, the chunks not written
+ * yet have size 0. If header_size is bigger, the rest is taken by the
+ * comment. */
+std::string dictzip_writer_t::build_header(size_t count, size_t header_size) const
+{
+	std::string header;
+	header += char(GZ_MAGIC1);
+	header += char(GZ_MAGIC2);
+	header += char(Z_DEFLATED);
+	header += char(GZ_FEXTRA | GZ_FNAME);
+	put_uint32(header, guint32(mtime));
+	header += char(GZ_MAX);
+	header += char(GZ_OS_UNIX);
+	put_uint16(header, 10 + 2 * count);
+	header += GZ_RND_S1;
+	header += GZ_RND_S2;
+	put_uint16(header, 6 + 2 * count);
+	put_uint16(header, 1);
+	put_uint16(header, CHUNK_LENGTH);
+	put_uint16(header, count);
+	for(size_t i = 0; i < count; ++i)
+		put_uint16(header, i < chunk_sizes.size() ? chunk_sizes[i] : 0);
+	glib::CharStr basename(g_path_get_basename(filename.c_str()));
+	std::string name(get_impl(basename));
+	if(g_str_has_suffix(name.c_str(), ".dz"))
+		name.resize(name.length() - 3);
+	header.append(name.c_str(), name.length() + 1);
+	/* the room is left for an even number of bytes, at least 2 */
+	if(header.length() < header_size) {
+		header[3] |= GZ_FCOMMENT;
+		header.append(header_size - header.length() - 1, ' ');
+		header += '\0';
+	}
+	return header;
+}
+
+/* Move the chunks between start and end delta bytes further to make room
+ * for a bigger header. The file is less than 2 GB, see MAX_CHUNK_COUNT. */
+int dictzip_writer_t::move_chunks(long start, long end, long delta)
+{
+	long pos = end;
+	std::vector<char> buffer(1024 * 1024);
+	while(pos > start) {
+		const size_t len = std::min(size_t(pos - start), buffer.size());
+		pos -= len;
+		if(fseek(file, pos, SEEK_SET) || 1 != fread(&buffer[0], len, 1, file)) {
+			std::string error(g_strerror(errno));
+			g_critical(read_file_err, filename.c_str(), error.c_str());
+			return EXIT_FAILURE;
+		}
+		if(fseek(file, pos + delta, SEEK_SET) || 1 != fwrite(&buffer[0], len, 1, file)) {
+			g_critical(write_file_err, filename.c_str());
+			return EXIT_FAILURE;
+		}
+	}
+	return EXIT_SUCCESS;
+}
+
+/* Write the trailer after the chunks and the header in the room left for
+ * it. */
+int dictzip_writer_t::write_file(void)
+{
+	const size_t count = chunk_sizes.size();
+	const size_t reserved_size = build_header(reserved_count, 0).length();
+	/* the file is not extended by the room left if no chunk is written */
+	long end = ftell(file);
+	std::string header;
+	if(count > reserved_count) {
+		header = build_header(count, 0);
+		const long delta = header.length() - reserved_size;
+		if(move_chunks(reserved_size, end, delta))
+			return EXIT_FAILURE;
+		end += delta;
+	} else {
+		header = build_header(count, reserved_size);
+	}
+
+	/* the end of the deflate stream as dictzip writes it */
+	std::string trailer;
+	z_stream zStream;
+	memset(&zStream, 0, sizeof(zStream));
+	if(deflateInit2(&zStream, Z_BEST_COMPRESSION, Z_DEFLATED, -15,
+			Z_BEST_COMPRESSION, Z_DEFAULT_STRATEGY) != Z_OK) {
+		g_critical("Unable to compress %s: deflate failed.", filename.c_str());
+		return EXIT_FAILURE;
+	}
+	Bytef finish[16];
+	zStream.next_out = finish;
+	zStream.avail_out = sizeof(finish);
+	deflate(&zStream, Z_FINISH);
+	trailer.append((const char *)finish, sizeof(finish) - zStream.avail_out);
+	deflateEnd(&zStream);
+	put_uint32(trailer, crc);
+	put_uint32(trailer, guint32(length));
+
+	if(fseek(file, end, SEEK_SET)
+			|| 1 != fwrite(trailer.data(), trailer.length(), 1, file)
+			|| fseek(file, 0, SEEK_SET)
+			|| 1 != fwrite(header.data(), header.length(), 1, file)
+			|| fflush(file)) {
+		g_critical(write_file_err, filename.c_str());
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
+
+/* Drop the data, remove the file. */
+void dictzip_writer_t::abort(void)
+{
+	if(pool) {
+		g_thread_pool_free(pool, FALSE, TRUE);
+		pool = NULL;
+	}
+	delete cur_chunk;
+	cur_chunk = NULL;
+	for(std::map<size_t, chunk_t *>::iterator it = compressed.begin();
+			it != compressed.end(); ++it)
+		delete it->second;
+	compressed.clear();
+	if(file) {
+		fclose(file);
+		file = NULL;
+	}
+	g_remove(filename.c_str());
+}
+
+int dictzip_file(const std::string& filename)
+{
+	stardict_stat_t stats;
+	clib::File in(g_fopen(filename.c_str(), "rb"));
+	if(!in || g_stat(filename.c_str(), &stats)) {
+		std::string error(g_strerror(errno));
+		g_critical(open_read_file_err, filename.c_str(), error.c_str());
+		return EXIT_FAILURE;
+	}
+	const std::string dzfilename = filename + ".dz";
+	dictzip_writer_t writer;
+	if(writer.open(dzfilename, 0, stats.st_mtime, stats.st_size))
+		return EXIT_FAILURE;
+	std::vector<char> buffer(1024 * 1024);
+	size_t len;
+	while((len = fread(&buffer[0], 1, buffer.size(), get_impl(in))) > 0) {
+		if(writer.write(&buffer[0], len))
+			return EXIT_FAILURE;
+	}
+	if(ferror(get_impl(in))) {
+		std::string error(g_strerror(errno));
+		g_critical(read_file_err, filename.c_str(), error.c_str());
+		return EXIT_FAILURE;
+	}
+	if(writer.close())
+		return EXIT_FAILURE;
+	in.reset(NULL);
+	if(g_remove(filename.c_str()))
+		g_warning("Unable to remove the file %s.", filename.c_str());
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,119 @@
+/*
+ * This file is part of StarDict.
+ *
+ * StarDict is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * StarDict is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with StarDict.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIB_DICTZIP_H_
+#define LIB_DICTZIP_H_
+
+#include <glib.h>
+#include <ctime>
+#include <string>
+#include <map>
+#include <vector>
+#include "libcommon.h"
+
+/* Writes a .dict.dz file without running dictzip.
+ * The data is cut into chunks that are compressed independently, the gzip
+ * header holds the table of compressed chunk sizes, so dictData can read
+ * any part of the file. dictzip -d and dictData read the file as one made
+ * by dictzip.
+ * The chunks are compressed by a pool of threads while the data is being
+ * written. They are written to the output after room for the header, which
+ * holds their sizes, close() writes the header in that room. The room left
+ * over is filled with the gzip comment. */
+class dictzip_writer_t
+{
+public:
+	/* Uncompressed bytes in a chunk, as dictzip does. A compressed chunk
+	 * must fit in 16 bits. */
+	static const size_t CHUNK_LENGTH = 58315;
+	/* the chunk table is in the gzip extra field of 64K */
+	static const size_t MAX_CHUNK_COUNT = (0xffff - 10) / 2;
+	/* the most uncompressed bytes in a file, about 1.9 GB */
+	static const guint64 MAX_LENGTH = guint64(MAX_CHUNK_COUNT) * CHUNK_LENGTH;
+	/* Room for the sizes of so many chunks, about 60 MB of data, is left
+	 * for the header if the length of the data is not known. The chunks
+	 * are moved if there are more of them. */
+	static const size_t RESERVED_CHUNK_COUNT = 1024;
+
+	dictzip_writer_t(void);
+	~dictzip_writer_t(void);
+	/* threads - the number of compressing threads, 0 - the number of
+	 * processors. mtime - the time stored in the header, 0 - now.
+	 * expected_length - the number of bytes to be written if known,
+	 * 0 - unknown. */
+	int open(const std::string& filename, int threads = 0, time_t mtime = 0,
+		guint64 expected_length = 0);
+	int write(const void *data, size_t size);
+	/* uncompressed bytes written so far */
+	guint64 tell(void) const
+	{
+		return length;
+	}
+	/* Write the file. The file is removed on failure. */
+	int close(void);
+	bool is_open(void) const
+	{
+		return file != NULL;
+	}
+private:
+	struct chunk_t {
+		size_t index;
+		std::vector<char> in;
+		std::vector<char> out;
+		size_t in_size;
+		/* crc32 of in */
+		guint32 crc;
+		bool failed;
+	};
+
+	static void compress_chunk(gpointer data, gpointer user_data);
+	int submit_chunk(void);
+	int write_chunks(bool wait_all);
+	std::string build_header(size_t count, size_t header_size) const;
+	int move_chunks(long start, long end, long delta);
+	int write_file(void);
+	void abort(void);
+
+	std::string filename;
+	FILE *file;
+	time_t mtime;
+	guint64 length;
+	guint32 crc;
+	/* the chunk being filled */
+	chunk_t *cur_chunk;
+	/* the header has room for the sizes of so many chunks */
+	size_t reserved_count;
+	/* compressed sizes of the chunks written to file */
+	std::vector<guint16> chunk_sizes;
+	GThreadPool *pool;
+	/* the most chunks in the pool and waiting to be written */
+	size_t max_queued;
+	/* index of the next chunk given to the pool */
+	size_t next_index;
+	/* index of the next chunk written to file */
+	size_t next_write;
+	/* chunks compressed by the pool, protected by mutex */
+	std::map<size_t, chunk_t *> compressed;
+	GMutex mutex;
+	GCond cond;
+};
+
+/* Compress filename to filename.dz as "dictzip filename" does, remove
+ * filename on success. */
+int dictzip_file(const std::string& filename);
+
+#endif /* LIB_DICTZIP_H_ */
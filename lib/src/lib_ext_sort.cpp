@@ -0,0 +1,360 @@
+/*
+ * This file is part of StarDict.
+ *
+ * StarDict is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * StarDict is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with StarDict.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+#include <glib/gstdio.h>
+#include <errno.h>
+#include "lib_ext_sort.h"
+
+/* The most runs read at once. More runs are merged in several passes. */
+static const size_t MAX_OPEN_RUNS = 64;
+/* stdio buffer of a run file */
+static const size_t RUN_BUFFER_SIZE = 256 * 1024;
+
+/* orders the records in memory by key, then by the order they were added */
+struct record_less_t {
+	record_less_t(const char *buffer)
+	:
+		buffer(buffer)
+	{
+
+	}
+	bool operator()(size_t left, size_t right) const
+	{
+		const gint res = stardict_strcmp(buffer + left, buffer + right);
+		return res < 0 || (res == 0 && left < right);
+	}
+	const char *buffer;
+};
+
+/* std::push_heap makes a max-heap, the reader with the least record must
+ * be on top. */
+bool ext_sorter_t::run_reader_greater_t::operator()(const run_reader_t *left,
+	const run_reader_t *right) const
+{
+	const gint res = stardict_strcmp(left->key.c_str(), right->key.c_str());
+	return res > 0 || (res == 0 && left->index > right->index);
+}
+
+ext_sorter_t::ext_sorter_t(void)
+:
+	max_memory(0),
+	count(0),
+	sorted(false),
+	cur_record(0)
+{
+
+}
+
+ext_sorter_t::~ext_sorter_t(void)
+{
+	clear();
+}
+
+bool ext_sorter_t::max_memory_from_megabytes(gint64 megabytes, size_t& max_memory)
+{
+	if(megabytes < 0 || guint64(megabytes) > G_MAXSIZE / (1024 * 1024))
+		return false;
+	max_memory = size_t(megabytes) * 1024 * 1024;
+	return true;
+}
+
+int ext_sorter_t::add(const std::string& key, const char *data, size_t size)
+{
+	if(sorted) {
+		g_critical("Unable to add a record to sorted records.");
+		return EXIT_FAILURE;
+	}
+	const size_t record_size = key.length() + 1 + sizeof(guint32) + size;
+	if(max_memory && !records.empty()
+		&& buffer.size() + record_size + (records.size() + 1) * sizeof(size_t) > max_memory) {
+		if(spill())
+			return EXIT_FAILURE;
+	}
+	const size_t offset = buffer.size();
+	if(buffer.capacity() < offset + record_size) {
+		/* do not let the buffer grow twice over the limit */
+		size_t capacity = std::max(offset + record_size, 2 * buffer.capacity());
+		if(max_memory)
+			capacity = std::max(offset + record_size, std::min(capacity, max_memory));
+		buffer.reserve(capacity);
+	}
+	buffer.resize(offset + record_size);
+	char *p = &buffer[offset];
+	memcpy(p, key.c_str(), key.length() + 1);
+	p += key.length() + 1;
+	const guint32 size32 = size;
+	memcpy(p, &size32, sizeof(guint32));
+	p += sizeof(guint32);
+	if(size)
+		memcpy(p, data, size);
+	records.push_back(offset);
+	++count;
+	return EXIT_SUCCESS;
+}
+
+int ext_sorter_t::sort(void)
+{
+	if(!sorted) {
+		sorted = true;
+		if(runs.empty()) {
+			if(!records.empty())
+				std::sort(records.begin(), records.end(), record_less_t(&buffer[0]));
+		} else {
+			if(!records.empty() && spill())
+				return EXIT_FAILURE;
+			std::vector<char>().swap(buffer);
+			std::vector<size_t>().swap(records);
+			if(reduce_runs())
+				return EXIT_FAILURE;
+		}
+	}
+	cur_record = 0;
+	if(runs.empty())
+		return EXIT_SUCCESS;
+	return merger.open(runs);
+}
+
+int ext_sorter_t::read(std::string& key, std::string& data, bool& eof)
+{
+	if(!sorted) {
+		g_critical("Unable to read records before they are sorted.");
+		return EXIT_FAILURE;
+	}
+	if(!runs.empty())
+		return merger.read(key, data, eof);
+	eof = cur_record >= records.size();
+	if(eof)
+		return EXIT_SUCCESS;
+	const char *p = &buffer[records[cur_record++]];
+	const size_t key_len = strlen(p);
+	key.assign(p, key_len);
+	p += key_len + 1;
+	guint32 size;
+	memcpy(&size, p, sizeof(guint32));
+	data.assign(p + sizeof(guint32), size);
+	return EXIT_SUCCESS;
+}
+
+void ext_sorter_t::clear(void)
+{
+	merger.close();
+	for(size_t i = 0; i < runs.size(); ++i)
+		if(g_remove(runs[i].c_str()))
+			g_warning(remove_temp_file_err, runs[i].c_str());
+	runs.clear();
+	std::vector<char>().swap(buffer);
+	std::vector<size_t>().swap(records);
+	count = 0;
+	sorted = false;
+	cur_record = 0;
+}
+
+/* Sort the records in memory and write them to a new run. */
+int ext_sorter_t::spill(void)
+{
+	std::sort(records.begin(), records.end(), record_less_t(&buffer[0]));
+	clib::File file;
+	const std::string runname = create_run(file);
+	if(runname.empty())
+		return EXIT_FAILURE;
+	for(size_t i = 0; i < records.size(); ++i) {
+		const char *p = &buffer[records[i]];
+		const size_t key_len = strlen(p);
+		guint32 size;
+		memcpy(&size, p + key_len + 1, sizeof(guint32));
+		if(write_record(get_impl(file), runname, p, key_len,
+				p + key_len + 1 + sizeof(guint32), size))
+			return EXIT_FAILURE;
+	}
+	if(fflush(get_impl(file))) {
+		g_critical(write_file_err, runname.c_str());
+		return EXIT_FAILURE;
+	}
+	buffer.clear();
+	records.clear();
+	return EXIT_SUCCESS;
+}
+
+/* Merge the runs in groups till no more than MAX_OPEN_RUNS are left.
+ * A group is of adjacent runs, so the merged run keeps the place of the
+ * group in the order of runs. */
+int ext_sorter_t::reduce_runs(void)
+{
+	while(runs.size() > MAX_OPEN_RUNS) {
+		/* create_run() adds the new runs to runs, so they are removed if
+		 * something fails */
+		const std::vector<std::string> cur_runs(runs);
+		std::vector<std::string> merged;
+		for(size_t first = 0; first < cur_runs.size(); first += MAX_OPEN_RUNS) {
+			const size_t last = std::min(first + MAX_OPEN_RUNS, cur_runs.size());
+			if(last - first == 1) {
+				merged.push_back(cur_runs[first]);
+				continue;
+			}
+			const std::vector<std::string> group(cur_runs.begin() + first, cur_runs.begin() + last);
+			clib::File file;
+			const std::string runname = create_run(file);
+			if(runname.empty())
+				return EXIT_FAILURE;
+			if(merger.open(group))
+				return EXIT_FAILURE;
+			std::string key, data;
+			bool eof;
+			while(true) {
+				if(merger.read(key, data, eof))
+					return EXIT_FAILURE;
+				if(eof)
+					break;
+				if(write_record(get_impl(file), runname, key.c_str(), key.length(),
+						data.data(), data.length()))
+					return EXIT_FAILURE;
+			}
+			merger.close();
+			if(fflush(get_impl(file))) {
+				g_critical(write_file_err, runname.c_str());
+				return EXIT_FAILURE;
+			}
+			for(size_t i = 0; i < group.size(); ++i)
+				if(g_remove(group[i].c_str()))
+					g_warning(remove_temp_file_err, group[i].c_str());
+			merged.push_back(runname);
+		}
+		runs.swap(merged);
+	}
+	return EXIT_SUCCESS;
+}
+
+/* Return the file name, an empty string on error. */
+std::string ext_sorter_t::create_run(clib::File& file)
+{
+	const std::string runname = create_temp_file();
+	if(runname.empty()) {
+		g_critical(create_temp_file_no_name_err);
+		return "";
+	}
+	file.reset(g_fopen(runname.c_str(), "wb"));
+	if(!file) {
+		g_critical(create_temp_file_err, runname.c_str());
+		g_remove(runname.c_str());
+		return "";
+	}
+	setvbuf(get_impl(file), NULL, _IOFBF, RUN_BUFFER_SIZE);
+	runs.push_back(runname);
+	return runname;
+}
+
+/* A record in a run is guint32 key length, key, guint32 data size, data. */
+int ext_sorter_t::write_record(FILE *file, const std::string& runname,
+	const char *key, size_t key_len, const char *data, size_t size)
+{
+	const guint32 key_len32 = key_len;
+	const guint32 size32 = size;
+	if(1 != fwrite(&key_len32, sizeof(guint32), 1, file)
+		|| (key_len && 1 != fwrite(key, key_len, 1, file))
+		|| 1 != fwrite(&size32, sizeof(guint32), 1, file)
+		|| (size && 1 != fwrite(data, size, 1, file))) {
+		g_critical(write_file_err, runname.c_str());
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
+
+int ext_sorter_t::read_record(run_reader_t& reader, bool& eof)
+{
+	guint32 len;
+	eof = false;
+	if(1 != fread(&len, sizeof(guint32), 1, reader.file)) {
+		if(feof(reader.file)) {
+			eof = true;
+			return EXIT_SUCCESS;
+		}
+	} else {
+		reader.key.resize(len);
+		if(!len || 1 == fread(&reader.key[0], len, 1, reader.file)) {
+			if(1 == fread(&len, sizeof(guint32), 1, reader.file)) {
+				reader.data.resize(len);
+				if(!len || 1 == fread(&reader.data[0], len, 1, reader.file))
+					return EXIT_SUCCESS;
+			}
+		}
+	}
+	std::string error(g_strerror(errno));
+	g_critical(read_file_err, reader.name.c_str(), error.c_str());
+	return EXIT_FAILURE;
+}
+
+int ext_sorter_t::merger_t::open(const std::vector<std::string>& runs)
+{
+	close();
+	for(size_t i = 0; i < runs.size(); ++i) {
+		run_reader_t *reader = new run_reader_t;
+		reader->index = i;
+		reader->name = runs[i];
+		reader->file = g_fopen(runs[i].c_str(), "rb");
+		if(!reader->file) {
+			delete reader;
+			std::string error(g_strerror(errno));
+			g_critical(open_read_file_err, runs[i].c_str(), error.c_str());
+			return EXIT_FAILURE;
+		}
+		setvbuf(reader->file, NULL, _IOFBF, RUN_BUFFER_SIZE);
+		readers.push_back(reader);
+		bool eof;
+		if(read_record(*reader, eof))
+			return EXIT_FAILURE;
+		if(!eof)
+			heap.push_back(reader);
+	}
+	std::make_heap(heap.begin(), heap.end(), run_reader_greater_t());
+	return EXIT_SUCCESS;
+}
+
+int ext_sorter_t::merger_t::read(std::string& key, std::string& data, bool& eof)
+{
+	eof = heap.empty();
+	if(eof)
+		return EXIT_SUCCESS;
+	std::pop_heap(heap.begin(), heap.end(), run_reader_greater_t());
+	run_reader_t *reader = heap.back();
+	key.swap(reader->key);
+	data.swap(reader->data);
+	bool reader_eof;
+	if(read_record(*reader, reader_eof))
+		return EXIT_FAILURE;
+	if(reader_eof)
+		heap.pop_back();
+	else
+		std::push_heap(heap.begin(), heap.end(), run_reader_greater_t());
+	return EXIT_SUCCESS;
+}
+
+void ext_sorter_t::merger_t::close(void)
+{
+	for(size_t i = 0; i < readers.size(); ++i) {
+		fclose(readers[i]->file);
+		delete readers[i];
+	}
+	readers.clear();
+	heap.clear();
+}
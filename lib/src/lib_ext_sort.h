@@ -0,0 +1,124 @@
+/*
+ * This file is part of StarDict.
+ *
+ * StarDict is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * StarDict is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with StarDict.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIB_EXT_SORT_H_
+#define LIB_EXT_SORT_H_
+
+#include <glib.h>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "libcommon.h"
+
+/* Sorts records of a key and data by key with stardict_strcmp, records with
+ * equal keys stay in the order they were added.
+ * The records are kept in memory while they take no more than max_memory
+ * bytes. Then they are sorted and moved to a temporary file, a run, and
+ * the runs are merged when the records are read. So a dictionary larger
+ * than the memory can be sorted. */
+class ext_sorter_t
+{
+public:
+	/* the memory limit the tools use unless told otherwise */
+	static const size_t DEFAULT_MAX_MEMORY = 256 * 1024 * 1024;
+	/* The memory limit of so many megabytes. false if megabytes is
+	 * negative or the limit does not fit in size_t. */
+	static bool max_memory_from_megabytes(gint64 megabytes, size_t& max_memory);
+
+	ext_sorter_t(void);
+	~ext_sorter_t(void);
+	/* 0 - no limit, the records are never written to disk */
+	void set_max_memory(size_t max_memory)
+	{
+		this->max_memory = max_memory;
+	}
+	size_t get_max_memory(void) const
+	{
+		return max_memory;
+	}
+	/* The key must not contain '\0'. */
+	int add(const std::string& key, const char *data, size_t size);
+	/* Sort the records. read() returns them from the first one afterwards.
+	 * Call again to read the records once more. No records may be added
+	 * after that. */
+	int sort(void);
+	/* eof is set after the last record */
+	int read(std::string& key, std::string& data, bool& eof);
+	/* number of records added */
+	size_t size(void) const
+	{
+		return count;
+	}
+	/* Drop all records, remove the temporary files. */
+	void clear(void);
+private:
+	struct run_reader_t {
+		std::string name;
+		FILE *file;
+		/* the current record */
+		std::string key;
+		std::string data;
+		/* the runs are numbered in the order they were written */
+		size_t index;
+	};
+	struct run_reader_greater_t {
+		bool operator()(const run_reader_t *left, const run_reader_t *right) const;
+	};
+	/* merges the runs */
+	class merger_t {
+	public:
+		merger_t(void) {}
+		~merger_t(void)
+		{
+			close();
+		}
+		int open(const std::vector<std::string>& runs);
+		int read(std::string& key, std::string& data, bool& eof);
+		void close(void);
+	private:
+		std::vector<run_reader_t *> readers;
+		/* readers with a current record, heap by run_reader_greater_t */
+		std::vector<run_reader_t *> heap;
+		merger_t(const merger_t&);
+		merger_t& operator=(const merger_t&);
+	};
+
+	int spill(void);
+	int reduce_runs(void);
+	std::string create_run(clib::File& file);
+	static int write_record(FILE *file, const std::string& runname,
+		const char *key, size_t key_len, const char *data, size_t size);
+	static int read_record(run_reader_t& reader, bool& eof);
+
+	size_t max_memory;
+	size_t count;
+	bool sorted;
+	/* records in memory: key, '\0', guint32 data size, data */
+	std::vector<char> buffer;
+	/* offsets of the records in buffer */
+	std::vector<size_t> records;
+	/* the next record to read if there are no runs */
+	size_t cur_record;
+	/* temporary files of the sorted runs */
+	std::vector<std::string> runs;
+	merger_t merger;
+
+	ext_sorter_t(const ext_sorter_t&);
+	ext_sorter_t& operator=(const ext_sorter_t&);
+};
+
+#endif /* LIB_EXT_SORT_H_ */
@@ -0,0 +1,259 @@
+/*
+ * This file is part of StarDict.
+ *
+ * StarDict is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * StarDict is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with StarDict.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+#include <vector>
+#include <glib/gstdio.h>
+#include <zlib.h>
+#include "libcommon.h"
+#include "lib_index_cache.h"
+
+/* The index is read whole, entries - offsets of the index entries. */
+static int load_index(const std::string& idxfilename, glib::CharStr& contents,
+	gsize& size, std::vector<guint32>& entries)
+{
+	glib::Error error;
+	if (!g_file_get_contents(idxfilename.c_str(), get_addr(contents), &size, get_addr(error))) {
+		g_critical(open_read_file_err, idxfilename.c_str(), error->message);
+		return EXIT_FAILURE;
+	}
+	if (size > G_MAXUINT32) {
+		g_critical("Index file %s is too large.", idxfilename.c_str());
+		return EXIT_FAILURE;
+	}
+	/* .syn entries hold an index, .idx entries an offset and a size */
+	const gsize data_size = g_str_has_suffix(idxfilename.c_str(), ".syn")
+		? sizeof(guint32) : 2 * sizeof(guint32);
+	const gchar *p = get_impl(contents);
+	const gchar *end = p + size;
+	entries.clear();
+	while (p < end) {
+		const gchar *key_end = static_cast<const gchar *>(memchr(p, '\0', end - p));
+		if (!key_end || gsize(end - key_end - 1) < data_size) {
+			g_critical("Index file %s is broken, the last entry is incomplete.",
+				idxfilename.c_str());
+			return EXIT_FAILURE;
+		}
+		entries.push_back(p - get_impl(contents));
+		p = key_end + 1 + data_size;
+	}
+	if (entries.empty()) {
+		g_critical("Index file %s is empty.", idxfilename.c_str());
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
+
+/* The ranges of the index the checksum is taken of: the first
+ * INDEX_CACHE_CHECK_SIZE bytes and the last ones, the whole index if it is
+ * small. */
+static void checksum_ranges(guint64 idxfilesize, guint64& first_len,
+	guint64& last_beg)
+{
+	first_len = std::min<guint64>(idxfilesize, INDEX_CACHE_CHECK_SIZE);
+	last_beg = std::max<guint64>(first_len,
+		idxfilesize > INDEX_CACHE_CHECK_SIZE ? idxfilesize - INDEX_CACHE_CHECK_SIZE : 0);
+}
+
+static guint32 index_checksum(const gchar *contents, gsize size)
+{
+	guint64 first_len, last_beg;
+	checksum_ranges(size, first_len, last_beg);
+	guint32 crc = crc32(0L, Z_NULL, 0);
+	crc = crc32(crc, reinterpret_cast<const Bytef *>(contents), first_len);
+	return crc32(crc, reinterpret_cast<const Bytef *>(contents + last_beg), size - last_beg);
+}
+
+/* The same checksum of the index file, reading only the ranges. false if the
+ * file can not be read. */
+static bool index_checksum(const std::string& idxfilename, guint64 idxfilesize,
+	guint32& crc)
+{
+	clib::File file(g_fopen(idxfilename.c_str(), "rb"));
+	if (!file)
+		return false;
+	guint64 first_len, last_beg;
+	checksum_ranges(idxfilesize, first_len, last_beg);
+	const size_t last_len = idxfilesize - last_beg;
+	std::vector<gchar> buf(first_len + last_len);
+	if (buf.empty())
+		return false;
+	if (first_len != fread(&buf[0], 1, first_len, get_impl(file)))
+		return false;
+	if (last_len > 0 && (fseek(get_impl(file), last_beg, SEEK_SET)
+		|| last_len != fread(&buf[first_len], 1, last_len, get_impl(file))))
+		return false;
+	crc = crc32(crc32(0L, Z_NULL, 0), reinterpret_cast<const Bytef *>(&buf[0]), buf.size());
+	return true;
+}
+
+static std::string build_header(const gchar *magic_data, const void *values,
+	guint32 nvalues, CollateFunctions func, guint64 idxfilesize, guint32 idxcrc)
+{
+	const guint32 crc = crc32(crc32(0L, Z_NULL, 0),
+		static_cast<const Bytef *>(values), nvalues * sizeof(guint32));
+	std::string header(magic_data);
+	glib::CharStr str(g_strdup_printf("byteorder=%d\nidxfilesize=%" G_GUINT64_FORMAT "\n"
+		"idxchecksum=%08x\n", G_BYTE_ORDER, idxfilesize, idxcrc));
+	header += get_impl(str);
+	if (func != COLLATE_FUNC_NONE) {
+		str.reset(g_strdup_printf("func=%d\n", func));
+		header += get_impl(str);
+	}
+	str.reset(g_strdup_printf("checksum=%08x\n", crc));
+	header += get_impl(str);
+	return header;
+}
+
+static int write_index_cache(const std::string& filename, const gchar *magic_data,
+	const std::vector<guint32>& values, CollateFunctions func,
+	const glib::CharStr& contents, gsize size)
+{
+	const guint32 nvalues = values.size();
+	const guint32 idxcrc = index_checksum(get_impl(contents), size);
+	const std::string header = build_header(magic_data, &values[0], nvalues, func,
+		size, idxcrc);
+	clib::File file(g_fopen(filename.c_str(), "wb"));
+	if (!file) {
+		g_critical(open_write_file_err, filename.c_str());
+		return EXIT_FAILURE;
+	}
+	if (1 != fwrite(&nvalues, sizeof(guint32), 1, get_impl(file))
+		|| nvalues != fwrite(&values[0], sizeof(guint32), nvalues, get_impl(file))
+		|| 1 != fwrite(header.c_str(), header.length() + 1, 1, get_impl(file))
+		|| fflush(get_impl(file))) {
+		g_critical(write_file_err, filename.c_str());
+		file.reset(NULL);
+		g_remove(filename.c_str());
+		return EXIT_FAILURE;
+	}
+	g_message("Save cache file: %s", filename.c_str());
+	return EXIT_SUCCESS;
+}
+
+int build_oft_file(const std::string& idxfilename)
+{
+	glib::CharStr contents;
+	gsize size;
+	std::vector<guint32> entries;
+	if (load_index(idxfilename, contents, size, entries))
+		return EXIT_FAILURE;
+	/* the offset of the first entry of each page, then the size of the index */
+	std::vector<guint32> values;
+	for (size_t i = 0; i < entries.size(); i += INDEX_CACHE_ENTR_PER_PAGE)
+		values.push_back(entries[i]);
+	values.push_back(size);
+	return write_index_cache(idxfilename + ".oft", INDEX_CACHE_OFT_MAGIC_DATA,
+		values, COLLATE_FUNC_NONE, contents, size);
+}
+
+/* The order of sort_collation_index in stddict.cpp: by the collate function,
+ * then by strcmp, then by the place in the index. */
+struct collate_less_t {
+	collate_less_t(const gchar *contents, const std::vector<guint32>& entries,
+		CollateFunctions func)
+	:
+		contents(contents),
+		entries(entries),
+		func(func)
+	{
+
+	}
+	bool operator()(guint32 left, guint32 right) const
+	{
+		const gchar *str1 = contents + entries[left];
+		const gchar *str2 = contents + entries[right];
+		gint res = utf8_collate(str1, str2, func);
+		if (res == 0)
+			res = strcmp(str1, str2);
+		return res < 0 || (res == 0 && left < right);
+	}
+	const gchar *contents;
+	const std::vector<guint32>& entries;
+	CollateFunctions func;
+};
+
+int build_clt_file(const std::string& idxfilename, CollateFunctions func)
+{
+	if (func < 0 || func >= COLLATE_FUNC_NUMS) {
+		g_critical("Unknown collate function: %d.", func);
+		return EXIT_FAILURE;
+	}
+	glib::CharStr contents;
+	gsize size;
+	std::vector<guint32> entries;
+	if (load_index(idxfilename, contents, size, entries))
+		return EXIT_FAILURE;
+	std::vector<guint32> values(entries.size());
+	for (size_t i = 0; i < values.size(); ++i)
+		values[i] = i;
+	utf8_collate_init(func);
+	std::sort(values.begin(), values.end(), collate_less_t(get_impl(contents), entries, func));
+	utf8_collate_end(func);
+	return write_index_cache(idxfilename + ".clt", INDEX_CACHE_CLT_MAGIC_DATA,
+		values, func, contents, size);
+}
+
+bool is_index_cache(const gchar *header)
+{
+	return g_str_has_prefix(header, INDEX_CACHE_OFT_MAGIC_DATA)
+		|| g_str_has_prefix(header, INDEX_CACHE_CLT_MAGIC_DATA);
+}
+
+bool check_index_cache(const gchar *data, size_t size, guint32 nvalues,
+	CollateFunctions func, const std::string& idxfilename, guint64 idxfilesize)
+{
+	const size_t values_size = (size_t(nvalues) + 1) * sizeof(guint32);
+	if (nvalues == 0 || size <= values_size || data[size - 1] != '\0')
+		return false;
+	guint32 n;
+	memcpy(&n, data, sizeof(guint32));
+	if (n != nvalues)
+		return false;
+	const gchar *values = data + sizeof(guint32);
+	/* the pages of an .oft file follow each other from the start of the index
+	 * to its end */
+	if (func == COLLATE_FUNC_NONE) {
+		guint32 prev = 0;
+		for (guint32 i = 0; i < nvalues; ++i) {
+			guint32 offset;
+			memcpy(&offset, values + i * sizeof(guint32), sizeof(guint32));
+			if (i == 0 ? offset != 0 : offset <= prev)
+				return false;
+			prev = offset;
+		}
+		if (prev != idxfilesize)
+			return false;
+	}
+	const gchar *header = data + values_size;
+	if (strlen(header) + 1 != size - values_size)
+		return false;
+	const gchar *magic_data = func == COLLATE_FUNC_NONE
+		? INDEX_CACHE_OFT_MAGIC_DATA : INDEX_CACHE_CLT_MAGIC_DATA;
+	/* the ends of the index are read only for a file that passed the checks
+	 * above, the rest of it is not read */
+	guint32 idxcrc;
+	if (!index_checksum(idxfilename, idxfilesize, idxcrc))
+		return false;
+	return build_header(magic_data, values, nvalues, func, idxfilesize, idxcrc) == header;
+}
@@ -0,0 +1,79 @@
+/*
+ * This file is part of StarDict.
+ *
+ * StarDict is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * StarDict is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with StarDict.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIB_INDEX_CACHE_H_
+#define LIB_INDEX_CACHE_H_
+
+#include <glib.h>
+#include <string>
+#include "collation.h"
+
+/* .oft and .clt files made together with the dictionary.
+ *
+ * The first time StarDict opens an index (.idx or .syn) it scans the whole
+ * file to find the offsets of the index pages and saves them in an .oft
+ * file. If collation is on, it sorts the whole index with the collate
+ * function and saves the order in a .clt file. See cache_file in
+ * dict/src/lib/stddict.h. The files made here spare that work, StarDict
+ * loads them as they are.
+ *
+ * The layout is that of the cache files StarDict saves:
+ * guint32 n, n guint32 values, a text header ending with '\0'.
+ * The header of a saved cache names the index file and the cache is
+ * trusted if it is newer than the index. The files made here do not name
+ * the index, so the dictionary may be moved or installed anywhere, and
+ * file times do not matter. The checksum of the ends of the index tells a
+ * rebuilt index of the same size from the one the files were made for in
+ * most cases, without reading the whole index each time StarDict starts.
+ * Their header is:
+ *
+ * StarDict's oft file (or clt file)
+ * version=4.0.0
+ * byteorder=1234 (G_BYTE_ORDER of the values)
+ * idxfilesize=size of the index file
+ * idxchecksum=crc32 of the first and the last INDEX_CACHE_CHECK_SIZE bytes
+ *   of the index file (of the whole file if it is smaller), 8 hex digits
+ * func=N (.clt only, the collate function)
+ * checksum=crc32 of the values, 8 hex digits
+ *
+ * Old versions of StarDict do not know the header and ignore the file. */
+
+#define INDEX_CACHE_OFT_MAGIC_DATA "StarDict's oft file\nversion=4.0.0\n"
+#define INDEX_CACHE_CLT_MAGIC_DATA "StarDict's clt file\nversion=4.0.0\n"
+
+/* index entries on a page of an .oft file, ENTR_PER_PAGE in stddict.cpp */
+const guint32 INDEX_CACHE_ENTR_PER_PAGE = 32;
+/* the size of each end of the index the checksum is taken of */
+const guint32 INDEX_CACHE_CHECK_SIZE = 4096;
+
+/* Write idxfilename.oft. idxfilename is an .idx or a .syn file. */
+int build_oft_file(const std::string& idxfilename);
+/* Write idxfilename.clt, the order of the index in the func collate function. */
+int build_clt_file(const std::string& idxfilename, CollateFunctions func);
+
+/* true if header is the header of a file made by the functions above */
+bool is_index_cache(const gchar *header);
+/* Check a file made by the functions above.
+ * data, size - the contents of the file,
+ * nvalues - the number of values the file must hold,
+ * func - COLLATE_FUNC_NONE for an .oft file,
+ * idxfilename, idxfilesize - the index file and its size.
+ * Only the ends of the index are read to check its checksum. */
+bool check_index_cache(const gchar *data, size_t size, guint32 nvalues,
+	CollateFunctions func, const std::string& idxfilename, guint64 idxfilesize);
+
+#endif /* LIB_INDEX_CACHE_H_ */
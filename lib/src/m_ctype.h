@@ -20,6 +20,22 @@
 #ifndef _m_ctype_h
 #define _m_ctype_h
 
+#include <cstring>
+
+#ifdef _WIN32
+#define bzero(p, l) memset(p, 0, l)
+#endif
+
+typedef unsigned int uint;
+typedef unsigned short  uint16; /* Short for unsigned integer >= 16 bits */
+typedef unsigned long   ulong;            /* Short for unsigned long */
+typedef unsigned long long int ulonglong; /* ulong or unsigned long long */
+typedef long long int   longlong;
+typedef char    pchar;          /* Mixed prototypes can take char */
+typedef char    pbool;          /* Mixed prototypes can take char */
+typedef unsigned char   uchar;  /* Short for unsigned char */
+typedef char            my_bool; /* Small bool */
+
 namespace stardict_collation {
 
 #define my_wc_t ulong
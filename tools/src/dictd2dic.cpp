@@ -28,6 +28,7 @@
 
 #include <gtk/gtk.h>
 #include <glib.h>
+#include "lib_dictzip.h"
 
 #define DICTD_WEBSITE "www.dict.org"
 //#define DICTD_WEBSITE "www.freedict.de"
@@ -325,13 +326,8 @@ void convert(char *basefilename)
 	fprintf(ifofile, "StarDict's dict ifo file\nversion=2.4.2\nwordcount=%ld\nidxfilesize=%ld\nbookname=%s\nsametypesequence=m\n", wordcount, stats.st_size, basefilename);
 	fclose(ifofile);
 
-	gchar command[256];
-	sprintf(command, "dictzip dictd_" DICTD_WEBSITE "_%s.dict", basefilename);
-	int result;
-	result = system(command);
-	if (result == -1) {
-		g_print("system() error!\n");
-	}
+	if (dictzip_file(std::string("dictd_" DICTD_WEBSITE "_") + basefilename + ".dict"))
+		exit(EXIT_FAILURE);
 }
 
 int
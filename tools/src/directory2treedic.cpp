@@ -36,6 +36,7 @@
 #include <gtk/gtk.h>
 
 #include <string>
+#include "lib_dictzip.h"
 
 
 typedef struct MyDir{
@@ -256,11 +257,8 @@ void convert(char *dirname)
 	if (result == -1) {
 		g_print("system() error!\n");
 	}
-	sprintf(command, "dictzip %s.dict -f", dirname);
-	result = system(command);
-	if (result == -1) {
-		g_print("system() error!\n");
-	}
+	if (dictzip_file(std::string(dirname) + ".dict"))
+		exit(EXIT_FAILURE);
 }
 
 int
@@ -24,6 +24,7 @@
 
 #include <gtk/gtk.h>
 #include <glib.h>
+#include "lib_dictzip.h"
 
 struct _worditem
 {
@@ -221,13 +222,8 @@ void convert(char *filename)
 	fclose(idxfile);
 	fclose(dicfile);
 
-	gchar command[256];
-        sprintf(command, "dictzip %s.dict", basefilename);
-	int result;
-        result = system(command);
-	if (result == -1) {
-		g_print("system() error!\n");
-	}
+	if (dictzip_file(std::string(basefilename) + ".dict"))
+		exit(EXIT_FAILURE);
 
 	g_free(basefilename);
 }
@@ -26,6 +26,7 @@
 
 #include <list>
 #include <string>
+#include "lib_dictzip.h"
 
 struct _worditem
 {
@@ -416,13 +417,8 @@ void builddata(gchar *datafilename, glong &wordcount, glong &idxfilesize, glong
 	g_array_free(array,TRUE);
 	g_array_free(array2,TRUE);
 
-	gchar command[256];
-	sprintf(command, "dictzip %s", dicfilename);
-	int result;
-	result = system(command);
-	if (result == -1) {
-		g_print("system() error!\n");
-	}
+	if (dictzip_file(dicfilename))
+		exit(EXIT_FAILURE);
 }
 
 void buildifo(gchar *xmlfilename, glong wordcount, glong idxfilesize, glong synwordcount)
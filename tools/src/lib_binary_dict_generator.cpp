@@ -20,32 +20,17 @@
 #endif
 
 #include <cstring>
-#include <algorithm>
 #include "lib_binary_dict_generator.h"
 #include "lib_dict_verify.h"
-
-struct synitem_t {
-	synitem_t(const std::string& synonym, size_t index)
-	:
-		synonym(synonym),
-		index(index)
-	{
-
-	}
-	std::string synonym;
-	size_t index;
-};
-
-static bool compare_synitems_by_synonym(const synitem_t& left, const synitem_t& right)
-{
-	return 0 > stardict_strcmp(left.synonym.c_str(), right.synonym.c_str());
-}
+#include "lib_index_cache.h"
 
 binary_dict_gen_t::binary_dict_gen_t(void)
 :
 	norm_dict(NULL),
 	use_same_type_sequence(true),
-	compress_dict(true)
+	compress_dict(true),
+	cache_files(false),
+	collate_func(COLLATE_FUNC_NONE)
 {
 
 }
@@ -60,21 +45,15 @@ int binary_dict_gen_t::generate(const std::string& ifofilename, common_dict_t *n
 		return EXIT_FAILURE;
 	}
 	basefilename.assign(ifofilename, 0, ifofilename.length() - (sizeof(".ifo")-1));
-	decide_on_same_type_sequence();
+	syn_sorter.set_max_memory(norm_dict->get_max_memory());
+	if(decide_on_same_type_sequence())
+		return EXIT_FAILURE;
 	if(generate_dict_and_idx())
 		return EXIT_FAILURE;
-#ifndef _WIN32
-	if(compress_dict) {
-		std::string command(std::string("dictzip ") + dictfilename);
-		int result;
-		result = system(command.c_str());
-		if (result == -1) {
-			g_print("system() error!\n");
-		}
-	}
-#endif
 	if(generate_syn())
 		return EXIT_FAILURE;
+	if(generate_cache())
+		return EXIT_FAILURE;
 	norm_dict->dict_info.ifo_file_name = ifofilename;
 	norm_dict->dict_info.set_infotype(DictInfoType_NormDict);
 	if(!norm_dict->dict_info.save_ifo_file())
@@ -93,17 +72,27 @@ void binary_dict_gen_t::clear(void)
 	dictfile.reset(NULL);
 	idxfile.reset(NULL);
 	synfile.reset(NULL);
+	syn_sorter.clear();
 }
 
+/* The synonyms are collected in syn_sorter on the way. */
 int binary_dict_gen_t::generate_dict_and_idx(void)
 {
 	if(prepare_dict())
 		return EXIT_FAILURE;
 	if(prepare_idx())
 		return EXIT_FAILURE;
-	for(size_t i=0; i<norm_dict->articles.size(); ++i) {
-		const article_data_t& article = norm_dict->articles[i];
-		const guint32 offset = ftell(get_impl(dictfile));
+	if(norm_dict->rewind_articles())
+		return EXIT_FAILURE;
+	article_data_t article;
+	guint32 index = 0;
+	while(true) {
+		bool eof;
+		if(norm_dict->read_article(article, eof))
+			return EXIT_FAILURE;
+		if(eof)
+			break;
+		const guint32 offset = tell_dict();
 		for(size_t j=0; j<article.definitions.size(); ++j) {
 			if(same_type_sequence.empty()) {
 				if(generate_dict_definition(article.definitions[j], article.key))
@@ -114,13 +103,20 @@ int binary_dict_gen_t::generate_dict_and_idx(void)
 					return EXIT_FAILURE;
 			}
 		}
-		const guint32 size = ftell(get_impl(dictfile)) - offset;
+		const guint32 size = tell_dict() - offset;
 		if(generate_index_item(article.key, offset, size))
 			return EXIT_FAILURE;
+		const guint32 index_be = g_htonl(index);
+		for(size_t j=0; j<article.synonyms.size(); ++j)
+			if(syn_sorter.add(article.synonyms[j], reinterpret_cast<const char*>(&index_be),
+					sizeof(index_be)))
+				return EXIT_FAILURE;
+		++index;
 	}
-	norm_dict->dict_info.set_wordcount(norm_dict->articles.size());
+	norm_dict->dict_info.set_wordcount(index);
 	norm_dict->dict_info.set_index_file_size(ftell(get_impl(idxfile)));
-	dictfile.reset(NULL);
+	if(close_dict())
+		return EXIT_FAILURE;
 	idxfile.reset(NULL);
 	return EXIT_SUCCESS;
 }
@@ -128,37 +124,59 @@ int binary_dict_gen_t::generate_dict_and_idx(void)
 int binary_dict_gen_t::generate_syn(void)
 {
 	norm_dict->dict_info.unset_synwordcount();
-	std::vector<synitem_t> synonyms;
-	for(size_t i=0; i<norm_dict->articles.size(); ++i) {
-		const article_data_t& article = norm_dict->articles[i];
-		for(size_t j=0; j<article.synonyms.size(); ++j) {
-			synonyms.push_back(synitem_t(article.synonyms[j], i));
-		}
-	}
-	if(synonyms.empty())
+	if(syn_sorter.size() == 0)
 		return EXIT_SUCCESS;
-	std::sort(synonyms.begin(), synonyms.end(), compare_synitems_by_synonym);
+	if(syn_sorter.sort())
+		return EXIT_FAILURE;
 	if(prepare_syn())
 		return EXIT_SUCCESS;
-	std::vector<char> buf;
-	for(size_t i=0; i<synonyms.size(); ++i) {
-		const size_t len = synonyms[i].synonym.length();
-		buf.resize(len + 1 + sizeof(guint32));
-		memcpy(&buf[0], synonyms[i].synonym.c_str(), len+1);
-		*reinterpret_cast<guint32*>(&buf[len+1]) = g_htonl(static_cast<guint32>(synonyms[i].index));
-		if(1 != fwrite(&buf[0], buf.size(), 1, get_impl(synfile))) {
+	std::string synonym, index_be;
+	while(true) {
+		bool eof;
+		if(syn_sorter.read(synonym, index_be, eof))
+			return EXIT_FAILURE;
+		if(eof)
+			break;
+		synonym += '\0';
+		synonym += index_be;
+		if(1 != fwrite(synonym.data(), synonym.length(), 1, get_impl(synfile))) {
 			g_critical(write_file_err, synfilename.c_str());
 			return EXIT_FAILURE;
 		}
 	}
-	norm_dict->dict_info.set_synwordcount(synonyms.size());
+	norm_dict->dict_info.set_synwordcount(syn_sorter.size());
 	synfile.reset(NULL);
+	syn_sorter.clear();
 	return EXIT_SUCCESS;
 }
 
+/* The .oft and .clt files spare StarDict the scan and the sort of the index
+ * the first time the dictionary is opened. */
+int binary_dict_gen_t::generate_cache(void)
+{
+	if(!cache_files)
+		return EXIT_SUCCESS;
+	std::vector<std::string> filenames;
+	filenames.push_back(idxfilename);
+	if(norm_dict->dict_info.is_synwordcount())
+		filenames.push_back(synfilename);
+	for(size_t i=0; i<filenames.size(); ++i) {
+		if(build_oft_file(filenames[i]))
+			return EXIT_FAILURE;
+		if(collate_func != COLLATE_FUNC_NONE && build_clt_file(filenames[i], collate_func))
+			return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
+
+/* The .dict.dz file is written directly if compress_dict. */
 int binary_dict_gen_t::prepare_dict(void)
 {
 	dictfilename = basefilename + ".dict";
+	if(compress_dict) {
+		dictfilename += ".dz";
+		return dictzwriter.open(dictfilename);
+	}
 	dictfile.reset(g_fopen(dictfilename.c_str(), "wb"));
 	if(!dictfile) {
 		g_critical(open_write_file_err, dictfilename.c_str());
@@ -167,6 +185,32 @@ int binary_dict_gen_t::prepare_dict(void)
 	return EXIT_SUCCESS;
 }
 
+int binary_dict_gen_t::write_dict(const void *data, size_t size)
+{
+	if(compress_dict)
+		return dictzwriter.write(data, size);
+	if(1 != fwrite(data, size, 1, get_impl(dictfile))) {
+		g_critical(write_file_err, dictfilename.c_str());
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
+
+guint32 binary_dict_gen_t::tell_dict(void) const
+{
+	if(compress_dict)
+		return dictzwriter.tell();
+	return ftell(get_impl(dictfile));
+}
+
+int binary_dict_gen_t::close_dict(void)
+{
+	if(compress_dict)
+		return dictzwriter.close();
+	dictfile.reset(NULL);
+	return EXIT_SUCCESS;
+}
+
 int binary_dict_gen_t::prepare_idx(void)
 {
 	idxfilename = basefilename + ".idx";
@@ -204,10 +248,8 @@ int binary_dict_gen_t::generate_dict_definition(const article_def_t& def, const
 				return EXIT_FAILURE;
 			}
 			buf.back() = '\0';
-			if(1 != fwrite(&buf[0], buf.size(), 1, get_impl(dictfile))) {
-				g_critical(write_file_err, dictfilename.c_str());
+			if(write_dict(&buf[0], buf.size()))
 				return EXIT_FAILURE;
-			}
 		}
 	} else if(g_ascii_isupper(type_id)) {
 		std::vector<char> buf;
@@ -217,10 +259,8 @@ int binary_dict_gen_t::generate_dict_definition(const article_def_t& def, const
 		if(norm_dict->read_data(&buf[1 + sizeof(guint32)], def.size, def.offset)) {
 			return EXIT_FAILURE;
 		}
-		if(1 != fwrite(&buf[0], buf.size(), 1, get_impl(dictfile))) {
-			g_critical(write_file_err, dictfilename.c_str());
+		if(write_dict(&buf[0], buf.size()))
 			return EXIT_FAILURE;
-		}
 	} else {
 		g_critical(unknown_type_id_err, key.c_str(), type_id);
 		return EXIT_FAILURE;
@@ -246,10 +286,8 @@ int binary_dict_gen_t::generate_dict_definition_sts(const article_def_t& def,
 			}
 			if(!last)
 				buf.back() = '\0';
-			if(1 != fwrite(&buf[0], buf.size(), 1, get_impl(dictfile))) {
-				g_critical(write_file_err, dictfilename.c_str());
+			if(write_dict(&buf[0], buf.size()))
 				return EXIT_FAILURE;
-			}
 		}
 	} else if(g_ascii_isupper(type_id)) {
 		std::vector<char> buf;
@@ -259,10 +297,8 @@ int binary_dict_gen_t::generate_dict_definition_sts(const article_def_t& def,
 		if(norm_dict->read_data(&buf[(last ? 0 : sizeof(guint32))], def.size, def.offset)) {
 			return EXIT_FAILURE;
 		}
-		if(1 != fwrite(&buf[0], buf.size(), 1, get_impl(dictfile))) {
-			g_critical(write_file_err, dictfilename.c_str());
+		if(write_dict(&buf[0], buf.size()))
 			return EXIT_FAILURE;
-		}
 	} else {
 		g_critical(unknown_type_id_err, key.c_str(), type_id);
 		return EXIT_FAILURE;
@@ -282,10 +318,8 @@ int binary_dict_gen_t::generate_dict_definition_r(const resource_vect_t& resourc
 		str += ':';
 		str += resources[i].key;
 	}
-	if(1 != fwrite(str.c_str(), str.length() + 1, 1, get_impl(dictfile))) {
-		g_critical(write_file_err, dictfilename.c_str());
+	if(write_dict(str.c_str(), str.length() + 1))
 		return EXIT_FAILURE;
-	}
 	return EXIT_SUCCESS;
 }
 
@@ -303,10 +337,8 @@ int binary_dict_gen_t::generate_dict_definition_r_sts(const resource_vect_t& res
 		str += ':';
 		str += resources[i].key;
 	}
-	if(1 != fwrite(str.c_str(), str.length() + (last ? 0 : 1), 1, get_impl(dictfile))) {
-		g_critical(write_file_err, dictfilename.c_str());
+	if(write_dict(str.c_str(), str.length() + (last ? 0 : 1)))
 		return EXIT_FAILURE;
-	}
 	return EXIT_SUCCESS;
 }
 
@@ -327,30 +359,42 @@ int binary_dict_gen_t::generate_index_item(const std::string& key, guint32 offse
 
 /* Decide on whether the same type sequence can be used.
  * Set same_type_sequence and norm_dict->dict_info.*_sametypesequence options. */
-void binary_dict_gen_t::decide_on_same_type_sequence(void)
+int binary_dict_gen_t::decide_on_same_type_sequence(void)
 {
 	norm_dict->dict_info.unset_sametypesequence();
 	same_type_sequence.clear();
 	if(!use_same_type_sequence)
-		return;
-	if(norm_dict->articles.empty())
-		return;
-	const std::string seq1 = build_type_sequence(norm_dict->articles[0]);
+		return EXIT_SUCCESS;
+	if(norm_dict->rewind_articles())
+		return EXIT_FAILURE;
+	article_data_t article;
+	bool eof;
+	if(norm_dict->read_article(article, eof))
+		return EXIT_FAILURE;
+	if(eof)
+		return EXIT_SUCCESS;
+	const std::string key1 = article.key;
+	const std::string seq1 = build_type_sequence(article);
 	std::string seq2;
-	for(size_t i=1; i<norm_dict->articles.size(); ++i) {
-		seq2 = build_type_sequence(norm_dict->articles[i]);
+	while(true) {
+		if(norm_dict->read_article(article, eof))
+			return EXIT_FAILURE;
+		if(eof)
+			break;
+		seq2 = build_type_sequence(article);
 		if(seq1 != seq2) {
 			g_message("Can not use same type sequence. "
 				"Article '%s' needs type sequence '%s', "
 				"while article '%s' needs type sequence '%s'.",
-				norm_dict->articles[0].key.c_str(), seq1.c_str(),
-				norm_dict->articles[i].key.c_str(), seq2.c_str());
-			return;
+				key1.c_str(), seq1.c_str(),
+				article.key.c_str(), seq2.c_str());
+			return EXIT_SUCCESS;
 		}
 	}
 	same_type_sequence = seq1;
 	norm_dict->dict_info.set_sametypesequence(seq1);
 	g_message("Using same type sequence '%s'.", same_type_sequence.c_str());
+	return EXIT_SUCCESS;
 }
 
 std::string binary_dict_gen_t::build_type_sequence(const article_data_t& article) const
@@ -22,6 +22,9 @@
 #include <glib.h>
 #include "lib_common_dict.h"
 #include "libcommon.h"
+#include "lib_dictzip.h"
+#include "lib_ext_sort.h"
+#include "collation.h"
 
 /* generate binary normal dictionary */
 class binary_dict_gen_t
@@ -38,10 +41,24 @@ public:
 	{
 		compress_dict = b;
 	}
+	/* write .oft files for the index and the synonyms, see lib_index_cache.h */
+	void set_cache_files(bool b)
+	{
+		cache_files = b;
+	}
+	/* with cache_files, write .clt files for the collate function too */
+	void set_collate_func(CollateFunctions func)
+	{
+		collate_func = func;
+	}
 private:
 	int generate_dict_and_idx(void);
 	int generate_syn(void);
+	int generate_cache(void);
 	int prepare_dict(void);
+	int write_dict(const void *data, size_t size);
+	guint32 tell_dict(void) const;
+	int close_dict(void);
 	int prepare_idx(void);
 	int prepare_syn(void);
 	int generate_dict_definition(const article_def_t& def, const std::string& key);
@@ -49,7 +66,7 @@ private:
 	int generate_dict_definition_r(const resource_vect_t& resources, const std::string& key);
 	int generate_dict_definition_r_sts(const resource_vect_t& resources, const std::string& key, bool last);
 	int generate_index_item(const std::string& key, guint32 offset, guint32 size);
-	void decide_on_same_type_sequence(void);
+	int decide_on_same_type_sequence(void);
 	std::string build_type_sequence(const article_data_t& article) const;
 	common_dict_t *norm_dict;
 	std::string basefilename;
@@ -58,6 +75,7 @@ private:
 	std::string idxfilename;
 	std::string synfilename;
 	clib::File dictfile;
+	dictzip_writer_t dictzwriter;
 	clib::File idxfile;
 	clib::File synfile;
 	/* use same_type_sequence if possible */
@@ -66,8 +84,12 @@ private:
 	 * this string contains the sequence of types to use.
 	 * Otherwise this is an empty string. */
 	std::string same_type_sequence;
-	/* run dictzip on the generated file if enabled */
+	/* write .dict.dz instead of .dict */
 	bool compress_dict;
+	/* synonyms with the big endian index of their article */
+	ext_sorter_t syn_sorter;
+	bool cache_files;
+	CollateFunctions collate_func;
 };
 
 #endif
@@ -75,9 +75,118 @@ int article_data_t::add_definition(const article_def_t& def)
 	return EXIT_SUCCESS;
 }
 
+static bool compare_article_data_by_key(const article_data_t& left, const article_data_t& right)
+{
+	return 0 > stardict_strcmp(left.key.c_str(), right.key.c_str());
+}
+
+static void put_uint32(std::string& buf, guint32 val)
+{
+	buf.append(reinterpret_cast<const char*>(&val), sizeof(val));
+}
+
+static void put_string(std::string& buf, const std::string& str)
+{
+	put_uint32(buf, str.length());
+	buf += str;
+}
+
+static bool get_uint32(const std::string& buf, size_t& pos, guint32& val)
+{
+	if(pos + sizeof(val) > buf.length())
+		return false;
+	memcpy(&val, buf.data() + pos, sizeof(val));
+	pos += sizeof(val);
+	return true;
+}
+
+static bool get_string(const std::string& buf, size_t& pos, std::string& str)
+{
+	guint32 len;
+	if(!get_uint32(buf, pos, len) || pos + len > buf.length())
+		return false;
+	str.assign(buf, pos, len);
+	pos += len;
+	return true;
+}
+
+/* An article in article_sorter: the key is the sort key, the data is the
+ * synonyms and the definitions, each list begins with the number of
+ * items. */
+static void serialize_article(const article_data_t& article, std::string& buf)
+{
+	buf.clear();
+	put_uint32(buf, article.synonyms.size());
+	for(size_t i=0; i<article.synonyms.size(); ++i)
+		put_string(buf, article.synonyms[i]);
+	put_uint32(buf, article.definitions.size());
+	for(size_t i=0; i<article.definitions.size(); ++i) {
+		const article_def_t& def = article.definitions[i];
+		buf += def.type;
+		if(def.type == 'r') {
+			put_uint32(buf, def.resources.size());
+			for(size_t j=0; j<def.resources.size(); ++j) {
+				put_string(buf, def.resources[j].type);
+				put_string(buf, def.resources[j].key);
+			}
+		} else {
+			const guint64 offset = def.offset, size = def.size;
+			buf.append(reinterpret_cast<const char*>(&offset), sizeof(offset));
+			buf.append(reinterpret_cast<const char*>(&size), sizeof(size));
+		}
+	}
+}
+
+static bool deserialize_article(const std::string& buf, article_data_t& article)
+{
+	size_t pos = 0;
+	guint32 count;
+	article.synonyms.clear();
+	article.definitions.clear();
+	if(!get_uint32(buf, pos, count))
+		return false;
+	article.synonyms.resize(count);
+	for(size_t i=0; i<count; ++i)
+		if(!get_string(buf, pos, article.synonyms[i]))
+			return false;
+	if(!get_uint32(buf, pos, count))
+		return false;
+	article.definitions.resize(count);
+	for(size_t i=0; i<count; ++i) {
+		article_def_t& def = article.definitions[i];
+		if(pos >= buf.length())
+			return false;
+		def.type = buf[pos++];
+		if(def.type == 'r') {
+			guint32 res_count;
+			if(!get_uint32(buf, pos, res_count))
+				return false;
+			for(size_t j=0; j<res_count; ++j) {
+				std::string type, key;
+				if(!get_string(buf, pos, type) || !get_string(buf, pos, key))
+					return false;
+				def.resources.push_back(resource_t(type, key));
+			}
+		} else {
+			guint64 offset, size;
+			if(pos + sizeof(offset) + sizeof(size) > buf.length())
+				return false;
+			memcpy(&offset, buf.data() + pos, sizeof(offset));
+			pos += sizeof(offset);
+			memcpy(&size, buf.data() + pos, sizeof(size));
+			pos += sizeof(size);
+			def.offset = offset;
+			def.size = size;
+		}
+	}
+	return pos == buf.length();
+}
+
 common_dict_t::common_dict_t(void)
 :
-	lot_of_memory(false)
+	lot_of_memory(false),
+	max_memory(0),
+	cur_article(0)
 {
 
 }
@@ -87,6 +196,13 @@ common_dict_t::common_dict_t(void)
 int common_dict_t::reset(void)
 {
 	articles.clear();
+	cur_article = 0;
+	if(max_memory) {
+		article_sorter.reset(new ext_sorter_t);
+		article_sorter->set_max_memory(max_memory);
+	} else {
+		article_sorter.reset(NULL);
+	}
 	// First close the previous temporary file, otherwise we'll cannot remove it.
 	contents_file.reset(NULL);
 	contents_file_name.clear();
@@ -164,6 +280,94 @@ int common_dict_t::read_data(char* data, size_t size, size_t offset)
 
 int common_dict_t::add_article(const article_data_t& article)
 {
+	if(article_sorter.get()) {
+		std::string buf;
+		serialize_article(article, buf);
+		return article_sorter->add(article.key, buf.data(), buf.length());
+	}
 	articles.push_back(article);
 	return EXIT_SUCCESS;
 }
+
+size_t common_dict_t::get_article_count(void) const
+{
+	if(article_sorter.get())
+		return article_sorter->size();
+	return articles.size();
+}
+
+/* The articles in temporary files are read and added to a new sorter,
+ * func may change the keys. */
+int common_dict_t::update_articles(article_func_t func)
+{
+	if(!article_sorter.get()) {
+		size_t j = 0;
+		for(size_t i=0; i<articles.size(); ++i) {
+			if(func(articles[i], *this))
+				return EXIT_FAILURE;
+			if(articles[i].key.empty())
+				continue;
+			if(i != j)
+				std::swap(articles[i], articles[j]);
+			++j;
+		}
+		articles.resize(j);
+		return EXIT_SUCCESS;
+	}
+	std::auto_ptr<ext_sorter_t> new_sorter(new ext_sorter_t);
+	new_sorter->set_max_memory(max_memory);
+	if(rewind_articles())
+		return EXIT_FAILURE;
+	article_data_t article;
+	std::string buf;
+	while(true) {
+		bool eof;
+		if(read_article(article, eof))
+			return EXIT_FAILURE;
+		if(eof)
+			break;
+		if(func(article, *this))
+			return EXIT_FAILURE;
+		if(article.key.empty())
+			continue;
+		serialize_article(article, buf);
+		if(new_sorter->add(article.key, buf.data(), buf.length()))
+			return EXIT_FAILURE;
+	}
+	article_sorter = new_sorter;
+	return EXIT_SUCCESS;
+}
+
+int common_dict_t::sort_articles(void)
+{
+	/* article_sorter returns the articles sorted */
+	if(!article_sorter.get())
+		std::stable_sort(articles.begin(), articles.end(), compare_article_data_by_key);
+	return EXIT_SUCCESS;
+}
+
+int common_dict_t::rewind_articles(void)
+{
+	cur_article = 0;
+	if(article_sorter.get())
+		return article_sorter->sort();
+	return EXIT_SUCCESS;
+}
+
+int common_dict_t::read_article(article_data_t& article, bool& eof)
+{
+	if(!article_sorter.get()) {
+		eof = cur_article >= articles.size();
+		if(!eof)
+			article = articles[cur_article++];
+		return EXIT_SUCCESS;
+	}
+	std::string buf;
+	if(article_sorter->read(article.key, buf, eof))
+		return EXIT_FAILURE;
+	if(!eof && !deserialize_article(buf, article)) {
+		g_critical("Article %s is corrupted in the temporary file.", article.key.c_str());
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
@@ -23,9 +23,11 @@
 
 #include <string>
 #include <vector>
+#include <memory>
 #include <cstdlib>
 #include "libcommon.h"
 #include "ifo_file.h"
+#include "lib_ext_sort.h"
 
 struct resource_t
 {
@@ -98,17 +100,42 @@ struct article_data_t
 class common_dict_t
 {
 public:
+	typedef int (*article_func_t)(article_data_t& article, common_dict_t& norm_dict);
+
 	common_dict_t(void);
+	/* Empty if max_memory is set, use read_article(). */
 	std::vector<article_data_t> articles;
 	DictInfo dict_info;
 	int reset(void);
 	int write_data(const char* data, size_t size, size_t& offset);
 	int read_data(char* data, size_t size, size_t offset);
 	int add_article(const article_data_t& article);
+	size_t get_article_count(void) const;
+	/* Call func for each article, func may change the article.
+	 * Articles with an empty key are removed. */
+	int update_articles(article_func_t func);
+	/* Sort articles by key. */
+	int sort_articles(void);
+	/* Read articles one by one from the first one.
+	 * eof is set after the last article. */
+	int rewind_articles(void);
+	int read_article(article_data_t& article, bool& eof);
 	void set_lot_of_memory(bool b)
 	{
 		lot_of_memory = b;
 	}
+	/* Keep no more than max_memory bytes of articles in memory, the rest
+	 * is sorted in temporary files. The articles are always read sorted
+	 * then. 0 - keep all articles in the articles vector.
+	 * Takes effect on reset(). */
+	void set_max_memory(size_t max_memory)
+	{
+		this->max_memory = max_memory;
+	}
+	size_t get_max_memory(void) const
+	{
+		return max_memory;
+	}
 private:
 	TempFile contents_file_creator;
 	std::string contents_file_name;
@@ -116,6 +143,11 @@ private:
 	/* Then true, do not use temporary file, store data in memory. */
 	bool lot_of_memory;
 	std::vector<char> data_store;
+	size_t max_memory;
+	/* articles if max_memory is set */
+	std::auto_ptr<ext_sorter_t> article_sorter;
+	/* the next article to read from articles */
+	size_t cur_article;
 };
 
 #endif /* LIB_COMMON_DICT_H_ */
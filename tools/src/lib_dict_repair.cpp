@@ -24,11 +24,6 @@
 #include "lib_dict_repair.h"
 #include "lib_chars.h"
 
-static bool compare_article_data_by_key(const article_data_t& left, const article_data_t& right)
-{
-	return 0 > stardict_strcmp(left.key.c_str(), right.key.c_str());
-}
-
 static void repair_text_data(std::string& text)
 {
 	if(!g_utf8_validate(text.c_str(), -1, NULL)) {
@@ -151,21 +146,14 @@ static int repair_article(article_data_t& article, common_dict_t& norm_dict)
 
 int repair_dict(common_dict_t& norm_dict)
 {
-	for(std::vector<article_data_t>::iterator it=norm_dict.articles.begin(); it!=norm_dict.articles.end(); ++it)
-		if(repair_article(*it, norm_dict))
-			return EXIT_FAILURE;
-	std::sort(norm_dict.articles.begin(), norm_dict.articles.end(), compare_article_data_by_key);
-	// remove empty articles
-	article_data_t empty_article;
-	typedef std::vector<article_data_t>::iterator article_iter_t;
-	std::pair<article_iter_t, article_iter_t> range
-		= std::equal_range(norm_dict.articles.begin(), norm_dict.articles.end(), empty_article,
-			compare_article_data_by_key);
-	norm_dict.articles.erase(range.first, range.second);
-	if(norm_dict.articles.empty()) {
+	if(norm_dict.update_articles(repair_article))
+		return EXIT_FAILURE;
+	if(norm_dict.sort_articles())
+		return EXIT_FAILURE;
+	if(norm_dict.get_article_count() == 0) {
 		g_critical("Dictionary contains no articles");
 		return EXIT_FAILURE;
 	}
-	norm_dict.dict_info.set_wordcount(norm_dict.articles.size());
+	norm_dict.dict_info.set_wordcount(norm_dict.get_article_count());
 	return EXIT_SUCCESS;
 }
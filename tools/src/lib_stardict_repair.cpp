@@ -175,6 +175,7 @@ int stardict_repair(const std::string& ifofilepath, const std::string& outdirpat
 	g_message("Checking and repairing the dictionary...");
 	common_dict_t norm_dict;
 	norm_dict.set_lot_of_memory(options.lot_of_memory);
+	norm_dict.set_max_memory(options.max_memory);
 	if(convert_to_parsed_dict(norm_dict, parser))
 		return EXIT_FAILURE;
 	if(repair_dict(norm_dict))
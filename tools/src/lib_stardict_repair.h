@@ -25,6 +25,8 @@ struct RepairOptions
 	bool lot_of_memory;
 	bool compress_dict;
 	bool copy_res_store;
+	/* see common_dict_t::set_max_memory */
+	size_t max_memory;
 };
 
 int stardict_repair(const std::string& ifofilepath, const std::string& outdirpath,
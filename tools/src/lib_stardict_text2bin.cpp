@@ -31,9 +31,11 @@
 #include "lib_dict_repair.h"
 
 int stardict_text2bin(const std::string& xmlfilename, const std::string& ifofilename,
-		bool show_xincludes, bool use_same_type_sequence)
+		bool show_xincludes, bool use_same_type_sequence, size_t max_memory,
+		bool cache_files, CollateFunctions collate_func)
 {
 	common_dict_t norm_dict;
+	norm_dict.set_max_memory(max_memory);
 	if(parse_textual_dict(xmlfilename, &norm_dict,
 			show_xincludes))
 		return EXIT_FAILURE;
@@ -42,6 +44,8 @@ int stardict_text2bin(const std::string& xmlfilename, const std::string& ifofile
 	binary_dict_gen_t generator;
 	generator.set_use_same_type_sequence(use_same_type_sequence);
 	generator.set_compress_dict(true);
+	generator.set_cache_files(cache_files);
+	generator.set_collate_func(collate_func);
 	g_message("Generating dictionary '%s'...", ifofilename.c_str());
 	if(generator.generate(ifofilename, &norm_dict)) {
 		g_critical("Generation failed.");
@@ -19,8 +19,12 @@
 #define LIB_STARDICT_TEXT2BIN_H_
 
 #include <string>
+#include "lib_ext_sort.h"
+#include "collation.h"
 
 extern int stardict_text2bin(const std::string& xmlfilename, const std::string& ifofilename,
-		bool show_xincludes, bool use_same_type_sequence);
+		bool show_xincludes, bool use_same_type_sequence,
+		size_t max_memory = ext_sorter_t::DEFAULT_MAX_MEMORY,
+		bool cache_files = false, CollateFunctions collate_func = COLLATE_FUNC_NONE);
 
 #endif /* LIB_STARDICT_TEXT2BIN_H_ */
@@ -437,11 +437,11 @@ int textual_dict_parser_t::read_stardict(void)
 		g_critical(missing_info_section_err);
 		return EXIT_FAILURE;
 	}
-	if(norm_dict->articles.empty()) {
+	if(norm_dict->get_article_count() == 0) {
 		g_critical(article_list_empty);
 		return EXIT_FAILURE;
 	}
-	g_message("total articles: %lu.", static_cast<unsigned long>(norm_dict->articles.size()));
+	g_message("total articles: %lu.", static_cast<unsigned long>(norm_dict->get_article_count()));
 	return EXIT_SUCCESS;
 }
 
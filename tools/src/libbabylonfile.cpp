@@ -29,6 +29,7 @@
 
 #include "libbabylonfile.h"
 #include "libcommon.h"
+#include "lib_dictzip.h"
 
 struct _worditem
 {
@@ -378,8 +379,10 @@ int read_articles(gchar *p, gint& linenum,
 int write_dict_and_index(const std::string& idxfilename, const std::string& dicfilename,
 		GArray *array)
 {
+	dictzip_writer_t dicfile;
+	if(dicfile.open(dicfilename))
+		return EXIT_FAILURE;
 	FILE *idxfile = g_fopen(idxfilename.c_str(),"wb");
-	FILE *dicfile = g_fopen(dicfilename.c_str(),"wb");
 
 	guint32 offset_old;
 	guint32 tmpglong;
@@ -387,10 +390,13 @@ int write_dict_and_index(const std::string& idxfilename, const std::string& dicf
 	gint definition_len;
 	gulong i;
 	for (i=0; i< array->len; i++) {
-		offset_old = ftell(dicfile);
+		offset_old = dicfile.tell();
 		pworditem = &g_array_index(array, struct _worditem, i);
 		definition_len = strlen(pworditem->definition);
-		fwrite(pworditem->definition, 1 ,definition_len,dicfile);
+		if(dicfile.write(pworditem->definition, definition_len)) {
+			fclose(idxfile);
+			return EXIT_FAILURE;
+		}
 		fwrite(pworditem->word,sizeof(gchar),strlen(pworditem->word)+1,idxfile);
 		tmpglong = g_htonl(offset_old);
 		fwrite(&(tmpglong),sizeof(guint32),1,idxfile);
@@ -399,7 +405,8 @@ int write_dict_and_index(const std::string& idxfilename, const std::string& dicf
 
 	}
 	fclose(idxfile);
-	fclose(dicfile);
+	if(dicfile.close())
+		return EXIT_FAILURE;
 	g_message("wordcount: %d.", array->len);
 	return EXIT_SUCCESS;
 }
@@ -566,7 +573,7 @@ void convert_babylonfile(const char *filename, bool strip_html)
 	const std::string fullbasefilename = build_path(dirname, basefilename);
 	const std::string ifofilename = fullbasefilename + ".ifo";
 	const std::string idxfilename = fullbasefilename + ".idx";
-	const std::string dicfilename = fullbasefilename + ".dict";
+	const std::string dicfilename = fullbasefilename + ".dict.dz";
 
 	if(write_dict_and_index(idxfilename, dicfilename, array))
 		return;
@@ -581,15 +588,6 @@ void convert_babylonfile(const char *filename, bool strip_html)
 	g_array_free(array,TRUE);
 	g_array_free(array2,TRUE);
 
-#ifndef _WIN32
-	std::string command(std::string("dictzip ") + dicfilename);
-	int result;
-	result = system(command.c_str());
-	if (result == -1) {
-		g_print("system() error!\n");
-	}
-#endif
-
 	g_free(basefilename);
 	g_free(dirname);
 }
@@ -22,27 +22,60 @@
 #include <cstring>
 #include <cstdlib>
 #include <string>
+#include <vector>
+#include <errno.h>
 #include <glib/gstdio.h>
 #include <glib.h>
 
 #include "libtabfile.h"
 #include "libcommon.h"
+#include "lib_dictzip.h"
 
-struct _worditem
+/* Reads a file line by line in large blocks. */
+class line_reader_t
 {
-	gchar *word;
-	gchar *definition;
-};
+public:
+	line_reader_t(FILE *file)
+	:
+		file(file),
+		buffer(1024 * 1024),
+		pos(0),
+		end(0)
+	{
 
-static gint comparefunc(gconstpointer a,gconstpointer b)
-{
-	gint x;
-	x = stardict_strcmp(((struct _worditem *)a)->word,((struct _worditem *)b)->word);
-	if (x == 0)
-		return ((struct _worditem *)a)->definition - ((struct _worditem *)b)->definition;
-	else
-		return x;
-}
+	}
+	/* Return false after the last line.
+	 * newline is false if the line does not end with a new line. */
+	bool read(std::string& line, bool& newline)
+	{
+		line.clear();
+		while(true) {
+			if(pos == end) {
+				pos = 0;
+				end = fread(&buffer[0], 1, buffer.size(), file);
+				if(end == 0) {
+					newline = false;
+					return !line.empty();
+				}
+			}
+			const char *p = &buffer[pos];
+			const char *nl = static_cast<const char *>(memchr(p, '\n', end - pos));
+			if(nl) {
+				line.append(p, nl - p);
+				pos += nl - p + 1;
+				newline = true;
+				return true;
+			}
+			line.append(p, end - pos);
+			pos = end;
+		}
+	}
+private:
+	FILE *file;
+	std::vector<char> buffer;
+	size_t pos;
+	size_t end;
+};
 
 static void my_strstrip(char *str, glong linenum)
 {
@@ -96,89 +129,63 @@ static void my_strstrip(char *str, glong linenum)
 	*p2 = '\0';
 }
 
-/* return: true - OK, false - error 
-Dictionary index is allowed to contain duplicates in fact. */
-/*
-static bool check_duplicate_words(GArray *array)
-{
-	if(array->len < 2)
-		return true;
-
-	gulong i;
-	struct _worditem *pworditem1, *pworditem2;
-	pworditem1 = &g_array_index(array, struct _worditem, 0);
-	bool return_var = true;
-	for (i=1; i < array->len; i++) {
-		pworditem2 = &g_array_index(array, struct _worditem, i);
-		if ((stardict_strcmp(pworditem1->word, pworditem2->word) == 0) && (strcmp(pworditem1->definition, pworditem2->definition) ==0)) {
-			g_warning("Error, duplicate word: %s", pworditem2->word);
-			return_var = false;
-		}
-		pworditem1 = pworditem2;
-	}
-	return return_var;
-}
-*/
-
-static bool read_tab_file(gchar *buffer, GArray *array)
+/* Add the words and the definitions to sorter. */
+static bool read_tab_file(const char *filename, ext_sorter_t& sorter)
 {
-	gchar *p, *p1, *p2;
-	p = buffer;
-	if(g_str_has_prefix(p, "\xEF\xBB\xBF")) // UTF-8 BOM
-		p+=3;
-	if(!g_utf8_validate(p, -1, NULL)) {
-		g_critical("Error, invalid UTF-8 encoded text.");
+	clib::File file(g_fopen(filename, "rb"));
+	if (!file) {
+		std::string error(g_strerror(errno));
+		g_critical("Unable to open file %s, error: %s.", filename, error.c_str());
 		return false;
 	}
-	struct _worditem worditem;
+	line_reader_t reader(get_impl(file));
+	std::string line;
+	bool newline;
 	glong linenum=1;
-	while (true) {
-		if (*p == '\0') {
-			g_message("Convertion is over.");
-			break;
-		}
-		p1 = strchr(p,'\n');
-		if (!p1) {
+	for (; reader.read(line, newline); linenum++) {
+		if (!newline) {
 			g_critical("Error, no new line at the end.");
 			return false;
 		}
-		*p1 = '\0';
-		p1++;
-		p2 = strchr(p,'\t');
-		if (!p2) {
+		if (linenum == 1 && g_str_has_prefix(line.c_str(), UTF8_BOM))
+			line.erase(0, sizeof(UTF8_BOM) - 1);
+		if (!g_utf8_validate(line.data(), line.length(), NULL)) {
+			g_critical("Error, line %ld: invalid UTF-8 encoded text.", linenum);
+			return false;
+		}
+		const std::string::size_type tab = line.find('\t');
+		if (tab == std::string::npos) {
 			g_warning("Warning: line %ld, no tab! Skipping line.", linenum);
-			p = p1;
-			linenum++;
 			continue;
 		}
-		*p2 = '\0';
-		p2++;
-		worditem.word = p;
-		worditem.definition = p2;
-		my_strstrip(worditem.word, linenum);
-		my_strstrip(worditem.definition, linenum);
-		g_strstrip(worditem.word);
-		g_strstrip(worditem.definition);
-		if (!worditem.word[0]) {
+		line[tab] = '\0';
+		gchar *word = &line[0];
+		gchar *definition = &line[tab + 1];
+		my_strstrip(word, linenum);
+		my_strstrip(definition, linenum);
+		g_strstrip(word);
+		g_strstrip(definition);
+		if (!word[0]) {
 			g_warning("Warning: line %ld, bad word! Skipping line.", linenum);
-			p = p1;
-			linenum++;
 			continue;
 		}
-		if (!worditem.definition[0]) {
+		if (!definition[0]) {
 			g_warning("Warning: line %ld, bad definition! Skipping line.", linenum);
-			p = p1;
-			linenum++;
 			continue;
 		}
-		g_array_append_val(array, worditem);
-		p = p1;
-		linenum++;
+		if (sorter.add(word, definition, strlen(definition)))
+			return false;
+	}
+	if (ferror(get_impl(file))) {
+		std::string error(g_strerror(errno));
+		g_critical(read_file_err, filename, error.c_str());
+		return false;
 	}
+	g_message("Convertion is over.");
 	return true;
 }
 
-static bool write_dictionary(const char *filename, GArray *array)
+static bool write_dictionary(const char *filename, ext_sorter_t& sorter)
 {
 	glib::CharStr basefilename(g_path_get_basename(filename));
 	gchar *ch = strrchr(get_impl(basefilename), '.');
@@ -189,7 +196,7 @@ static bool write_dictionary(const char *filename, GArray *array)
 	const std::string fullbasefilename = build_path(get_impl(dirname), get_impl(basefilename));
 	const std::string ifofilename = fullbasefilename + ".ifo";
 	const std::string idxfilename = fullbasefilename + ".idx";
-	const std::string dicfilename = fullbasefilename + ".dict";
+	const std::string dicfilename = fullbasefilename + ".dict.dz";
 	clib::File ifofile(g_fopen(ifofilename.c_str(),"wb"));
 	if (!ifofile) {
 		g_critical("Write to ifo file %s failed!", ifofilename.c_str());
@@ -200,88 +207,60 @@ static bool write_dictionary(const char *filename, GArray *array)
 		g_critical("Write to idx file %s failed!", idxfilename.c_str());
 		return false;
 	}
-	clib::File dicfile(g_fopen(dicfilename.c_str(),"wb"));
-	if (!dicfile) {
-		g_critical("Write to dict file %s failed!", dicfilename.c_str());
+	dictzip_writer_t dicfile;
+	if (dicfile.open(dicfilename))
 		return false;
-	}
 
+	if (sorter.sort())
+		return false;
 	guint32 offset_old;
 	guint32 tmpglong;
-	struct _worditem *pworditem;
-	gint definition_len;
-	gulong i;
-	for (i=0; i < array->len; i++) {
-		offset_old = ftell(get_impl(dicfile));
-		pworditem = &g_array_index(array, struct _worditem, i);
-		definition_len = strlen(pworditem->definition);
-		fwrite(pworditem->definition, 1 ,definition_len,get_impl(dicfile));
-		fwrite(pworditem->word,sizeof(gchar),strlen(pworditem->word)+1,get_impl(idxfile));
+	std::string word, definition;
+	while (true) {
+		bool eof;
+		if (sorter.read(word, definition, eof))
+			return false;
+		if (eof)
+			break;
+		offset_old = dicfile.tell();
+		if (dicfile.write(definition.data(), definition.length()))
+			return false;
+		fwrite(word.c_str(),sizeof(gchar),word.length()+1,get_impl(idxfile));
 		tmpglong = g_htonl(offset_old);
 		fwrite(&(tmpglong),sizeof(guint32),1,get_impl(idxfile));
-		tmpglong = g_htonl(definition_len);
+		tmpglong = g_htonl(definition.length());
 		fwrite(&(tmpglong),sizeof(guint32),1,get_impl(idxfile));
 	}
 	idxfile.reset(NULL);
-	dicfile.reset(NULL);
-
-	g_message("%s wordcount: %d.", get_impl(basefilename), array->len);
+	if (dicfile.close())
+		return false;
 
-#ifndef _WIN32
-	std::string command(std::string("dictzip ") + dicfilename);
-	int result;
-	result = system(command.c_str());
-	if (result == -1) {
-		g_print("system() error!\n");
-	}
-#endif
+	g_message("%s wordcount: %lu.", get_impl(basefilename), (unsigned long)sorter.size());
 
 	stardict_stat_t stats;
 	g_stat(idxfilename.c_str(), &stats);
-	fprintf(get_impl(ifofile), "StarDict's dict ifo file\nversion=2.4.2\nwordcount=%d\n"
+	fprintf(get_impl(ifofile), "StarDict's dict ifo file\nversion=2.4.2\nwordcount=%lu\n"
 		"idxfilesize=%ld\nbookname=%s\nsametypesequence=m\n",
-		array->len, (long) stats.st_size, get_impl(basefilename));
+		(unsigned long)sorter.size(), (long) stats.st_size, get_impl(basefilename));
 	return true;
 }
 
-class ArrayWrapper {
-public:
-	ArrayWrapper(GArray *array)
-		: array(array)
-	{
-	}
-	~ArrayWrapper(void)
-	{
-		g_array_free(array,TRUE);
-	}
-private:
-	GArray *array;
-};
-
-bool convert_tabfile(const char *filename)
+/* The words are sorted in temporary files if they take more than
+ * max_memory bytes, so a tab file larger than the memory can be
+ * converted. */
+bool convert_tabfile(const char *filename, size_t max_memory)
 {
-	glib::CharStr buffer;
-	glib::Error err;
-	if(!g_file_get_contents(filename, get_addr(buffer), NULL, get_addr(err))) {
-		g_critical("Unable to open file %s, error: %s.", filename, err->message);
-		return false;
-	}
-
-	GArray *array = g_array_sized_new(FALSE,FALSE, sizeof(struct _worditem),20000);
-	ArrayWrapper array_wrapper(array);
-	
-	if(!read_tab_file(get_impl(buffer), array))
+	ext_sorter_t sorter;
+	sorter.set_max_memory(max_memory);
+	if(!read_tab_file(filename, sorter))
 		return false;
 
-	if(array->len < 1) {
+	if(sorter.size() < 1) {
 		g_critical("Error: empty dictionary.");
 		return false;
 	}
-	g_array_sort(array, comparefunc);
-	//if(!check_duplicate_words(array))
-	//	return false;
-	
-	if(!write_dictionary(filename, array))
+
+	if(!write_dictionary(filename, sorter))
 		return false;
 	return true;
 }
@@ -18,6 +18,9 @@
 #ifndef _LIBTABFILE_H_
 #define _LIBTABFILE_H_
 
-extern bool convert_tabfile(const char *filename);
+#include "lib_ext_sort.h"
+
+extern bool convert_tabfile(const char *filename,
+	size_t max_memory = ext_sorter_t::DEFAULT_MAX_MEMORY);
 
 #endif
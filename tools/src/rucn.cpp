@@ -26,6 +26,7 @@
 #include <locale.h>
 #include <glib/gstdio.h>
 #include <glib.h>
+#include "lib_dictzip.h"
 
 typedef void (*print_info_t)(const char *info);
 
@@ -190,15 +191,8 @@ void convert(const char *filename, print_info_t print_info)
 	print_info(str);
 	g_free(str);
 
-#ifndef _WIN32
-	gchar command[256];
-        sprintf(command, "dictzip %s", dicfilename);
-	int result;
-        result = system(command);
-	if (result == -1) {
-		g_print("system() error!\n");
-	}
-#endif
+	if (dictzip_file(dicfilename))
+		exit(EXIT_FAILURE);
 
 	g_stat(idxfilename, &stats);
 	fprintf(ifofile, "StarDict's dict ifo file\nversion=2.4.2\nwordcount=%d\n"
@@ -49,6 +49,7 @@ static GtkWidget *decompile_page_textual_stardict_hbox;
 static GtkWidget *compile_page_show_xinclude_check_box;
 static GtkWidget *compile_page_use_sametypesequence_check_box;
 static GtkWidget *compile_page_textual_stardict_hbox;
+static GtkWidget *compile_page_entry_max_memory;
 
 class HookMessages
 {
@@ -157,9 +158,16 @@ static void on_compile_page_compile_button_clicked(GtkButton *button, gpointer d
 	gtk_text_buffer_set_text(compile_page_text_view_buffer, "Building...\n", -1);
 	HookMessages hookOutput(compile_page_text_view_buffer);
 	gint output_format_ind = gtk_combo_box_get_active(GTK_COMBO_BOX(compile_page_combo_box));
+	const gchar* max_memory_str = gtk_entry_get_text(GTK_ENTRY(compile_page_entry_max_memory));
+	size_t max_memory;
+	if (!ext_sorter_t::max_memory_from_megabytes(g_ascii_strtoll(max_memory_str, NULL, 10), max_memory))
+		max_memory = ext_sorter_t::DEFAULT_MAX_MEMORY;
+	glib::CharStr temp(g_strdup_printf("%lu", (unsigned long)(max_memory / (1024 * 1024))));
+	// set the memory limit back to the entry for the user to see what value was actually used.
+	gtk_entry_set_text(GTK_ENTRY(compile_page_entry_max_memory), get_impl(temp));
 	bool res = true;
 	if (output_format_ind == 0) {
-		res = convert_tabfile(srcfilename.c_str());
+		res = convert_tabfile(srcfilename.c_str(), max_memory);
 	} else if (output_format_ind == 1) {
 		convert_babylonfile(srcfilename.c_str(), true);
 	} else if (output_format_ind == 2) {
@@ -173,7 +181,7 @@ static void on_compile_page_compile_button_clicked(GtkButton *button, gpointer d
 		bool use_same_type_sequence = gtk_toggle_button_get_active(
 			GTK_TOGGLE_BUTTON(compile_page_use_sametypesequence_check_box));
 		res = (EXIT_SUCCESS == stardict_text2bin(srcfilename, ifofilename,
-			show_xincludes, use_same_type_sequence));
+			show_xincludes, use_same_type_sequence, max_memory));
 	}
 	gtk_text_buffer_insert_at_cursor(compile_page_text_view_buffer, 
 		res ? "Done!\n" : "Failed!\n",
@@ -296,6 +304,21 @@ static void create_compile_page(GtkWidget *notebook)
 	gtk_box_pack_start(GTK_BOX(hbox), button, true, false, 0);
 	g_signal_connect(G_OBJECT(button), "clicked", G_CALLBACK(on_compile_page_compile_button_clicked), entry);
 
+	// the memory limit of tab files and textual StarDict dictionaries
+#if GTK_MAJOR_VERSION >= 3
+	hbox = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 6);
+#else
+	hbox = gtk_hbox_new(FALSE, 6);
+#endif
+	gtk_box_pack_start(GTK_BOX(vbox), hbox, false, false, 0);
+	label = gtk_label_new("Memory for sorting (in megabytes, 0 - no limit):");
+	gtk_box_pack_start(GTK_BOX(hbox), label, false, false, 0);
+	compile_page_entry_max_memory = gtk_entry_new();
+	glib::CharStr max_memory(g_strdup_printf("%lu",
+		(unsigned long)(ext_sorter_t::DEFAULT_MAX_MEMORY / (1024 * 1024))));
+	gtk_entry_set_text(GTK_ENTRY(compile_page_entry_max_memory), get_impl(max_memory));
+	gtk_box_pack_start(GTK_BOX(hbox), compile_page_entry_max_memory, false, false, 0);
+
 	// parameter panel
 #if GTK_MAJOR_VERSION >= 3
 	compile_page_textual_stardict_hbox = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 6);
@@ -22,6 +22,7 @@
 #include <cstdlib>
 #include <iomanip>
 #include "libcommon.h"
+#include "lib_index_cache.h"
 
 
 class Main {
@@ -30,6 +31,8 @@ public:
 	{
 		if(ParseCommandLine(argc, argv))
 			return EXIT_FAILURE;
+		if(cache_files)
+			return make_cache_files();
 		print_index(idx_file_name);
 		return EXIT_SUCCESS;
 	}
@@ -38,9 +41,13 @@ private:
 	{
 		quiet_mode = FALSE;
 		key_only = FALSE;
+		cache_files = FALSE;
+		collate_func = COLLATE_FUNC_NONE;
 		static GOptionEntry entries[] = {
 			{ "quiet", 'q', 0, G_OPTION_ARG_NONE, &quiet_mode, "no additional information, only index entries", NULL },
 			{ "key-only", 'k', 0, G_OPTION_ARG_NONE, &key_only, "print only keys (implies --quiet option)", NULL },
+			{ "cache-files", 'c', 0, G_OPTION_ARG_NONE, &cache_files, "write the .oft file of the index instead of printing it", NULL },
+			{ "collate-func", 0, 0, G_OPTION_ARG_INT, &collate_func, "with --cache-files, write the .clt file for collate function N too", "N" },
 			{ NULL },
 		};
 		glib::OptionContext opt_cnt(g_option_context_new("INDEX_FILE"));
@@ -50,6 +57,9 @@ private:
 			"Print context of StarDict index file in human readable form.\n"
 			"\n"
 			"Supported files: .idx, .ridx, .syn\n"
+			"\n"
+			"With --cache-files the .oft and .clt files StarDict makes the first time "
+			"it opens the index are written next to the index (.idx and .syn only).\n"
 			);
 		glib::Error err;
 		if (!g_option_context_parse(get_impl(opt_cnt), &argc, &argv, get_addr(err))) {
@@ -71,10 +81,32 @@ private:
 			return EXIT_FAILURE;
 		}
 		syn_file = g_str_has_suffix(idx_file_name.c_str(), ".syn");
+		if(cache_files && g_str_has_suffix(idx_file_name.c_str(), ".ridx")) {
+			std::cerr << "Cache files are not used for .ridx files." << std::endl;
+			return EXIT_FAILURE;
+		}
+		if(collate_func != COLLATE_FUNC_NONE
+			&& int_to_colate_func(collate_func) == COLLATE_FUNC_NONE) {
+			std::cerr << "Invalid collate function." << std::endl;
+			return EXIT_FAILURE;
+		}
+		if(collate_func != COLLATE_FUNC_NONE && !cache_files) {
+			std::cerr << "--collate-func requires --cache-files." << std::endl;
+			return EXIT_FAILURE;
+		}
 		if(key_only)
 			quiet_mode = TRUE;
 		return EXIT_SUCCESS;
 	}
+	int make_cache_files(void)
+	{
+		if(build_oft_file(idx_file_name))
+			return EXIT_FAILURE;
+		if(collate_func != COLLATE_FUNC_NONE
+			&& build_clt_file(idx_file_name, CollateFunctions(collate_func)))
+			return EXIT_FAILURE;
+		return EXIT_SUCCESS;
+	}
 	void print_index(std::string& idx_file_name)
 	{
 		glib::CharStr contents;
@@ -130,6 +162,8 @@ private:
 	gboolean quiet_mode;
 	gboolean key_only;
 	gboolean syn_file;
+	gboolean cache_files;
+	gint collate_func;
 };
 
 
@@ -26,6 +26,7 @@
 #include <iostream>
 #include <sstream>
 #include "libcommon.h"
+#include "lib_ext_sort.h"
 #include "lib_stardict_repair.h"
 
 const char* repair_dict_failure = "Dictionary '%s'. Repair result: failure\n";
@@ -41,11 +42,13 @@ struct Main
 		lot_of_memory = FALSE;
 		compress_dict = FALSE;
 		copy_res_store = TRUE;
+		max_memory_mb = ext_sorter_t::DEFAULT_MAX_MEMORY / (1024 * 1024);
 		char* out_dir = NULL;
 		static GOptionEntry entries[] = {
 			{ "quiet", 'q', 0, G_OPTION_ARG_NONE, &quiet, "show only whether the dictionary was repaired or not", NULL },
 			{ "lot-of-memory", 0, 0, G_OPTION_ARG_NONE, &lot_of_memory, "store data in memory when possible (vs. temporary files)", NULL },
 			{ "compress-dict", 0, 0, G_OPTION_ARG_NONE, &compress_dict, "compress dictionary - produce DICT.dict.dz file", NULL },
+			{ "max-memory", 'm', 0, G_OPTION_ARG_INT, &max_memory_mb, "keep no more than MB megabytes of articles in memory, the rest is sorted in temporary files, 0 - no limit", "MB" },
 			{ "no-copy-res-store", 0, G_OPTION_FLAG_REVERSE, G_OPTION_ARG_NONE, &copy_res_store, "prevent copying resource storage data", NULL },
 			{ "out-dir", 'O', 0, G_OPTION_ARG_FILENAME, &out_dir, "output directory (\".\" by default)", "DIR" },
 			{ NULL },
@@ -66,8 +69,6 @@ struct Main
 				"The utility silently overwrites any file in the output directory. "
 				"Original dictionaries are never changed.\n"
 				"\n"
-				"Note. '--compress-dict' option requires dictzip utility.\n"
-				"\n"
 				"EXIT STATUS\n"
 				"The utility exits with status 0 if conversion succeeds, with non-zero status otherwise."
 			);
@@ -80,6 +81,10 @@ struct Main
 			std::cerr << "No files to repair." << std::endl;
 			return EXIT_FAILURE;
 		}
+		if(!ext_sorter_t::max_memory_from_megabytes(max_memory_mb, max_memory)) {
+			std::cerr << "Invalid memory limit." << std::endl;
+			return EXIT_FAILURE;
+		}
 		files = argv+1;
 		if(out_dir)
 			outdirpath = out_dir;
@@ -91,6 +96,8 @@ struct Main
 	gboolean lot_of_memory;
 	gboolean compress_dict;
 	gboolean copy_res_store;
+	gint max_memory_mb;
+	size_t max_memory;
 };
 
 Main gmain;
@@ -134,6 +141,7 @@ int main(int argc,char * argv [])
 	options.lot_of_memory = !!gmain.lot_of_memory;
 	options.compress_dict = !!gmain.compress_dict;
 	options.copy_res_store = !!gmain.copy_res_store;
+	options.max_memory = gmain.max_memory;
 	int res_total = EXIT_SUCCESS;
 	for(int i=0; gmain.files[i]; ++i) {
 		int res = stardict_repair(gmain.files[i], gmain.outdirpath, options);
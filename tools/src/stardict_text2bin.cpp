@@ -35,9 +35,15 @@ struct Main
 	{
 		show_xinclude = FALSE;
 		use_same_type_sequence = TRUE;
+		max_memory_mb = ext_sorter_t::DEFAULT_MAX_MEMORY / (1024 * 1024);
+		cache_files = FALSE;
+		collate_func = COLLATE_FUNC_NONE;
 		static GOptionEntry entries[] = {
 			{ "show-xinclude", 'i', 0, G_OPTION_ARG_NONE, &show_xinclude, "show each processed xinclude", NULL },
 			{ "no-same-type-sequence", 0, G_OPTION_FLAG_REVERSE, G_OPTION_ARG_NONE, &use_same_type_sequence, "no sametypesequence optimization", NULL },
+			{ "max-memory", 'm', 0, G_OPTION_ARG_INT, &max_memory_mb, "keep no more than MB megabytes of articles in memory, the rest is sorted in temporary files, 0 - no limit", "MB" },
+			{ "cache-files", 'c', 0, G_OPTION_ARG_NONE, &cache_files, "write .oft files next to the index, so StarDict does not scan the index when it opens the dictionary the first time", NULL },
+			{ "collate-func", 0, 0, G_OPTION_ARG_INT, &collate_func, "with --cache-files, write .clt files for collate function N too, so StarDict does not sort the index with collation on", "N" },
 			{ NULL },
 		};
 		glib::OptionContext opt_cnt(g_option_context_new("TEXT_DICTIONARY.xml DICTIONARY.ifo"));
@@ -76,6 +82,19 @@ struct Main
 		if(argc > 3) {
 			std::cerr << "Too many files, two files are needed. Extra files will be ignored." << std::endl;
 		}
+		if(!ext_sorter_t::max_memory_from_megabytes(max_memory_mb, max_memory)) {
+			std::cerr << "Invalid memory limit." << std::endl;
+			return EXIT_FAILURE;
+		}
+		if(collate_func != COLLATE_FUNC_NONE
+			&& int_to_colate_func(collate_func) == COLLATE_FUNC_NONE) {
+			std::cerr << "Invalid collate function." << std::endl;
+			return EXIT_FAILURE;
+		}
+		if(collate_func != COLLATE_FUNC_NONE && !cache_files) {
+			std::cerr << "--collate-func requires --cache-files." << std::endl;
+			return EXIT_FAILURE;
+		}
 		xmlfilename = argv[1];
 		ifofilename = argv[2];
 		return EXIT_SUCCESS;
@@ -84,6 +103,10 @@ struct Main
 	std::string xmlfilename;
 	gboolean show_xinclude;
 	gboolean use_same_type_sequence;
+	gint max_memory_mb;
+	size_t max_memory;
+	gboolean cache_files;
+	gint collate_func;
 };
 
 int main(int argc,char * argv [])
@@ -93,5 +116,7 @@ int main(int argc,char * argv [])
 	if(oMain.main(argc, argv))
 		return EXIT_FAILURE;
 	return stardict_text2bin(oMain.xmlfilename, oMain.ifofilename,
-		oMain.show_xinclude, oMain.use_same_type_sequence);
+		oMain.show_xinclude, oMain.use_same_type_sequence,
+		oMain.max_memory,
+		oMain.cache_files, CollateFunctions(oMain.collate_func));
 }
@@ -15,6 +15,8 @@
  * along with StarDict.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <cstdlib>
+#include <cstring>
 #include <locale.h>
 #include <gtk/gtk.h>
 
@@ -23,12 +25,24 @@
 int main(int argc,char * argv [])
 {
 	if (argc<2) {
-		printf("please type this:\n./tabfile Chinese-idiom-quick.pdb.tab.utf8\n");
+		printf("please type this:\n./tabfile [-m MB] Chinese-idiom-quick.pdb.tab.utf8\n"
+			"-m MB - keep no more than MB megabytes of articles in memory, 0 - no limit\n");
 		return FALSE;
 	}
 
 	setlocale(LC_ALL, "");
-	for (int i=1; i< argc; i++)
-		convert_tabfile (argv[i]);
+	size_t max_memory = ext_sorter_t::DEFAULT_MAX_MEMORY;
+	for (int i=1; i< argc; i++) {
+		if (strcmp(argv[i], "-m") == 0) {
+			gchar *end = NULL;
+			const gint64 megabytes = i + 1 < argc ? g_ascii_strtoll(argv[++i], &end, 10) : -1;
+			if (!end || *end || !ext_sorter_t::max_memory_from_megabytes(megabytes, max_memory)) {
+				printf("Invalid memory limit.\n");
+				return EXIT_FAILURE;
+			}
+			continue;
+		}
+		convert_tabfile (argv[i], max_memory);
+	}
 	return FALSE;
 }
@@ -28,6 +28,8 @@
 
 
 #include <gtk/gtk.h>
+#include <glib/gstdio.h>
+#include "lib_dictzip.h"
 
 // for systems where O_LARGEFILE is not defined
 #ifndef O_LARGEFILE
@@ -114,6 +116,13 @@ static void func_parse_text(GMarkupParseContext *context, const gchar *text, gsi
 	}
 }
 
+static void move_to_dir(const std::string& filename, const char *dirname)
+{
+	const std::string newfilename = std::string(dirname) + G_DIR_SEPARATOR_S + filename;
+	if (g_rename(filename.c_str(), newfilename.c_str()) == -1)
+		g_print("Move %s to %s failed!\n", filename.c_str(), dirname);
+}
+
 void convert(char *filename, char *wikiname, char *wikidate)
 {
         struct stat stats;
@@ -207,36 +216,16 @@ void convert(char *filename, char *wikiname, char *wikidate)
         g_print("%s wordcount: %d\n", filename, array->len);
 	g_array_free(array,TRUE);
 
-	gchar command[256];
-        sprintf(command, "dictzip %s", dicfilename);
-	int result;
-        result = system(command);
-	if (result == -1) {
-		g_print("system() error!\n");
-	}
+	if (dictzip_file(dicfilename))
+		exit(EXIT_FAILURE);
 
 	char dirname[256];
 	sprintf(dirname, "stardict-wikipedia-%s-2.4.2", wikiname);
-	sprintf(command, "mkdir %s", dirname);
-	result = system(command);
-	if (result == -1) {
-		g_print("system() error!\n");
-	}
-	sprintf(command, "mv %s %s", idxfilename, dirname);
-	result = system(command);
-	if (result == -1) {
-		g_print("system() error!\n");
-	}
-	sprintf(command, "mv %s.dz %s", dicfilename, dirname);
-	result = system(command);
-	if (result == -1) {
-		g_print("system() error!\n");
-	}
-	sprintf(command, "mv %s %s", ifofilename, dirname);
-	result = system(command);
-	if (result == -1) {
-		g_print("system() error!\n");
-	}
+	if (g_mkdir(dirname, 0755) == -1)
+		g_print("Create directory %s failed!\n", dirname);
+	move_to_dir(idxfilename, dirname);
+	move_to_dir(std::string(dicfilename) + ".dz", dirname);
+	move_to_dir(ifofilename, dirname);
 }
 
 int main(int argc,char * argv [])